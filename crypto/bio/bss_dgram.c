@@ -82,6 +82,19 @@
 #  define BIO_CMSG_LEN(x) CMSG_LEN(x)
 # endif
 
+/*
+ * UDP segmentation offload (UDP_SEGMENT) and generic receive offload (UDP_GRO)
+ * are Linux-specific and are only used with sendmmsg/recvmmsg.
+ */
+# if defined(OPENSSL_SYS_LINUX) && M_METHOD == M_METHOD_RECVMMSG
+#  include <netinet/udp.h>
+#  if defined(UDP_SEGMENT) && defined(UDP_GRO) && defined(SOL_UDP)
+#   define SUPPORT_UDP_SEGMENT
+/* Maximum number of segments the kernel accepts in a single send. */
+#   define BIO_UDP_MAX_SEGMENTS     64
+#  endif
+# endif
+
 # if   M_METHOD == M_METHOD_RECVMMSG   \
     || M_METHOD == M_METHOD_RECVMSG    \
     || M_METHOD == M_METHOD_WSARECVMSG
@@ -107,10 +120,17 @@
 #   else
 #     define BIO_CMSG_ALLOC_LEN_3   0
 #   endif
+#   if defined(SUPPORT_UDP_SEGMENT)
+/* Segment size, which may accompany a local address. */
+#     define BIO_CMSG_ALLOC_LEN_4   BIO_CMSG_SPACE(sizeof(int))
+#   else
+#     define BIO_CMSG_ALLOC_LEN_4   0
+#   endif
 #   define BIO_MAX(X,Y) ((X) > (Y) ? (X) : (Y))
 #   define BIO_CMSG_ALLOC_LEN                                        \
-        BIO_MAX(BIO_CMSG_ALLOC_LEN_1,                                \
-                BIO_MAX(BIO_CMSG_ALLOC_LEN_2, BIO_CMSG_ALLOC_LEN_3))
+        (BIO_MAX(BIO_CMSG_ALLOC_LEN_1,                               \
+                 BIO_MAX(BIO_CMSG_ALLOC_LEN_2, BIO_CMSG_ALLOC_LEN_3)) \
+         + BIO_CMSG_ALLOC_LEN_4)
 #  endif
 #  if (defined(IP_PKTINFO) || defined(IP_RECVDSTADDR)) && defined(IPV6_RECVPKTINFO)
 #   define SUPPORT_LOCAL_ADDR
@@ -119,6 +139,11 @@
 
 # define BIO_MSG_N(array, stride, n) (*(BIO_MSG *)((char *)(array) + (n)*(stride)))
 
+/* Determines whether a BIO_MSG asks for segmentation offload. */
+# define BIO_MSG_IS_SEGMENTED(m)                                     \
+    (((m)->flags & BIO_MSG_SEGMENT_SIZE_MASK) != 0                  \
+     && (m)->data_len > ((m)->flags & BIO_MSG_SEGMENT_SIZE_MASK))
+
 static int dgram_write(BIO *h, const char *buf, int num);
 static int dgram_read(BIO *h, char *buf, int size);
 static int dgram_puts(BIO *h, const char *str);
@@ -196,6 +221,7 @@ typedef struct bio_dgram_data_st {
     OSSL_TIME socket_timeout;
     unsigned int peekmode;
     char local_addr_enabled;
+    char gro_enabled;
 } bio_dgram_data;
 
 # ifndef OPENSSL_NO_SCTP
@@ -522,6 +548,26 @@ static int enable_local_addr(BIO *b, int enable) {
 }
 # endif
 
+# if defined(SUPPORT_UDP_SEGMENT)
+/* Enables or disables reception of coalesced datagrams on the socket. */
+static int enable_gro(BIO *b, int enable)
+{
+    if (setsockopt(b->num, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) < 0)
+        return 0;
+
+    return 1;
+}
+
+/* Determines whether the kernel supports UDP_SEGMENT for the socket. */
+static int have_udp_segment(BIO *b)
+{
+    int seg = 0;
+    socklen_t seg_len = sizeof(seg);
+
+    return getsockopt(b->num, SOL_UDP, UDP_SEGMENT, &seg, &seg_len) == 0;
+}
+# endif
+
 static long dgram_ctrl(BIO *b, int cmd, long num, void *ptr)
 {
     long ret = 1;
@@ -557,6 +603,12 @@ static long dgram_ctrl(BIO *b, int cmd, long num, void *ptr)
             if (enable_local_addr(b, 1) < 1)
                 data->local_addr_enabled = 0;
         }
+# endif
+# if defined(SUPPORT_UDP_SEGMENT)
+        if (data->gro_enabled) {
+            if (enable_gro(b, 1) < 1)
+                data->gro_enabled = 0;
+        }
 # endif
         break;
     case BIO_C_GET_FD:
@@ -941,6 +993,34 @@ static long dgram_ctrl(BIO *b, int cmd, long num, void *ptr)
         *(int *)ptr = data->local_addr_enabled;
         break;
 
+    case BIO_CTRL_DGRAM_GET_SEGMENT_CAP:
+# if defined(SUPPORT_UDP_SEGMENT)
+        ret = b->init && have_udp_segment(b) ? BIO_UDP_MAX_SEGMENTS : 0;
+# else
+        ret = 0;
+# endif
+        break;
+
+    case BIO_CTRL_DGRAM_SET_GRO_ENABLE:
+# if defined(SUPPORT_UDP_SEGMENT)
+        num = num > 0;
+        if (num != data->gro_enabled) {
+            if (!b->init || enable_gro(b, num) < 1) {
+                ret = 0;
+                break;
+            }
+
+            data->gro_enabled = (char)num;
+        }
+# else
+        ret = 0;
+# endif
+        break;
+
+    case BIO_CTRL_DGRAM_GET_GRO_ENABLE:
+        *(int *)ptr = data->gro_enabled;
+        break;
+
     default:
         ret = 0;
         break;
@@ -1217,6 +1297,67 @@ static int pack_local(BIO *b, MSGHDR_TYPE *mh, const BIO_ADDR *local) {
 }
 # endif
 
+# if defined(SUPPORT_UDP_SEGMENT)
+/*
+ * Appends a UDP_SEGMENT control message to mh if msg asks for segmentation
+ * offload. control is the buffer any other control messages were packed into.
+ */
+static int pack_segment_size(struct msghdr *mh, unsigned char *control,
+                             const BIO_MSG *msg)
+{
+    struct cmsghdr *cmsg;
+    uint16_t seg = (uint16_t)(msg->flags & BIO_MSG_SEGMENT_SIZE_MASK);
+    size_t off = mh->msg_control != NULL ? mh->msg_controllen : 0;
+
+    if (!BIO_MSG_IS_SEGMENTED(msg))
+        return 1;
+
+    if (msg->data_len > (size_t)seg * BIO_UDP_MAX_SEGMENTS) {
+        ERR_raise(ERR_LIB_BIO, ERR_R_PASSED_INVALID_ARGUMENT);
+        return 0;
+    }
+
+    memset(control + off, 0, BIO_CMSG_SPACE(sizeof(seg)));
+    cmsg = (struct cmsghdr *)(control + off);
+    cmsg->cmsg_len   = BIO_CMSG_LEN(sizeof(seg));
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type  = UDP_SEGMENT;
+    memcpy(BIO_CMSG_DATA(cmsg), &seg, sizeof(seg));
+
+    mh->msg_control     = control;
+    mh->msg_controllen  = off + BIO_CMSG_SPACE(sizeof(seg));
+    return 1;
+}
+
+/*
+ * Returns the segment size reported for a received message containing
+ * multiple coalesced datagrams, or 0 if it contains a single datagram.
+ */
+static uint64_t extract_segment_size(struct msghdr *mh, size_t data_len)
+{
+    struct cmsghdr *cmsg;
+    int seg;
+
+    if (mh->msg_control == NULL)
+        return 0;
+
+    for (cmsg = BIO_CMSG_FIRSTHDR(mh); cmsg != NULL;
+         cmsg = BIO_CMSG_NXTHDR(mh, cmsg)) {
+        if (cmsg->cmsg_level != SOL_UDP || cmsg->cmsg_type != UDP_GRO)
+            continue;
+
+        memcpy(&seg, BIO_CMSG_DATA(cmsg), sizeof(seg));
+        if (seg > 0 && (size_t)seg < data_len
+            && (uint64_t)seg <= BIO_MSG_SEGMENT_SIZE_MASK)
+            return (uint64_t)seg;
+
+        break;
+    }
+
+    return 0;
+}
+# endif
+
 /*
  * Converts flags passed to BIO_sendmmsg or BIO_recvmmsg to syscall flags. You
  * should mask out any system flags returned by this function you cannot support
@@ -1262,6 +1403,9 @@ static int dgram_sendmmsg(BIO *b, BIO_MSG *msg, size_t stride,
 # if M_METHOD == M_METHOD_RECVFROM || M_METHOD == M_METHOD_WSARECVMSG
     int sysflags;
 # endif
+# if !defined(SUPPORT_UDP_SEGMENT)
+    size_t j;
+# endif
 
     if (num_msg == 0) {
         *num_processed = 0;
@@ -1271,6 +1415,16 @@ static int dgram_sendmmsg(BIO *b, BIO_MSG *msg, size_t stride,
     if (num_msg > OSSL_SSIZE_MAX)
         num_msg = OSSL_SSIZE_MAX;
 
+# if !defined(SUPPORT_UDP_SEGMENT)
+    /* Segmentation offload is not available; see BIO_dgram_get_segment_cap. */
+    for (j = 0; j < num_msg; ++j)
+        if (BIO_MSG_IS_SEGMENTED(&BIO_MSG_N(msg, stride, j))) {
+            ERR_raise(ERR_LIB_BIO, BIO_R_UNSUPPORTED_METHOD);
+            *num_processed = 0;
+            return 0;
+        }
+# endif
+
 # if M_METHOD != M_METHOD_NONE
     sysflags = translate_flags(flags);
 # endif
@@ -1305,6 +1459,14 @@ static int dgram_sendmmsg(BIO *b, BIO_MSG *msg, size_t stride,
                 return 0;
             }
         }
+
+#  if defined(SUPPORT_UDP_SEGMENT)
+        if (pack_segment_size(&mh[i].msg_hdr, control[i],
+                              &BIO_MSG_N(msg, stride, i)) < 1) {
+            *num_processed = 0;
+            return 0;
+        }
+#  endif
     }
 
     /* Do the batch */
@@ -1444,6 +1606,9 @@ static int dgram_recvmmsg(BIO *b, BIO_MSG *msg,
     struct iovec iov[BIO_MAX_MSGS_PER_CALL];
     unsigned char control[BIO_MAX_MSGS_PER_CALL][BIO_CMSG_ALLOC_LEN];
     int have_local_enabled = data->local_addr_enabled;
+#  if defined(SUPPORT_UDP_SEGMENT)
+    int have_gro_enabled = data->gro_enabled;
+#  endif
 # elif M_METHOD == M_METHOD_RECVMSG
     int sysflags;
     bio_dgram_data *data = (bio_dgram_data *)b->ptr;
@@ -1498,6 +1663,14 @@ static int dgram_recvmmsg(BIO *b, BIO_MSG *msg,
             *num_processed = 0;
             return 0;
         }
+
+#  if defined(SUPPORT_UDP_SEGMENT)
+        /* The segment size of coalesced datagrams arrives as control data. */
+        if (have_gro_enabled) {
+            mh[i].msg_hdr.msg_control       = control[i];
+            mh[i].msg_hdr.msg_controllen    = BIO_CMSG_ALLOC_LEN;
+        }
+#  endif
     }
 
     /* Do the batch */
@@ -1511,6 +1684,11 @@ static int dgram_recvmmsg(BIO *b, BIO_MSG *msg,
     for (i = 0; i < (size_t)ret; ++i) {
         BIO_MSG_N(msg, stride, i).data_len = mh[i].msg_len;
         BIO_MSG_N(msg, stride, i).flags    = 0;
+#  if defined(SUPPORT_UDP_SEGMENT)
+        if (have_gro_enabled)
+            BIO_MSG_N(msg, stride, i).flags
+                = extract_segment_size(&mh[i].msg_hdr, mh[i].msg_len);
+#  endif
         /*
          * *(msg->peer) will have been filled in by recvmmsg;
          * for msg->local we parse the control data returned
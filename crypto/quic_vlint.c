@@ -63,6 +63,11 @@ int ossl_quic_vlint_decode(const unsigned char *buf, size_t buf_len, uint64_t *v
     size_t dec_len;
     uint64_t x;
 
+    if (buf_len >= 8) {
+        *v = ossl_quic_vlint_decode_unchecked8(buf, &dec_len);
+        return dec_len;
+    }
+
     if (buf_len < 1)
         return 0;
 
@@ -43,6 +43,8 @@ struct ossl_event_st {
     /* These fields are for internal use only */
     PRIORITY_QUEUE_OF(OSSL_EVENT) *queue;    /* Queue containing this event */
     size_t ref;                 /* ID for this event                        */
+    struct ossl_event_st **wheel_slot;      /* Timer wheel slot holding it  */
+    struct ossl_event_st *wheel_prev, *wheel_next;  /* Timer wheel links    */
     unsigned int flag_dynamic : 1;  /* Malloced or not?                     */
 };
 
@@ -95,6 +97,19 @@ void *ossl_event_get0_payload(const OSSL_EVENT *event, size_t *length)
 OSSL_EVENT_QUEUE *ossl_event_queue_new(void);
 void ossl_event_queue_free(OSSL_EVENT_QUEUE *queue);
 
+/*
+ * Create a queue which keeps timed events in a hierarchical timer wheel with
+ * the given tick, rather than in a binary heap.  Adding and removing a timed
+ * event is O(1) instead of O(log n), and events falling due are moved to the
+ * queue of runnable events a whole wheel slot at a time, which suits a large
+ * number of timers which are mostly rescheduled or cancelled before they fire.
+ *
+ * Events never become runnable before their time.  The tick only bounds how
+ * much work is needed to find the next event; it should be around the
+ * granularity at which the events are scheduled.
+ */
+OSSL_EVENT_QUEUE *ossl_event_queue_new_wheel(OSSL_TIME tick);
+
 /*
  * Schedule a new event into an event queue.
  *
@@ -143,6 +158,8 @@ OSSL_TIME ossl_event_time_until(const OSSL_EVENT *event);
 /*
  * Return the time until the next event in the queue.
  * If the next event is in the past, zero is returned.
+ * For a timer wheel queue, the result may be earlier than the next event,
+ * but is never later.
  */
 OSSL_TIME ossl_event_queue_time_until_next(const OSSL_EVENT_QUEUE *queue);
 
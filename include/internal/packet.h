@@ -260,6 +260,13 @@ __owur static ossl_inline int PACKET_get_quic_vlint(PACKET *pkt,
 {
     size_t enclen;
 
+    /* Fast path when any encoding would fit in the remaining bytes. */
+    if (PACKET_remaining(pkt) >= 8) {
+        *data = ossl_quic_vlint_decode_unchecked8(pkt->curr, &enclen);
+        packet_forward(pkt, enclen);
+        return 1;
+    }
+
     if (PACKET_remaining(pkt) < 1)
         return 0;
 
@@ -283,6 +290,11 @@ __owur static ossl_inline int PACKET_peek_quic_vlint(PACKET *pkt,
 {
     size_t enclen;
 
+    if (PACKET_remaining(pkt) >= 8) {
+        *data = ossl_quic_vlint_decode_unchecked8(pkt->curr, &enclen);
+        return 1;
+    }
+
     if (PACKET_remaining(pkt) < 1)
         return 0;
 
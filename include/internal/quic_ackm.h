@@ -24,6 +24,15 @@ OSSL_ACKM *ossl_ackm_new(OSSL_TIME (*now)(void *arg),
                          OSSL_CC_DATA *cc_data);
 void ossl_ackm_free(OSSL_ACKM *ackm);
 
+/*
+ * Switches the ACKM to the RTT estimator and congestion controller of another
+ * path, which must use the same congestion control method. Bytes in flight
+ * are moved from the old controller to the new one, so that acknowledgements
+ * and losses of packets sent on the old path are accounted consistently.
+ */
+void ossl_ackm_set_path_state(OSSL_ACKM *ackm, OSSL_STATM *statm,
+                              OSSL_CC_DATA *cc_data);
+
 void ossl_ackm_set_loss_detection_deadline_callback(OSSL_ACKM *ackm,
                                                     void (*fn)(OSSL_TIME deadline,
                                                                void *arg),
@@ -135,6 +144,20 @@ int ossl_ackm_on_rx_packet(OSSL_ACKM *ackm, const OSSL_ACKM_RX_PKT *pkt);
 int ossl_ackm_on_rx_ack_frame(OSSL_ACKM *ackm, const OSSL_QUIC_FRAME_ACK *ack,
                               int pkt_space, OSSL_TIME rx_time);
 
+/*
+ * Processes a batch of num_acks ACK frames received for the same PN space, for
+ * example from a burst of datagrams, with the same result as passing each to
+ * ossl_ackm_on_rx_ack_frame in turn, except that loss detection is run once
+ * after all frames have been applied and the congestion controller is notified
+ * of acknowledged and lost packets once for the whole batch. Thus the frames
+ * may be in any order, and a packet acknowledged by any frame in the batch is
+ * never declared lost because of another. At most one RTT sample is taken,
+ * from the frame with the largest newly acknowledged PN.
+ */
+int ossl_ackm_on_rx_ack_frames(OSSL_ACKM *ackm,
+                               const OSSL_QUIC_FRAME_ACK *acks, size_t num_acks,
+                               int pkt_space, OSSL_TIME rx_time);
+
 int ossl_ackm_on_pkt_space_discarded(OSSL_ACKM *ackm, int pkt_space);
 int ossl_ackm_on_handshake_confirmed(OSSL_ACKM *ackm);
 int ossl_ackm_on_timeout(OSSL_ACKM *ackm);
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_QUIC_ADMIT_H
+# define OSSL_QUIC_ADMIT_H
+
+# include <openssl/ssl.h>
+# include "internal/time.h"
+# include "internal/quic_demux.h"
+# include "internal/quic_token.h"
+
+/*
+ * QUIC Initial Packet Admission Control
+ * =====================================
+ *
+ * Each Initial packet that starts a new connection costs a server key
+ * derivation, decryption and a TLS handshake. A server flooded with Initial
+ * packets will spend all of its time on these, and serve nobody. The admission
+ * stage sits in front of the demuxer's default handler, which receives every
+ * datagram whose DCID is not known, and decides whether to admit datagrams
+ * beginning with an Initial packet, looking only at the first five bytes of the
+ * packet and the address it came from. A datagram which is not admitted is
+ * returned to the demuxer at once, without any parsing or cryptography.
+ *
+ * Three mechanisms are provided, each disabled by default:
+ *
+ *   - Per-source rate limit. Initial datagrams are limited to a sustained
+ *     rate, with a burst allowance, for each source address prefix (by
+ *     default /24 for IPv4 and /48 for IPv6, since a single client often
+ *     controls many addresses in a prefix). The limit is enforced with the
+ *     generic cell rate algorithm, which needs one timestamp per prefix. These
+ *     are held in a fixed-size table indexed by a keyed hash of the prefix,
+ *     so memory use does not grow with the number of sources; when two active
+ *     prefixes share a slot, they share a limit.
+ *
+ *   - Handshake concurrency cap. The server reports when it starts and
+ *     finishes each handshake. While the cap is reached, new Initial
+ *     datagrams are dropped.
+ *
+ *   - Retry under load. When a token engine is given, Retry is required only
+ *     while the number of handshakes in progress is at or above a threshold.
+ *     Clients then pay a round trip to prove their address only when the
+ *     server is busy.
+ *
+ * Datagrams not beginning with a QUIC v1 Initial packet are always passed on.
+ *
+ * The admission stage is not thread safe.
+ */
+typedef struct quic_admit_st QUIC_ADMIT;
+
+typedef struct quic_admit_stats_st {
+    uint64_t    admitted;           /* Initial datagrams passed on */
+    uint64_t    dropped_rate;       /* dropped by the rate limit */
+    uint64_t    dropped_cap;        /* dropped by the handshake cap */
+} QUIC_ADMIT_STATS;
+
+/* Number of rate limit slots. */
+# define QUIC_ADMIT_NUM_SLOTS       4096
+
+/*
+ * Creates an admission stage with all limits disabled. now is used to
+ * determine the current time; if NULL, ossl_time_now() is used.
+ */
+QUIC_ADMIT *ossl_quic_admit_new(OSSL_LIB_CTX *libctx,
+                                OSSL_TIME (*now)(void *arg), void *now_arg);
+
+/* Frees an admission stage. No-op if admit is NULL. */
+void ossl_quic_admit_free(QUIC_ADMIT *admit);
+
+/*
+ * Limits Initial datagrams from each source address prefix to rate per second,
+ * with bursts of up to burst datagrams. v4_prefix_len and v6_prefix_len are
+ * the prefix lengths in bits used to group IPv4 and IPv6 sources. A rate of 0
+ * disables the limit.
+ *
+ * Returns 1 on success or 0 if the arguments are invalid.
+ */
+int ossl_quic_admit_set_rate_limit(QUIC_ADMIT *admit, uint64_t rate,
+                                   uint64_t burst, size_t v4_prefix_len,
+                                   size_t v6_prefix_len);
+
+/*
+ * Drops new Initial datagrams while max_handshakes handshakes are in progress.
+ * 0 disables the cap.
+ */
+void ossl_quic_admit_set_max_handshakes(QUIC_ADMIT *admit,
+                                        size_t max_handshakes);
+
+/*
+ * Requires Retry on eng while threshold or more handshakes are in progress.
+ * A threshold of 0 disables the check, so Retry is never required. eng may be
+ * NULL to stop managing a token engine, which is left in whatever state it was
+ * in.
+ */
+void ossl_quic_admit_set_retry_threshold(QUIC_ADMIT *admit,
+                                         QUIC_TOKEN_ENGINE *eng,
+                                         size_t threshold);
+
+/*
+ * Places the admission stage in front of the default handler of demux. The
+ * default handler must already be set. Datagrams admitted are passed to it.
+ *
+ * Returns 1 on success or 0 on failure.
+ */
+int ossl_quic_admit_install(QUIC_ADMIT *admit, QUIC_DEMUX *demux);
+
+/*
+ * Called by the server when it creates state for a new connection, and when
+ * that connection's handshake completes or the connection is abandoned.
+ */
+void ossl_quic_admit_on_handshake_start(QUIC_ADMIT *admit);
+void ossl_quic_admit_on_handshake_end(QUIC_ADMIT *admit);
+
+/* Returns the number of handshakes in progress. */
+size_t ossl_quic_admit_get_num_handshakes(const QUIC_ADMIT *admit);
+
+/* Retrieves admission statistics. */
+void ossl_quic_admit_get_stats(const QUIC_ADMIT *admit,
+                               QUIC_ADMIT_STATS *stats);
+
+#endif
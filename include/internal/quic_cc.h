@@ -14,6 +14,15 @@
 
 typedef struct ossl_cc_data_st *OSSL_CC_DATA;
 
+/*
+ * Well-known parameter names which may be passed to the new() call of an
+ * OSSL_CC_METHOD.
+ *
+ * OSSL_CC_OPTION_MAX_DGRAM_PAYLOAD_LEN (size_t, changeable): the current
+ * maximum datagram payload length for the path, in bytes.
+ */
+# define OSSL_CC_OPTION_MAX_DGRAM_PAYLOAD_LEN "max_dgram_payload_len"
+
 typedef struct ossl_cc_method_st {
     void *dummy;
 
@@ -143,8 +152,43 @@ typedef struct ossl_cc_method_st {
      * Returns 1 if sending is unblocked, 0 otherwise.
      */
     int (*on_spurious_congestion_event)(OSSL_CC_DATA *ccdata);
+
+    /*
+     * Optional; may be NULL.
+     * To be called whenever a new RTT sample is taken.
+     * |time_now| is the current time.
+     * |latest_rtt| is the newly measured RTT, not adjusted for ACK delay.
+     */
+    void (*on_rtt_sample)(OSSL_CC_DATA *ccdata, OSSL_TIME time_now,
+                          OSSL_TIME latest_rtt);
+
+    /*
+     * Optional; may be NULL.
+     * Returns the rate in bytes per second at which the congestion controller
+     * wants data to be released to the network, or 0 if it does not require
+     * pacing.
+     */
+    uint64_t (*get_pacing_rate)(OSSL_CC_DATA *ccdata);
 } OSSL_CC_METHOD;
 
 extern const OSSL_CC_METHOD ossl_cc_dummy_method;
+extern const OSSL_CC_METHOD ossl_cc_newreno_method;
+extern const OSSL_CC_METHOD ossl_cc_cubic_method;
+extern const OSSL_CC_METHOD ossl_cc_bbr_method;
+
+/*
+ * Returns the congestion control method with the given name ("newreno",
+ * "cubic", "bbr" or "dummy"), or NULL if the name is not known. A NULL |name| selects
+ * the default method.
+ */
+const OSSL_CC_METHOD *ossl_cc_method_by_name(const char *name);
+
+/*
+ * Helper for OSSL_CC_METHOD implementations. Locates the
+ * OSSL_CC_OPTION_MAX_DGRAM_PAYLOAD_LEN parameter in |changeables| and writes a
+ * pointer to its (permanent) data to |*pmdpl|, or NULL if it is not present.
+ * Returns 0 if the parameter is present but malformed, 1 otherwise.
+ */
+int ossl_cc_bind_max_dgram_size(OSSL_PARAM *changeables, const size_t **pmdpl);
 
 #endif
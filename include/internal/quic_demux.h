@@ -14,6 +14,7 @@
 # include "internal/quic_types.h"
 # include "internal/bio_addr.h"
 # include "internal/time.h"
+# include "internal/quic_slab.h"
 
 /*
  * QUIC Demuxer
@@ -180,6 +181,10 @@ typedef void (ossl_quic_demux_cb_fn)(QUIC_URXE *e, void *arg);
  * now is an optional function used to determine the time a datagram was
  * received. now_arg is an opaque argument passed to the function. If now is
  * NULL, ossl_time_zero() is used as the datagram reception time.
+ *
+ * If the BIO supports segmentation offload, reception of coalesced datagrams
+ * (GRO) is enabled on it, and received messages are split into one URXE per
+ * datagram.
  */
 QUIC_DEMUX *ossl_quic_demux_new(BIO *net_bio,
                                 size_t short_conn_id_len,
@@ -237,6 +242,38 @@ void ossl_quic_demux_unregister_by_cb(QUIC_DEMUX *demux,
                                       ossl_quic_demux_cb_fn *cb,
                                       void *cb_arg);
 
+/*
+ * Allocate URXEs from the given pool rather than the heap. This bounds the
+ * memory used for received datagrams to the limit of the pool, and avoids heap
+ * allocation once the pool has warmed up. The pool must outlive the demuxer,
+ * and must be thread safe if URXEs may be released to a different demuxer
+ * using the same pool from another thread. Must be called before the first
+ * datagram is received; fails otherwise.
+ *
+ * Returns 1 on success or 0 on failure.
+ */
+int ossl_quic_demux_set_slab_pool(QUIC_DEMUX *demux, QUIC_SLAB_POOL *pool);
+
+/*
+ * Set a callback to be called for datagrams whose first packet has a
+ * destination connection ID for which no handler is registered. Such datagrams
+ * are dropped if no default handler is set, as are datagrams so malformed that
+ * no DCID can be determined. The callback has the same semantics as
+ * ossl_quic_demux_cb_fn above; in particular, it takes ownership of the URXE.
+ * Passing a NULL cb clears any default handler.
+ */
+void ossl_quic_demux_set_default_handler(QUIC_DEMUX *demux,
+                                         ossl_quic_demux_cb_fn *cb,
+                                         void *cb_arg);
+
+/*
+ * Retrieves the default handler and its argument, so that a filter can be
+ * placed in front of it. *cb is set to NULL if no default handler is set.
+ */
+void ossl_quic_demux_get_default_handler(const QUIC_DEMUX *demux,
+                                         ossl_quic_demux_cb_fn **cb,
+                                         void **cb_arg);
+
 /*
  * Releases a URXE back to the demuxer. No reference must be made to the URXE or
  * its buffer after calling this function. The URXE must not be in any queue;
@@ -253,12 +290,25 @@ void ossl_quic_demux_release_urxe(QUIC_DEMUX *demux,
  */
 int ossl_quic_demux_pump(QUIC_DEMUX *demux);
 
+/*
+ * Take ownership of a URXE which is not in any queue, such as one received by
+ * another demuxer and passed to a handler, and route it as though it had been
+ * received by this demuxer. Once the registered handler releases it, the URXE
+ * joins this demuxer's free list. The URXE must have been allocated by a
+ * demuxer using the same slab pool (or none), and must not be adopted from
+ * within a callback of the same demuxer.
+ *
+ * Returns 1 on success or 0 on failure.
+ */
+int ossl_quic_demux_adopt_urxe(QUIC_DEMUX *demux, QUIC_URXE *e);
+
 /*
  * Artificially inject a packet into the demuxer for testing purposes. The
  * buffer must not exceed the URXE size being used by the demuxer.
  *
  * If peer or local are NULL, their respective fields are zeroed in the injected
- * URXE.
+ * URXE. The datagram is timestamped with the demuxer's now() function, as if it
+ * had just been received.
  *
  * Returns 1 on success or 0 on failure.
  */
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_QUIC_DEMUX_SHARD_H
+# define OSSL_QUIC_DEMUX_SHARD_H
+
+# include <openssl/ssl.h>
+# include "internal/quic_demux.h"
+
+/*
+ * QUIC Sharded Demuxer
+ * ====================
+ *
+ * A single QUIC_DEMUX pumps a single BIO and looks up connections in a single
+ * hashtable, which limits a busy server to one core for packet reception. The
+ * sharded demuxer splits this work across N shards, each consisting of a
+ * QUIC_DEMUX with its own network BIO, connection table and URXE free list.
+ * Each shard is intended to be pumped by a different thread; no state is
+ * shared between shards other than a small per-shard inbox, described below.
+ *
+ * Typically each shard's BIO wraps one of N UDP sockets bound to the same
+ * address with SO_REUSEPORT, so that the kernel spreads incoming datagrams
+ * across the shards. The kernel chooses a socket by hashing the address
+ * 4-tuple, which does not survive connection migration or NAT rebinding, so
+ * datagrams may still arrive at the wrong shard. Each connection therefore
+ * belongs to the shard determined by a steering function over its DCID, and a
+ * shard which receives a datagram for a connection ID it does not know passes
+ * it to the owning shard's inbox. The URXE itself is handed over, so no copy is
+ * made; it joins the owning shard's free list once released.
+ *
+ * Connection ID Encoding
+ * ----------------------
+ *
+ * The default steering function requires no state, as the shard index is
+ * encoded in the connection IDs we issue:
+ *
+ *   octet 0        first octet, random (reserved for future config rotation)
+ *   octets 1..2    shard index, big-endian
+ *   octets 3..     random
+ *
+ * This is similar to the plaintext algorithm of QUIC-LB. Connection IDs chosen
+ * by a client (for Initial packets) decode to an arbitrary but consistent
+ * shard, which is then responsible for the new connection. Connection IDs too
+ * short to contain a shard index are steered by hash.
+ *
+ * Threading
+ * ---------
+ *
+ * ossl_quic_demux_shards_pump() for a given shard, and any use of that shard's
+ * QUIC_DEMUX (registering connection IDs, releasing URXEs), must only happen on
+ * one thread at a time. Different shards may be pumped concurrently.
+ */
+
+/* Number of octets of a connection ID used by the shard encoding. */
+# define QUIC_DEMUX_SHARD_CONN_ID_MIN_LEN   4
+
+/* Maximum number of shards representable in the connection ID encoding. */
+# define QUIC_DEMUX_MAX_SHARDS              65536
+
+typedef struct quic_demux_shards_st QUIC_DEMUX_SHARDS;
+
+/*
+ * Steering function mapping a DCID to a shard index in [0, num_shards). Must
+ * always return the same shard for the same DCID.
+ */
+typedef size_t (ossl_quic_demux_steer_fn)(const QUIC_CONN_ID *dcid,
+                                          size_t num_shards, void *arg);
+
+/*
+ * Called when a URXE is placed in the inbox of a shard whose inbox was
+ * previously empty. This can be used to wake the thread pumping that shard,
+ * which may otherwise be waiting for its own BIO to become readable. Called on
+ * the thread of the shard which forwarded the datagram.
+ */
+typedef void (ossl_quic_demux_shard_notify_fn)(size_t shard, void *arg);
+
+typedef struct quic_demux_shards_args_st {
+    /* Array of num_shards network BIOs, one per shard. */
+    BIO                    **net_bios;
+    size_t                  num_shards;
+
+    /* As for ossl_quic_demux_new. */
+    size_t                  short_conn_id_len;
+    size_t                  default_urxe_alloc_len;
+    OSSL_TIME             (*now)(void *arg);
+    void                   *now_arg;
+
+    /*
+     * Optional pool shared by all shards for URXE allocation; see
+     * ossl_quic_demux_set_slab_pool. As URXEs move between shards, it must be
+     * created with QUIC_SLAB_FLAG_THREAD_SAFE.
+     */
+    QUIC_SLAB_POOL         *pool;
+
+    /*
+     * Optional steering function. If NULL, ossl_quic_demux_shard_from_conn_id
+     * is used.
+     */
+    ossl_quic_demux_steer_fn        *steer;
+    void                            *steer_arg;
+
+    /* Optional inbox notification callback. */
+    ossl_quic_demux_shard_notify_fn *notify;
+    void                            *notify_arg;
+} QUIC_DEMUX_SHARDS_ARGS;
+
+/*
+ * Creates a sharded demuxer. Returns NULL on failure, including if num_shards
+ * is zero or exceeds QUIC_DEMUX_MAX_SHARDS.
+ */
+QUIC_DEMUX_SHARDS *ossl_quic_demux_shards_new(const QUIC_DEMUX_SHARDS_ARGS *args);
+
+/*
+ * Frees a sharded demuxer and all of its shards. No shard may be being pumped,
+ * and all URXEs must have been released. Datagrams still in an inbox are
+ * discarded. No-op if shards is NULL.
+ */
+void ossl_quic_demux_shards_free(QUIC_DEMUX_SHARDS *shards);
+
+/* Returns the number of shards. */
+size_t ossl_quic_demux_shards_get_num(const QUIC_DEMUX_SHARDS *shards);
+
+/*
+ * Returns the QUIC_DEMUX for a shard, or NULL if shard is out of range. It may
+ * be used to register connection IDs, set a default handler for new
+ * connections and release URXEs, subject to the threading rules above. Its
+ * own default handler is reserved by the sharded demuxer; use
+ * ossl_quic_demux_shards_set_default_handler instead.
+ */
+QUIC_DEMUX *ossl_quic_demux_shards_get_demux(QUIC_DEMUX_SHARDS *shards,
+                                             size_t shard);
+
+/* Returns the shard which owns a given DCID. */
+size_t ossl_quic_demux_shards_steer(const QUIC_DEMUX_SHARDS *shards,
+                                    const QUIC_CONN_ID *dcid);
+
+/*
+ * Sets the handler for datagrams which arrive at (or are forwarded to) their
+ * owning shard but match no registered connection ID; typically, those
+ * starting a new connection. Datagrams are dropped if no handler is set.
+ */
+void ossl_quic_demux_shards_set_default_handler(QUIC_DEMUX_SHARDS *shards,
+                                                size_t shard,
+                                                ossl_quic_demux_cb_fn *cb,
+                                                void *cb_arg);
+
+/*
+ * Pumps a shard. Datagrams forwarded to the shard's inbox by other shards are
+ * processed first, then the shard's QUIC_DEMUX is pumped. Datagrams received
+ * for connections owned by other shards are forwarded to their inboxes.
+ *
+ * Returns 1 on success or 0 on failure. Failure to read from the network is
+ * not treated as failure if datagrams from the inbox were processed.
+ */
+int ossl_quic_demux_shards_pump(QUIC_DEMUX_SHARDS *shards, size_t shard);
+
+/*
+ * Default steering function. Decodes the shard index from a connection ID
+ * generated by ossl_quic_demux_shard_gen_conn_id, reduced modulo num_shards.
+ */
+size_t ossl_quic_demux_shard_from_conn_id(const QUIC_CONN_ID *dcid,
+                                          size_t num_shards);
+
+/*
+ * Generates a random connection ID of length len which the default steering
+ * function maps to the given shard. len must be at least
+ * QUIC_DEMUX_SHARD_CONN_ID_MIN_LEN and at most QUIC_MAX_CONN_ID_LEN.
+ *
+ * Returns 1 on success or 0 on failure.
+ */
+int ossl_quic_demux_shard_gen_conn_id(OSSL_LIB_CTX *libctx, size_t len,
+                                      size_t shard, QUIC_CONN_ID *cid);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_QUIC_EARLY_H
+# define OSSL_QUIC_EARLY_H
+
+# include <openssl/ssl.h>
+# include "internal/time.h"
+# include "internal/packet.h"
+# include "internal/quic_types.h"
+
+/*
+ * QUIC 0-RTT Support
+ * ==================
+ *
+ * A client which resumes a TLS 1.3 session may send application data in 0-RTT
+ * packets before the handshake completes, saving a round trip on reconnection
+ * (RFC 9001 s. 4.6). The keys for the 0-RTT EL are derived from the resumed
+ * session by the handshake layer and provided to the QTX (client) and QRX
+ * (server) as for any other EL; a server's QRX must also be created with
+ * allow_0rtt set. This module provides the remaining transport-level state:
+ * the transport parameters which a client must remember with a session ticket,
+ * and the replay protection a server needs before accepting early data.
+ */
+
+/*
+ * Remembered Transport Parameters
+ * -------------------------------
+ *
+ * A client sending 0-RTT data must use the flow control and stream limits the
+ * server advertised in the connection in which the session ticket was issued,
+ * since it has not yet received the new ones (RFC 9000 s. 7.4.1). A server
+ * which accepts 0-RTT must not advertise smaller limits than those.
+ *
+ * The parameters are stored along with the session ticket, for example as its
+ * application data. The encoding is a sequence of (transport parameter ID,
+ * value) pairs encoded as variable-length integers, using the IDs of RFC 9000
+ * s. 18.2. Unknown IDs are ignored when decoding, and parameters which are
+ * absent take their default values, so the encoding can be extended.
+ */
+typedef struct quic_early_params_st {
+    uint64_t    init_max_data;
+    uint64_t    init_max_stream_data_bidi_local;
+    uint64_t    init_max_stream_data_bidi_remote;
+    uint64_t    init_max_stream_data_uni;
+    uint64_t    init_max_streams_bidi;
+    uint64_t    init_max_streams_uni;
+    uint64_t    active_conn_id_limit;
+} QUIC_EARLY_PARAMS;
+
+/* Sets all parameters to their default values. */
+void ossl_quic_early_params_init(QUIC_EARLY_PARAMS *params);
+
+/* Encodes params to pkt. Returns 1 on success or 0 on failure. */
+int ossl_quic_early_params_encode(WPACKET *pkt,
+                                  const QUIC_EARLY_PARAMS *params);
+
+/*
+ * Decodes params from the rest of pkt. Returns 1 on success or 0 if the
+ * encoding is malformed.
+ */
+int ossl_quic_early_params_decode(PACKET *pkt, QUIC_EARLY_PARAMS *params);
+
+/*
+ * Checks whether a server whose transport parameters are cur can accept 0-RTT
+ * data sent using the parameters remembered. Returns 1 if none of the limits
+ * in cur are smaller than those remembered, and 0 otherwise, in which case
+ * the server must reject 0-RTT.
+ */
+int ossl_quic_early_params_compatible(const QUIC_EARLY_PARAMS *remembered,
+                                      const QUIC_EARLY_PARAMS *cur);
+
+/*
+ * Anti-Replay
+ * -----------
+ *
+ * 0-RTT data is not protected against replay: an attacker can capture a
+ * client's first flight and send it to the server again, possibly many times
+ * (RFC 8446 s. 8). A server must therefore accept 0-RTT at most once for any
+ * given ClientHello, which is done by recording an identifier of each
+ * ClientHello accepting early data, such as its PSK binder, and refusing 0-RTT
+ * for any ClientHello already recorded.
+ *
+ * Recording every ClientHello forever is impractical, so the filter also
+ * checks freshness (RFC 8446 s. 8.3): the time a ClientHello should have
+ * arrived is estimated from the time the ticket was issued plus the ticket age
+ * reported by the client, and 0-RTT is refused if this is more than half of
+ * the window from the time it actually arrived. A replayed ClientHello carries
+ * the same ticket age, so it is only fresh for a period as long as the window,
+ * and the filter keeps each identifier for at least that long.
+ *
+ * Identifiers are recorded in two generations of a hash table of SHA-256
+ * fingerprints. Each generation spans one window; when the current generation
+ * is a window old, the older one is cleared and becomes current. The filter
+ * has a fixed capacity; if a generation is full, 0-RTT is refused. In all
+ * cases where 0-RTT is refused, the handshake proceeds as a 1-RTT handshake,
+ * so the filter errs towards refusing.
+ *
+ * The filter is thread safe. To be effective, one filter must be shared by
+ * everything which can accept tickets issued by the same server, that is, by
+ * all connections using the same ticket keys.
+ */
+typedef struct quic_anti_replay_st QUIC_ANTI_REPLAY;
+
+/* Default window. */
+# define QUIC_ANTI_REPLAY_DEFAULT_WINDOW    (10 * OSSL_TIME_SECOND)
+
+typedef struct quic_anti_replay_stats_st {
+    uint64_t    accepted;           /* ClientHellos accepted for 0-RTT */
+    uint64_t    replayed;           /* Refused as already recorded */
+    uint64_t    stale;              /* Refused as not fresh */
+    uint64_t    full;               /* Refused as the filter was full */
+} QUIC_ANTI_REPLAY_STATS;
+
+/*
+ * Creates a new anti-replay filter with the given window, which records up to
+ * max_entries ClientHellos per window. now is used to determine the current
+ * time; if NULL, ossl_time_now() is used. Returns NULL on failure.
+ */
+QUIC_ANTI_REPLAY *ossl_quic_anti_replay_new(OSSL_LIB_CTX *libctx,
+                                            const char *propq,
+                                            OSSL_TIME window,
+                                            size_t max_entries,
+                                            OSSL_TIME (*now)(void *arg),
+                                            void *now_arg);
+
+/* Frees an anti-replay filter. No-op if ar is NULL. */
+void ossl_quic_anti_replay_free(QUIC_ANTI_REPLAY *ar);
+
+/*
+ * Checks whether 0-RTT may be accepted for a ClientHello identified by the
+ * id_len bytes at id, for a ticket issued at time issued, whose age the client
+ * reported as client_age. If so, the ClientHello is recorded.
+ *
+ * Returns 1 if 0-RTT may be accepted and 0 if it must be refused.
+ */
+int ossl_quic_anti_replay_check(QUIC_ANTI_REPLAY *ar,
+                                const unsigned char *id, size_t id_len,
+                                OSSL_TIME issued, OSSL_TIME client_age);
+
+/* Retrieves statistics on the decisions made by the filter. */
+void ossl_quic_anti_replay_get_stats(QUIC_ANTI_REPLAY *ar,
+                                     QUIC_ANTI_REPLAY_STATS *stats);
+
+#endif
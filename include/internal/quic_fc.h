@@ -120,6 +120,7 @@ uint64_t ossl_quic_txfc_get_swm(QUIC_TXFC *txfc);
  * =========================
  */
 typedef struct quic_rxfc_st QUIC_RXFC;
+typedef struct quic_rxfc_budget_st QUIC_RXFC_BUDGET;
 
 struct quic_rxfc_st {
     /*
@@ -131,10 +132,12 @@ struct quic_rxfc_st {
      * yet.
      */
     uint64_t        cwm, swm, rwm, esrwm, hwm, cur_window_size, max_window_size;
+    uint64_t        init_window_size;
     OSSL_TIME       epoch_start;
     OSSL_TIME       (*now)(void *arg);
     void            *now_arg;
     QUIC_RXFC       *parent;
+    QUIC_RXFC_BUDGET *budget;
     unsigned char   error_code, has_cwm_changed, is_fin;
 };
 
@@ -145,6 +148,13 @@ struct quic_rxfc_st {
  * and absolute maximum window sizes, respectively. Window size values are
  * expressed in bytes and determine how much credit the RXFC extends to the peer
  * to transmit more data at a time.
+ *
+ * The window is tuned automatically each time the peer is granted more credit.
+ * The rate at which the application has retired data since the window was last
+ * tuned, times the RTT, estimates the bandwidth-delay product (BDP) of the
+ * connection. If the window is smaller than four times the BDP, it is grown to
+ * that size, or doubled if that is more, but by no more than a factor of four
+ * at a time.
  */
 int ossl_quic_rxfc_init(QUIC_RXFC *rxfc, QUIC_RXFC *conn_rxfc,
                         uint64_t initial_window_size,
@@ -164,6 +174,56 @@ QUIC_RXFC *ossl_quic_rxfc_get_parent(QUIC_RXFC *rxfc);
 void ossl_quic_rxfc_set_max_window_size(QUIC_RXFC *rxfc,
                                         size_t max_window_size);
 
+/*
+ * Memory Budget
+ * -------------
+ *
+ * The connection-level window bounds the amount of data received which the
+ * application has not yet read, and thus the memory used to buffer it. A
+ * budget is a limit on the sum of the connection-level windows of the RXFCs
+ * sharing it, for example all of the connections in a process. It is thread
+ * safe, so may be shared by connections being serviced by different threads.
+ *
+ * A window is not grown beyond what the budget has left. While more than 3/4 of
+ * the budget is in use, windows larger than a fair share of it (the limit
+ * divided by the number of RXFCs) are halved each time they are tuned, until
+ * they reach the fair share, but never below their initial size. As credit
+ * already extended to the peer cannot be withdrawn, a smaller window takes
+ * effect once the application has read the data the peer was allowed to send.
+ *
+ * The initial window of an RXFC is always charged to the budget, even if it
+ * exceeds what is left, since it has already been advertised to the peer.
+ */
+
+/*
+ * Creates a budget allowing limit bytes in total across all RXFCs using it.
+ * Returns NULL on failure.
+ */
+QUIC_RXFC_BUDGET *ossl_quic_rxfc_budget_new(uint64_t limit);
+
+/*
+ * Frees a budget. All RXFCs using it must have been detached from it first.
+ * No-op if budget is NULL.
+ */
+void ossl_quic_rxfc_budget_free(QUIC_RXFC_BUDGET *budget);
+
+/* Returns the number of bytes of a budget in use. */
+uint64_t ossl_quic_rxfc_budget_get_used(QUIC_RXFC_BUDGET *budget);
+
+/*
+ * Makes a connection-level RXFC use budget, detaching it from any budget it was
+ * using before. If budget is NULL, the RXFC is just detached. An RXFC using a
+ * budget must be detached before it is discarded. Returns 1 on success or 0 if
+ * rxfc is a stream-level RXFC.
+ */
+int ossl_quic_rxfc_set_budget(QUIC_RXFC *rxfc, QUIC_RXFC_BUDGET *budget);
+
+/*
+ * Returns the current window size, which determines how much credit is
+ * extended to the peer past the retired watermark.
+ */
+uint64_t ossl_quic_rxfc_get_window_size(QUIC_RXFC *rxfc);
+
 /*
  * To be called whenever a STREAM frame is received.
  *
@@ -0,0 +1,236 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_QUIC_PATH_H
+# define OSSL_QUIC_PATH_H
+
+# include <openssl/ssl.h>
+# include "internal/time.h"
+# include "internal/packet.h"
+# include "internal/quic_types.h"
+# include "internal/quic_statm.h"
+# include "internal/quic_cc.h"
+# include "internal/quic_ackm.h"
+
+/*
+ * QUIC Path Manager
+ * =================
+ *
+ * A path is a pair of local and peer addresses over which a connection
+ * exchanges datagrams. The path manager tracks the paths of a connection and
+ * lets it move from one to another without a new handshake (RFC 9000 s. 9):
+ *
+ *   - Path validation (RFC 9000 s. 8.2). A PATH_CHALLENGE is sent on a new
+ *     path and retransmitted every PTO until a matching PATH_RESPONSE arrives,
+ *     or the validation timeout of max(3*PTO, 6*kInitialRtt) expires. Every
+ *     PATH_CHALLENGE received is answered with a PATH_RESPONSE on the path it
+ *     arrived on.
+ *
+ *   - Anti-amplification (RFC 9000 s. 8). Until a path is validated, no more
+ *     than three times the bytes received on it may be sent on it.
+ *
+ *   - Per-path RTT and congestion control state (RFC 9002 s. 9.4). Each path
+ *     has its own RTT estimator and congestion controller, which are given to
+ *     the ACKM when the path becomes the active one. A change of peer address
+ *     in which only the port differs, as happens when a NAT rebinds, is
+ *     treated as the same network path: the new path takes over the RTT and
+ *     congestion state of the old one rather than starting from scratch.
+ *
+ *   - Migration (RFC 9000 s. 9.3). The server switches to a new peer address
+ *     when it receives a non-probing packet from it with the highest packet
+ *     number yet seen, and starts validating the address if it has not been
+ *     validated already. The client migrates by calling
+ *     ossl_quic_path_mgr_migrate(). If validation of the new active path
+ *     fails, the connection reverts to the last validated path.
+ *
+ * The path manager does not send anything itself. The packetiser asks it for a
+ * path with frames to send, writes them with ossl_quic_path_mgr_write_frames()
+ * into a packet addressed with the addresses of that path, and reports what it
+ * sent with ossl_quic_path_mgr_on_tx(). Datagrams carrying a PATH_CHALLENGE
+ * must be padded to at least 1200 bytes, subject to the anti-amplification
+ * limit.
+ *
+ * The path manager is not thread safe.
+ */
+typedef struct quic_path_mgr_st QUIC_PATH_MGR;
+typedef struct quic_path_st QUIC_PATH;
+
+/* Path states. */
+# define QUIC_PATH_STATE_VALIDATING     1
+# define QUIC_PATH_STATE_VALIDATED      2
+# define QUIC_PATH_STATE_FAILED         3
+
+/* Maximum number of paths tracked by default. */
+# define QUIC_PATH_DEFAULT_MAX_PATHS    4
+
+/* Number of outstanding PATH_CHALLENGE values kept for each path. */
+# define QUIC_PATH_MAX_CHALLENGES       3
+
+/* Number of PATH_RESPONSE frames which may be queued for each path. */
+# define QUIC_PATH_MAX_RESPONSES        4
+
+typedef struct quic_path_mgr_args_st {
+    OSSL_LIB_CTX            *libctx;
+    const char              *propq;
+
+    /* Used to determine the current time. If NULL, ossl_time_now() is used. */
+    OSSL_TIME               (*now)(void *arg);
+    void                    *now_arg;
+
+    /*
+     * Congestion controller used for each path. If NULL, the dummy controller
+     * is used.
+     */
+    const OSSL_CC_METHOD    *cc_method;
+
+    /*
+     * Optional ACKM, which is switched to the RTT estimator and congestion
+     * controller of the active path whenever it changes. It must have been
+     * created with cc_method and with the state of the initial path, as
+     * returned by ossl_quic_path_get0_statm() and
+     * ossl_quic_path_get0_cc_data() for ossl_quic_path_mgr_get0_active().
+     * It may also be set later with ossl_quic_path_mgr_set_ackm().
+     */
+    OSSL_ACKM               *ackm;
+
+    /* 1 if this is the server end of the connection. */
+    int                     is_server;
+
+    /* Maximum number of paths tracked. If 0, a default is used. */
+    size_t                  max_paths;
+
+    /* The addresses of the path the connection was established on. */
+    const BIO_ADDR          *peer, *local;
+} QUIC_PATH_MGR_ARGS;
+
+/*
+ * Creates a path manager with a single path, the one given in args, which is
+ * active and treated as validated. Anti-amplification during the handshake is
+ * the responsibility of the caller.
+ */
+QUIC_PATH_MGR *ossl_quic_path_mgr_new(const QUIC_PATH_MGR_ARGS *args);
+
+/* Frees a path manager and all of its paths. No-op if pm is NULL. */
+void ossl_quic_path_mgr_free(QUIC_PATH_MGR *pm);
+
+/* Sets the ACKM used with the active path. See QUIC_PATH_MGR_ARGS. */
+void ossl_quic_path_mgr_set_ackm(QUIC_PATH_MGR *pm, OSSL_ACKM *ackm);
+
+/* Returns the path currently used to send non-probing packets. */
+QUIC_PATH *ossl_quic_path_mgr_get0_active(QUIC_PATH_MGR *pm);
+
+/* Returns the number of paths being tracked. */
+size_t ossl_quic_path_mgr_get_num_paths(const QUIC_PATH_MGR *pm);
+
+/*
+ * Called for each packet received, with its addresses (either of which may be
+ * NULL if not known) and length in bytes. Returns the path the packet was
+ * received on, which is created and begins validation if it is new. If a new
+ * path is needed and max_paths are already tracked, the path least recently
+ * received on which is not active, and which the connection could not revert
+ * to, is forgotten. Returns NULL on failure.
+ */
+QUIC_PATH *ossl_quic_path_mgr_on_rx(QUIC_PATH_MGR *pm, const BIO_ADDR *peer,
+                                    const BIO_ADDR *local, size_t len);
+
+/* Called when a PATH_CHALLENGE frame is received on a path. */
+void ossl_quic_path_mgr_on_path_challenge(QUIC_PATH_MGR *pm, QUIC_PATH *path,
+                                          uint64_t data);
+
+/*
+ * Called when a PATH_RESPONSE frame is received on a path. If the data matches
+ * a challenge sent on any path, that path is validated. (RFC 9000 does not
+ * require the response to arrive on the path being validated.) Responses
+ * which match no challenge are ignored.
+ */
+void ossl_quic_path_mgr_on_path_response(QUIC_PATH_MGR *pm, QUIC_PATH *path,
+                                         uint64_t data);
+
+/*
+ * Called when a 1-RTT packet containing frames other than PADDING,
+ * PATH_CHALLENGE, PATH_RESPONSE and NEW_CONNECTION_ID has been received on a
+ * path and processed, with its packet number. On the server, this migrates the
+ * connection to the path if pn is the largest packet number yet received.
+ *
+ * Returns 1 if the connection migrated to the path, else 0.
+ */
+int ossl_quic_path_mgr_on_non_probing(QUIC_PATH_MGR *pm, QUIC_PATH *path,
+                                      QUIC_PN pn);
+
+/*
+ * Starts validating a path to peer from local, for example after the local
+ * address changes. This is usually done by the client. Returns the new path, or
+ * the existing one if there already is a path with these addresses, or NULL on
+ * failure.
+ */
+QUIC_PATH *ossl_quic_path_mgr_probe(QUIC_PATH_MGR *pm, const BIO_ADDR *peer,
+                                    const BIO_ADDR *local);
+
+/*
+ * Makes a path the active one. The path may still be being validated; if
+ * validation fails, the connection reverts to the last validated path.
+ * Returns 1 on success or 0 if the path has failed validation.
+ */
+int ossl_quic_path_mgr_migrate(QUIC_PATH_MGR *pm, QUIC_PATH *path);
+
+/*
+ * Handles timer events: retransmits PATH_CHALLENGE frames and fails paths
+ * whose validation timed out, reverting the connection to the last validated
+ * path if the active path failed. Failed paths other than the active one are
+ * forgotten.
+ */
+void ossl_quic_path_mgr_tick(QUIC_PATH_MGR *pm);
+
+/*
+ * Returns the time at which ossl_quic_path_mgr_tick() next needs to be called,
+ * or ossl_time_infinite() if it does not.
+ */
+OSSL_TIME ossl_quic_path_mgr_get_tick_deadline(QUIC_PATH_MGR *pm);
+
+/* Returns a path which has PATH_CHALLENGE or PATH_RESPONSE frames to send. */
+QUIC_PATH *ossl_quic_path_mgr_get_next_tx_path(QUIC_PATH_MGR *pm);
+
+/*
+ * Writes as many of the PATH_RESPONSE and PATH_CHALLENGE frames pending for a
+ * path as fit into wpkt, and marks them as sent. *num_frames is set to the
+ * number of frames written. Returns 1 on success or 0 on failure.
+ */
+int ossl_quic_path_mgr_write_frames(QUIC_PATH_MGR *pm, QUIC_PATH *path,
+                                    WPACKET *wpkt, size_t *num_frames);
+
+/* Called for each datagram sent on a path, with its length in bytes. */
+void ossl_quic_path_mgr_on_tx(QUIC_PATH_MGR *pm, QUIC_PATH *path, size_t len);
+
+/* Path accessors. */
+const BIO_ADDR *ossl_quic_path_get0_peer(const QUIC_PATH *path);
+const BIO_ADDR *ossl_quic_path_get0_local(const QUIC_PATH *path);
+int ossl_quic_path_get_state(const QUIC_PATH *path);
+OSSL_STATM *ossl_quic_path_get0_statm(QUIC_PATH *path);
+OSSL_CC_DATA *ossl_quic_path_get0_cc_data(QUIC_PATH *path);
+
+/*
+ * Returns the number of bytes which may be sent on a path before the
+ * anti-amplification limit is reached, or UINT64_MAX if it is validated.
+ */
+uint64_t ossl_quic_path_get_tx_allowance(const QUIC_PATH *path);
+
+/*
+ * Sets the maximum datagram payload length of a path, which is made available
+ * to its congestion controller.
+ */
+void ossl_quic_path_set_mdpl(QUIC_PATH *path, size_t mdpl);
+
+/*
+ * Returns 1 if a and b are the same address. NULL and an address of family
+ * AF_UNSPEC are equal to each other. If ignore_port is 1, the ports are not
+ * compared.
+ */
+int ossl_quic_addr_eq(const BIO_ADDR *a, const BIO_ADDR *b, int ignore_port);
+
+#endif
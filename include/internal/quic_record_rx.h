@@ -43,6 +43,21 @@ typedef struct ossl_qrx_args_st {
 
     /* Initial key phase. For debugging use only; always 0 in real use. */
     unsigned char   init_key_phase_bit;
+
+    /*
+     * Whether 0-RTT packets are accepted, which is only the case for a server.
+     * A client's QRX discards them early. A server which does not accept early
+     * data, or has rejected it, should discard the 0-RTT EL so that 0-RTT
+     * packets are not buffered waiting for keys which will never arrive.
+     */
+    int             allow_0rtt;
+
+    /*
+     * Optional cache of the algorithms used to provision encryption levels.
+     * If set, it must have been created with the same libctx and propq, and
+     * must outlive the QRX.
+     */
+    OSSL_QRL_CIPHER_CACHE *cipher_cache;
 } OSSL_QRX_ARGS;
 
 /* Instantiates a new QRX. */
@@ -14,6 +14,8 @@
 # include "internal/quic_wire_pkt.h"
 # include "internal/quic_types.h"
 # include "internal/quic_record_util.h"
+# include "internal/time.h"
+# include "internal/quic_slab.h"
 
 /*
  * QUIC Record Layer - TX
@@ -30,6 +32,27 @@ typedef struct ossl_qtx_args_st {
 
     /* Maximum datagram payload length (MDPL) for TX purposes. */
     size_t          mdpl;
+
+    /*
+     * Optional function used to determine the current time for pacing
+     * purposes. now_arg is an opaque argument passed to the function. If now
+     * is NULL, ossl_time_now() is used.
+     */
+    OSSL_TIME     (*now)(void *arg);
+    void           *now_arg;
+
+    /*
+     * Optional pool from which TXEs are allocated. If NULL, TXEs are allocated
+     * from the heap. The pool must outlive the QTX.
+     */
+    QUIC_SLAB_POOL *pool;
+
+    /*
+     * Optional cache of the algorithms used to provision encryption levels.
+     * If set, it must have been created with the same libctx and propq, and
+     * must outlive the QTX.
+     */
+    OSSL_QRL_CIPHER_CACHE *cipher_cache;
 } OSSL_QTX_ARGS;
 
 /* Instantiates a new QTX. */
@@ -191,6 +214,10 @@ void ossl_qtx_finish_dgram(OSSL_QTX *qtx);
  * is desired. The queue is drained into the OS's sockets as much as possible.
  * To determine if there is still data to be sent after calling this function,
  * use ossl_qtx_get_queue_len_bytes().
+ *
+ * If the BIO supports segmentation offload (see BIO_dgram_get_segment_cap),
+ * consecutive datagrams of the same size to the same destination are passed
+ * to the BIO as a single message.
  */
 void ossl_qtx_flush_net(OSSL_QTX *qtx);
 
@@ -233,6 +260,35 @@ int ossl_qtx_set1_bio(OSSL_QTX *qtx, BIO *bio);
 int ossl_qtx_set_mdpl(OSSL_QTX *qtx, size_t mdpl);
 
 
+/*
+ * Pacing
+ * ------
+ *
+ * By default ossl_qtx_flush_net() sends everything queued in one burst. When
+ * pacing is enabled, datagrams are released from the queue at no more than a
+ * given rate, which is normally the pacing rate of the congestion controller
+ * (see the get_pacing_rate call of OSSL_CC_METHOD). Datagrams which cannot be
+ * released yet stay queued; the caller should arrange to call
+ * ossl_qtx_flush_net() again at the deadline returned by
+ * ossl_qtx_get_flush_deadline().
+ */
+
+/*
+ * Sets the pacing rate in bytes per second and the largest burst in bytes
+ * which may be released at once. A rate of 0 disables pacing. burst must be
+ * non-zero if rate is non-zero, and should be at least one MDPL. Returns 1 on
+ * success or 0 on failure.
+ */
+int ossl_qtx_set_pacing_rate(OSSL_QTX *qtx, uint64_t rate, size_t burst);
+
+/*
+ * Returns the time at which ossl_qtx_flush_net() is next able to release a
+ * queued datagram: ossl_time_zero() if it can do so now, or
+ * ossl_time_infinite() if there is nothing queued.
+ */
+OSSL_TIME ossl_qtx_get_flush_deadline(OSSL_QTX *qtx);
+
+
 /*
  * Key Update
  * ----------
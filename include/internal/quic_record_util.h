@@ -16,6 +16,8 @@
 struct ossl_qrx_st;
 struct ossl_qtx_st;
 
+typedef struct ossl_qrl_cipher_cache_st OSSL_QRL_CIPHER_CACHE;
+
 /*
  * QUIC Key Derivation Utilities
  * =============================
@@ -63,6 +65,20 @@ int ossl_quic_provide_initial_secret(OSSL_LIB_CTX *libctx,
                                      struct ossl_qrx_st *qrx,
                                      struct ossl_qtx_st *qtx);
 
+/*
+ * As for ossl_quic_provide_initial_secret, but the Initial secrets for the DCID
+ * are looked up in, or derived using and then added to, a cipher cache. cache
+ * may be NULL, in which case this is equivalent to
+ * ossl_quic_provide_initial_secret.
+ */
+int ossl_quic_provide_initial_secret_ex(OSSL_LIB_CTX *libctx,
+                                        const char *propq,
+                                        OSSL_QRL_CIPHER_CACHE *cache,
+                                        const QUIC_CONN_ID *dst_conn_id,
+                                        int is_server,
+                                        struct ossl_qrx_st *qrx,
+                                        struct ossl_qtx_st *qtx);
+
 /*
  * QUIC Record Layer Ciphersuite Info
  * ==================================
@@ -109,4 +125,65 @@ uint64_t ossl_qrl_get_suite_max_pkt(uint32_t suite_id);
  */
 uint64_t ossl_qrl_get_suite_max_forged_pkt(uint32_t suite_id);
 
+/*
+ * QUIC Record Layer Cipher Cache
+ * ==============================
+ *
+ * Provisioning an encryption level fetches an AEAD cipher, a header protection
+ * cipher and a hash function from a provider, and runs the TLS 1.3 KDF several
+ * times, each of which also fetches the KDF and a hash function. On a busy
+ * server, this is done several times for each connection, and Initial secrets
+ * are derived again for each Initial packet which starts a connection.
+ *
+ * A cipher cache fetches all of these once, for each ciphersuite, when it is
+ * created, and keeps a KDF context with the hash function and label prefix
+ * already set, which is duplicated for each derivation rather than rebuilt.
+ * It also keeps the Initial secrets of recently seen DCIDs. A cache is created
+ * for a given library context and property query, and may be given to any
+ * number of QRX and QTX instances using them, in any number of threads. It
+ * must outlive them.
+ *
+ * A ciphersuite whose algorithms cannot be fetched (for example, because the
+ * provider does not offer them) is simply not cached, and QRX and QTX
+ * instances fall back to fetching them as they would without a cache.
+ */
+
+/* Number of DCIDs for which Initial secrets are kept. */
+# define QRL_CIPHER_CACHE_NUM_INITIAL   64
+
+/* Creates a cipher cache. Returns NULL on failure. */
+OSSL_QRL_CIPHER_CACHE *ossl_qrl_cipher_cache_new(OSSL_LIB_CTX *libctx,
+                                                 const char *propq);
+
+/* Frees a cipher cache. No-op if cache is NULL. */
+void ossl_qrl_cipher_cache_free(OSSL_QRL_CIPHER_CACHE *cache);
+
+/* Returns 1 if the algorithms of the given suite are cached. */
+int ossl_qrl_cipher_cache_have_suite(const OSSL_QRL_CIPHER_CACHE *cache,
+                                     uint32_t suite_id);
+
+/*
+ * Return the cached AEAD cipher, header protection cipher and hash function of
+ * a suite, or NULL if the suite is not cached. No reference is taken.
+ */
+EVP_CIPHER *ossl_qrl_cipher_cache_get0_cipher(const OSSL_QRL_CIPHER_CACHE *cache,
+                                              uint32_t suite_id);
+EVP_CIPHER *
+ossl_qrl_cipher_cache_get0_hdr_prot_cipher(const OSSL_QRL_CIPHER_CACHE *cache,
+                                           uint32_t suite_id);
+EVP_MD *ossl_qrl_cipher_cache_get0_md(const OSSL_QRL_CIPHER_CACHE *cache,
+                                      uint32_t suite_id);
+
+/*
+ * HKDF-Expand-Label (RFC 8446) using the hash function of a cached suite.
+ * secret must be as long as the hash function output. Returns 1 on success or
+ * 0 on failure, including if the suite is not cached.
+ */
+int ossl_qrl_cipher_cache_hkdf_expand(const OSSL_QRL_CIPHER_CACHE *cache,
+                                      uint32_t suite_id,
+                                      const unsigned char *secret,
+                                      const unsigned char *label,
+                                      size_t label_len,
+                                      unsigned char *out, size_t out_len);
+
 #endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_QUIC_SLAB_H
+# define OSSL_QUIC_SLAB_H
+
+# include <openssl/crypto.h>
+
+/*
+ * QUIC Slab Pool
+ * ==============
+ *
+ * A simple size-class allocator for datagram buffers (URXEs and TXEs). Memory
+ * is obtained from the system in slabs which are carved into objects of a
+ * single power-of-two size class, and freed objects are kept on a per-class
+ * free list for reuse. Slabs are only returned to the system when the pool is
+ * freed. Thus once a pool has warmed up, steady-state traffic performs no heap
+ * allocations, and the total memory used by the pool can be bounded.
+ *
+ * Slabs are first written by the thread which allocates from them, so with
+ * the usual first-touch policy a pool used by a single thread (for example,
+ * one per demuxer shard) is local to that thread's NUMA node. If hugepages are
+ * requested, slabs are made larger and, where supported, the kernel is advised
+ * to back them with transparent hugepages, reducing TLB pressure.
+ *
+ * An object must be freed to the pool it was allocated from. A pool is not
+ * thread safe unless QUIC_SLAB_FLAG_THREAD_SAFE is specified.
+ */
+typedef struct quic_slab_pool_st QUIC_SLAB_POOL;
+
+/* Smallest and largest size classes. Larger allocations always fail. */
+# define QUIC_SLAB_MIN_OBJ_LEN          256
+# define QUIC_SLAB_MAX_OBJ_LEN          (128 * 1024)
+
+# define QUIC_SLAB_FLAG_THREAD_SAFE     (1U << 0)
+# define QUIC_SLAB_FLAG_HUGEPAGES       (1U << 1)
+
+typedef struct quic_slab_stats_st {
+    /* Number of successful allocations and frees. */
+    uint64_t    num_alloc, num_free;
+
+    /* Number of allocations which failed due to the limit or lack of memory. */
+    uint64_t    num_alloc_fail;
+
+    /* Number of slabs obtained from the system, and their total size. */
+    uint64_t    num_slabs;
+    size_t      bytes_reserved;
+
+    /* Total size (by size class) of objects currently allocated. */
+    size_t      bytes_in_use;
+} QUIC_SLAB_STATS;
+
+/*
+ * Creates a new pool. max_bytes limits the total size of slabs the pool may
+ * obtain from the system; if it is 0, there is no limit. flags is zero or more
+ * QUIC_SLAB_FLAG_* values.
+ */
+QUIC_SLAB_POOL *ossl_quic_slab_pool_new(size_t max_bytes, uint32_t flags);
+
+/*
+ * Frees a pool and all of its slabs. All objects allocated from the pool
+ * become invalid. No-op if pool is NULL.
+ */
+void ossl_quic_slab_pool_free(QUIC_SLAB_POOL *pool);
+
+/*
+ * Allocates an object of at least len bytes. The object is suitably aligned
+ * for any type. Returns NULL on failure or if the pool limit would be
+ * exceeded.
+ */
+void *ossl_quic_slab_alloc(QUIC_SLAB_POOL *pool, size_t len);
+
+/* Returns an object to the pool. No-op if p is NULL. */
+void ossl_quic_slab_free(QUIC_SLAB_POOL *pool, void *p);
+
+/*
+ * Returns the number of bytes actually usable in an object, which is the size
+ * of its size class and may exceed the length requested. Callers may use all
+ * of it, so buffers can grow without reallocation.
+ */
+size_t ossl_quic_slab_usable_size(const void *p);
+
+/* Retrieves pool statistics. */
+void ossl_quic_slab_get_stats(QUIC_SLAB_POOL *pool, QUIC_SLAB_STATS *stats);
+
+#endif
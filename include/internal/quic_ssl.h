@@ -13,6 +13,7 @@
 # include <openssl/ssl.h>
 # include "internal/quic_record_rx.h" /* OSSL_QRX */
 # include "internal/quic_ackm.h"      /* OSSL_ACKM */
+# include "internal/quic_path.h"      /* QUIC_PATH_MGR */
 
 __owur SSL *ossl_quic_new(SSL_CTX *ctx);
 __owur int ossl_quic_init(SSL *s);
@@ -43,5 +44,7 @@ int ossl_quic_conn_set_qrx(QUIC_CONNECTION *qc, OSSL_QRX *qrx);
 OSSL_QRX *ossl_quic_conn_get_qrx(QUIC_CONNECTION *qc);
 int ossl_quic_conn_set_ackm(QUIC_CONNECTION *qc, OSSL_ACKM *ackm);
 OSSL_ACKM *ossl_quic_conn_set_akcm(QUIC_CONNECTION *qc);
+int ossl_quic_conn_set_path_mgr(QUIC_CONNECTION *qc, QUIC_PATH_MGR *pm);
+QUIC_PATH_MGR *ossl_quic_conn_get_path_mgr(QUIC_CONNECTION *qc);
 
 #endif
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_QUIC_STREAM_H
+# define OSSL_QUIC_STREAM_H
+
+# include <openssl/ssl.h>
+# include "internal/quic_record_rx.h"
+# include "internal/quic_record_rx_wrap.h"
+# include "internal/quic_fc.h"
+# include "internal/quic_statm.h"
+
+/*
+ * QUIC Receive Stream
+ * ===================
+ *
+ * A QUIC_RSTREAM holds the data received in STREAM frames for one stream until
+ * the application consumes it. Frames are not copied: each frame queued holds
+ * a reference to the OSSL_QRX_PKT_WRAP of the packet which carried it, and
+ * points into that packet's decrypted payload, which lives in the URXE it was
+ * received in. Once all of the data in a packet has been consumed (from this
+ * and any other stream), the last reference is released and the URXE returns
+ * to the demuxer for reuse.
+ *
+ * Frames may arrive out of order and may overlap. Overlapping data is assumed
+ * to be identical, as RFC 9000 requires, and is only stored once.
+ *
+ * Data which arrives after a gap, and so cannot be read until a retransmission
+ * fills it, is the exception. Referencing it would pin each packet's URXE (a
+ * whole datagram, which may be much larger than the frame) for at least a round
+ * trip, so a lossy path could hold a large amount of memory per stream. Such
+ * data is instead copied into a per-stream ring buffer of max_buf bytes and the
+ * packet is released at once. The ring is indexed by stream offset, so data
+ * beyond read offset + max_buf cannot be held and is dropped; this never
+ * happens with a peer respecting flow control credit if the stream's window
+ * does not exceed max_buf.
+ *
+ * If an RXFC is provided, received frames are reported to it, and data is
+ * retired from it as the application consumes it.
+ *
+ * There are two ways to consume data. ossl_quic_rstream_read() copies data
+ * into a caller's buffer. Alternatively, ossl_quic_rstream_get_record()
+ * returns a pointer directly into the packet holding the next data in the
+ * stream, which the caller may use in place until it calls
+ * ossl_quic_rstream_release_record(). Large transfers using the latter avoid
+ * copying the data again after decryption.
+ */
+typedef struct quic_rstream_st QUIC_RSTREAM;
+
+typedef struct quic_rstream_stats_st {
+    /* Number of frames queued, after coalescing. */
+    size_t      num_frames;
+
+    /* Bytes queued which are referenced in place or held in the ring. */
+    uint64_t    bytes_in_place, bytes_in_rbuf;
+
+    /* Total bytes copied into the ring, and dropped as beyond max_buf. */
+    uint64_t    bytes_copied, bytes_dropped;
+} QUIC_RSTREAM_STATS;
+
+/*
+ * Creates a new receive stream. qrx is the QRX which produced the packets
+ * whose wrappers will be queued, and to which they are released. It may be
+ * NULL if only data not belonging to a packet (pkt_wrap == NULL) is queued.
+ *
+ * rxfc is the stream-level RXFC for the stream, or NULL. statm is used for RTT
+ * information when retiring data from the RXFC, and may be NULL.
+ *
+ * max_buf limits how far beyond the read offset data is held, and is the size
+ * of the ring buffer for out-of-order data. If 0, there is no limit and all
+ * data is referenced in place.
+ */
+QUIC_RSTREAM *ossl_quic_rstream_new(OSSL_QRX *qrx, QUIC_RXFC *rxfc,
+                                    OSSL_STATM *statm, size_t max_buf);
+
+/*
+ * Frees a receive stream, releasing all packets it references. No-op if qrs
+ * is NULL.
+ */
+void ossl_quic_rstream_free(QUIC_RSTREAM *qrs);
+
+/*
+ * Queues data_len bytes of stream data received at the given logical offset.
+ * is_fin indicates that this is the end of the stream. data must point into
+ * the packet referenced by pkt_wrap, which gains a reference that is held until
+ * the data has been consumed; pkt_wrap may also be NULL, in which case the
+ * caller must keep data valid until then.
+ *
+ * Data which has already been consumed or queued is ignored. Returns 0 if the
+ * data is inconsistent with a final size already known for the stream (a
+ * FINAL_SIZE_ERROR), if the RXFC detects a flow control error, or on
+ * allocation failure.
+ */
+int ossl_quic_rstream_queue_data(QUIC_RSTREAM *qrs, OSSL_QRX_PKT_WRAP *pkt_wrap,
+                                 uint64_t offset,
+                                 const unsigned char *data, uint64_t data_len,
+                                 int is_fin);
+
+/*
+ * Copies up to size bytes of contiguous data from the current read position
+ * into buf and consumes it. *readbytes is set to the number of bytes copied,
+ * and *fin to 1 if the end of the stream has been reached. Returns 1 on
+ * success, even if no data is available.
+ */
+int ossl_quic_rstream_read(QUIC_RSTREAM *qrs, unsigned char *buf, size_t size,
+                           size_t *readbytes, int *fin);
+
+/* As for ossl_quic_rstream_read, but does not consume the data. */
+int ossl_quic_rstream_peek(QUIC_RSTREAM *qrs, unsigned char *buf, size_t size,
+                           size_t *readbytes, int *fin);
+
+/*
+ * Sets *avail to the number of contiguous bytes which can be read from the
+ * current read position, and *fin to 1 if they extend to the end of the
+ * stream.
+ */
+int ossl_quic_rstream_available(QUIC_RSTREAM *qrs, size_t *avail, int *fin);
+
+/*
+ * Zero-copy read. Sets *record to point to the contiguous data at the current
+ * read position and *rec_len to its length, which may be less than the total
+ * available as the data may be split across packets. *fin is set to 1 if the
+ * record extends to the end of the stream. If no data is available, *rec_len
+ * is 0 and *record is NULL.
+ *
+ * The record remains valid until it is released by
+ * ossl_quic_rstream_release_record, or the stream is freed, and must not be
+ * modified. Only one record may be outstanding at a time.
+ */
+int ossl_quic_rstream_get_record(QUIC_RSTREAM *qrs,
+                                 const unsigned char **record, size_t *rec_len,
+                                 int *fin);
+
+/*
+ * Consumes read_len bytes of the record returned by
+ * ossl_quic_rstream_get_record, which must not exceed its length. Packets
+ * whose data has been fully consumed are released. read_len may also be
+ * SIZE_MAX to consume the whole record. The data consumed is retired from the
+ * RXFC, if any; check ossl_quic_rxfc_has_cwm_changed() afterwards.
+ */
+int ossl_quic_rstream_release_record(QUIC_RSTREAM *qrs, size_t read_len);
+
+/* Returns the logical offset of the current read position. */
+uint64_t ossl_quic_rstream_get_read_offset(const QUIC_RSTREAM *qrs);
+
+/* Retrieves buffering statistics. */
+void ossl_quic_rstream_get_stats(const QUIC_RSTREAM *qrs,
+                                 QUIC_RSTREAM_STATS *stats);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_QUIC_TOKEN_H
+# define OSSL_QUIC_TOKEN_H
+
+# include <openssl/ssl.h>
+# include "internal/time.h"
+# include "internal/quic_types.h"
+# include "internal/quic_demux.h"
+
+/*
+ * QUIC Address Validation Token Engine
+ * ====================================
+ *
+ * A server validates a client's address by sending it a token, which the
+ * client must echo in the Token field of its Initial packets (RFC 9000 s. 8.1).
+ * Tokens are sent either in a Retry packet, in response to an Initial packet,
+ * or in a NEW_TOKEN frame, for use in a future connection.
+ *
+ * The token engine generates and validates tokens without keeping any per-token
+ * or per-client state. Each token is sealed with AES-256-GCM under a key known
+ * only to the server, with the client's address as additional authenticated
+ * data, so a token is only valid when presented from the address it was issued
+ * to. Retry tokens are bound to the address family, IP address and port.
+ * NEW_TOKEN tokens are bound to the address family and IP address only, since a
+ * client's port is likely to change between connections (RFC 9000 s. 8.1.3).
+ * The sealed contents record the time the token was issued, and for Retry
+ * tokens, the connection IDs which the server must later echo in its transport
+ * parameters.
+ *
+ * Token format:
+ *
+ *   octet 0          key ID
+ *   octet 1          type
+ *   octets 2..13     nonce, random
+ *   octets 14..      ciphertext of:
+ *                      issue time (8 octets, big-endian ticks)
+ *                      ODCID length (1 octet), ODCID
+ *                      Retry SCID length (1 octet), Retry SCID
+ *   last 16 octets   AEAD tag
+ *
+ * Keys are generated randomly and rotated at a configurable interval. The
+ * current key is used to generate tokens, and tokens sealed with the current or
+ * previous key are accepted, so a token remains valid for at least one
+ * rotation interval. A NEW_TOKEN lifetime longer than the rotation interval is
+ * therefore cut short by rotation.
+ *
+ * Stateless Retry
+ * ---------------
+ *
+ * The engine can also be placed in front of a QUIC_DEMUX as its default
+ * handler, where it sees the first datagram of every new connection. While
+ * Retry is required, an Initial packet without a valid token is answered with
+ * a Retry packet carrying a fresh token and is then dropped, so no connection
+ * state is created and no handshake processing takes place until the client
+ * has proven it can receive at its claimed address. Only datagrams with a
+ * valid token are passed on, along with what the token contained.
+ *
+ * Retry tokens are not single-use: within its lifetime (a few seconds by
+ * default), a token can be replayed from the address it was issued to. This is
+ * inherent to a stateless design and does not let an attacker use an address
+ * it cannot receive at.
+ *
+ * The engine is not thread safe.
+ */
+typedef struct quic_token_engine_st QUIC_TOKEN_ENGINE;
+
+/* Token types. */
+# define QUIC_TOKEN_TYPE_RETRY          1
+# define QUIC_TOKEN_TYPE_NEW_TOKEN      2
+
+/* Maximum length of a token generated by the engine. */
+# define QUIC_TOKEN_MAX_LEN \
+    (1 + 1 + 12 + 8 + 2 * (1 + QUIC_MAX_CONN_ID_LEN) + 16)
+
+/* Default lifetimes. */
+# define QUIC_TOKEN_DEFAULT_RETRY_LIFETIME      (10 * OSSL_TIME_SECOND)
+# define QUIC_TOKEN_DEFAULT_NEW_TOKEN_LIFETIME  (24 * 3600 * OSSL_TIME_SECOND)
+# define QUIC_TOKEN_DEFAULT_ROTATION_INTERVAL  (24 * 3600 * OSSL_TIME_SECOND)
+
+/* Information recovered from a valid token. */
+typedef struct quic_token_info_st {
+    /* A QUIC_TOKEN_TYPE_* value. */
+    int             type;
+
+    /* Time the token was issued. */
+    OSSL_TIME       issued;
+
+    /*
+     * For Retry tokens, the DCID of the client's first Initial packet and the
+     * SCID of the Retry packet, to be sent in the original_destination_
+     * connection_id and retry_source_connection_id transport parameters.
+     * Zero length for NEW_TOKEN tokens.
+     */
+    QUIC_CONN_ID    odcid, retry_scid;
+} QUIC_TOKEN_INFO;
+
+typedef struct quic_token_engine_stats_st {
+    uint64_t    retry_sent;         /* Retry packets sent */
+    uint64_t    token_valid;        /* Initial datagrams with a valid token */
+    uint64_t    token_invalid;      /* Tokens rejected by validation */
+    uint64_t    dropped;            /* Datagrams dropped by the Retry filter */
+} QUIC_TOKEN_ENGINE_STATS;
+
+/*
+ * Called by the Retry filter for each datagram it passes on. info describes
+ * the token of the Initial packet which began the datagram, or is NULL if the
+ * datagram does not begin with an Initial packet, or did not need a token
+ * because Retry was not required. Takes ownership of the URXE, as for
+ * ossl_quic_demux_cb_fn.
+ */
+typedef void (ossl_quic_token_validated_cb_fn)(QUIC_URXE *e,
+                                               const QUIC_TOKEN_INFO *info,
+                                               void *arg);
+
+/*
+ * Creates a new token engine with a randomly generated initial key. now is
+ * used to determine the current time for issuing and expiring tokens and
+ * rotating keys; if NULL, ossl_time_now() is used.
+ */
+QUIC_TOKEN_ENGINE *ossl_quic_token_engine_new(OSSL_LIB_CTX *libctx,
+                                              const char *propq,
+                                              OSSL_TIME (*now)(void *arg),
+                                              void *now_arg);
+
+/* Frees a token engine. No-op if eng is NULL. */
+void ossl_quic_token_engine_free(QUIC_TOKEN_ENGINE *eng);
+
+/*
+ * Sets how long Retry and NEW_TOKEN tokens remain valid after issue, and the
+ * interval at which keys are rotated. Returns 0 if any value is zero.
+ */
+int ossl_quic_token_engine_set_lifetimes(QUIC_TOKEN_ENGINE *eng,
+                                         OSSL_TIME retry_lifetime,
+                                         OSSL_TIME new_token_lifetime,
+                                         OSSL_TIME rotation_interval);
+
+/*
+ * Rotates keys immediately. The previous key remains acceptable for validation
+ * until the next rotation. Keys are otherwise rotated automatically.
+ *
+ * Returns 1 on success or 0 on failure.
+ */
+int ossl_quic_token_engine_rotate(QUIC_TOKEN_ENGINE *eng);
+
+/*
+ * Generates a Retry token for a client at address peer, whose first Initial
+ * packet had the DCID odcid, in response to which a Retry packet with the SCID
+ * retry_scid will be sent. The token is written to buf, which has room for
+ * buf_len bytes (QUIC_TOKEN_MAX_LEN suffices), and its length to *out_len.
+ *
+ * Returns 1 on success or 0 on failure.
+ */
+int ossl_quic_token_engine_gen_retry_token(QUIC_TOKEN_ENGINE *eng,
+                                           const BIO_ADDR *peer,
+                                           const QUIC_CONN_ID *odcid,
+                                           const QUIC_CONN_ID *retry_scid,
+                                           unsigned char *buf, size_t buf_len,
+                                           size_t *out_len);
+
+/*
+ * Generates a token for a NEW_TOKEN frame to be sent to a client at address
+ * peer. As for ossl_quic_token_engine_gen_retry_token.
+ */
+int ossl_quic_token_engine_gen_new_token(QUIC_TOKEN_ENGINE *eng,
+                                         const BIO_ADDR *peer,
+                                         unsigned char *buf, size_t buf_len,
+                                         size_t *out_len);
+
+/*
+ * Validates a token received from address peer. The token is valid if it was
+ * generated by this engine with a key which is still acceptable, for the same
+ * address, and has not expired. On success, its contents are written to *info
+ * if info is non-NULL.
+ *
+ * Returns 1 if the token is valid and 0 otherwise.
+ */
+int ossl_quic_token_engine_validate(QUIC_TOKEN_ENGINE *eng,
+                                    const BIO_ADDR *peer,
+                                    const unsigned char *token,
+                                    size_t token_len,
+                                    QUIC_TOKEN_INFO *info);
+
+/*
+ * Installs the engine as the default handler of demux, so that it filters the
+ * datagrams of new connections as described above. Retry packets are sent
+ * using net_bio, which is usually the BIO the demuxer reads from. Datagrams
+ * which pass the filter are given to cb. Retry is initially required.
+ *
+ * Returns 1 on success or 0 on failure.
+ */
+int ossl_quic_token_engine_set_retry_filter(QUIC_TOKEN_ENGINE *eng,
+                                            QUIC_DEMUX *demux, BIO *net_bio,
+                                            ossl_quic_token_validated_cb_fn *cb,
+                                            void *cb_arg);
+
+/*
+ * Sets whether the Retry filter requires address validation. When it does not,
+ * Initial packets are passed on without their tokens being examined, avoiding
+ * the extra round trip when the server is not under attack.
+ */
+void ossl_quic_token_engine_set_require_retry(QUIC_TOKEN_ENGINE *eng,
+                                              int require);
+
+/* Retrieves Retry filter statistics. */
+void ossl_quic_token_engine_get_stats(const QUIC_TOKEN_ENGINE *eng,
+                                      QUIC_TOKEN_ENGINE_STATS *stats);
+
+#endif
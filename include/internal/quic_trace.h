@@ -0,0 +1,85 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_QUIC_TRACE_H
+# define OSSL_QUIC_TRACE_H
+
+# include <openssl/trace.h>
+# include "internal/time.h"
+# include "internal/quic_types.h"
+# include "internal/quic_statm.h"
+
+/*
+ * QUIC Event Tracing
+ * ==================
+ *
+ * Events in the QUIC implementation are written to the QUIC trace category
+ * (OSSL_TRACE_CATEGORY_QUIC) in the qlog JSON-SEQ format: each event is a JSON
+ * text sequence record (RFC 7464), that is, an RS character, a JSON object and
+ * a newline, so that the output of a channel can be read by qlog tools once a
+ * header record is prepended. For example:
+ *
+ *   <RS>{"time":1043.250000,"name":"recovery:packet_lost","group_id":"...",
+ *        "data":{"header":{"packet_type":"1RTT","packet_number":5}}}
+ *
+ * Times are absolute, in milliseconds. The group_id identifies the object
+ * which emitted the event (an ACKM, QTX, QRX or flow controller), so that the
+ * events of many connections in one trace can be told apart.
+ *
+ * The following events are emitted:
+ *
+ *   transport:packet_sent          by the QTX for each packet written
+ *   transport:packet_received      by the QRX for each packet decrypted
+ *   recovery:packet_lost           by the ACKM for each packet declared lost
+ *   recovery:metrics_updated       by the ACKM after processing ACKs and after
+ *                                  detecting loss on a timeout
+ *   flow_control:blocked           by a TXFC which has run out of credit
+ *   flow_control:window_updated    by an RXFC which has raised its CWM
+ *
+ * The last two are not defined by qlog.
+ *
+ * Call sites use QLOG_EVENT(), which costs a single test of whether the
+ * category is enabled when tracing is off, and nothing at all in builds with
+ * no-trace (the default), where the event functions are not compiled.
+ */
+# if !defined(OPENSSL_NO_TRACE) && !defined(FIPS_MODULE)
+
+#  define QLOG_EVENT(event, args)                           \
+    do {                                                    \
+        if (OSSL_TRACE_ENABLED(QUIC))                       \
+            ossl_qlog_##event args;                         \
+    } while (0)
+
+void ossl_qlog_packet_sent(const void *group, OSSL_TIME now, int pkt_type,
+                           QUIC_PN pn, size_t len);
+
+void ossl_qlog_packet_received(const void *group, OSSL_TIME now, int pkt_type,
+                               QUIC_PN pn, size_t len);
+
+void ossl_qlog_packet_lost(const void *group, OSSL_TIME now, int pkt_space,
+                           QUIC_PN pn);
+
+void ossl_qlog_metrics_updated(const void *group, OSSL_TIME now,
+                               OSSL_STATM *statm, uint64_t cwnd,
+                               uint64_t bytes_in_flight);
+
+void ossl_qlog_flow_control_blocked(const void *group, int is_stream,
+                                    uint64_t limit);
+
+void ossl_qlog_flow_control_window_updated(const void *group, OSSL_TIME now,
+                                           int is_stream, uint64_t limit,
+                                           uint64_t window);
+
+# else
+
+#  define QLOG_EVENT(event, args)   ((void)0)
+
+# endif
+
+#endif
@@ -64,6 +64,12 @@ static ossl_unused ossl_inline QUIC_PN ossl_quic_pn_min(QUIC_PN a, QUIC_PN b)
     return a < b ? a : b;
 }
 
+/*
+ * The minimum size of a datagram carrying an Initial packet, and therefore
+ * the smallest maximum datagram payload length a QUIC path may have.
+ */
+#define QUIC_MIN_INITIAL_DGRAM_LEN  1200
+
 /* QUIC connection ID representation. */
 #define QUIC_MAX_CONN_ID_LEN   20
 
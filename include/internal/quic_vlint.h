@@ -108,6 +108,34 @@ static ossl_unused ossl_inline size_t ossl_quic_vlint_decode_len(uint8_t first_b
  */
 uint64_t ossl_quic_vlint_decode_unchecked(const unsigned char *buf);
 
+/*
+ * Like ossl_quic_vlint_decode_unchecked, but without branching on the length
+ * of the encoding: eight bytes are loaded and those which are not part of the
+ * encoded integer are shifted out. The length of the encoding is written to
+ * *enclen. This is the fast path used when the buffer is known to be long
+ * enough, which is the common case when parsing frames in a packet.
+ *
+ * Precondition: buf is at least 8 bytes in size, regardless of the length of
+ *   the encoded integer (unchecked)
+ */
+static ossl_unused ossl_inline
+uint64_t ossl_quic_vlint_decode_unchecked8(const unsigned char *buf,
+                                           size_t *enclen)
+{
+    unsigned int lg = buf[0] >> 6;
+    uint64_t x = ((uint64_t)buf[0] << 56)
+               | ((uint64_t)buf[1] << 48)
+               | ((uint64_t)buf[2] << 40)
+               | ((uint64_t)buf[3] << 32)
+               | ((uint64_t)buf[4] << 24)
+               | ((uint64_t)buf[5] << 16)
+               | ((uint64_t)buf[6] <<  8)
+               |  buf[7];
+
+    *enclen = (size_t)1 << lg;
+    return (x & OSSL_QUIC_VLINT_MAX) >> (64 - (8U << lg));
+}
+
 /*
  * Given a buffer buf of buf_len bytes in length, attempts to decode an encoded
  * QUIC variable-length integer at the start of the buffer and writes the result
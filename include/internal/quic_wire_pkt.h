@@ -155,6 +155,17 @@ int ossl_quic_hdr_protector_init(QUIC_HDR_PROTECTOR *hpr,
                                  const unsigned char *quic_hp_key,
                                  size_t quic_hp_key_len);
 
+/*
+ * As for ossl_quic_hdr_protector_init, but uses a cipher which has already
+ * been fetched, which must be the one for cipher_id. The header protector
+ * takes its own reference to the cipher.
+ */
+int ossl_quic_hdr_protector_init_with_cipher(QUIC_HDR_PROTECTOR *hpr,
+                                             uint32_t cipher_id,
+                                             EVP_CIPHER *cipher,
+                                             const unsigned char *quic_hp_key,
+                                             size_t quic_hp_key_len);
+
 /*
  * Destroys a header protector. This is also safe to call on a zero-initialized
  * OSSL_QUIC_HDR_PROTECTOR structure which has not been initialized, or which
@@ -226,6 +237,21 @@ int ossl_quic_hdr_protector_encrypt_fields(QUIC_HDR_PROTECTOR *hpr,
                                            unsigned char *first_byte,
                                            unsigned char *pn_bytes);
 
+/*
+ * Applies header protection to num_ptrs packets, as for
+ * ossl_quic_hdr_protector_encrypt. For AES-based header protection, the masks
+ * for many packets are generated with a single cipher call, which is cheaper
+ * than protecting each packet in turn. The samples of all of the packets must
+ * be final before this is called.
+ *
+ * If this function fails, some of the packets may have been protected.
+ *
+ * Returns 1 on success and 0 on failure.
+ */
+int ossl_quic_hdr_protector_encrypt_many(QUIC_HDR_PROTECTOR *hpr,
+                                         QUIC_PKT_HDR_PTRS *ptrs,
+                                         size_t num_ptrs);
+
 /*
  * QUIC Packet Header
  * ==================
@@ -520,4 +546,65 @@ int ossl_quic_wire_determine_pn_len(QUIC_PN pn, QUIC_PN largest_acked);
 int ossl_quic_wire_encode_pkt_hdr_pn(QUIC_PN pn,
                                      unsigned char *enc_pn,
                                      size_t enc_pn_len);
+
+/*
+ * Retry Integrity Tag
+ * ===================
+ *
+ * A Retry packet ends with a tag computed with a fixed key over the packet and
+ * the Original Destination Connection ID of the Initial packet it responds to
+ * (RFC 9001 s. 5.8), allowing the client to check it was sent by a party which
+ * saw that Initial packet.
+ */
+# define QUIC_RETRY_INTEGRITY_TAG_LEN   16
+
+/*
+ * Creates a cipher context keyed for calculating Retry Integrity Tags with
+ * ossl_quic_calculate_retry_integrity_tag_ctx, so that callers which do so
+ * often need not fetch and key the cipher each time. Free it with
+ * EVP_CIPHER_CTX_free().
+ *
+ * Returns the context on success and NULL on failure.
+ */
+EVP_CIPHER_CTX *ossl_quic_retry_integrity_ctx_new(OSSL_LIB_CTX *libctx,
+                                                  const char *propq);
+
+/*
+ * As for ossl_quic_calculate_retry_integrity_tag, but using a context created
+ * by ossl_quic_retry_integrity_ctx_new.
+ */
+int ossl_quic_calculate_retry_integrity_tag_ctx(EVP_CIPHER_CTX *cctx,
+                                                const unsigned char *pkt,
+                                                size_t pkt_len,
+                                                const QUIC_CONN_ID *odcid,
+                                                unsigned char *tag);
+
+/*
+ * Calculates the Retry Integrity Tag for a QUIC v1 Retry packet. pkt points to
+ * the encoded Retry packet excluding the tag, which is pkt_len bytes long, and
+ * odcid is the Original Destination Connection ID. The tag is written to tag,
+ * which must have room for QUIC_RETRY_INTEGRITY_TAG_LEN bytes.
+ *
+ * Returns 1 on success and 0 on failure.
+ */
+int ossl_quic_calculate_retry_integrity_tag(OSSL_LIB_CTX *libctx,
+                                            const char *propq,
+                                            const unsigned char *pkt,
+                                            size_t pkt_len,
+                                            const QUIC_CONN_ID *odcid,
+                                            unsigned char *tag);
+
+/*
+ * Validates the Retry Integrity Tag of a QUIC v1 Retry packet. pkt points to
+ * the whole encoded Retry packet, including the tag, which is pkt_len bytes
+ * long.
+ *
+ * Returns 1 if the tag is valid and 0 otherwise.
+ */
+int ossl_quic_validate_retry_integrity_tag(OSSL_LIB_CTX *libctx,
+                                           const char *propq,
+                                           const unsigned char *pkt,
+                                           size_t pkt_len,
+                                           const QUIC_CONN_ID *odcid);
+
 #endif
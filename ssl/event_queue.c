@@ -12,9 +12,33 @@
 #include "crypto/sparse_array.h"
 #include "ssl_local.h"
 
+/*
+ * Hierarchical timer wheel.  Level n has WHEEL_SLOTS slots each covering
+ * WHEEL_SLOTS^n ticks.  An event is placed in the lowest level whose range
+ * from the current tick covers it; whenever the current tick crosses a slot
+ * boundary of a level, the events in the next slot of that level are
+ * redistributed into the levels below ("cascaded").  Events further away than
+ * the top level covers are placed in its furthest slot and cascaded again
+ * until they come into range.
+ */
+#define WHEEL_BITS      8
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      ((uint64_t)WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    4
+#define WHEEL_SPAN      ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+typedef struct event_wheel_st {
+    uint64_t tick;              /* Length of a tick                         */
+    uint64_t cur;               /* Current tick; all earlier ones are done  */
+    size_t num;                 /* Number of events in the wheel            */
+    OSSL_EVENT *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_LEVELS][WHEEL_SLOTS / 64];  /* Non-empty slots  */
+} EVENT_WHEEL;
+
 struct ossl_event_queue_st {
     PRIORITY_QUEUE_OF(OSSL_EVENT) *timed_events;
     PRIORITY_QUEUE_OF(OSSL_EVENT) *now_events;
+    EVENT_WHEEL *wheel;         /* If non-NULL, used instead of timed_events */
 };
 
 static int event_compare_times(const OSSL_EVENT *a, const OSSL_EVENT *b)
@@ -36,6 +60,7 @@ OSSL_EVENT_QUEUE *ossl_event_queue_new(void)
     OSSL_EVENT_QUEUE *r = OPENSSL_malloc(sizeof(*r));
 
     if (r != NULL) {
+        r->wheel = NULL;
         r->timed_events = ossl_pqueue_OSSL_EVENT_new(&event_compare_times);
         r->now_events = ossl_pqueue_OSSL_EVENT_new(&event_compare_priority);
         if (r->timed_events == NULL || r->now_events == NULL) {
@@ -46,13 +71,231 @@ OSSL_EVENT_QUEUE *ossl_event_queue_new(void)
     return r;
 }
 
+OSSL_EVENT_QUEUE *ossl_event_queue_new_wheel(OSSL_TIME tick)
+{
+    OSSL_EVENT_QUEUE *r;
+
+    if (ossl_time2ticks(tick) == 0)
+        return NULL;
+
+    r = OPENSSL_malloc(sizeof(*r));
+    if (r != NULL) {
+        r->timed_events = NULL;
+        r->now_events = ossl_pqueue_OSSL_EVENT_new(&event_compare_priority);
+        r->wheel = OPENSSL_zalloc(sizeof(*r->wheel));
+        if (r->now_events == NULL || r->wheel == NULL) {
+            ossl_event_queue_free(r);
+            return NULL;
+        }
+        r->wheel->tick = ossl_time2ticks(tick);
+        r->wheel->cur = ossl_time2ticks(ossl_time_now()) / r->wheel->tick;
+    }
+    return r;
+}
+
+static ossl_inline uint64_t wheel_tick_of(const EVENT_WHEEL *w, OSSL_TIME t)
+{
+    return ossl_time2ticks(t) / w->tick;
+}
+
+static void wheel_link(EVENT_WHEEL *w, OSSL_EVENT *e)
+{
+    uint64_t t = wheel_tick_of(w, e->when), d;
+    size_t level, idx;
+
+    if (t < w->cur)
+        t = w->cur;
+    d = t - w->cur;
+    if (d >= WHEEL_SPAN) {
+        t = w->cur + WHEEL_SPAN - 1;
+        d = WHEEL_SPAN - 1;
+    }
+
+    for (level = 0; level < WHEEL_LEVELS - 1
+                    && d >= (uint64_t)1 << (WHEEL_BITS * (level + 1)); ++level)
+        continue;
+
+    idx = (size_t)((t >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    e->wheel_slot = &w->slots[level][idx];
+    e->wheel_prev = NULL;
+    e->wheel_next = *e->wheel_slot;
+    if (e->wheel_next != NULL)
+        e->wheel_next->wheel_prev = e;
+    *e->wheel_slot = e;
+    w->occupied[level][idx / 64] |= (uint64_t)1 << (idx % 64);
+    ++w->num;
+}
+
+static void wheel_unlink(EVENT_WHEEL *w, OSSL_EVENT *e)
+{
+    size_t pos = e->wheel_slot - &w->slots[0][0];
+    size_t level = pos / WHEEL_SLOTS, idx = pos % WHEEL_SLOTS;
+
+    if (e->wheel_prev != NULL)
+        e->wheel_prev->wheel_next = e->wheel_next;
+    else
+        *e->wheel_slot = e->wheel_next;
+    if (e->wheel_next != NULL)
+        e->wheel_next->wheel_prev = e->wheel_prev;
+
+    if (*e->wheel_slot == NULL)
+        w->occupied[level][idx / 64] &= ~((uint64_t)1 << (idx % 64));
+
+    e->wheel_slot = NULL;
+    e->wheel_prev = e->wheel_next = NULL;
+    --w->num;
+}
+
+/*
+ * Returns the first non-empty slot of a level at or after from, or
+ * WHEEL_SLOTS if there is none.
+ */
+static size_t wheel_find_slot(const EVENT_WHEEL *w, size_t level, size_t from)
+{
+    size_t i;
+    uint64_t bits;
+
+    for (i = from / 64; i < WHEEL_SLOTS / 64; ++i) {
+        bits = w->occupied[level][i];
+        if (i == from / 64)
+            bits &= ~(uint64_t)0 << (from % 64);
+        if (bits != 0) {
+            from = i * 64;
+            while ((bits & 1) == 0) {
+                bits >>= 1;
+                ++from;
+            }
+            return from;
+        }
+    }
+    return WHEEL_SLOTS;
+}
+
+/* Redistributes the events of the slots higher levels are now entering. */
+static void wheel_cascade(EVENT_WHEEL *w)
+{
+    size_t level, idx;
+    OSSL_EVENT *e;
+
+    for (level = 1; level < WHEEL_LEVELS; ++level) {
+        idx = (size_t)((w->cur >> (WHEEL_BITS * level)) & WHEEL_MASK);
+        while ((e = w->slots[level][idx]) != NULL) {
+            wheel_unlink(w, e);
+            wheel_link(w, e);
+        }
+        if (idx != 0)
+            break;
+    }
+}
+
+static int wheel_expire(OSSL_EVENT_QUEUE *queue, OSSL_EVENT *e)
+{
+    wheel_unlink(queue->wheel, e);
+    if (!ossl_pqueue_OSSL_EVENT_push(queue->now_events, e, &e->ref)) {
+        e->queue = NULL;
+        return 0;
+    }
+    e->queue = queue->now_events;
+    return 1;
+}
+
+/* Moves all events which are due by now to the now queue. */
+static int wheel_advance(OSSL_EVENT_QUEUE *queue, OSSL_TIME now)
+{
+    EVENT_WHEEL *w = queue->wheel;
+    uint64_t now_tick = wheel_tick_of(w, now), next;
+    OSSL_EVENT *e, *enext;
+    size_t idx;
+
+    while (w->cur < now_tick) {
+        /* Every event in the slot for a past tick is due. */
+        idx = (size_t)(w->cur & WHEEL_MASK);
+        while ((e = w->slots[0][idx]) != NULL)
+            if (!wheel_expire(queue, e))
+                return 0;
+
+        if (w->num == 0) {
+            w->cur = now_tick;
+            break;
+        }
+
+        /* Skip empty slots, stopping at the next cascade. */
+        idx = wheel_find_slot(w, 0, idx + 1);
+        next = (w->cur & ~WHEEL_MASK) + idx;
+        w->cur = next < now_tick ? next : now_tick;
+        if ((w->cur & WHEEL_MASK) == 0)
+            wheel_cascade(w);
+    }
+
+    /* The current tick is only partly over. */
+    idx = (size_t)(w->cur & WHEEL_MASK);
+    for (e = w->slots[0][idx]; e != NULL; e = enext) {
+        enext = e->wheel_next;
+        if (ossl_time_compare(e->when, now) <= 0 && !wheel_expire(queue, e))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Returns a time no later than that of the earliest event in the wheel, or
+ * infinity if it is empty.  Events in the next occupied slot of level 0 all
+ * fall in the same tick and are searched for the exact time; for higher levels
+ * the start of the next occupied slot is used, as scanning such a slot could
+ * mean visiting a large fraction of all events.  The bound becomes exact once
+ * that slot has cascaded down to level 0.
+ */
+static OSSL_TIME wheel_next_time(const EVENT_WHEEL *w)
+{
+    OSSL_TIME best = ossl_time_infinite(), t;
+    OSSL_EVENT *e;
+    uint64_t base, start;
+    size_t level, shift, cur_idx, idx;
+
+    if (w->num == 0)
+        return best;
+
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+        /*
+         * Slots after the current one hold successively later events.  Above
+         * level 0, the current slot has been cascaded, so anything in it
+         * comes a whole rotation later.
+         */
+        shift = WHEEL_BITS * level;
+        cur_idx = (size_t)((w->cur >> shift) & WHEEL_MASK);
+        idx = wheel_find_slot(w, level, level == 0 ? cur_idx : cur_idx + 1);
+        if (idx == WHEEL_SLOTS)
+            idx = wheel_find_slot(w, level, 0);
+        if (idx == WHEEL_SLOTS)
+            continue;
+
+        if (level == 0) {
+            for (e = w->slots[0][idx]; e != NULL; e = e->wheel_next)
+                if (ossl_time_compare(e->when, best) < 0)
+                    best = e->when;
+            continue;
+        }
+
+        base = (w->cur >> (shift + WHEEL_BITS)) << (shift + WHEEL_BITS);
+        start = base + ((uint64_t)idx << shift);
+        if (idx <= cur_idx)
+            start += (uint64_t)1 << (shift + WHEEL_BITS);
+        t = ossl_time_multiply(ossl_ticks2time(start), w->tick);
+        if (ossl_time_compare(t, best) < 0)
+            best = t;
+    }
+    return best;
+}
+
 void ossl_event_free(OSSL_EVENT *event)
 {
     if (event != NULL) {
-        if (event->flag_dynamic)
+        if (event->flag_dynamic) {
             OPENSSL_free(event);
-        else
+        } else {
             event->queue = NULL;
+            event->wheel_slot = NULL;
+        }
     }
 }
 
@@ -67,11 +310,28 @@ static void event_queue_free(PRIORITY_QUEUE_OF(OSSL_EVENT) *queue)
     }
 }
 
+static void event_wheel_free(EVENT_WHEEL *w)
+{
+    size_t level, idx;
+    OSSL_EVENT *e;
+
+    if (w != NULL) {
+        for (level = 0; level < WHEEL_LEVELS; ++level)
+            for (idx = 0; idx < WHEEL_SLOTS; ++idx)
+                while ((e = w->slots[level][idx]) != NULL) {
+                    wheel_unlink(w, e);
+                    ossl_event_free(e);
+                }
+        OPENSSL_free(w);
+    }
+}
+
 void ossl_event_queue_free(OSSL_EVENT_QUEUE *queue)
 {
     if (queue != NULL) {
         event_queue_free(queue->now_events);
         event_queue_free(queue->timed_events);
+        event_wheel_free(queue->wheel);
         OPENSSL_free(queue);
     }
 }
@@ -79,10 +339,16 @@ void ossl_event_queue_free(OSSL_EVENT_QUEUE *queue)
 static ossl_inline
 int event_queue_add(OSSL_EVENT_QUEUE *queue, OSSL_EVENT *event)
 {
-    PRIORITY_QUEUE_OF(OSSL_EVENT) *pq =
-            ossl_time_compare(event->when, ossl_time_now()) <= 0
-            ? queue->now_events
-            : queue->timed_events;
+    int due = ossl_time_compare(event->when, ossl_time_now()) <= 0;
+    PRIORITY_QUEUE_OF(OSSL_EVENT) *pq = due ? queue->now_events
+                                            : queue->timed_events;
+
+    event->wheel_slot = NULL;
+    if (!due && queue->wheel != NULL) {
+        event->queue = NULL;
+        wheel_link(queue->wheel, event);
+        return 1;
+    }
 
     if (ossl_pqueue_OSSL_EVENT_push(pq, event, &event->ref)) {
         event->queue = pq;
@@ -138,6 +404,8 @@ int ossl_event_queue_remove(OSSL_EVENT_QUEUE *queue, OSSL_EVENT *event)
     if (event != NULL && event->queue != NULL) {
         ossl_pqueue_OSSL_EVENT_remove(event->queue, event->ref);
         event->queue = NULL;
+    } else if (event != NULL && event->wheel_slot != NULL) {
+        wheel_unlink(queue->wheel, event);
     }
     return 1;
 }
@@ -155,6 +423,13 @@ OSSL_TIME ossl_event_queue_time_until_next(const OSSL_EVENT_QUEUE *queue)
         return ossl_time_infinite();
     if (ossl_pqueue_OSSL_EVENT_num(queue->now_events) > 0)
         return ossl_time_zero();
+    if (queue->wheel != NULL) {
+        OSSL_TIME next = wheel_next_time(queue->wheel);
+
+        if (ossl_time_is_infinite(next))
+            return next;
+        return ossl_time_subtract(next, ossl_time_now());
+    }
     return ossl_event_time_until(ossl_pqueue_OSSL_EVENT_peek(queue->timed_events));
 }
 
@@ -176,12 +451,18 @@ int ossl_event_queue_get1_next_event(OSSL_EVENT_QUEUE *queue,
     OSSL_EVENT *e;
 
     /* Check for expired timer based events and convert them to now events */
-    while ((e = ossl_pqueue_OSSL_EVENT_peek(queue->timed_events)) != NULL
-           && ossl_time_compare(e->when, now) <= 0) {
-        e = ossl_pqueue_OSSL_EVENT_pop(queue->timed_events);
-        if (!ossl_pqueue_OSSL_EVENT_push(queue->now_events, e, &e->ref)) {
-            e->queue = NULL;
+    if (queue->wheel != NULL) {
+        if (!wheel_advance(queue, now))
             return 0;
+    } else {
+        while ((e = ossl_pqueue_OSSL_EVENT_peek(queue->timed_events)) != NULL
+               && ossl_time_compare(e->when, now) <= 0) {
+            e = ossl_pqueue_OSSL_EVENT_pop(queue->timed_events);
+            if (!ossl_pqueue_OSSL_EVENT_push(queue->now_events, e, &e->ref)) {
+                e->queue = NULL;
+                return 0;
+            }
+            e->queue = queue->now_events;
         }
     }
 
@@ -190,5 +471,7 @@ int ossl_event_queue_get1_next_event(OSSL_EVENT_QUEUE *queue,
      * The pop returns NULL when there is none.
      */
     *event = ossl_pqueue_OSSL_EVENT_pop(queue->now_events);
+    if (*event != NULL)
+        (*event)->queue = NULL;
     return 1;
 }
@@ -0,0 +1,594 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include "internal/nelem.h"
+#include "internal/quic_cc.h"
+#include "internal/quic_types.h"
+
+/*
+ * BBR Congestion Controller
+ * =========================
+ *
+ * This is a model-based congestion controller in the style of BBRv2. Rather
+ * than reacting to loss, it estimates the bottleneck bandwidth (BtlBw) and the
+ * round-trip propagation delay (RTprop) of the path and paces data at the
+ * estimated bandwidth, keeping roughly one bandwidth-delay product (BDP) of
+ * data in flight. Like BBRv2, it also bounds the amount of data in flight when
+ * the loss rate in a round trip exceeds a threshold.
+ *
+ * The OSSL_CC_METHOD interface does not carry per-packet delivery state, so
+ * the delivery rate is sampled once per round trip as the number of bytes
+ * acknowledged during the round divided by its duration, and rounds are
+ * delimited by time (one RTprop) rather than by packet number.
+ *
+ * The pacing rate is exposed via get_pacing_rate, so that the caller can pace
+ * the QTX (see ossl_qtx_set_pacing_rate), and is also enforced by
+ * get_send_allowance when the caller supplies the time since the last send.
+ */
+#define BBR_STATE_STARTUP       0
+#define BBR_STATE_DRAIN         1
+#define BBR_STATE_PROBE_BW      2
+#define BBR_STATE_PROBE_RTT     3
+
+/* Gains are expressed in percent. */
+#define BBR_HIGH_GAIN           277     /* 4 * ln(2) */
+#define BBR_DRAIN_GAIN          36      /* 1 / BBR_HIGH_GAIN */
+#define BBR_CWND_GAIN           200
+#define BBR_PROBE_RTT_GAIN      100
+
+/* PROBE_BW gain cycle: probe up, drain down, then cruise. */
+static const unsigned int bbr_pacing_gain_cycle[] = {
+    125, 75, 100, 100, 100, 100, 100, 100
+};
+
+#define BBR_GAIN_CYCLE_LEN      OSSL_NELEM(bbr_pacing_gain_cycle)
+
+/* Number of rounds over which the maximum bandwidth sample is kept. */
+#define BBR_BW_FILTER_LEN       10
+
+/* STARTUP ends when bandwidth grows by less than 25% for 3 rounds. */
+#define BBR_FULL_BW_THRESH      125
+#define BBR_FULL_BW_ROUNDS      3
+
+/* Loss rate (in percent) in a round above which we bound inflight. */
+#define BBR_LOSS_THRESH         2
+
+/* Multiplicative decrease of inflight_hi on excessive loss, in percent. */
+#define BBR_BETA                70
+
+/* RTprop expires if not refreshed in this time; PROBE_RTT then runs. */
+#define BBR_MIN_RTT_WINDOW      ossl_seconds2time(10)
+#define BBR_PROBE_RTT_DURATION  ossl_ms2time(200)
+
+/* Round duration used until we have an RTT sample (RFC 9002 kInitialRtt). */
+#define BBR_INITIAL_RTT         ossl_ms2time(333)
+
+#define BBR_DEFAULT_MAX_DGRAM_SIZE  QUIC_MIN_INITIAL_DGRAM_LEN
+#define BBR_MIN_PIPE_CWND_PKTS      4
+#define BBR_INITIAL_WINDOW_PKTS     10
+#define BBR_MAX_SEND_QUANTUM        (64 * 1024)
+
+typedef struct ossl_cc_bbr_st {
+    /* Current maximum datagram payload length, from the changeables. */
+    const size_t   *p_max_dgram_size;
+
+    int             state;
+    uint64_t        cwnd;
+    uint64_t        bytes_in_flight;
+    uint64_t        pacing_rate;        /* bytes/s */
+    unsigned int    pacing_gain;        /* percent */
+    unsigned int    cwnd_gain;          /* percent */
+
+    /* Loss-derived upper bound on inflight (BBRv2); UINT64_MAX if unset. */
+    uint64_t        inflight_hi;
+    uint64_t        prior_inflight_hi;
+
+    /* BtlBw max filter, one delivery rate sample (bytes/s) per round. */
+    uint64_t        bw_samples[BBR_BW_FILTER_LEN];
+    size_t          bw_idx;
+    uint64_t        max_bw;
+
+    /* STARTUP exit detection. */
+    uint64_t        full_bw;
+    int             full_bw_count;
+    int             full_bw_reached;
+
+    /* Current round. */
+    OSSL_TIME       round_start;
+    uint64_t        round_delivered;
+    uint64_t        round_lost;
+
+    /* RTprop min filter. */
+    OSSL_TIME       min_rtt;            /* infinite if no sample */
+    OSSL_TIME       min_rtt_stamp;
+    OSSL_TIME       probe_rtt_done;     /* zero if not yet scheduled */
+    int             min_rtt_expired;
+
+    /* PROBE_BW gain cycling. */
+    size_t          cycle_idx;
+    OSSL_TIME       cycle_stamp;
+
+    /* Number of packets which may be sent regardless of the window. */
+    int             exemptions;
+} OSSL_CC_BBR;
+
+static size_t bbr_max_dgram_size(const OSSL_CC_BBR *b)
+{
+    if (b->p_max_dgram_size == NULL || *b->p_max_dgram_size == 0)
+        return BBR_DEFAULT_MAX_DGRAM_SIZE;
+
+    return *b->p_max_dgram_size;
+}
+
+static uint64_t bbr_min_pipe_cwnd(const OSSL_CC_BBR *b)
+{
+    return BBR_MIN_PIPE_CWND_PKTS * (uint64_t)bbr_max_dgram_size(b);
+}
+
+static int bbr_have_min_rtt(const OSSL_CC_BBR *b)
+{
+    return !ossl_time_is_infinite(b->min_rtt);
+}
+
+/* Returns the estimated BDP in bytes, scaled by |gain| percent. */
+static uint64_t bbr_bdp(const OSSL_CC_BBR *b, unsigned int gain)
+{
+    uint64_t bdp;
+
+    if (b->max_bw == 0 || !bbr_have_min_rtt(b))
+        return BBR_INITIAL_WINDOW_PKTS * (uint64_t)bbr_max_dgram_size(b);
+
+    bdp = (b->max_bw * ossl_time2us(b->min_rtt)) / 1000000;
+    return (bdp * gain) / 100;
+}
+
+static void bbr_enter_probe_bw(OSSL_CC_BBR *b, OSSL_TIME now)
+{
+    b->state        = BBR_STATE_PROBE_BW;
+    b->cwnd_gain    = BBR_CWND_GAIN;
+    /* Start cruising; the next probe follows a full cycle. */
+    b->cycle_idx    = 2;
+    b->cycle_stamp  = now;
+    b->pacing_gain  = bbr_pacing_gain_cycle[b->cycle_idx];
+}
+
+static void bbr_update_pacing_rate(OSSL_CC_BBR *b)
+{
+    uint64_t rtt_us;
+
+    if (b->max_bw == 0) {
+        /* No bandwidth sample yet; pace the initial window over one RTT. */
+        rtt_us = bbr_have_min_rtt(b) ? ossl_time2us(b->min_rtt)
+                                     : ossl_time2us(BBR_INITIAL_RTT);
+        if (rtt_us == 0)
+            rtt_us = 1;
+
+        b->pacing_rate = (b->cwnd * 1000000 / rtt_us) * b->pacing_gain / 100;
+        return;
+    }
+
+    b->pacing_rate = (b->max_bw * b->pacing_gain) / 100;
+}
+
+static void bbr_reset(OSSL_CC_DATA *cc, int flags)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+    const size_t *p_max_dgram_size = b->p_max_dgram_size;
+
+    memset(b, 0, sizeof(*b));
+    b->p_max_dgram_size = p_max_dgram_size;
+    b->state            = BBR_STATE_STARTUP;
+    b->pacing_gain      = BBR_HIGH_GAIN;
+    b->cwnd_gain        = BBR_CWND_GAIN;
+    b->cwnd             = BBR_INITIAL_WINDOW_PKTS
+                          * (uint64_t)bbr_max_dgram_size(b);
+    b->inflight_hi      = UINT64_MAX;
+    b->prior_inflight_hi = UINT64_MAX;
+    b->min_rtt          = ossl_time_infinite();
+
+    /* Pace the initial window at the startup gain until the first ACK. */
+    bbr_update_pacing_rate(b);
+}
+
+static OSSL_CC_DATA *bbr_new(OSSL_PARAM *settings, OSSL_PARAM *options,
+                             OSSL_PARAM *changeables)
+{
+    OSSL_CC_BBR *b;
+
+    b = OPENSSL_zalloc(sizeof(*b));
+    if (b == NULL)
+        return NULL;
+
+    if (!ossl_cc_bind_max_dgram_size(changeables, &b->p_max_dgram_size)) {
+        OPENSSL_free(b);
+        return NULL;
+    }
+
+    bbr_reset((OSSL_CC_DATA *)b, 0);
+    return (OSSL_CC_DATA *)b;
+}
+
+static void bbr_free(OSSL_CC_DATA *cc)
+{
+    OPENSSL_free(cc);
+}
+
+static int bbr_set_exemption(OSSL_CC_DATA *cc, int numpackets)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+
+    if (numpackets < 0)
+        return 0;
+
+    b->exemptions = numpackets;
+    return 1;
+}
+
+static int bbr_get_exemption(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+
+    return b->exemptions;
+}
+
+static int bbr_can_send(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+
+    return b->exemptions > 0 || b->bytes_in_flight < b->cwnd;
+}
+
+/*
+ * The send quantum is the largest burst we release at once: about 1ms worth of
+ * data at the pacing rate, but at least two datagrams.
+ */
+static uint64_t bbr_send_quantum(const OSSL_CC_BBR *b)
+{
+    uint64_t q = b->pacing_rate / 1000;
+
+    if (q > BBR_MAX_SEND_QUANTUM)
+        q = BBR_MAX_SEND_QUANTUM;
+    if (q < 2 * (uint64_t)bbr_max_dgram_size(b))
+        q = 2 * (uint64_t)bbr_max_dgram_size(b);
+
+    return q;
+}
+
+static size_t bbr_get_send_allowance(OSSL_CC_DATA *cc,
+                                     OSSL_TIME time_since_last_send,
+                                     int time_valid)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+    uint64_t allowance, paced, us;
+
+    if (b->bytes_in_flight >= b->cwnd)
+        allowance = 0;
+    else
+        allowance = b->cwnd - b->bytes_in_flight;
+
+    /*
+     * Pacing: the time since the last send earns credit at the pacing rate, up
+     * to one send quantum. A caller which cannot yet send a whole datagram
+     * should wait; the credit grows as the time since the last send does.
+     */
+    if (time_valid && b->pacing_rate > 0) {
+        us = ossl_time2us(time_since_last_send);
+        paced = bbr_send_quantum(b);
+        if (us < 1000000 && (b->pacing_rate * us) / 1000000 < paced)
+            paced = (b->pacing_rate * us) / 1000000;
+        if (paced < allowance)
+            allowance = paced;
+    }
+
+    /* Probe packets may always be sent. */
+    if (b->exemptions > 0 && allowance < bbr_max_dgram_size(b))
+        allowance = bbr_max_dgram_size(b);
+
+    return allowance > SIZE_MAX ? SIZE_MAX : (size_t)allowance;
+}
+
+static size_t bbr_get_bytes_in_flight_max(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+
+    return b->cwnd > SIZE_MAX ? SIZE_MAX : (size_t)b->cwnd;
+}
+
+static int bbr_on_data_sent(OSSL_CC_DATA *cc, size_t num_retransmittable_bytes)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+
+    if (b->exemptions > 0)
+        --b->exemptions;
+
+    b->bytes_in_flight += num_retransmittable_bytes;
+    return 1;
+}
+
+static void bbr_remove_from_flight(OSSL_CC_BBR *b, size_t num_bytes)
+{
+    if (num_bytes > b->bytes_in_flight)
+        b->bytes_in_flight = 0;
+    else
+        b->bytes_in_flight -= num_bytes;
+}
+
+static int bbr_on_data_invalidated(OSSL_CC_DATA *cc,
+                                   size_t num_retransmittable_bytes)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+
+    bbr_remove_from_flight(b, num_retransmittable_bytes);
+    return bbr_can_send(cc);
+}
+
+/* Adds a delivery rate sample to the BtlBw max filter. */
+static void bbr_update_bw(OSSL_CC_BBR *b, uint64_t sample)
+{
+    size_t i;
+
+    b->bw_idx = (b->bw_idx + 1) % BBR_BW_FILTER_LEN;
+    b->bw_samples[b->bw_idx] = sample;
+
+    b->max_bw = 0;
+    for (i = 0; i < BBR_BW_FILTER_LEN; ++i)
+        if (b->bw_samples[i] > b->max_bw)
+            b->max_bw = b->bw_samples[i];
+}
+
+/* Called at the end of each round in STARTUP to detect a full pipe. */
+static void bbr_check_full_bw(OSSL_CC_BBR *b)
+{
+    if (b->full_bw_reached)
+        return;
+
+    if (b->max_bw * 100 >= b->full_bw * BBR_FULL_BW_THRESH) {
+        b->full_bw          = b->max_bw;
+        b->full_bw_count    = 0;
+        return;
+    }
+
+    if (++b->full_bw_count >= BBR_FULL_BW_ROUNDS)
+        b->full_bw_reached = 1;
+}
+
+/*
+ * BBRv2: if the loss rate in a round is excessive, the path cannot hold the
+ * amount of data we had in flight. Remember a reduced bound and stop probing.
+ */
+static void bbr_check_loss(OSSL_CC_BBR *b, uint64_t inflight)
+{
+    uint64_t total = b->round_delivered + b->round_lost;
+
+    if (b->round_lost == 0 || b->round_lost * 100 <= total * BBR_LOSS_THRESH)
+        return;
+
+    b->prior_inflight_hi = b->inflight_hi;
+    b->inflight_hi = (inflight * BBR_BETA) / 100;
+    if (b->inflight_hi < bbr_min_pipe_cwnd(b))
+        b->inflight_hi = bbr_min_pipe_cwnd(b);
+
+    if (b->state == BBR_STATE_STARTUP)
+        b->full_bw_reached = 1;
+    else if (b->state == BBR_STATE_PROBE_BW && b->cycle_idx == 0)
+        b->cycle_idx = 1; /* stop probing up */
+
+    /* Only react once per round. */
+    b->round_lost = 0;
+}
+
+static void bbr_end_round(OSSL_CC_BBR *b, OSSL_TIME now)
+{
+    uint64_t us = ossl_time2us(ossl_time_subtract(now, b->round_start));
+
+    if (us == 0)
+        us = 1;
+
+    bbr_update_bw(b, (b->round_delivered * 1000000) / us);
+
+    if (b->state == BBR_STATE_STARTUP)
+        bbr_check_full_bw(b);
+
+    b->round_start      = now;
+    b->round_delivered  = 0;
+    b->round_lost       = 0;
+}
+
+static void bbr_advance_cycle(OSSL_CC_BBR *b, OSSL_TIME now)
+{
+    b->cycle_idx    = (b->cycle_idx + 1) % BBR_GAIN_CYCLE_LEN;
+    b->cycle_stamp  = now;
+
+    /* BBRv2: cautiously raise the inflight bound each time we probe up. */
+    if (b->cycle_idx == 0 && b->inflight_hi != UINT64_MAX)
+        b->inflight_hi += b->inflight_hi / 4;
+}
+
+static void bbr_update_state(OSSL_CC_BBR *b, OSSL_TIME now)
+{
+    OSSL_TIME rtt = bbr_have_min_rtt(b) ? b->min_rtt : BBR_INITIAL_RTT;
+
+    switch (b->state) {
+    case BBR_STATE_STARTUP:
+        if (b->full_bw_reached) {
+            b->state        = BBR_STATE_DRAIN;
+            b->pacing_gain  = BBR_DRAIN_GAIN;
+            b->cwnd_gain    = BBR_HIGH_GAIN;
+        }
+        break;
+
+    case BBR_STATE_DRAIN:
+        if (b->bytes_in_flight <= bbr_bdp(b, 100))
+            bbr_enter_probe_bw(b, now);
+        break;
+
+    case BBR_STATE_PROBE_BW:
+        if (ossl_time_compare(ossl_time_subtract(now, b->cycle_stamp),
+                              rtt) > 0
+            /* Leave the drain phase early once the queue is gone. */
+            || (b->cycle_idx == 1 && b->bytes_in_flight <= bbr_bdp(b, 100)))
+            bbr_advance_cycle(b, now);
+
+        b->pacing_gain = bbr_pacing_gain_cycle[b->cycle_idx];
+        break;
+
+    case BBR_STATE_PROBE_RTT:
+        if (ossl_time_is_zero(b->probe_rtt_done)) {
+            if (b->bytes_in_flight <= bbr_min_pipe_cwnd(b))
+                b->probe_rtt_done = ossl_time_add(now, BBR_PROBE_RTT_DURATION);
+        } else if (ossl_time_compare(now, b->probe_rtt_done) >= 0) {
+            b->min_rtt_stamp = now;
+            if (b->full_bw_reached) {
+                bbr_enter_probe_bw(b, now);
+            } else {
+                b->state        = BBR_STATE_STARTUP;
+                b->pacing_gain  = BBR_HIGH_GAIN;
+                b->cwnd_gain    = BBR_CWND_GAIN;
+            }
+        }
+        break;
+    }
+
+    /* Enter PROBE_RTT if the RTprop estimate was not refreshed in time. */
+    if (b->state != BBR_STATE_PROBE_RTT && b->min_rtt_expired) {
+        b->state            = BBR_STATE_PROBE_RTT;
+        b->pacing_gain      = BBR_PROBE_RTT_GAIN;
+        b->probe_rtt_done   = ossl_time_zero();
+    }
+
+    b->min_rtt_expired = 0;
+}
+
+static void bbr_update_cwnd(OSSL_CC_BBR *b, uint64_t num_bytes)
+{
+    uint64_t target = bbr_bdp(b, b->cwnd_gain)
+                      + 3 * (uint64_t)bbr_max_dgram_size(b);
+
+    if (b->full_bw_reached) {
+        b->cwnd += num_bytes;
+        if (b->cwnd > target)
+            b->cwnd = target;
+    } else if (b->cwnd < target || b->max_bw == 0) {
+        b->cwnd += num_bytes;
+    }
+
+    if (b->cwnd > b->inflight_hi)
+        b->cwnd = b->inflight_hi;
+
+    if (b->state == BBR_STATE_PROBE_RTT && b->cwnd > bbr_min_pipe_cwnd(b))
+        b->cwnd = bbr_min_pipe_cwnd(b);
+
+    if (b->cwnd < bbr_min_pipe_cwnd(b))
+        b->cwnd = bbr_min_pipe_cwnd(b);
+}
+
+static int bbr_on_data_acked(OSSL_CC_DATA *cc, OSSL_TIME time_now,
+                             uint64_t last_pn_acked,
+                             size_t num_retransmittable_bytes)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+    OSSL_TIME rtt = bbr_have_min_rtt(b) ? b->min_rtt : BBR_INITIAL_RTT;
+
+    bbr_remove_from_flight(b, num_retransmittable_bytes);
+
+    if (ossl_time_is_zero(b->round_start))
+        b->round_start = time_now;
+
+    b->round_delivered += num_retransmittable_bytes;
+
+    if (ossl_time_compare(ossl_time_subtract(time_now, b->round_start),
+                          rtt) >= 0)
+        bbr_end_round(b, time_now);
+
+    bbr_update_state(b, time_now);
+    bbr_update_pacing_rate(b);
+    bbr_update_cwnd(b, num_retransmittable_bytes);
+    return bbr_can_send(cc);
+}
+
+static void bbr_on_data_lost(OSSL_CC_DATA *cc,
+                             uint64_t largest_pn_lost,
+                             uint64_t largest_pn_sent,
+                             size_t num_retransmittable_bytes,
+                             int persistent_congestion)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+    uint64_t inflight = b->bytes_in_flight;
+
+    bbr_remove_from_flight(b, num_retransmittable_bytes);
+
+    if (persistent_congestion) {
+        b->prior_inflight_hi    = b->inflight_hi;
+        b->cwnd                 = bbr_min_pipe_cwnd(b);
+        return;
+    }
+
+    b->round_lost += num_retransmittable_bytes;
+    bbr_check_loss(b, inflight);
+
+    if (b->cwnd > b->inflight_hi)
+        b->cwnd = b->inflight_hi;
+}
+
+static int bbr_on_spurious_congestion_event(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+
+    b->inflight_hi = b->prior_inflight_hi;
+    return bbr_can_send(cc);
+}
+
+static void bbr_on_rtt_sample(OSSL_CC_DATA *cc, OSSL_TIME time_now,
+                              OSSL_TIME latest_rtt)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+    int expired;
+
+    if (ossl_time_is_zero(latest_rtt))
+        return;
+
+    expired = bbr_have_min_rtt(b)
+        && ossl_time_compare(ossl_time_subtract(time_now, b->min_rtt_stamp),
+                             BBR_MIN_RTT_WINDOW) > 0;
+
+    if (ossl_time_compare(latest_rtt, b->min_rtt) <= 0 || expired) {
+        b->min_rtt       = latest_rtt;
+        b->min_rtt_stamp = time_now;
+    }
+
+    if (expired)
+        b->min_rtt_expired = 1;
+}
+
+static uint64_t bbr_get_pacing_rate(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_BBR *b = (OSSL_CC_BBR *)cc;
+
+    return b->pacing_rate;
+}
+
+const OSSL_CC_METHOD ossl_cc_bbr_method = {
+    NULL,
+    bbr_new,
+    bbr_free,
+    bbr_reset,
+    bbr_set_exemption,
+    bbr_get_exemption,
+    bbr_can_send,
+    bbr_get_send_allowance,
+    bbr_get_bytes_in_flight_max,
+    bbr_on_data_sent,
+    bbr_on_data_invalidated,
+    bbr_on_data_acked,
+    bbr_on_data_lost,
+    bbr_on_spurious_congestion_event,
+    bbr_on_rtt_sample,
+    bbr_get_pacing_rate,
+};
@@ -0,0 +1,449 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include "internal/quic_cc.h"
+#include "internal/quic_types.h"
+
+/*
+ * CUBIC Congestion Controller
+ * ===========================
+ *
+ * This is the congestion controller described in RFC 9438, layered on the
+ * RFC 9002 slow start and recovery logic (see cc_newreno.c). All arithmetic is
+ * done in integers: windows are tracked in bytes and the cubic function is
+ * evaluated with a millisecond time base, so C = 0.4 segments/s^3 becomes
+ * 4 * 10^-10 segments/ms^3.
+ *
+ * The window target is computed for one smoothed RTT in the future, using the
+ * RTT samples provided via on_rtt_sample. Until a sample is available it is
+ * computed for the current time, which makes window growth marginally more
+ * conservative.
+ */
+typedef struct ossl_cc_cubic_st {
+    /* Current maximum datagram payload length, from the changeables. */
+    const size_t   *p_max_dgram_size;
+
+    uint64_t        cwnd;
+    uint64_t        ssthresh;
+    uint64_t        bytes_in_flight;
+
+    /* CUBIC state (RFC 9438 s. 4). */
+    uint64_t        w_max;          /* window before the last reduction */
+    uint64_t        w_est;          /* Reno-friendly window estimate */
+    uint64_t        k_ms;           /* time to regrow to w_max */
+    OSSL_TIME       epoch_start;    /* zero if no epoch has started */
+    OSSL_TIME       srtt;           /* smoothed RTT, zero if no sample */
+
+    /*
+     * Largest PN sent when the current recovery period started, or
+     * QUIC_PN_INVALID if we are not in a recovery period.
+     */
+    QUIC_PN         recovery_pn;
+
+    /* State saved for on_spurious_congestion_event. */
+    uint64_t        prior_cwnd;
+    uint64_t        prior_ssthresh;
+    uint64_t        prior_w_max;
+    uint64_t        prior_k_ms;
+    OSSL_TIME       prior_epoch_start;
+    QUIC_PN         prior_recovery_pn;
+
+    /* Number of packets which may be sent regardless of the window. */
+    int             exemptions;
+} OSSL_CC_CUBIC;
+
+#define CUBIC_DEFAULT_MAX_DGRAM_SIZE    QUIC_MIN_INITIAL_DGRAM_LEN
+#define CUBIC_MIN_WINDOW_PKTS           2
+#define CUBIC_INITIAL_WINDOW_PKTS       10
+#define CUBIC_INITIAL_WINDOW_BYTES      14720
+
+/* beta_cubic = 0.7 */
+#define CUBIC_BETA_NUM                  7
+#define CUBIC_BETA_DEN                  10
+
+/* alpha_cubic = 3 * (1 - beta_cubic) / (1 + beta_cubic) = 9/17 */
+#define CUBIC_ALPHA_NUM                 9
+#define CUBIC_ALPHA_DEN                 17
+
+/*
+ * Bound on |t - K| when evaluating the cubic function. This keeps the
+ * intermediate products within 64 bits; after 100 seconds of growth without
+ * loss the window has long been limited by other factors.
+ */
+#define CUBIC_MAX_DELTA_MS              100000
+
+/* Bound on the window growth term used to compute K, in thousandths of MSS. */
+#define CUBIC_MAX_K_SEGS_X1000          ((uint64_t)4000000000000)
+
+static size_t cubic_max_dgram_size(const OSSL_CC_CUBIC *c)
+{
+    if (c->p_max_dgram_size == NULL || *c->p_max_dgram_size == 0)
+        return CUBIC_DEFAULT_MAX_DGRAM_SIZE;
+
+    return *c->p_max_dgram_size;
+}
+
+static uint64_t cubic_min_window(const OSSL_CC_CUBIC *c)
+{
+    return CUBIC_MIN_WINDOW_PKTS * (uint64_t)cubic_max_dgram_size(c);
+}
+
+static uint64_t cubic_initial_window(const OSSL_CC_CUBIC *c)
+{
+    uint64_t mdpl = cubic_max_dgram_size(c);
+    uint64_t lim = 2 * mdpl;
+
+    if (lim < CUBIC_INITIAL_WINDOW_BYTES)
+        lim = CUBIC_INITIAL_WINDOW_BYTES;
+
+    if (CUBIC_INITIAL_WINDOW_PKTS * mdpl < lim)
+        lim = CUBIC_INITIAL_WINDOW_PKTS * mdpl;
+
+    return lim;
+}
+
+/* Integer cube root, rounded down. */
+static uint64_t cubic_cbrt(uint64_t x)
+{
+    uint64_t r = 0, b;
+    int s;
+
+    for (s = 63; s >= 0; s -= 3) {
+        r <<= 1;
+        b = 3 * r * (r + 1) + 1;
+        if ((x >> s) >= b) {
+            x -= b << s;
+            ++r;
+        }
+    }
+
+    return r;
+}
+
+/* Computes W_cubic(t) in bytes, for |t_ms| milliseconds into the epoch. */
+static uint64_t cubic_w_cubic(const OSSL_CC_CUBIC *c, uint64_t t_ms)
+{
+    uint64_t d, offs;
+
+    d = t_ms > c->k_ms ? t_ms - c->k_ms : c->k_ms - t_ms;
+    if (d > CUBIC_MAX_DELTA_MS)
+        d = CUBIC_MAX_DELTA_MS;
+
+    /* C * d^3 in millionths of a segment, then converted to bytes. */
+    offs = (d * d * d * 4) / 10000;
+    offs = (offs * cubic_max_dgram_size(c)) / 1000000;
+
+    if (t_ms >= c->k_ms)
+        return c->w_max + offs;
+
+    return c->w_max > offs ? c->w_max - offs : 0;
+}
+
+/* Computes K in milliseconds from w_max and the current window. */
+static void cubic_update_k(OSSL_CC_CUBIC *c)
+{
+    uint64_t segs_x1000;
+
+    if (c->w_max <= c->cwnd) {
+        c->k_ms = 0;
+        return;
+    }
+
+    /* K^3 = (W_max - cwnd_epoch) / C */
+    segs_x1000 = ((c->w_max - c->cwnd) * 1000) / cubic_max_dgram_size(c);
+    if (segs_x1000 > CUBIC_MAX_K_SEGS_X1000)
+        segs_x1000 = CUBIC_MAX_K_SEGS_X1000;
+
+    c->k_ms = cubic_cbrt(segs_x1000 * 2500000);
+}
+
+static void cubic_reset(OSSL_CC_DATA *cc, int flags)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    c->cwnd             = cubic_initial_window(c);
+    c->ssthresh         = UINT64_MAX;
+    c->bytes_in_flight  = 0;
+    c->w_max            = 0;
+    c->w_est            = 0;
+    c->k_ms             = 0;
+    c->epoch_start      = ossl_time_zero();
+    c->srtt             = ossl_time_zero();
+    c->recovery_pn      = QUIC_PN_INVALID;
+    c->prior_cwnd       = c->cwnd;
+    c->prior_ssthresh   = c->ssthresh;
+    c->prior_w_max      = 0;
+    c->prior_k_ms       = 0;
+    c->prior_epoch_start = ossl_time_zero();
+    c->prior_recovery_pn = QUIC_PN_INVALID;
+    c->exemptions       = 0;
+}
+
+static OSSL_CC_DATA *cubic_new(OSSL_PARAM *settings, OSSL_PARAM *options,
+                               OSSL_PARAM *changeables)
+{
+    OSSL_CC_CUBIC *c;
+
+    c = OPENSSL_zalloc(sizeof(*c));
+    if (c == NULL)
+        return NULL;
+
+    if (!ossl_cc_bind_max_dgram_size(changeables, &c->p_max_dgram_size)) {
+        OPENSSL_free(c);
+        return NULL;
+    }
+
+    cubic_reset((OSSL_CC_DATA *)c, 0);
+    return (OSSL_CC_DATA *)c;
+}
+
+static void cubic_free(OSSL_CC_DATA *cc)
+{
+    OPENSSL_free(cc);
+}
+
+static int cubic_set_exemption(OSSL_CC_DATA *cc, int numpackets)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    if (numpackets < 0)
+        return 0;
+
+    c->exemptions = numpackets;
+    return 1;
+}
+
+static int cubic_get_exemption(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    return c->exemptions;
+}
+
+static int cubic_can_send(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    return c->exemptions > 0 || c->bytes_in_flight < c->cwnd;
+}
+
+static size_t cubic_get_send_allowance(OSSL_CC_DATA *cc,
+                                       OSSL_TIME time_since_last_send,
+                                       int time_valid)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+    uint64_t allowance;
+
+    if (c->bytes_in_flight >= c->cwnd)
+        allowance = 0;
+    else
+        allowance = c->cwnd - c->bytes_in_flight;
+
+    /* Probe packets may always be sent. */
+    if (c->exemptions > 0 && allowance < cubic_max_dgram_size(c))
+        allowance = cubic_max_dgram_size(c);
+
+    return allowance > SIZE_MAX ? SIZE_MAX : (size_t)allowance;
+}
+
+static size_t cubic_get_bytes_in_flight_max(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    return c->cwnd > SIZE_MAX ? SIZE_MAX : (size_t)c->cwnd;
+}
+
+static int cubic_on_data_sent(OSSL_CC_DATA *cc,
+                              size_t num_retransmittable_bytes)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    if (c->exemptions > 0)
+        --c->exemptions;
+
+    c->bytes_in_flight += num_retransmittable_bytes;
+    return 1;
+}
+
+static void cubic_remove_from_flight(OSSL_CC_CUBIC *c, size_t num_bytes)
+{
+    if (num_bytes > c->bytes_in_flight)
+        c->bytes_in_flight = 0;
+    else
+        c->bytes_in_flight -= num_bytes;
+}
+
+static int cubic_on_data_invalidated(OSSL_CC_DATA *cc,
+                                     size_t num_retransmittable_bytes)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    cubic_remove_from_flight(c, num_retransmittable_bytes);
+    return cubic_can_send(cc);
+}
+
+static int cubic_in_recovery(const OSSL_CC_CUBIC *c, QUIC_PN pn)
+{
+    return c->recovery_pn != QUIC_PN_INVALID && pn <= c->recovery_pn;
+}
+
+static void cubic_congestion_avoidance(OSSL_CC_CUBIC *c, OSSL_TIME now,
+                                       uint64_t num_bytes)
+{
+    uint64_t mdpl = cubic_max_dgram_size(c), t_ms, w_cubic, target;
+
+    if (ossl_time_is_zero(c->epoch_start)) {
+        /* Start a new epoch (RFC 9438 s. 4.2). */
+        c->epoch_start = now;
+        if (c->w_max < c->cwnd)
+            c->w_max = c->cwnd;
+
+        cubic_update_k(c);
+        c->w_est = c->cwnd;
+    }
+
+    t_ms    = ossl_time2ms(ossl_time_subtract(now, c->epoch_start));
+    w_cubic = cubic_w_cubic(c, t_ms);
+
+    /* Reno-friendly region (RFC 9438 s. 4.3). */
+    c->w_est += (num_bytes * mdpl * CUBIC_ALPHA_NUM)
+                / (c->cwnd * CUBIC_ALPHA_DEN);
+
+    if (w_cubic < c->w_est) {
+        if (c->w_est > c->cwnd)
+            c->cwnd = c->w_est;
+        return;
+    }
+
+    /* Concave and convex regions (RFC 9438 s. 4.4, 4.5). */
+    target = cubic_w_cubic(c, t_ms + ossl_time2ms(c->srtt));
+    if (target < c->cwnd)
+        target = c->cwnd;
+    else if (target > c->cwnd + c->cwnd / 2)
+        target = c->cwnd + c->cwnd / 2;
+
+    c->cwnd += ((target - c->cwnd) * num_bytes) / c->cwnd;
+}
+
+static int cubic_on_data_acked(OSSL_CC_DATA *cc, OSSL_TIME time_now,
+                               uint64_t last_pn_acked,
+                               size_t num_retransmittable_bytes)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    cubic_remove_from_flight(c, num_retransmittable_bytes);
+
+    /* Do not increase the window during a recovery period. */
+    if (cubic_in_recovery(c, last_pn_acked))
+        goto out;
+
+    c->recovery_pn = QUIC_PN_INVALID;
+
+    if (c->cwnd < c->ssthresh)
+        c->cwnd += num_retransmittable_bytes; /* slow start */
+    else
+        cubic_congestion_avoidance(c, time_now, num_retransmittable_bytes);
+
+out:
+    return cubic_can_send(cc);
+}
+
+static void cubic_on_data_lost(OSSL_CC_DATA *cc,
+                               uint64_t largest_pn_lost,
+                               uint64_t largest_pn_sent,
+                               size_t num_retransmittable_bytes,
+                               int persistent_congestion)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    cubic_remove_from_flight(c, num_retransmittable_bytes);
+
+    if (!persistent_congestion && cubic_in_recovery(c, largest_pn_lost))
+        return;
+
+    c->prior_cwnd           = c->cwnd;
+    c->prior_ssthresh       = c->ssthresh;
+    c->prior_w_max          = c->w_max;
+    c->prior_k_ms           = c->k_ms;
+    c->prior_epoch_start    = c->epoch_start;
+    c->prior_recovery_pn    = c->recovery_pn;
+
+    /* Fast convergence (RFC 9438 s. 4.7). */
+    if (c->cwnd < c->w_max)
+        c->w_max = (c->cwnd * (CUBIC_BETA_DEN + CUBIC_BETA_NUM))
+                   / (2 * CUBIC_BETA_DEN);
+    else
+        c->w_max = c->cwnd;
+
+    c->ssthresh = (c->cwnd * CUBIC_BETA_NUM) / CUBIC_BETA_DEN;
+    if (c->ssthresh < cubic_min_window(c))
+        c->ssthresh = cubic_min_window(c);
+
+    c->epoch_start = ossl_time_zero();
+
+    if (persistent_congestion) {
+        /* RFC 9002 s. 7.6.2: collapse the window to the minimum. */
+        c->cwnd         = cubic_min_window(c);
+        c->recovery_pn  = QUIC_PN_INVALID;
+    } else {
+        c->cwnd         = c->ssthresh;
+        c->recovery_pn  = largest_pn_sent;
+    }
+
+    cubic_update_k(c);
+    c->w_est = c->cwnd;
+}
+
+static int cubic_on_spurious_congestion_event(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    if (c->prior_cwnd > c->cwnd) {
+        c->cwnd         = c->prior_cwnd;
+        c->ssthresh     = c->prior_ssthresh;
+        c->w_max        = c->prior_w_max;
+        c->k_ms         = c->prior_k_ms;
+        c->epoch_start  = c->prior_epoch_start;
+        c->recovery_pn  = c->prior_recovery_pn;
+        c->w_est        = c->cwnd;
+    }
+
+    return cubic_can_send(cc);
+}
+
+static void cubic_on_rtt_sample(OSSL_CC_DATA *cc, OSSL_TIME time_now,
+                                OSSL_TIME latest_rtt)
+{
+    OSSL_CC_CUBIC *c = (OSSL_CC_CUBIC *)cc;
+
+    if (ossl_time_is_zero(c->srtt))
+        c->srtt = latest_rtt;
+    else
+        c->srtt = ossl_time_divide(ossl_time_add(ossl_time_multiply(c->srtt, 7),
+                                                 latest_rtt), 8);
+}
+
+const OSSL_CC_METHOD ossl_cc_cubic_method = {
+    NULL,
+    cubic_new,
+    cubic_free,
+    cubic_reset,
+    cubic_set_exemption,
+    cubic_get_exemption,
+    cubic_can_send,
+    cubic_get_send_allowance,
+    cubic_get_bytes_in_flight_max,
+    cubic_on_data_sent,
+    cubic_on_data_invalidated,
+    cubic_on_data_acked,
+    cubic_on_data_lost,
+    cubic_on_spurious_congestion_event,
+    cubic_on_rtt_sample,
+    NULL, /* get_pacing_rate */
+};
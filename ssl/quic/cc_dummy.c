@@ -103,4 +103,6 @@ const OSSL_CC_METHOD ossl_cc_dummy_method = {
     dummy_on_data_acked,
     dummy_on_data_lost,
     dummy_on_spurious_congestion_event,
+    NULL, /* on_rtt_sample */
+    NULL, /* get_pacing_rate */
 };
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <openssl/crypto.h>
+#include <openssl/params.h>
+#include "internal/nelem.h"
+#include "internal/quic_cc.h"
+
+static const struct {
+    const char              *name;
+    const OSSL_CC_METHOD    *method;
+} cc_methods[] = {
+    { "newreno",    &ossl_cc_newreno_method },
+    { "cubic",      &ossl_cc_cubic_method   },
+    { "bbr",        &ossl_cc_bbr_method     },
+    { "dummy",      &ossl_cc_dummy_method   },
+};
+
+const OSSL_CC_METHOD *ossl_cc_method_by_name(const char *name)
+{
+    size_t i;
+
+    if (name == NULL)
+        return &ossl_cc_newreno_method;
+
+    for (i = 0; i < OSSL_NELEM(cc_methods); ++i)
+        if (OPENSSL_strcasecmp(cc_methods[i].name, name) == 0)
+            return cc_methods[i].method;
+
+    return NULL;
+}
+
+int ossl_cc_bind_max_dgram_size(OSSL_PARAM *changeables, const size_t **pmdpl)
+{
+    OSSL_PARAM *p;
+
+    *pmdpl = NULL;
+
+    if (changeables == NULL)
+        return 1;
+
+    p = OSSL_PARAM_locate(changeables, OSSL_CC_OPTION_MAX_DGRAM_PAYLOAD_LEN);
+    if (p == NULL)
+        return 1;
+
+    if (p->data_type != OSSL_PARAM_UNSIGNED_INTEGER
+        || p->data_size != sizeof(size_t)
+        || p->data == NULL)
+        return 0;
+
+    *pmdpl = p->data;
+    return 1;
+}
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include "internal/quic_cc.h"
+#include "internal/quic_types.h"
+
+/*
+ * NewReno Congestion Controller
+ * =============================
+ *
+ * This is the congestion controller described in RFC 9002 s. 7 and Appendix
+ * B. Recovery periods are tracked using packet numbers rather than send times:
+ * when a congestion event occurs we note the largest PN sent so far, and the
+ * recovery period ends as soon as a packet with a higher PN is acknowledged.
+ */
+typedef struct ossl_cc_newreno_st {
+    /* Current maximum datagram payload length, from the changeables. */
+    const size_t   *p_max_dgram_size;
+
+    /* RFC 9002 variables. */
+    uint64_t        cwnd;
+    uint64_t        ssthresh;
+    uint64_t        bytes_in_flight;
+    uint64_t        bytes_acked; /* congestion avoidance accumulator */
+
+    /*
+     * Largest PN sent when the current recovery period started, or
+     * QUIC_PN_INVALID if we are not in a recovery period.
+     */
+    QUIC_PN         recovery_pn;
+
+    /* State saved for on_spurious_congestion_event. */
+    uint64_t        prior_cwnd;
+    uint64_t        prior_ssthresh;
+    QUIC_PN         prior_recovery_pn;
+
+    /* Number of packets which may be sent regardless of the window. */
+    int             exemptions;
+} OSSL_CC_NEWRENO;
+
+#define NEWRENO_DEFAULT_MAX_DGRAM_SIZE  QUIC_MIN_INITIAL_DGRAM_LEN
+#define NEWRENO_MIN_WINDOW_PKTS         2
+#define NEWRENO_INITIAL_WINDOW_PKTS     10
+#define NEWRENO_INITIAL_WINDOW_BYTES    14720
+
+static size_t newreno_max_dgram_size(const OSSL_CC_NEWRENO *nr)
+{
+    if (nr->p_max_dgram_size == NULL || *nr->p_max_dgram_size == 0)
+        return NEWRENO_DEFAULT_MAX_DGRAM_SIZE;
+
+    return *nr->p_max_dgram_size;
+}
+
+static uint64_t newreno_min_window(const OSSL_CC_NEWRENO *nr)
+{
+    return NEWRENO_MIN_WINDOW_PKTS * (uint64_t)newreno_max_dgram_size(nr);
+}
+
+static uint64_t newreno_initial_window(const OSSL_CC_NEWRENO *nr)
+{
+    uint64_t mdpl = newreno_max_dgram_size(nr);
+    uint64_t lim = 2 * mdpl;
+
+    /* min(10 * max_datagram_size, max(14720, 2 * max_datagram_size)) */
+    if (lim < NEWRENO_INITIAL_WINDOW_BYTES)
+        lim = NEWRENO_INITIAL_WINDOW_BYTES;
+
+    if (NEWRENO_INITIAL_WINDOW_PKTS * mdpl < lim)
+        lim = NEWRENO_INITIAL_WINDOW_PKTS * mdpl;
+
+    return lim;
+}
+
+static void newreno_reset(OSSL_CC_DATA *cc, int flags)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    nr->cwnd            = newreno_initial_window(nr);
+    nr->ssthresh        = UINT64_MAX;
+    nr->bytes_in_flight = 0;
+    nr->bytes_acked     = 0;
+    nr->recovery_pn     = QUIC_PN_INVALID;
+    nr->prior_cwnd      = nr->cwnd;
+    nr->prior_ssthresh  = nr->ssthresh;
+    nr->prior_recovery_pn = QUIC_PN_INVALID;
+    nr->exemptions      = 0;
+}
+
+static OSSL_CC_DATA *newreno_new(OSSL_PARAM *settings, OSSL_PARAM *options,
+                                 OSSL_PARAM *changeables)
+{
+    OSSL_CC_NEWRENO *nr;
+
+    nr = OPENSSL_zalloc(sizeof(*nr));
+    if (nr == NULL)
+        return NULL;
+
+    if (!ossl_cc_bind_max_dgram_size(changeables, &nr->p_max_dgram_size)) {
+        OPENSSL_free(nr);
+        return NULL;
+    }
+
+    newreno_reset((OSSL_CC_DATA *)nr, 0);
+    return (OSSL_CC_DATA *)nr;
+}
+
+static void newreno_free(OSSL_CC_DATA *cc)
+{
+    OPENSSL_free(cc);
+}
+
+static int newreno_set_exemption(OSSL_CC_DATA *cc, int numpackets)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    if (numpackets < 0)
+        return 0;
+
+    nr->exemptions = numpackets;
+    return 1;
+}
+
+static int newreno_get_exemption(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    return nr->exemptions;
+}
+
+static int newreno_can_send(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    return nr->exemptions > 0 || nr->bytes_in_flight < nr->cwnd;
+}
+
+static size_t newreno_get_send_allowance(OSSL_CC_DATA *cc,
+                                         OSSL_TIME time_since_last_send,
+                                         int time_valid)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+    uint64_t allowance;
+
+    if (nr->bytes_in_flight >= nr->cwnd)
+        allowance = 0;
+    else
+        allowance = nr->cwnd - nr->bytes_in_flight;
+
+    /* Probe packets may always be sent. */
+    if (nr->exemptions > 0 && allowance < newreno_max_dgram_size(nr))
+        allowance = newreno_max_dgram_size(nr);
+
+    return allowance > SIZE_MAX ? SIZE_MAX : (size_t)allowance;
+}
+
+static size_t newreno_get_bytes_in_flight_max(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    return nr->cwnd > SIZE_MAX ? SIZE_MAX : (size_t)nr->cwnd;
+}
+
+static int newreno_on_data_sent(OSSL_CC_DATA *cc,
+                                size_t num_retransmittable_bytes)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    if (nr->exemptions > 0)
+        --nr->exemptions;
+
+    nr->bytes_in_flight += num_retransmittable_bytes;
+    return 1;
+}
+
+static void newreno_remove_from_flight(OSSL_CC_NEWRENO *nr, size_t num_bytes)
+{
+    if (num_bytes > nr->bytes_in_flight)
+        nr->bytes_in_flight = 0;
+    else
+        nr->bytes_in_flight -= num_bytes;
+}
+
+static int newreno_on_data_invalidated(OSSL_CC_DATA *cc,
+                                       size_t num_retransmittable_bytes)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    newreno_remove_from_flight(nr, num_retransmittable_bytes);
+    return newreno_can_send(cc);
+}
+
+static int newreno_in_recovery(const OSSL_CC_NEWRENO *nr, QUIC_PN pn)
+{
+    return nr->recovery_pn != QUIC_PN_INVALID && pn <= nr->recovery_pn;
+}
+
+static int newreno_on_data_acked(OSSL_CC_DATA *cc, OSSL_TIME time_now,
+                                 uint64_t last_pn_acked,
+                                 size_t num_retransmittable_bytes)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+    uint64_t mdpl = newreno_max_dgram_size(nr);
+
+    newreno_remove_from_flight(nr, num_retransmittable_bytes);
+
+    /* Do not increase the window during a recovery period. */
+    if (newreno_in_recovery(nr, last_pn_acked))
+        goto out;
+
+    nr->recovery_pn = QUIC_PN_INVALID;
+
+    if (nr->cwnd < nr->ssthresh) {
+        /* Slow start. */
+        nr->cwnd += num_retransmittable_bytes;
+    } else {
+        /*
+         * Congestion avoidance. Accumulate acknowledged bytes so that the
+         * window grows by one datagram per window's worth of ACKs, without
+         * losing precision to integer division on every ACK.
+         */
+        nr->bytes_acked += num_retransmittable_bytes;
+        if (nr->bytes_acked >= nr->cwnd) {
+            nr->bytes_acked -= nr->cwnd;
+            nr->cwnd += mdpl;
+        }
+    }
+
+out:
+    return newreno_can_send(cc);
+}
+
+static void newreno_on_data_lost(OSSL_CC_DATA *cc,
+                                 uint64_t largest_pn_lost,
+                                 uint64_t largest_pn_sent,
+                                 size_t num_retransmittable_bytes,
+                                 int persistent_congestion)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    newreno_remove_from_flight(nr, num_retransmittable_bytes);
+
+    /* Only one window reduction per recovery period. */
+    if (!newreno_in_recovery(nr, largest_pn_lost)) {
+        nr->prior_cwnd          = nr->cwnd;
+        nr->prior_ssthresh      = nr->ssthresh;
+        nr->prior_recovery_pn   = nr->recovery_pn;
+
+        nr->recovery_pn = largest_pn_sent;
+        nr->ssthresh    = nr->cwnd / 2; /* kLossReductionFactor */
+        if (nr->ssthresh < newreno_min_window(nr))
+            nr->ssthresh = newreno_min_window(nr);
+
+        nr->cwnd        = nr->ssthresh;
+        nr->bytes_acked = 0;
+    }
+
+    /*
+     * RFC 9002 s. 7.6.2: collapse the window to the minimum. This comes on top
+     * of the congestion event above, so that ssthresh is set and we do not go
+     * back to unbounded slow start.
+     */
+    if (persistent_congestion) {
+        nr->cwnd        = newreno_min_window(nr);
+        nr->bytes_acked = 0;
+        nr->recovery_pn = QUIC_PN_INVALID;
+    }
+}
+
+static int newreno_on_spurious_congestion_event(OSSL_CC_DATA *cc)
+{
+    OSSL_CC_NEWRENO *nr = (OSSL_CC_NEWRENO *)cc;
+
+    if (nr->prior_cwnd > nr->cwnd) {
+        nr->cwnd        = nr->prior_cwnd;
+        nr->ssthresh    = nr->prior_ssthresh;
+        nr->recovery_pn = nr->prior_recovery_pn;
+    }
+
+    return newreno_can_send(cc);
+}
+
+const OSSL_CC_METHOD ossl_cc_newreno_method = {
+    NULL,
+    newreno_new,
+    newreno_free,
+    newreno_reset,
+    newreno_set_exemption,
+    newreno_get_exemption,
+    newreno_can_send,
+    newreno_get_send_allowance,
+    newreno_get_bytes_in_flight_max,
+    newreno_on_data_sent,
+    newreno_on_data_invalidated,
+    newreno_on_data_acked,
+    newreno_on_data_lost,
+    newreno_on_spurious_congestion_event,
+    NULL, /* on_rtt_sample */
+    NULL, /* get_pacing_rate */
+};
@@ -8,6 +8,7 @@
  */
 
 #include "internal/quic_ackm.h"
+#include "internal/quic_trace.h"
 #include "internal/common.h"
 #include <assert.h>
 
@@ -24,6 +25,14 @@
  * numbers of the packets appended to the list must monotonically increase), as
  * we should not currently need more general functionality such as a sorted list
  * insert.
+ *
+ * Since packet numbers are appended in order, lookup by packet number does not
+ * need a hashtable. Instead, we keep a ring of pointers indexed directly by
+ * packet number, covering the packet numbers from the head of the list to the
+ * tail. Slots for packet numbers which were skipped or whose packets have since
+ * been removed are NULL. This needs no allocation per packet, and lookup is a
+ * single array access. The ring grows (by doubling) to cover the span between
+ * the oldest and newest packets in flight.
  */
 struct tx_pkt_history_st {
     /* A linked list of all our packets. */
@@ -33,12 +42,15 @@ struct tx_pkt_history_st {
     size_t num_packets;
 
     /*
-     * Mapping from packet numbers (uint64_t) to (OSSL_ACKM_TX_PKT *)
+     * Mapping from packet numbers to (OSSL_ACKM_TX_PKT *). The packet with
+     * number pn, if any, is at ring[pn & (ring_cap - 1)]. ring_cap is a power
+     * of two greater than tail->pkt_num - head->pkt_num.
      *
      * Invariant: A packet is in this map if and only if it is in the linked
      *            list.
      */
-    LHASH_OF(OSSL_ACKM_TX_PKT) *map;
+    OSSL_ACKM_TX_PKT **ring;
+    size_t ring_cap;
 
     /*
      * The lowest packet number which may currently be added to the history list
@@ -56,22 +68,16 @@ struct tx_pkt_history_st {
     uint64_t highest_sent;
 };
 
-DEFINE_LHASH_OF_EX(OSSL_ACKM_TX_PKT);
-
-static unsigned long tx_pkt_info_hash(const OSSL_ACKM_TX_PKT *pkt)
-{
-    return pkt->pkt_num;
-}
+#define TX_PKT_RING_MIN_CAP     64
 
-static int tx_pkt_info_compare(const OSSL_ACKM_TX_PKT *a,
-                               const OSSL_ACKM_TX_PKT *b)
-{
-    if (a->pkt_num < b->pkt_num)
-        return -1;
-    if (a->pkt_num > b->pkt_num)
-        return 1;
-    return 0;
-}
+/*
+ * Limit on the span of packet numbers in the history, which bounds the size of
+ * the ring at 8 MiB on 64-bit platforms. Once the oldest packet still in the
+ * history is this many packet numbers behind, registering a further packet
+ * fails (ossl_ackm_on_tx_packet returns 0) until older packets have been
+ * acknowledged, declared lost or discarded.
+ */
+#define TX_PKT_RING_MAX_CAP     ((size_t)1 << 20)
 
 static int
 tx_pkt_history_init(struct tx_pkt_history_st *h)
@@ -81,8 +87,9 @@ tx_pkt_history_init(struct tx_pkt_history_st *h)
     h->watermark    = 0;
     h->highest_sent = 0;
 
-    h->map = lh_OSSL_ACKM_TX_PKT_new(tx_pkt_info_hash, tx_pkt_info_compare);
-    if (h->map == NULL)
+    h->ring_cap = TX_PKT_RING_MIN_CAP;
+    h->ring = OPENSSL_zalloc(sizeof(OSSL_ACKM_TX_PKT *) * h->ring_cap);
+    if (h->ring == NULL)
         return 0;
 
     return 1;
@@ -91,30 +98,73 @@ tx_pkt_history_init(struct tx_pkt_history_st *h)
 static void
 tx_pkt_history_destroy(struct tx_pkt_history_st *h)
 {
-    lh_OSSL_ACKM_TX_PKT_free(h->map);
-    h->map = NULL;
+    OPENSSL_free(h->ring);
+    h->ring = NULL;
     h->head = h->tail = NULL;
 }
 
+static ossl_inline OSSL_ACKM_TX_PKT **
+tx_pkt_history_slot(struct tx_pkt_history_st *h, uint64_t pkt_num)
+{
+    return &h->ring[pkt_num & (h->ring_cap - 1)];
+}
+
+/*
+ * Ensure the ring can cover the packets in the list plus pkt_num. Fails if this
+ * would need more than TX_PKT_RING_MAX_CAP slots.
+ */
+static int
+tx_pkt_history_reserve(struct tx_pkt_history_st *h, uint64_t pkt_num)
+{
+    OSSL_ACKM_TX_PKT **ring, *pkt;
+    size_t cap = h->ring_cap;
+    uint64_t span;
+
+    if (h->head == NULL)
+        return 1;
+
+    span = pkt_num - h->head->pkt_num;
+    if (span < cap)
+        return 1;
+
+    if (span >= TX_PKT_RING_MAX_CAP)
+        return 0;
+
+    while (span >= cap)
+        cap *= 2;
+
+    ring = OPENSSL_zalloc(sizeof(OSSL_ACKM_TX_PKT *) * cap);
+    if (ring == NULL)
+        return 0;
+
+    for (pkt = h->head; pkt != NULL; pkt = pkt->next)
+        ring[pkt->pkt_num & (cap - 1)] = pkt;
+
+    OPENSSL_free(h->ring);
+    h->ring     = ring;
+    h->ring_cap = cap;
+    return 1;
+}
+
 static int
 tx_pkt_history_add_actual(struct tx_pkt_history_st *h,
                           OSSL_ACKM_TX_PKT *pkt)
 {
-    OSSL_ACKM_TX_PKT *existing;
+    /* Should not already be in a list. */
+    if (!ossl_assert(pkt->next == NULL && pkt->prev == NULL))
+        return 0;
+
+    if (!tx_pkt_history_reserve(h, pkt->pkt_num))
+        return 0;
 
     /*
      * There should not be any existing packet with this number
      * in our mapping.
      */
-    existing = lh_OSSL_ACKM_TX_PKT_retrieve(h->map, pkt);
-    if (!ossl_assert(existing == NULL))
+    if (!ossl_assert(*tx_pkt_history_slot(h, pkt->pkt_num) == NULL))
         return 0;
 
-    /* Should not already be in a list. */
-    if (!ossl_assert(pkt->next == NULL && pkt->prev == NULL))
-        return 0;
-
-    lh_OSSL_ACKM_TX_PKT_insert(h->map, pkt);
+    *tx_pkt_history_slot(h, pkt->pkt_num) = pkt;
 
     pkt->next = NULL;
     pkt->prev = h->tail;
@@ -148,19 +198,57 @@ tx_pkt_history_add(struct tx_pkt_history_st *h,
 static OSSL_ACKM_TX_PKT *
 tx_pkt_history_by_pkt_num(struct tx_pkt_history_st *h, uint64_t pkt_num)
 {
-    OSSL_ACKM_TX_PKT key;
+    if (h->head == NULL
+        || pkt_num < h->head->pkt_num
+        || pkt_num > h->tail->pkt_num)
+        return NULL;
 
-    key.pkt_num = pkt_num;
+    return *tx_pkt_history_slot(h, pkt_num);
+}
 
-    return lh_OSSL_ACKM_TX_PKT_retrieve(h->map, &key);
+/*
+ * Find the packet with the highest packet number not exceeding pkt_num. hint,
+ * if not NULL, is a packet with a higher packet number from which the list may
+ * be walked backwards. We first probe the ring directly, as the packet we want
+ * is usually close to pkt_num, but fall back to walking the list to bound the
+ * work done when pkt_num is in a long run of packets which are gone.
+ */
+#define TX_PKT_RING_MAX_PROBE   64
+
+static OSSL_ACKM_TX_PKT *
+tx_pkt_history_find_le(struct tx_pkt_history_st *h, uint64_t pkt_num,
+                       OSSL_ACKM_TX_PKT *hint)
+{
+    OSSL_ACKM_TX_PKT *pkt;
+    size_t i;
+
+    if (h->head == NULL || pkt_num < h->head->pkt_num)
+        return NULL;
+
+    if (pkt_num >= h->tail->pkt_num)
+        return h->tail;
+
+    for (i = 0; i < TX_PKT_RING_MAX_PROBE; ++i, --pkt_num) {
+        pkt = *tx_pkt_history_slot(h, pkt_num);
+        if (pkt != NULL)
+            return pkt;
+
+        if (pkt_num == h->head->pkt_num)
+            return NULL;
+    }
+
+    for (pkt = hint != NULL ? hint : h->tail;
+         pkt != NULL && pkt->pkt_num > pkt_num;
+         pkt = pkt->prev);
+
+    return pkt;
 }
 
 /* Remove a packet information structure from the history log. */
 static int
 tx_pkt_history_remove(struct tx_pkt_history_st *h, uint64_t pkt_num)
 {
-    OSSL_ACKM_TX_PKT key, *pkt;
-    key.pkt_num = pkt_num;
+    OSSL_ACKM_TX_PKT *pkt;
 
     pkt = tx_pkt_history_by_pkt_num(h, pkt_num);
     if (pkt == NULL)
@@ -177,7 +265,7 @@ tx_pkt_history_remove(struct tx_pkt_history_st *h, uint64_t pkt_num)
 
     pkt->prev = pkt->next = NULL;
 
-    lh_OSSL_ACKM_TX_PKT_delete(h->map, &key);
+    *tx_pkt_history_slot(h, pkt_num) = NULL;
     --h->num_packets;
     return 1;
 }
@@ -390,15 +478,15 @@ tx_pkt_history_remove(struct tx_pkt_history_st *h, uint64_t pkt_num)
  *
  * For greater efficiency in tracking large numbers of contiguous PNs, we track
  * PN ranges rather than individual PNs. The data structure manages a list of PN
- * ranges [[start, end]...]. Internally this is implemented as a doubly linked
- * sorted list of range structures, which are automatically split and merged as
- * necessary.
+ * ranges [[start, end]...]. Internally this is implemented as a sorted array of
+ * range structures, which are automatically split and merged as necessary.
  *
- * This data structure requires O(n) traversal of the list for insertion,
- * removal and query when we are not adding/removing ranges which are near the
- * beginning or end of the set of ranges. It is expected that the number of PN
- * ranges needed at any given time will generally be small and that most
- * operations will be close to the beginning or end of the range.
+ * Query is a binary search and so takes O(log n) time in the number of ranges.
+ * Insertion and removal also find their position by binary search, but may need
+ * to move the ranges after that position and so take O(n) time in the worst
+ * case, except when they only touch the last range, which is the common case
+ * of PNs arriving in order and needs no data movement. It is expected that the
+ * number of PN ranges needed at any given time will generally be small.
  *
  * Invariant: The data structure is always sorted in ascending order by PN.
  *
@@ -435,232 +523,127 @@ tx_pkt_history_remove(struct tx_pkt_history_st *h, uint64_t pkt_num)
  * used to update the state of the RX side of the ACK manager by bumping the
  * watermark accordingly.
  */
-struct pn_set_item_st {
-    struct pn_set_item_st *prev, *next;
-    OSSL_QUIC_ACK_RANGE    range;
-};
-
+/*
+ * The PN set is kept as a sorted array of disjoint, non-adjacent ranges in
+ * ascending order. Since the number of ranges is bounded (see
+ * MAX_RX_ACK_RANGES), this is compact and cache-friendly; lookup is by binary
+ * search, and the common case of appending at the end needs no data movement.
+ */
 struct pn_set_st {
-    struct pn_set_item_st *head, *tail;
+    OSSL_QUIC_ACK_RANGE   *ranges;
 
-    /* Number of ranges (not PNs) in the set. */
-    size_t                 num_ranges;
+    /* Number of ranges (not PNs) in the set, and allocated capacity. */
+    size_t                 num_ranges, alloc_ranges;
 };
 
+#define PN_SET_MIN_ALLOC    8
+
 static void pn_set_init(struct pn_set_st *s)
 {
-    s->head = s->tail = NULL;
-    s->num_ranges = 0;
+    s->ranges       = NULL;
+    s->num_ranges   = 0;
+    s->alloc_ranges = 0;
 }
 
 static void pn_set_destroy(struct pn_set_st *s)
 {
-    struct pn_set_item_st *x, *xnext;
-
-    for (x = s->head; x != NULL; x = xnext) {
-        xnext = x->next;
-        OPENSSL_free(x);
-    }
+    OPENSSL_free(s->ranges);
+    s->ranges = NULL;
+    s->num_ranges = s->alloc_ranges = 0;
 }
 
-/* Possible merge of x, x->prev */
-static void pn_set_merge_adjacent(struct pn_set_st *s, struct pn_set_item_st *x)
+/* Ensure space for at least n ranges. */
+static int pn_set_reserve(struct pn_set_st *s, size_t n)
 {
-    struct pn_set_item_st *xprev = x->prev;
+    OSSL_QUIC_ACK_RANGE *ranges;
+    size_t alloc = s->alloc_ranges;
 
-    if (xprev == NULL)
-        return;
+    if (n <= alloc)
+        return 1;
 
-    if (x->range.start - 1 != xprev->range.end)
-        return;
+    if (alloc < PN_SET_MIN_ALLOC)
+        alloc = PN_SET_MIN_ALLOC;
 
-    x->range.start = xprev->range.start;
-    x->prev = xprev->prev;
-    if (x->prev != NULL)
-        x->prev->next = x;
+    while (alloc < n)
+        alloc *= 2;
 
-    if (s->head == xprev)
-        s->head = x;
+    ranges = OPENSSL_realloc(s->ranges, sizeof(OSSL_QUIC_ACK_RANGE) * alloc);
+    if (ranges == NULL)
+        return 0;
 
-    OPENSSL_free(xprev);
-    --s->num_ranges;
+    s->ranges       = ranges;
+    s->alloc_ranges = alloc;
+    return 1;
 }
 
-/* Returns 1 if there exists a PN x which falls within both ranges a and b. */
-static int pn_range_overlaps(const OSSL_QUIC_ACK_RANGE *a,
-                             const OSSL_QUIC_ACK_RANGE *b)
+/* Returns the index of the first range whose end is >= pn. */
+static size_t pn_set_lower_bound(const struct pn_set_st *s, QUIC_PN pn)
 {
-    return ossl_quic_pn_min(a->end, b->end)
-        >= ossl_quic_pn_max(a->start, b->start);
+    size_t lo = 0, hi = s->num_ranges, mid;
+
+    /* Fast path: most operations are at or beyond the end. */
+    if (hi == 0 || s->ranges[hi - 1].end < pn)
+        return hi;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (s->ranges[mid].end < pn)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
 }
 
 /*
- * Insert a range into a PN set. Returns 0 on allocation failure, in which case
- * the PN set is in a valid but undefined state. Otherwise, returns 1. Ranges
- * can overlap existing ranges without limitation. If a range is a subset of
- * an existing range in the set, this is a no-op and returns 1.
+ * Replace the ranges [i, j) with the n ranges in repl. Capacity must already
+ * be sufficient.
  */
-static int pn_set_insert(struct pn_set_st *s, const OSSL_QUIC_ACK_RANGE *range)
+static void pn_set_splice(struct pn_set_st *s, size_t i, size_t j,
+                          const OSSL_QUIC_ACK_RANGE *repl, size_t n)
 {
-    struct pn_set_item_st *x, *z, *xnext, *f, *fnext;
-    QUIC_PN start = range->start, end = range->end;
+    if (j - i != n)
+        memmove(&s->ranges[i + n], &s->ranges[j],
+                sizeof(OSSL_QUIC_ACK_RANGE) * (s->num_ranges - j));
 
-    if (!ossl_assert(start <= end))
-        return 0;
+    if (n > 0)
+        memcpy(&s->ranges[i], repl, sizeof(OSSL_QUIC_ACK_RANGE) * n);
 
-    if (s->head == NULL) {
-        /* Nothing in the set yet, so just add this range. */
-        x = OPENSSL_zalloc(sizeof(struct pn_set_item_st));
-        if (x == NULL)
-            return 0;
-
-        x->range.start = start;
-        x->range.end   = end;
-        s->head = s->tail = x;
-        ++s->num_ranges;
-        return 1;
-    }
-
-    if (start > s->tail->range.end) {
-        /*
-         * Range is after the latest range in the set, so append.
-         *
-         * Note: The case where the range is before the earliest range in the
-         * set is handled as a degenerate case of the final case below. See
-         * optimization note (*) below.
-         */
-        if (s->tail->range.end + 1 == start) {
-            s->tail->range.end = end;
-            return 1;
-        }
-
-        x = OPENSSL_zalloc(sizeof(struct pn_set_item_st));
-        if (x == NULL)
-            return 0;
-
-        x->range.start = start;
-        x->range.end   = end;
-        x->prev        = s->tail;
-        if (s->tail != NULL)
-            s->tail->next = x;
-        s->tail = x;
-        ++s->num_ranges;
-        return 1;
-    }
+    s->num_ranges = s->num_ranges - (j - i) + n;
+}
 
-    if (start <= s->head->range.start && end >= s->tail->range.end) {
-        /*
-         * New range dwarfs all ranges in our set.
-         *
-         * Free everything except the first range in the set, which we scavenge
-         * and reuse.
-         */
-        for (x = s->head->next; x != NULL; x = xnext) {
-            xnext = x->next;
-            OPENSSL_free(x);
-        }
+/*
+ * Insert a range into a PN set. Returns 0 on allocation failure, in which case
+ * the PN set is unchanged. Otherwise, returns 1. Ranges can overlap existing
+ * ranges without limitation. If a range is a subset of an existing range in
+ * the set, this is a no-op and returns 1.
+ */
+static int pn_set_insert(struct pn_set_st *s, const OSSL_QUIC_ACK_RANGE *range)
+{
+    OSSL_QUIC_ACK_RANGE t = *range;
+    size_t i, j;
 
-        s->head->range.start = start;
-        s->head->range.end   = end;
-        s->head->next = s->head->prev = NULL;
-        s->tail = s->head;
-        s->num_ranges = 1;
-        return 1;
-    }
+    if (!ossl_assert(t.start <= t.end))
+        return 0;
 
     /*
-     * Walk backwards since we will most often be inserting at the end. As an
-     * optimization, test the head node first and skip iterating over the
-     * entire list if we are inserting at the start. The assumption is that
-     * insertion at the start and end of the space will be the most common
-     * operations. (*)
+     * Find the ranges [i, j) which overlap or are adjacent to the new range;
+     * these are all merged with it.
      */
-    z = end < s->head->range.start ? s->head : s->tail;
-
-    for (; z != NULL; z = z->prev) {
-        /* An existing range dwarfs our new range (optimisation). */
-        if (z->range.start <= start && z->range.end >= end)
-            return 1;
+    i = pn_set_lower_bound(s, t.start > 0 ? t.start - 1 : 0);
+    for (j = i; j < s->num_ranges && s->ranges[j].start <= t.end + 1; ++j);
 
-        if (pn_range_overlaps(&z->range, range)) {
-            /*
-             * Our new range overlaps an existing range, or possibly several
-             * existing ranges.
-             */
-            struct pn_set_item_st *ovend = z;
-            OSSL_QUIC_ACK_RANGE t;
-            size_t n = 0;
-
-            t.end = ossl_quic_pn_max(end, z->range.end);
-
-            /* Get earliest overlapping range. */
-            for (; z->prev != NULL && pn_range_overlaps(&z->prev->range, range);
-                   z = z->prev);
-
-            t.start = ossl_quic_pn_min(start, z->range.start);
-
-            /* Replace sequence of nodes z..ovend with ovend only. */
-            ovend->range = t;
-            ovend->prev = z->prev;
-            if (z->prev != NULL)
-                z->prev->next = ovend;
-            if (s->head == z)
-                s->head = ovend;
-
-            /* Free now unused nodes. */
-            for (f = z; f != ovend; f = fnext, ++n) {
-                fnext = f->next;
-                OPENSSL_free(f);
-            }
-
-            s->num_ranges -= n;
-            break;
-        } else if (end < z->range.start
-                    && (z->prev == NULL || start > z->prev->range.end)) {
-            if (z->range.start == end + 1) {
-                /* We can extend the following range backwards. */
-                z->range.start = start;
-
-                /*
-                 * If this closes a gap we now need to merge
-                 * consecutive nodes.
-                 */
-                pn_set_merge_adjacent(s, z);
-            } else if (z->prev != NULL && z->prev->range.end + 1 == start) {
-                /* We can extend the preceding range forwards. */
-                z->prev->range.end = end;
-
-                /*
-                 * If this closes a gap we now need to merge
-                 * consecutive nodes.
-                 */
-                pn_set_merge_adjacent(s, z);
-            } else {
-                /*
-                 * The new interval is between intervals without overlapping or
-                 * touching them, so insert between, preserving sort.
-                 */
-                x = OPENSSL_zalloc(sizeof(struct pn_set_item_st));
-                if (x == NULL)
-                    return 0;
-
-                x->range.start = start;
-                x->range.end   = end;
-
-                x->next = z;
-                x->prev = z->prev;
-                if (x->prev != NULL)
-                    x->prev->next = x;
-                z->prev = x;
-                if (s->head == z)
-                    s->head = x;
-
-                ++s->num_ranges;
-            }
-            break;
-        }
+    if (i == j) {
+        /* Nothing to merge with, so insert a new range. */
+        if (!pn_set_reserve(s, s->num_ranges + 1))
+            return 0;
+    } else {
+        t.start = ossl_quic_pn_min(t.start, s->ranges[i].start);
+        t.end   = ossl_quic_pn_max(t.end, s->ranges[j - 1].end);
     }
 
+    pn_set_splice(s, i, j, &t, 1);
     return 1;
 }
 
@@ -672,103 +655,47 @@ static int pn_set_insert(struct pn_set_st *s, const OSSL_QUIC_ACK_RANGE *range)
  */
 static int pn_set_remove(struct pn_set_st *s, const OSSL_QUIC_ACK_RANGE *range)
 {
-    struct pn_set_item_st *z, *zprev, *y;
+    OSSL_QUIC_ACK_RANGE keep[2];
     QUIC_PN start = range->start, end = range->end;
+    size_t i, j, n = 0;
 
     if (!ossl_assert(start <= end))
         return 0;
 
-    /* Walk backwards since we will most often be removing at the end. */
-    for (z = s->tail; z != NULL; z = zprev) {
-        zprev = z->prev;
-
-        if (start > z->range.end)
-            /* No overlapping ranges can exist beyond this point, so stop. */
-            break;
-
-        if (start <= z->range.start && end >= z->range.end) {
-            /*
-             * The range being removed dwarfs this range, so it should be
-             * removed.
-             */
-            if (z->next != NULL)
-                z->next->prev = z->prev;
-            if (z->prev != NULL)
-                z->prev->next = z->next;
-            if (s->head == z)
-                s->head = z->next;
-            if (s->tail == z)
-                s->tail = z->prev;
-
-            OPENSSL_free(z);
-            --s->num_ranges;
-        } else if (start <= z->range.start) {
-            /*
-             * The range being removed includes start of this range, but does
-             * not cover the entire range (as this would be caught by the case
-             * above). Shorten the range.
-             */
-            assert(end < z->range.end);
-            z->range.start = end + 1;
-        } else if (end >= z->range.end) {
-            /*
-             * The range being removed includes the end of this range, but does
-             * not cover the entire range (as this would be caught by the case
-             * above). Shorten the range. We can also stop iterating.
-             */
-            assert(start > z->range.start);
-            assert(start > 0);
-            z->range.end = start - 1;
-            break;
-        } else if (start > z->range.start && end < z->range.end) {
-            /*
-             * The range being removed falls entirely in this range, so cut it
-             * into two. Cases where a zero-length range would be created are
-             * handled by the above cases.
-             */
-            y = OPENSSL_zalloc(sizeof(struct pn_set_item_st));
-            if (y == NULL)
-                return 0;
-
-            y->range.end   = z->range.end;
-            y->range.start = end + 1;
-            y->next = z->next;
-            y->prev = z;
-            if (y->next != NULL)
-                y->next->prev = y;
+    /* Find the ranges [i, j) which overlap the range being removed. */
+    i = pn_set_lower_bound(s, start);
+    for (j = i; j < s->num_ranges && s->ranges[j].start <= end; ++j);
 
-            z->range.end = start - 1;
-            z->next = y;
+    if (i == j)
+        return 1;
 
-            if (s->tail == z)
-                s->tail = y;
+    /* Keep any parts of the first and last ranges outside the removed range. */
+    if (s->ranges[i].start < start) {
+        keep[n].start = s->ranges[i].start;
+        keep[n].end   = start - 1;
+        ++n;
+    }
 
-            ++s->num_ranges;
-            break;
-        } else {
-            /* Assert no partial overlap; all cases should be covered above. */
-            assert(!pn_range_overlaps(&z->range, range));
-        }
+    if (s->ranges[j - 1].end > end) {
+        keep[n].start = end + 1;
+        keep[n].end   = s->ranges[j - 1].end;
+        ++n;
     }
 
-     return 1;
+    /* Cutting a range in two needs an extra slot. */
+    if (n > j - i && !pn_set_reserve(s, s->num_ranges + n - (j - i)))
+        return 0;
+
+    pn_set_splice(s, i, j, keep, n);
+    return 1;
 }
 
 /* Returns 1 iff the given PN is in the PN set. */
 static int pn_set_query(const struct pn_set_st *s, QUIC_PN pn)
 {
-    struct pn_set_item_st *x;
-
-    if (s->head == NULL)
-        return 0;
-
-    for (x = s->tail; x != NULL; x = x->prev)
-        if (x->range.start <= pn && x->range.end >= pn)
-            return 1;
-        else if (x->range.end < pn)
-            return 0;
+    size_t i = pn_set_lower_bound(s, pn);
 
-    return 0;
+    return i < s->num_ranges && s->ranges[i].start <= pn;
 }
 
 struct rx_pkt_history_st {
@@ -806,7 +733,7 @@ static void rx_pkt_history_trim_range_count(struct rx_pkt_history_st *h)
     QUIC_PN highest = QUIC_PN_INVALID;
 
     while (h->set.num_ranges > MAX_RX_ACK_RANGES) {
-        OSSL_QUIC_ACK_RANGE r = h->set.head->range;
+        OSSL_QUIC_ACK_RANGE r = h->set.ranges[0];
 
         highest = (highest == QUIC_PN_INVALID)
             ? r.end : ossl_quic_pn_max(highest, r.end);
@@ -869,6 +796,7 @@ static int rx_pkt_history_bump_watermark(struct rx_pkt_history_st *h,
 #define K_PKT_THRESHOLD         3
 #define K_TIME_THRESHOLD_NUM    9
 #define K_TIME_THRESHOLD_DEN    8
+#define K_PERSISTENT_CONGESTION_THRESHOLD   3
 
 /* The maximum number of times we allow PTO to be doubled. */
 #define MAX_PTO_COUNT          16
@@ -1029,17 +957,19 @@ static int range_contains(const OSSL_QUIC_ACK_RANGE *range, QUIC_PN pn)
 }
 
 /*
- * Given a logical representation of an ACK frame 'ack', create a singly-linked
- * list of the newly ACK'd frames; that is, of frames which are matched by the
- * list of PN ranges contained in the ACK frame. The packet structures in the
- * list returned are removed from the TX history list. Returns a pointer to the
- * list head (or NULL) if empty.
+ * Given a logical representation of an ACK frame 'ack', find the newly ACK'd
+ * frames; that is, frames which are matched by the list of PN ranges contained
+ * in the ACK frame. They are removed from the TX history list and appended, in
+ * descending PN order, to the singly-linked list whose terminating anext
+ * pointer is *pfixup, which is updated to point to the new terminator. Returns
+ * the first packet appended, or NULL if none were.
  */
 static OSSL_ACKM_TX_PKT *ackm_detect_and_remove_newly_acked_pkts(OSSL_ACKM *ackm,
                                                                  const OSSL_QUIC_FRAME_ACK *ack,
-                                                                 int pkt_space)
+                                                                 int pkt_space,
+                                                                 OSSL_ACKM_TX_PKT ***pfixup)
 {
-    OSSL_ACKM_TX_PKT *acked_pkts = NULL, **fixup = &acked_pkts, *pkt, *pprev;
+    OSSL_ACKM_TX_PKT *acked_pkts = NULL, **fixup = *pfixup, *pkt, *pprev;
     struct tx_pkt_history_st *h;
     size_t ridx = 0;
 
@@ -1053,14 +983,12 @@ static OSSL_ACKM_TX_PKT *ackm_detect_and_remove_newly_acked_pkts(OSSL_ACKM *ackm
      *
      * Walk through our history list from the end in order to efficiently detect
      * membership in the specified ack ranges. As an optimization, we use our
-     * hashtable to try and skip to the first matching packet. This may fail if
-     * the ACK ranges given include nonexistent packets.
+     * packet number index to skip directly to the first candidate packet, and
+     * to skip over packets falling in the gaps between ranges.
      */
     h = get_tx_history(ackm, pkt_space);
 
-    pkt = tx_pkt_history_by_pkt_num(h, ack->ack_ranges[0].end);
-    if (pkt == NULL)
-        pkt = h->tail;
+    pkt = tx_pkt_history_find_le(h, ack->ack_ranges[0].end, NULL);
 
     for (; pkt != NULL; pkt = pprev) {
         /*
@@ -1082,6 +1010,9 @@ static OSSL_ACKM_TX_PKT *ackm_detect_and_remove_newly_acked_pkts(OSSL_ACKM *ackm
                 /* We have matched this range. */
                 tx_pkt_history_remove(h, pkt->pkt_num);
 
+                if (acked_pkts == NULL)
+                    acked_pkts = pkt;
+
                 *fixup = pkt;
                 fixup = &pkt->anext;
                 *fixup = NULL;
@@ -1089,8 +1020,10 @@ static OSSL_ACKM_TX_PKT *ackm_detect_and_remove_newly_acked_pkts(OSSL_ACKM *ackm
             } else if (pkt->pkt_num > ack->ack_ranges[ridx].end) {
                 /*
                  * We have not reached this range yet in our list, so do not
-                 * advance ridx.
+                 * advance ridx, but skip to the last packet it may contain.
                  */
+                pprev = tx_pkt_history_find_le(h, ack->ack_ranges[ridx].end,
+                                               pkt);
                 break;
             } else {
                 /*
@@ -1103,7 +1036,7 @@ static OSSL_ACKM_TX_PKT *ackm_detect_and_remove_newly_acked_pkts(OSSL_ACKM *ackm
         }
     }
 stop:
-
+    *pfixup = fixup;
     return acked_pkts;
 }
 
@@ -1150,8 +1083,9 @@ static OSSL_ACKM_TX_PKT *ackm_detect_and_remove_lost_pkts(OSSL_ACKM *ackm,
          */
         pnext = pkt->next;
 
+        /* The list is in ascending order, so nothing after this is lost. */
         if (pkt->pkt_num > ackm->largest_acked_pkt[pkt_space])
-            continue;
+            break;
 
         /*
          * Mark packet as lost, or set time when it should be marked.
@@ -1165,13 +1099,15 @@ static OSSL_ACKM_TX_PKT *ackm_detect_and_remove_lost_pkts(OSSL_ACKM *ackm,
             fixup = &pkt->lnext;
             *fixup = NULL;
         } else {
-            if (ossl_time_is_zero(ackm->loss_time[pkt_space]))
-                ackm->loss_time[pkt_space] =
-                    ossl_time_add(pkt->time, loss_delay);
-            else
-                ackm->loss_time[pkt_space] =
-                    ossl_time_min(ackm->loss_time[pkt_space],
-                                  ossl_time_add(pkt->time, loss_delay));
+            /*
+             * Packets are sent in ascending PN order with non-decreasing send
+             * times, so neither threshold can be met by any later packet, and
+             * this packet is the first which may be lost by the time
+             * threshold. Stop here rather than walking every outstanding
+             * packet below the largest acknowledged PN.
+             */
+            ackm->loss_time[pkt_space] = ossl_time_add(pkt->time, loss_delay);
+            break;
         }
     }
 
@@ -1289,13 +1225,66 @@ static int ackm_set_loss_detection_timer(OSSL_ACKM *ackm)
     return 1;
 }
 
+/*
+ * Determines whether a list of newly lost packets establishes persistent
+ * congestion (RFC 9002 s. 7.6). This is the case if two ack-eliciting packets,
+ * both sent after we got our first RTT sample, were lost and the time between
+ * their transmission exceeds the persistent congestion duration, and no packet
+ * sent between them was acknowledged. Since every packet we send is recorded in
+ * the TX history until it is acked or lost, the last condition holds if the
+ * lost packets span a contiguous range of PNs.
+ */
 static int ackm_in_persistent_congestion(OSSL_ACKM *ackm,
                                          const OSSL_ACKM_TX_PKT *lpkt)
 {
-    /* Persistent congestion not currently implemented. */
+    const OSSL_ACKM_TX_PKT *p, *first = NULL;
+    OSSL_RTT_INFO rtt;
+    OSSL_TIME duration;
+    QUIC_PN prev_pn = QUIC_PN_INVALID;
+
+    if (ossl_time_is_zero(ackm->first_rtt_sample))
+        return 0;
+
+    ossl_statm_get_rtt_info(ackm->statm, &rtt);
+
+    duration
+        = ossl_time_add(rtt.smoothed_rtt,
+                        ossl_time_max(ossl_time_multiply(rtt.rtt_variance, 4),
+                                      ossl_ticks2time(K_GRANULARITY)));
+
+    if (!ossl_time_is_infinite(rtt.max_ack_delay))
+        duration = ossl_time_add(duration, rtt.max_ack_delay);
+
+    duration = ossl_time_multiply(duration, K_PERSISTENT_CONGESTION_THRESHOLD);
+
+    /* The list of lost packets is in ascending PN order. */
+    for (p = lpkt; p != NULL; p = p->lnext) {
+        if (prev_pn != QUIC_PN_INVALID && p->pkt_num != prev_pn + 1)
+            first = NULL;
+
+        prev_pn = p->pkt_num;
+
+        if (!p->is_ack_eliciting
+            || ossl_time_compare(p->time, ackm->first_rtt_sample) < 0)
+            continue;
+
+        if (first == NULL)
+            first = p;
+        else if (ossl_time_compare(ossl_time_subtract(p->time, first->time),
+                                   duration) > 0)
+            return 1;
+    }
+
     return 0;
 }
 
+/* Traces the RTT estimate, congestion window and bytes in flight. */
+#define ACKM_QLOG_METRICS(ackm)                                             \
+    QLOG_EVENT(metrics_updated,                                             \
+               ((ackm), (ackm)->now((ackm)->now_arg), (ackm)->statm,         \
+                (ackm)->cc_method->get_bytes_in_flight_max((ackm)->cc_data), \
+                (ackm)->bytes_in_flight))
+
 static void ackm_on_pkts_lost(OSSL_ACKM *ackm, int pkt_space,
                               const OSSL_ACKM_TX_PKT *lpkt)
 {
@@ -1303,6 +1292,10 @@ static void ackm_on_pkts_lost(OSSL_ACKM *ackm, int pkt_space,
     OSSL_RTT_INFO rtt;
     QUIC_PN largest_pn_lost = 0;
     uint64_t num_bytes = 0;
+    int in_persistent_congestion;
+
+    /* This must be done before on_lost is called, as it may free packets. */
+    in_persistent_congestion = ackm_in_persistent_congestion(ackm, lpkt);
 
     for (p = lpkt; p != NULL; p = pnext) {
         pnext = p->lnext;
@@ -1319,6 +1312,8 @@ static void ackm_on_pkts_lost(OSSL_ACKM *ackm, int pkt_space,
             num_bytes += p->num_bytes;
         }
 
+        QLOG_EVENT(packet_lost, (ackm, ackm->now(ackm->now_arg), p->pkt_space,
+                                 p->pkt_num));
         p->on_lost(p->cb_arg);
     }
 
@@ -1335,7 +1330,7 @@ static void ackm_on_pkts_lost(OSSL_ACKM *ackm, int pkt_space,
         largest_pn_lost,
         ackm->tx_history[pkt_space].highest_sent,
         num_bytes,
-        ackm_in_persistent_congestion(ackm, lpkt));
+        in_persistent_congestion);
 }
 
 static void ackm_on_pkts_acked(OSSL_ACKM *ackm, const OSSL_ACKM_TX_PKT *apkt)
@@ -1414,6 +1409,20 @@ err:
     return NULL;
 }
 
+void ossl_ackm_set_path_state(OSSL_ACKM *ackm, OSSL_STATM *statm,
+                              OSSL_CC_DATA *cc_data)
+{
+    if (cc_data != ackm->cc_data && ackm->bytes_in_flight > 0) {
+        ackm->cc_method->on_data_invalidated(ackm->cc_data,
+                                             (size_t)ackm->bytes_in_flight);
+        ackm->cc_method->on_data_sent(cc_data, (size_t)ackm->bytes_in_flight);
+    }
+
+    ackm->statm     = statm;
+    ackm->cc_data   = cc_data;
+    ackm_set_loss_detection_timer(ackm);
+}
+
 void ossl_ackm_free(OSSL_ACKM *ackm)
 {
     size_t i;
@@ -1469,17 +1478,22 @@ int ossl_ackm_on_rx_datagram(OSSL_ACKM *ackm, size_t num_bytes)
     return 1;
 }
 
-static void ackm_on_congestion(OSSL_ACKM *ackm, OSSL_TIME send_time)
+/*
+ * Signals a congestion event which was not caused by loss. The congestion
+ * controller determines whether this starts a new recovery period by comparing
+ * |pkt_num| against the largest PN sent when the current one started.
+ */
+static void ackm_on_congestion(OSSL_ACKM *ackm, int pkt_space, QUIC_PN pkt_num)
 {
-    /* Not currently implemented. */
+    ackm->cc_method->on_data_lost(ackm->cc_data,
+        pkt_num,
+        ackm->tx_history[pkt_space].highest_sent,
+        0, 0);
 }
 
 static void ackm_process_ecn(OSSL_ACKM *ackm, const OSSL_QUIC_FRAME_ACK *ack,
                              int pkt_space)
 {
-    struct tx_pkt_history_st *h;
-    OSSL_ACKM_TX_PKT *pkt;
-
     /*
      * If the ECN-CE counter reported by the peer has increased, this could
      * be a new congestion event.
@@ -1487,42 +1501,79 @@ static void ackm_process_ecn(OSSL_ACKM *ackm, const OSSL_QUIC_FRAME_ACK *ack,
     if (ack->ecnce > ackm->peer_ecnce[pkt_space]) {
         ackm->peer_ecnce[pkt_space] = ack->ecnce;
 
-        h = get_tx_history(ackm, pkt_space);
-        pkt = tx_pkt_history_by_pkt_num(h, ack->ack_ranges[0].end);
-        if (pkt == NULL)
-            return;
-
-        ackm_on_congestion(ackm, pkt->time);
+        ackm_on_congestion(ackm, pkt_space, ack->ack_ranges[0].end);
     }
 }
 
 int ossl_ackm_on_rx_ack_frame(OSSL_ACKM *ackm, const OSSL_QUIC_FRAME_ACK *ack,
                               int pkt_space, OSSL_TIME rx_time)
 {
-    OSSL_ACKM_TX_PKT *na_pkts, *lost_pkts;
+    return ossl_ackm_on_rx_ack_frames(ackm, ack, 1, pkt_space, rx_time);
+}
+
+int ossl_ackm_on_rx_ack_frames(OSSL_ACKM *ackm,
+                               const OSSL_QUIC_FRAME_ACK *acks, size_t num_acks,
+                               int pkt_space, OSSL_TIME rx_time)
+{
+    OSSL_ACKM_TX_PKT *na_pkts = NULL, **na_fixup = &na_pkts, *pkts, *lost_pkts;
+    OSSL_ACKM_TX_PKT *rtt_pkt = NULL;
+    const OSSL_QUIC_FRAME_ACK *ack, *rtt_ack = NULL;
+    size_t i;
     int must_set_timer = 0;
 
-    if (ackm->largest_acked_pkt[pkt_space] == QUIC_PN_INVALID)
-        ackm->largest_acked_pkt[pkt_space] = ack->ack_ranges[0].end;
-    else
-        ackm->largest_acked_pkt[pkt_space]
-            = ossl_quic_pn_max(ackm->largest_acked_pkt[pkt_space],
-                               ack->ack_ranges[0].end);
+    /*
+     * Validate the whole batch before acting on any of it, so that a malformed
+     * frame does not leave packets removed from the history but never
+     * processed.
+     */
+    for (i = 0; i < num_acks; ++i)
+        if (acks[i].num_ack_ranges == 0)
+            return 0;
+
+    for (i = 0; i < num_acks; ++i) {
+        ack = &acks[i];
+
+        if (ackm->largest_acked_pkt[pkt_space] == QUIC_PN_INVALID)
+            ackm->largest_acked_pkt[pkt_space] = ack->ack_ranges[0].end;
+        else
+            ackm->largest_acked_pkt[pkt_space]
+                = ossl_quic_pn_max(ackm->largest_acked_pkt[pkt_space],
+                                   ack->ack_ranges[0].end);
+
+        /*
+         * Find packets that are newly acknowledged, remove them from the
+         * history and append them to the list for the whole batch.
+         */
+        pkts = ackm_detect_and_remove_newly_acked_pkts(ackm, ack, pkt_space,
+                                                       &na_fixup);
+        if (pkts == NULL)
+            continue;
+
+        /*
+         * An RTT sample can be taken if the largest acknowledged PN of a frame
+         * is newly acked and at least one ACK-eliciting packet was newly acked
+         * by that frame. The first packet appended is always the one with the
+         * largest PN. Of the frames in the batch which qualify, only the one
+         * with the largest PN is used, as the others are older information.
+         */
+        if (pkts->pkt_num == ack->ack_ranges[0].end
+            && ack_includes_ack_eliciting(pkts)
+            && (rtt_pkt == NULL || pkts->pkt_num > rtt_pkt->pkt_num)) {
+            rtt_pkt = pkts;
+            rtt_ack = ack;
+        }
+    }
 
     /*
      * If we get an ACK in the handshake space, address validation is completed.
      * Make sure we update the timer, even if no packets were ACK'd.
      */
-    if (!ackm->peer_completed_addr_validation
+    if (num_acks > 0 && !ackm->peer_completed_addr_validation
             && pkt_space == QUIC_PN_SPACE_HANDSHAKE) {
         ackm->peer_completed_addr_validation = 1;
         must_set_timer = 1;
     }
 
-    /*
-     * Find packets that are newly acknowledged and remove them from the list.
-     */
-    na_pkts = ackm_detect_and_remove_newly_acked_pkts(ackm, ack, pkt_space);
     if (na_pkts == NULL) {
         if (must_set_timer)
             ackm_set_loss_detection_timer(ackm);
@@ -1530,20 +1581,14 @@ int ossl_ackm_on_rx_ack_frame(OSSL_ACKM *ackm, const OSSL_QUIC_FRAME_ACK *ack,
         return 1;
     }
 
-    /*
-     * Update the RTT if the largest acknowledged is newly acked and at least
-     * one ACK-eliciting packet was newly acked.
-     *
-     * First packet in the list is always the one with the largest PN.
-     */
-    if (na_pkts->pkt_num == ack->ack_ranges[0].end &&
-        ack_includes_ack_eliciting(na_pkts)) {
+    /* Update the RTT. */
+    if (rtt_pkt != NULL) {
         OSSL_TIME now = ackm->now(ackm->now_arg), ack_delay;
         if (ossl_time_is_zero(ackm->first_rtt_sample))
             ackm->first_rtt_sample = now;
 
         /* Enforce maximum ACK delay. */
-        ack_delay = ack->delay_time;
+        ack_delay = rtt_ack->delay_time;
         if (ackm->handshake_confirmed) {
             OSSL_RTT_INFO rtt;
 
@@ -1552,14 +1597,20 @@ int ossl_ackm_on_rx_ack_frame(OSSL_ACKM *ackm, const OSSL_QUIC_FRAME_ACK *ack,
         }
 
         ossl_statm_update_rtt(ackm->statm, ack_delay,
-                              ossl_time_subtract(now, na_pkts->time));
+                              ossl_time_subtract(now, rtt_pkt->time));
+
+        if (ackm->cc_method->on_rtt_sample != NULL)
+            ackm->cc_method->on_rtt_sample(ackm->cc_data, now,
+                                           ossl_time_subtract(now,
+                                                              rtt_pkt->time));
     }
 
     /* Process ECN information if present. */
-    if (ack->ecn_present)
-        ackm_process_ecn(ackm, ack, pkt_space);
+    for (i = 0; i < num_acks; ++i)
+        if (acks[i].ecn_present)
+            ackm_process_ecn(ackm, &acks[i], pkt_space);
 
-    /* Handle inferred loss. */
+    /* Handle inferred loss, once for the whole batch. */
     lost_pkts = ackm_detect_and_remove_lost_pkts(ackm, pkt_space);
     if (lost_pkts != NULL)
         ackm_on_pkts_lost(ackm, pkt_space, lost_pkts);
@@ -1574,6 +1625,7 @@ int ossl_ackm_on_rx_ack_frame(OSSL_ACKM *ackm, const OSSL_QUIC_FRAME_ACK *ack,
         ackm->pto_count = 0;
 
     ackm_set_loss_detection_timer(ackm);
+    ACKM_QLOG_METRICS(ackm);
     return 1;
 }
 
@@ -1652,6 +1704,7 @@ int ossl_ackm_on_timeout(OSSL_ACKM *ackm)
         assert(lost_pkts != NULL);
         ackm_on_pkts_lost(ackm, pkt_space, lost_pkts);
         ackm_set_loss_detection_timer(ackm);
+        ACKM_QLOG_METRICS(ackm);
         return 1;
     }
 
@@ -1774,12 +1827,15 @@ static int ackm_is_missing(OSSL_ACKM *ackm, int pkt_space, QUIC_PN pkt_num)
 static int ackm_has_newly_missing(OSSL_ACKM *ackm, int pkt_space)
 {
     struct rx_pkt_history_st *h;
+    const OSSL_QUIC_ACK_RANGE *tail;
 
     h = get_rx_history(ackm, pkt_space);
 
-    if (h->set.tail == NULL)
+    if (h->set.num_ranges == 0)
         return 0;
 
+    tail = &h->set.ranges[h->set.num_ranges - 1];
+
     /*
      * The second condition here establishes that the highest PN range in our RX
      * history comprises only a single PN. If there is more than one, then this
@@ -1793,9 +1849,8 @@ static int ackm_has_newly_missing(OSSL_ACKM *ackm, int pkt_space)
      * the PNs we have ACK'd previously and the PN we have just received.
      */
     return ackm->ack[pkt_space].num_ack_ranges > 0
-        && h->set.tail->range.start == h->set.tail->range.end
-        && h->set.tail->range.start
-            > ackm->ack[pkt_space].ack_ranges[0].end + 1;
+        && tail->start == tail->end
+        && tail->start > ackm->ack[pkt_space].ack_ranges[0].end + 1;
 }
 
 static void ackm_set_flush_deadline(OSSL_ACKM *ackm, int pkt_space,
@@ -1936,17 +1991,15 @@ static void ackm_fill_rx_ack_ranges(OSSL_ACKM *ackm, int pkt_space,
                                     OSSL_QUIC_FRAME_ACK *ack)
 {
     struct rx_pkt_history_st *h = get_rx_history(ackm, pkt_space);
-    struct pn_set_item_st *x;
     size_t i = 0;
 
     /*
      * Copy out ranges from the PN set, starting at the end, until we reach our
      * maximum number of ranges.
      */
-    for (x = h->set.tail;
-         x != NULL && i < OSSL_NELEM(ackm->ack_ranges);
-         x = x->prev, ++i)
-        ackm->ack_ranges[pkt_space][i] = x->range;
+    for (; i < h->set.num_ranges && i < OSSL_NELEM(ackm->ack_ranges[0]); ++i)
+        ackm->ack_ranges[pkt_space][i]
+            = h->set.ranges[h->set.num_ranges - 1 - i];
 
     ack->ack_ranges     = ackm->ack_ranges[pkt_space];
     ack->num_ack_ranges = i;
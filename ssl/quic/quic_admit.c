@@ -0,0 +1,288 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/rand.h>
+#include "internal/quic_admit.h"
+#include "internal/common.h"
+
+struct quic_admit_st {
+    OSSL_TIME           (*now)(void *arg);
+    void                *now_arg;
+
+    /*
+     * Rate limit, disabled if interval is zero. Each slot holds the
+     * theoretical arrival time (TAT) of the next datagram under the generic
+     * cell rate algorithm: a datagram is admitted if it arrives no earlier than
+     * TAT - tau, and then advances the TAT by the emission interval. A slot
+     * whose TAT has passed has its full burst available.
+     */
+    OSSL_TIME           interval, tau;
+    size_t              v4_prefix_len, v6_prefix_len;
+    uint32_t            hash_key[2];
+    OSSL_TIME           *slots;
+
+    /* Handshake cap and Retry threshold. */
+    size_t              num_handshakes, max_handshakes, retry_threshold;
+    QUIC_TOKEN_ENGINE   *token_eng;
+
+    /* The handler admitted datagrams are passed to. */
+    QUIC_DEMUX              *demux;
+    ossl_quic_demux_cb_fn   *next_cb;
+    void                    *next_cb_arg;
+
+    QUIC_ADMIT_STATS    stats;
+};
+
+static void admit_filter(QUIC_URXE *e, void *arg);
+
+static OSSL_TIME get_time(QUIC_ADMIT *admit)
+{
+    if (admit->now == NULL)
+        return ossl_time_now();
+
+    return admit->now(admit->now_arg);
+}
+
+QUIC_ADMIT *ossl_quic_admit_new(OSSL_LIB_CTX *libctx,
+                                OSSL_TIME (*now)(void *arg), void *now_arg)
+{
+    QUIC_ADMIT *admit;
+
+    admit = OPENSSL_zalloc(sizeof(*admit));
+    if (admit == NULL)
+        return NULL;
+
+    admit->now              = now;
+    admit->now_arg          = now_arg;
+    admit->v4_prefix_len    = 24;
+    admit->v6_prefix_len    = 48;
+
+    /* The hash key stops sources choosing addresses which share a slot. */
+    if (RAND_bytes_ex(libctx, (unsigned char *)admit->hash_key,
+                      sizeof(admit->hash_key), 0) != 1) {
+        OPENSSL_free(admit);
+        return NULL;
+    }
+
+    return admit;
+}
+
+void ossl_quic_admit_free(QUIC_ADMIT *admit)
+{
+    if (admit == NULL)
+        return;
+
+    if (admit->demux != NULL) {
+        ossl_quic_demux_cb_fn *cb;
+        void *cb_arg;
+
+        /* Restore the handler we were placed in front of. */
+        ossl_quic_demux_get_default_handler(admit->demux, &cb, &cb_arg);
+        if (cb == admit_filter && cb_arg == admit)
+            ossl_quic_demux_set_default_handler(admit->demux, admit->next_cb,
+                                                admit->next_cb_arg);
+    }
+
+    OPENSSL_free(admit->slots);
+    OPENSSL_free(admit);
+}
+
+int ossl_quic_admit_set_rate_limit(QUIC_ADMIT *admit, uint64_t rate,
+                                   uint64_t burst, size_t v4_prefix_len,
+                                   size_t v6_prefix_len)
+{
+    uint64_t interval;
+
+    if (rate == 0) {
+        admit->interval = ossl_time_zero();
+        return 1;
+    }
+
+    if (burst == 0 || v4_prefix_len > 32 || v6_prefix_len > 128)
+        return 0;
+
+    if (admit->slots == NULL) {
+        admit->slots = OPENSSL_zalloc(sizeof(*admit->slots)
+                                      * QUIC_ADMIT_NUM_SLOTS);
+        if (admit->slots == NULL)
+            return 0;
+    }
+
+    interval = OSSL_TIME_SECOND / rate;
+    if (interval == 0)
+        interval = 1;
+
+    admit->interval         = ossl_ticks2time(interval);
+    admit->tau              = ossl_time_multiply(admit->interval, burst - 1);
+    admit->v4_prefix_len    = v4_prefix_len;
+    admit->v6_prefix_len    = v6_prefix_len;
+    return 1;
+}
+
+static void update_retry(QUIC_ADMIT *admit)
+{
+    if (admit->token_eng != NULL)
+        ossl_quic_token_engine_set_require_retry(admit->token_eng,
+                                                 admit->retry_threshold != 0
+                                                 && admit->num_handshakes
+                                                    >= admit->retry_threshold);
+}
+
+void ossl_quic_admit_set_max_handshakes(QUIC_ADMIT *admit,
+                                        size_t max_handshakes)
+{
+    admit->max_handshakes = max_handshakes;
+}
+
+void ossl_quic_admit_set_retry_threshold(QUIC_ADMIT *admit,
+                                         QUIC_TOKEN_ENGINE *eng,
+                                         size_t threshold)
+{
+    admit->token_eng        = eng;
+    admit->retry_threshold  = threshold;
+    update_retry(admit);
+}
+
+int ossl_quic_admit_install(QUIC_ADMIT *admit, QUIC_DEMUX *demux)
+{
+    ossl_quic_demux_cb_fn *cb;
+    void *cb_arg;
+
+    ossl_quic_demux_get_default_handler(demux, &cb, &cb_arg);
+    if (cb == NULL || cb == admit_filter || admit->demux != NULL)
+        return 0;
+
+    admit->demux        = demux;
+    admit->next_cb      = cb;
+    admit->next_cb_arg  = cb_arg;
+    ossl_quic_demux_set_default_handler(demux, admit_filter, admit);
+    return 1;
+}
+
+void ossl_quic_admit_on_handshake_start(QUIC_ADMIT *admit)
+{
+    ++admit->num_handshakes;
+    update_retry(admit);
+}
+
+void ossl_quic_admit_on_handshake_end(QUIC_ADMIT *admit)
+{
+    if (!ossl_assert(admit->num_handshakes > 0))
+        return;
+
+    --admit->num_handshakes;
+    update_retry(admit);
+}
+
+size_t ossl_quic_admit_get_num_handshakes(const QUIC_ADMIT *admit)
+{
+    return admit->num_handshakes;
+}
+
+void ossl_quic_admit_get_stats(const QUIC_ADMIT *admit,
+                               QUIC_ADMIT_STATS *stats)
+{
+    *stats = admit->stats;
+}
+
+/*
+ * Hashes the source address prefix of peer. This needs to be fast rather than
+ * cryptographically strong, as all it protects is the choice of slot.
+ */
+static uint32_t prefix_hash(QUIC_ADMIT *admit, const BIO_ADDR *peer)
+{
+    unsigned char addr[16];
+    size_t addr_len = 0, prefix_len = 0, i;
+    int family = BIO_ADDR_family(peer);
+    uint32_t h = admit->hash_key[0];
+
+    /* Sources which are not IP all share one slot. */
+    if (family != AF_UNSPEC
+        && BIO_ADDR_rawaddress(peer, NULL, &addr_len)
+        && (addr_len == 4 || addr_len == 16)
+        && BIO_ADDR_rawaddress(peer, addr, &addr_len))
+        prefix_len = addr_len == 4 ? admit->v4_prefix_len
+                                   : admit->v6_prefix_len;
+
+    /* Mask off the host part. */
+    if ((prefix_len & 7) != 0)
+        addr[prefix_len / 8] &= (unsigned char)(0xff00 >> (prefix_len & 7));
+
+    /* FNV-1a, with a final mix so that the low bits depend on every bit. */
+    h = (h ^ (uint32_t)family) * 16777619;
+    for (i = 0; i < (prefix_len + 7) / 8; ++i)
+        h = (h ^ addr[i]) * 16777619;
+
+    h ^= admit->hash_key[1];
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static int rate_limit_admit(QUIC_ADMIT *admit, const BIO_ADDR *peer)
+{
+    OSSL_TIME *tat = &admit->slots[prefix_hash(admit, peer)
+                                   & (QUIC_ADMIT_NUM_SLOTS - 1)];
+    OSSL_TIME now = get_time(admit);
+
+    /*
+     * Prefixes sharing a slot share a limit; unless the slot is in use by an
+     * active source, this has no effect.
+     */
+    if (ossl_time_compare(*tat, now) < 0)
+        *tat = now;
+
+    if (ossl_time_compare(*tat, ossl_time_add(now, admit->tau)) > 0)
+        return 0;
+
+    *tat = ossl_time_add(*tat, admit->interval);
+    return 1;
+}
+
+/* Returns 1 if the datagram begins with a QUIC v1 Initial packet. */
+static int is_initial(const QUIC_URXE *e)
+{
+    const unsigned char *p = ossl_quic_urxe_data(e);
+
+    /* Long header with the Initial type, and version 1. */
+    return e->data_len >= 5
+        && (p[0] & 0xb0) == 0x80
+        && p[1] == 0 && p[2] == 0 && p[3] == 0 && p[4] == 1;
+}
+
+static void admit_filter(QUIC_URXE *e, void *arg)
+{
+    QUIC_ADMIT *admit = arg;
+
+    if (is_initial(e)) {
+        if (admit->max_handshakes > 0
+            && admit->num_handshakes >= admit->max_handshakes) {
+            ++admit->stats.dropped_cap;
+            goto drop;
+        }
+
+        if (!ossl_time_is_zero(admit->interval)
+            && !rate_limit_admit(admit, &e->peer)) {
+            ++admit->stats.dropped_rate;
+            goto drop;
+        }
+
+        ++admit->stats.admitted;
+    }
+
+    admit->next_cb(e, admit->next_cb_arg);
+    return;
+
+drop:
+    ossl_quic_demux_release_urxe(admit->demux, e);
+}
@@ -5,6 +5,14 @@
 
 #define DEMUX_MAX_MSGS_PER_CALL    32
 
+/*
+ * When the network BIO coalesces received datagrams (GRO), each message may
+ * hold up to 64 KiB of datagrams, so we receive fewer, larger messages, each
+ * into its own large URXE, and split them afterwards.
+ */
+#define DEMUX_MAX_GRO_MSGS_PER_CALL 4
+#define DEMUX_GRO_MSG_LEN           65536
+
 void ossl_quic_urxe_remove(QUIC_URXE_LIST *l, QUIC_URXE *e)
 {
     /* Must be in list currently. */
@@ -110,6 +118,18 @@ struct quic_demux_st {
     /* Hashtable mapping connection IDs to QUIC_DEMUX_CONN structures. */
     LHASH_OF(QUIC_DEMUX_CONN)  *conns_by_id;
 
+    /*
+     * Optional pool from which URXEs are allocated. If NULL, URXEs are
+     * allocated from the heap. urxe_allocated records whether any URXE has
+     * been allocated, after which the pool may no longer be changed.
+     */
+    QUIC_SLAB_POOL             *pool;
+    char                        urxe_allocated;
+
+    /* Handler for datagrams not matching any registered connection ID. */
+    ossl_quic_demux_cb_fn      *default_cb;
+    void                       *default_cb_arg;
+
     /*
      * List of URXEs which are not currently in use (i.e., not filled with
      * unconsumed data). These are moved to the pending list as they are filled.
@@ -128,6 +148,26 @@ struct quic_demux_st {
 
     /* Whether to use local address support. */
     char                        use_local_addr;
+
+    /*
+     * Whether the network BIO may coalesce received datagrams. If so, we
+     * receive into large URXEs of DEMUX_GRO_MSG_LEN bytes, which are kept in
+     * urx_gro_free rather than urx_free while not in use.
+     */
+    char                        use_gro;
+    QUIC_URXE_LIST              urx_gro_free;
+    size_t                      num_urx_gro_free;
+
+    /*
+     * Large URXEs holding received messages not yet fully split into
+     * datagrams because we could not allocate enough URXEs for them, together
+     * with the segment size of each and the offset of the first datagram not
+     * yet split. They are split before anything more is read from the network.
+     */
+    QUIC_URXE                  *gro_held[DEMUX_MAX_GRO_MSGS_PER_CALL];
+    size_t                      gro_held_seg[DEMUX_MAX_GRO_MSGS_PER_CALL];
+    size_t                      gro_held_off[DEMUX_MAX_GRO_MSGS_PER_CALL];
+    size_t                      num_gro_held;
 };
 
 QUIC_DEMUX *ossl_quic_demux_new(BIO *net_bio,
@@ -160,6 +200,11 @@ QUIC_DEMUX *ossl_quic_demux_new(BIO *net_bio,
         && BIO_dgram_set_local_addr_enable(net_bio, 1))
         demux->use_local_addr = 1;
 
+    if (net_bio != NULL
+        && BIO_dgram_get_segment_cap(net_bio) > 0
+        && BIO_dgram_set_gro_enable(net_bio, 1))
+        demux->use_gro = 1;
+
     return demux;
 }
 
@@ -168,13 +213,21 @@ static void demux_free_conn_it(QUIC_DEMUX_CONN *conn, void *arg)
     OPENSSL_free(conn);
 }
 
-static void demux_free_urxl(QUIC_URXE_LIST *l)
+static void demux_free_urxe(QUIC_DEMUX *demux, QUIC_URXE *e)
+{
+    if (demux->pool != NULL)
+        ossl_quic_slab_free(demux->pool, e);
+    else
+        OPENSSL_free(e);
+}
+
+static void demux_free_urxl(QUIC_DEMUX *demux, QUIC_URXE_LIST *l)
 {
     QUIC_URXE *e, *enext;
 
     for (e = l->head; e != NULL; e = enext) {
         enext = e->next;
-        OPENSSL_free(e);
+        demux_free_urxe(demux, e);
     }
 
     l->head = l->tail = NULL;
@@ -182,6 +235,8 @@ static void demux_free_urxl(QUIC_URXE_LIST *l)
 
 void ossl_quic_demux_free(QUIC_DEMUX *demux)
 {
+    size_t i;
+
     if (demux == NULL)
         return;
 
@@ -190,8 +245,11 @@ void ossl_quic_demux_free(QUIC_DEMUX *demux)
     lh_QUIC_DEMUX_CONN_free(demux->conns_by_id);
 
     /* Free all URXEs we are holding. */
-    demux_free_urxl(&demux->urx_free);
-    demux_free_urxl(&demux->urx_pending);
+    demux_free_urxl(demux, &demux->urx_free);
+    demux_free_urxl(demux, &demux->urx_pending);
+    demux_free_urxl(demux, &demux->urx_gro_free);
+    for (i = 0; i < demux->num_gro_held; ++i)
+        demux_free_urxe(demux, demux->gro_held[i]);
 
     OPENSSL_free(demux);
 }
@@ -294,16 +352,27 @@ void ossl_quic_demux_unregister_by_cb(QUIC_DEMUX *demux,
     }
 }
 
-static QUIC_URXE *demux_alloc_urxe(size_t alloc_len)
+static QUIC_URXE *demux_alloc_urxe(QUIC_DEMUX *demux, size_t alloc_len)
 {
     QUIC_URXE *e;
 
     if (alloc_len >= SIZE_MAX - sizeof(QUIC_URXE))
         return NULL;
 
-    e = OPENSSL_malloc(sizeof(QUIC_URXE) + alloc_len);
-    if (e == NULL)
-        return NULL;
+    if (demux->pool != NULL) {
+        e = ossl_quic_slab_alloc(demux->pool, sizeof(QUIC_URXE) + alloc_len);
+        if (e == NULL)
+            return NULL;
+
+        /* Use all of the space the size class gives us. */
+        alloc_len = ossl_quic_slab_usable_size(e) - sizeof(QUIC_URXE);
+    } else {
+        e = OPENSSL_malloc(sizeof(QUIC_URXE) + alloc_len);
+        if (e == NULL)
+            return NULL;
+    }
+
+    demux->urxe_allocated = 1;
 
     e->prev = e->next   = NULL;
     e->alloc_len        = alloc_len;
@@ -316,7 +385,7 @@ static int demux_ensure_free_urxe(QUIC_DEMUX *demux, size_t min_num_free)
     QUIC_URXE *e;
 
     while (demux->num_urx_free < min_num_free) {
-        e = demux_alloc_urxe(demux->default_urxe_alloc_len);
+        e = demux_alloc_urxe(demux, demux->default_urxe_alloc_len);
         if (e == NULL)
             return 0;
 
@@ -327,6 +396,190 @@ static int demux_ensure_free_urxe(QUIC_DEMUX *demux, size_t min_num_free)
     return 1;
 }
 
+/*
+ * Return a URXE we own to the appropriate free list. Large URXEs used for
+ * receiving coalesced datagrams are kept apart so that they are not used to
+ * hold single datagrams; we keep only as many as one receive call needs.
+ */
+static void demux_urxe_to_free(QUIC_DEMUX *demux, QUIC_URXE *e)
+{
+    if (demux->use_gro && e->alloc_len >= DEMUX_GRO_MSG_LEN) {
+        if (demux->num_urx_gro_free >= DEMUX_MAX_GRO_MSGS_PER_CALL) {
+            demux_free_urxe(demux, e);
+            return;
+        }
+
+        ossl_quic_urxe_insert_tail(&demux->urx_gro_free, e);
+        ++demux->num_urx_gro_free;
+        return;
+    }
+
+    ossl_quic_urxe_insert_tail(&demux->urx_free, e);
+    ++demux->num_urx_free;
+}
+
+/* Move a URXE from the free list to the pending list holding the given data. */
+static void demux_copy_to_pending(QUIC_DEMUX *demux, const QUIC_URXE *src,
+                                  const unsigned char *data, size_t len)
+{
+    QUIC_URXE *urxe = demux->urx_free.head;
+
+    urxe->data_len  = len < urxe->alloc_len ? len : urxe->alloc_len;
+    urxe->peer      = src->peer;
+    urxe->local     = src->local;
+    urxe->time      = src->time;
+    memcpy(ossl_quic_urxe_data(urxe), data, urxe->data_len);
+
+    ossl_quic_urxe_remove(&demux->urx_free, urxe);
+    --demux->num_urx_free;
+    ossl_quic_urxe_insert_tail(&demux->urx_pending, urxe);
+}
+
+/*
+ * Split the i-th held message into its constituent datagrams and append them
+ * to the pending list. As for demux_recv, a datagram which does not fit into a
+ * URXE is truncated.
+ *
+ * Normally the first datagram stays in place in the large URXE and only the
+ * subsequent datagrams are copied, each into a URXE of its own, as URXE data
+ * is stored inline. If we cannot allocate URXEs for all of them, we instead
+ * copy out as many datagrams as we can, in order, and keep the rest of the
+ * message held, so that no datagram is lost and progress is made as URXEs are
+ * released to us.
+ *
+ * Returns 1 if the whole message has been split, or 0 if some of it remains.
+ */
+static int demux_split_gro_held_one(QUIC_DEMUX *demux, size_t i)
+{
+    QUIC_URXE *e = demux->gro_held[i];
+    const unsigned char *data = ossl_quic_urxe_data(e);
+    size_t off = demux->gro_held_off[i], seg = demux->gro_held_seg[i], len;
+
+    if (seg == 0 || seg > e->data_len)
+        seg = e->data_len;
+
+    if (off == 0
+        && demux_ensure_free_urxe(demux, seg > 0 ? (e->data_len - 1) / seg : 0)) {
+        ossl_quic_urxe_insert_tail(&demux->urx_pending, e);
+
+        for (off = seg; off < e->data_len; off += len) {
+            len = e->data_len - off;
+            if (len > seg)
+                len = seg;
+
+            demux_copy_to_pending(demux, e, data + off, len);
+        }
+
+        e->data_len = seg;
+        return 1;
+    }
+
+    for (; off < e->data_len; off += len) {
+        if (!demux_ensure_free_urxe(demux, 1)) {
+            demux->gro_held_off[i] = off;
+            return 0;
+        }
+
+        len = e->data_len - off;
+        if (len > seg)
+            len = seg;
+
+        demux_copy_to_pending(demux, e, data + off, len);
+    }
+
+    demux_urxe_to_free(demux, e);
+    return 1;
+}
+
+/*
+ * Split any held messages, in order. Returns 1 if none remain held.
+ */
+static int demux_split_gro_held(QUIC_DEMUX *demux)
+{
+    size_t i, j;
+
+    for (i = 0; i < demux->num_gro_held; ++i)
+        if (!demux_split_gro_held_one(demux, i))
+            break;
+
+    for (j = 0; i < demux->num_gro_held; ++i, ++j) {
+        demux->gro_held[j]      = demux->gro_held[i];
+        demux->gro_held_seg[j]  = demux->gro_held_seg[i];
+        demux->gro_held_off[j]  = demux->gro_held_off[i];
+    }
+
+    demux->num_gro_held = j;
+    return j == 0;
+}
+
+/*
+ * Receive datagrams from network when the BIO may coalesce them. Each message
+ * is received directly into a large URXE and then split into its constituent
+ * datagrams by demux_split_gro_held_one. Anything which cannot be split yet is
+ * held and split before anything more is received.
+ *
+ * Returns 1 on success or 0 on failure.
+ */
+static int demux_recv_gro(QUIC_DEMUX *demux)
+{
+    BIO_MSG msg[DEMUX_MAX_GRO_MSGS_PER_CALL];
+    size_t rd, i, n;
+    QUIC_URXE *urxe, *unext;
+    OSSL_TIME now;
+
+    /* Deliver anything held over from the last call before receiving more. */
+    if (!demux_split_gro_held(demux) || demux->urx_pending.head != NULL)
+        return demux->urx_pending.head != NULL;
+
+    while (demux->num_urx_gro_free < DEMUX_MAX_GRO_MSGS_PER_CALL) {
+        urxe = demux_alloc_urxe(demux, DEMUX_GRO_MSG_LEN);
+        if (urxe == NULL)
+            break;
+
+        ossl_quic_urxe_insert_tail(&demux->urx_gro_free, urxe);
+        ++demux->num_urx_gro_free;
+    }
+
+    urxe = demux->urx_gro_free.head;
+    for (n = 0; n < OSSL_NELEM(msg) && urxe != NULL; ++n, urxe = urxe->next) {
+        memset(&msg[n], 0, sizeof(BIO_MSG));
+        msg[n].data     = ossl_quic_urxe_data(urxe);
+        msg[n].data_len = urxe->alloc_len;
+        msg[n].peer     = &urxe->peer;
+        if (demux->use_local_addr)
+            msg[n].local = &urxe->local;
+        else
+            BIO_ADDR_clear(&urxe->local);
+    }
+
+    /* We need at least one URXE to receive into. */
+    if (n == 0)
+        return 0;
+
+    if (!BIO_recvmmsg(demux->net_bio, msg, sizeof(BIO_MSG), n, 0, &rd))
+        return 0;
+
+    now = demux->now != NULL ? demux->now(demux->now_arg) : ossl_time_zero();
+
+    urxe = demux->urx_gro_free.head;
+    for (i = 0; i < rd; ++i, urxe = unext) {
+        unext = urxe->next;
+        urxe->data_len  = msg[i].data_len;
+        urxe->time      = now;
+        ossl_quic_urxe_remove(&demux->urx_gro_free, urxe);
+        --demux->num_urx_gro_free;
+
+        demux->gro_held[demux->num_gro_held]     = urxe;
+        demux->gro_held_seg[demux->num_gro_held]
+            = (size_t)(msg[i].flags & BIO_MSG_SEGMENT_SIZE_MASK);
+        demux->gro_held_off[demux->num_gro_held] = 0;
+        ++demux->num_gro_held;
+    }
+
+    demux_split_gro_held(demux);
+    return demux->urx_pending.head != NULL;
+}
+
 /*
  * Receive datagrams from network, placing them into URXEs.
  *
@@ -348,6 +601,9 @@ static int demux_recv(QUIC_DEMUX *demux)
     if (demux->net_bio == NULL)
         return 0;
 
+    if (demux->use_gro)
+        return demux_recv_gro(demux);
+
     /*
      * Opportunistically receive as many messages as possible in a single
      * syscall, determined by how many free URXEs are available.
@@ -404,12 +660,17 @@ static int demux_identify_conn_id(QUIC_DEMUX *demux,
                                                   dst_conn_id);
 }
 
-/* Identify the connection structure corresponding to a given URXE. */
-static QUIC_DEMUX_CONN *demux_identify_conn(QUIC_DEMUX *demux, QUIC_URXE *e)
+/*
+ * Identify the connection structure corresponding to a given URXE. *malformed
+ * is set if the DCID could not be determined at all.
+ */
+static QUIC_DEMUX_CONN *demux_identify_conn(QUIC_DEMUX *demux, QUIC_URXE *e,
+                                            int *malformed)
 {
     QUIC_CONN_ID dst_conn_id;
 
-    if (!demux_identify_conn_id(demux, e, &dst_conn_id))
+    *malformed = !demux_identify_conn_id(demux, e, &dst_conn_id);
+    if (*malformed)
         /*
          * Datagram is so badly malformed we can't get the DCID from the first
          * packet in it, so just give up.
@@ -423,20 +684,27 @@ static QUIC_DEMUX_CONN *demux_identify_conn(QUIC_DEMUX *demux, QUIC_URXE *e)
 static int demux_process_pending_urxe(QUIC_DEMUX *demux, QUIC_URXE *e)
 {
     QUIC_DEMUX_CONN *conn;
+    int malformed;
 
     /* The next URXE we process should be at the head of the pending list. */
     if (!ossl_assert(e == demux->urx_pending.head))
         return 0;
 
-    conn = demux_identify_conn(demux, e);
+    conn = demux_identify_conn(demux, e, &malformed);
+    if (conn == NULL && !malformed && demux->default_cb != NULL) {
+        /* The URXE now belongs to the default handler. */
+        ossl_quic_urxe_remove(&demux->urx_pending, e);
+        demux->default_cb(e, demux->default_cb_arg);
+        return 1;
+    }
+
     if (conn == NULL) {
         /*
          * We could not identify a connection. We will never be able to process
          * this datagram, so get rid of it.
          */
         ossl_quic_urxe_remove(&demux->urx_pending, e);
-        ossl_quic_urxe_insert_tail(&demux->urx_free, e);
-        ++demux->num_urx_free;
+        demux_urxe_to_free(demux, e);
         return 1; /* keep processing pending URXEs */
     }
 
@@ -470,9 +738,12 @@ int ossl_quic_demux_pump(QUIC_DEMUX *demux)
     int ret;
 
     if (demux->urx_pending.head == NULL) {
-        ret = demux_ensure_free_urxe(demux, DEMUX_MAX_MSGS_PER_CALL);
-        if (ret != 1)
-            return 0;
+        /* When using GRO, demux_recv_gro allocates what it needs itself. */
+        if (!demux->use_gro) {
+            ret = demux_ensure_free_urxe(demux, DEMUX_MAX_MSGS_PER_CALL);
+            if (ret != 1)
+                return 0;
+        }
 
         ret = demux_recv(demux);
         if (ret != 1)
@@ -511,13 +782,16 @@ int ossl_quic_demux_inject(QUIC_DEMUX *demux,
     if (peer != NULL)
         urxe->peer = *peer;
     else
-        BIO_ADDR_clear(&urxe->local);
+        BIO_ADDR_clear(&urxe->peer);
 
     if (local != NULL)
         urxe->local = *local;
     else
         BIO_ADDR_clear(&urxe->local);
 
+    urxe->time = demux->now != NULL ? demux->now(demux->now_arg)
+                                    : ossl_time_zero();
+
     /* Move from free list to pending list. */
     ossl_quic_urxe_remove(&demux->urx_free, urxe);
     --demux->num_urx_free;
@@ -526,11 +800,45 @@ int ossl_quic_demux_inject(QUIC_DEMUX *demux,
     return demux_process_pending_urxl(demux);
 }
 
+int ossl_quic_demux_adopt_urxe(QUIC_DEMUX *demux, QUIC_URXE *e)
+{
+    if (!ossl_assert(e->prev == NULL && e->next == NULL)
+        || !ossl_assert(e->data_len <= e->alloc_len))
+        return 0;
+
+    ossl_quic_urxe_insert_tail(&demux->urx_pending, e);
+    return demux_process_pending_urxl(demux);
+}
+
+int ossl_quic_demux_set_slab_pool(QUIC_DEMUX *demux, QUIC_SLAB_POOL *pool)
+{
+    if (demux->urxe_allocated)
+        return 0;
+
+    demux->pool = pool;
+    return 1;
+}
+
+void ossl_quic_demux_set_default_handler(QUIC_DEMUX *demux,
+                                         ossl_quic_demux_cb_fn *cb,
+                                         void *cb_arg)
+{
+    demux->default_cb       = cb;
+    demux->default_cb_arg   = cb_arg;
+}
+
+void ossl_quic_demux_get_default_handler(const QUIC_DEMUX *demux,
+                                         ossl_quic_demux_cb_fn **cb,
+                                         void **cb_arg)
+{
+    *cb     = demux->default_cb;
+    *cb_arg = demux->default_cb_arg;
+}
+
 /* Called by our user to return a URXE to the free list. */
 void ossl_quic_demux_release_urxe(QUIC_DEMUX *demux,
                                   QUIC_URXE *e)
 {
     assert(e->prev == NULL && e->next == NULL);
-    ossl_quic_urxe_insert_tail(&demux->urx_free, e);
-    ++demux->num_urx_free;
+    demux_urxe_to_free(demux, e);
 }
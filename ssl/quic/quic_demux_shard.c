@@ -0,0 +1,314 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include <openssl/err.h>
+#include "internal/quic_demux_shard.h"
+#include "internal/quic_wire_pkt.h"
+#include "internal/common.h"
+
+typedef struct quic_demux_shard_st {
+    QUIC_DEMUX_SHARDS          *parent;
+    size_t                      idx;
+    QUIC_DEMUX                 *demux;
+
+    /* Handler for datagrams owned by this shard but matching no connection. */
+    ossl_quic_demux_cb_fn      *default_cb;
+    void                       *default_cb_arg;
+
+    /*
+     * URXEs forwarded to us by other shards. This is the only state in a shard
+     * touched by other threads, and is protected by inbox_lock.
+     */
+    CRYPTO_RWLOCK              *inbox_lock;
+    QUIC_URXE_LIST              inbox;
+} QUIC_DEMUX_SHARD;
+
+struct quic_demux_shards_st {
+    QUIC_DEMUX_SHARD               *shards;
+    size_t                          num_shards;
+    size_t                          short_conn_id_len;
+
+    ossl_quic_demux_steer_fn       *steer;
+    void                           *steer_arg;
+
+    ossl_quic_demux_shard_notify_fn *notify;
+    void                           *notify_arg;
+};
+
+size_t ossl_quic_demux_shard_from_conn_id(const QUIC_CONN_ID *dcid,
+                                          size_t num_shards)
+{
+    size_t i, v = 0;
+
+    if (num_shards <= 1)
+        return 0;
+
+    if (dcid->id_len >= QUIC_DEMUX_SHARD_CONN_ID_MIN_LEN
+        && dcid->id_len <= QUIC_MAX_CONN_ID_LEN)
+        return (((size_t)dcid->id[1] << 8) | dcid->id[2]) % num_shards;
+
+    /* Too short to carry a shard index, so just spread by hash. */
+    for (i = 0; i < dcid->id_len && i < QUIC_MAX_CONN_ID_LEN; ++i)
+        v = v * 31 + dcid->id[i];
+
+    return v % num_shards;
+}
+
+int ossl_quic_demux_shard_gen_conn_id(OSSL_LIB_CTX *libctx, size_t len,
+                                      size_t shard, QUIC_CONN_ID *cid)
+{
+    if (len < QUIC_DEMUX_SHARD_CONN_ID_MIN_LEN || len > QUIC_MAX_CONN_ID_LEN
+        || shard >= QUIC_DEMUX_MAX_SHARDS)
+        return 0;
+
+    if (RAND_bytes_ex(libctx, cid->id, len, len * 8) != 1)
+        return 0;
+
+    cid->id_len = (unsigned char)len;
+    cid->id[1]  = (unsigned char)(shard >> 8);
+    cid->id[2]  = (unsigned char)shard;
+    return 1;
+}
+
+size_t ossl_quic_demux_shards_steer(const QUIC_DEMUX_SHARDS *shards,
+                                    const QUIC_CONN_ID *dcid)
+{
+    size_t shard;
+
+    if (shards->steer == NULL)
+        return ossl_quic_demux_shard_from_conn_id(dcid, shards->num_shards);
+
+    shard = shards->steer(dcid, shards->num_shards, shards->steer_arg);
+    return ossl_assert(shard < shards->num_shards) ? shard : 0;
+}
+
+/* Places a URXE in the inbox of its owning shard. */
+static int demux_shard_forward(QUIC_DEMUX_SHARDS *shards, size_t dst,
+                               QUIC_URXE *e)
+{
+    QUIC_DEMUX_SHARD *s = &shards->shards[dst];
+    int was_empty;
+
+    if (!CRYPTO_THREAD_write_lock(s->inbox_lock))
+        return 0;
+
+    was_empty = (s->inbox.head == NULL);
+    ossl_quic_urxe_insert_tail(&s->inbox, e);
+    CRYPTO_THREAD_unlock(s->inbox_lock);
+
+    if (was_empty && shards->notify != NULL)
+        shards->notify(dst, shards->notify_arg);
+
+    return 1;
+}
+
+/*
+ * Default handler of each shard's QUIC_DEMUX, called for datagrams matching no
+ * registered connection ID. Datagrams owned by another shard are forwarded to
+ * it; anything else is for the user's default handler.
+ */
+static void demux_shard_default_cb(QUIC_URXE *e, void *arg)
+{
+    QUIC_DEMUX_SHARD *s = arg;
+    QUIC_DEMUX_SHARDS *shards = s->parent;
+    QUIC_CONN_ID dcid;
+    size_t dst;
+
+    if (!ossl_quic_wire_get_pkt_hdr_dst_conn_id(ossl_quic_urxe_data(e),
+                                                e->data_len,
+                                                shards->short_conn_id_len,
+                                                &dcid)) {
+        ossl_quic_demux_release_urxe(s->demux, e);
+        return;
+    }
+
+    dst = ossl_quic_demux_shards_steer(shards, &dcid);
+    if (dst != s->idx) {
+        if (!demux_shard_forward(shards, dst, e))
+            /* Should not happen; drop the datagram. */
+            ossl_quic_demux_release_urxe(s->demux, e);
+        return;
+    }
+
+    if (s->default_cb == NULL) {
+        ossl_quic_demux_release_urxe(s->demux, e);
+        return;
+    }
+
+    s->default_cb(e, s->default_cb_arg);
+}
+
+QUIC_DEMUX_SHARDS *ossl_quic_demux_shards_new(const QUIC_DEMUX_SHARDS_ARGS *args)
+{
+    QUIC_DEMUX_SHARDS *shards;
+    QUIC_DEMUX_SHARD *s;
+    size_t i;
+
+    if (args->num_shards == 0 || args->num_shards > QUIC_DEMUX_MAX_SHARDS
+        || args->net_bios == NULL)
+        return NULL;
+
+    shards = OPENSSL_zalloc(sizeof(QUIC_DEMUX_SHARDS));
+    if (shards == NULL)
+        return NULL;
+
+    shards->shards = OPENSSL_zalloc(sizeof(QUIC_DEMUX_SHARD) * args->num_shards);
+    if (shards->shards == NULL) {
+        OPENSSL_free(shards);
+        return NULL;
+    }
+
+    shards->num_shards          = args->num_shards;
+    shards->short_conn_id_len   = args->short_conn_id_len;
+    shards->steer               = args->steer;
+    shards->steer_arg           = args->steer_arg;
+    shards->notify              = args->notify;
+    shards->notify_arg          = args->notify_arg;
+
+    for (i = 0; i < shards->num_shards; ++i) {
+        s = &shards->shards[i];
+        s->parent   = shards;
+        s->idx      = i;
+
+        s->inbox_lock = CRYPTO_THREAD_lock_new();
+        if (s->inbox_lock == NULL)
+            goto err;
+
+        s->demux = ossl_quic_demux_new(args->net_bios[i],
+                                       args->short_conn_id_len,
+                                       args->default_urxe_alloc_len,
+                                       args->now, args->now_arg);
+        if (s->demux == NULL)
+            goto err;
+
+        if (args->pool != NULL
+            && !ossl_quic_demux_set_slab_pool(s->demux, args->pool))
+            goto err;
+
+        ossl_quic_demux_set_default_handler(s->demux,
+                                            demux_shard_default_cb, s);
+    }
+
+    return shards;
+
+err:
+    ossl_quic_demux_shards_free(shards);
+    return NULL;
+}
+
+void ossl_quic_demux_shards_free(QUIC_DEMUX_SHARDS *shards)
+{
+    QUIC_DEMUX_SHARD *s;
+    QUIC_URXE *e;
+    size_t i;
+
+    if (shards == NULL)
+        return;
+
+    for (i = 0; i < shards->num_shards; ++i) {
+        s = &shards->shards[i];
+
+        /* Discard anything left in the inbox. */
+        while ((e = s->inbox.head) != NULL) {
+            ossl_quic_urxe_remove(&s->inbox, e);
+            ossl_quic_demux_release_urxe(s->demux, e);
+        }
+
+        ossl_quic_demux_free(s->demux);
+        CRYPTO_THREAD_lock_free(s->inbox_lock);
+    }
+
+    OPENSSL_free(shards->shards);
+    OPENSSL_free(shards);
+}
+
+size_t ossl_quic_demux_shards_get_num(const QUIC_DEMUX_SHARDS *shards)
+{
+    return shards->num_shards;
+}
+
+QUIC_DEMUX *ossl_quic_demux_shards_get_demux(QUIC_DEMUX_SHARDS *shards,
+                                             size_t shard)
+{
+    if (shard >= shards->num_shards)
+        return NULL;
+
+    return shards->shards[shard].demux;
+}
+
+void ossl_quic_demux_shards_set_default_handler(QUIC_DEMUX_SHARDS *shards,
+                                                size_t shard,
+                                                ossl_quic_demux_cb_fn *cb,
+                                                void *cb_arg)
+{
+    if (!ossl_assert(shard < shards->num_shards))
+        return;
+
+    shards->shards[shard].default_cb        = cb;
+    shards->shards[shard].default_cb_arg    = cb_arg;
+}
+
+/*
+ * Route everything forwarded to this shard. The inbox is detached under the
+ * lock and processed without it, so other shards are never blocked on our
+ * callbacks.
+ */
+static int demux_shard_drain_inbox(QUIC_DEMUX_SHARD *s, int *processed)
+{
+    QUIC_URXE_LIST l;
+    QUIC_URXE *e;
+    int ok = 1;
+
+    if (!CRYPTO_THREAD_write_lock(s->inbox_lock))
+        return 0;
+
+    l = s->inbox;
+    s->inbox.head = s->inbox.tail = NULL;
+    CRYPTO_THREAD_unlock(s->inbox_lock);
+
+    while ((e = l.head) != NULL) {
+        ossl_quic_urxe_remove(&l, e);
+        if (!ossl_quic_demux_adopt_urxe(s->demux, e)) {
+            ossl_quic_demux_release_urxe(s->demux, e);
+            ok = 0;
+        }
+
+        *processed = 1;
+    }
+
+    return ok;
+}
+
+int ossl_quic_demux_shards_pump(QUIC_DEMUX_SHARDS *shards, size_t shard)
+{
+    QUIC_DEMUX_SHARD *s;
+    int processed = 0, ret;
+
+    if (shard >= shards->num_shards)
+        return 0;
+
+    s = &shards->shards[shard];
+    if (!demux_shard_drain_inbox(s, &processed))
+        return 0;
+
+    if (!processed)
+        return ossl_quic_demux_pump(s->demux);
+
+    /* We made progress, so a failed network read is not an error. */
+    ERR_set_mark();
+    ret = ossl_quic_demux_pump(s->demux);
+    if (ret)
+        ERR_clear_last_mark();
+    else
+        ERR_pop_to_mark();
+
+    return 1;
+}
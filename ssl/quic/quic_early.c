@@ -0,0 +1,328 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include "internal/quic_early.h"
+
+/*
+ * Remembered Transport Parameters
+ * ===============================
+ */
+
+/* Transport parameter IDs (RFC 9000 s. 18.2). */
+#define TPARAM_INITIAL_MAX_DATA                     0x04
+#define TPARAM_INITIAL_MAX_STREAM_DATA_BIDI_LOCAL   0x05
+#define TPARAM_INITIAL_MAX_STREAM_DATA_BIDI_REMOTE  0x06
+#define TPARAM_INITIAL_MAX_STREAM_DATA_UNI          0x07
+#define TPARAM_INITIAL_MAX_STREAMS_BIDI             0x08
+#define TPARAM_INITIAL_MAX_STREAMS_UNI              0x09
+#define TPARAM_ACTIVE_CONN_ID_LIMIT                 0x0e
+
+/* Default active_connection_id_limit (RFC 9000 s. 18.2). */
+#define DEFAULT_ACTIVE_CONN_ID_LIMIT    2
+
+/* Maximum value of initial_max_streams_{bidi,uni} (RFC 9000 s. 4.6). */
+#define MAX_STREAMS_LIMIT               (((uint64_t)1) << 60)
+
+/* Maps each parameter to its ID. */
+#define FOR_EACH_PARAM(X)                                                   \
+    X(TPARAM_INITIAL_MAX_DATA, init_max_data)                               \
+    X(TPARAM_INITIAL_MAX_STREAM_DATA_BIDI_LOCAL,                            \
+      init_max_stream_data_bidi_local)                                      \
+    X(TPARAM_INITIAL_MAX_STREAM_DATA_BIDI_REMOTE,                           \
+      init_max_stream_data_bidi_remote)                                     \
+    X(TPARAM_INITIAL_MAX_STREAM_DATA_UNI, init_max_stream_data_uni)         \
+    X(TPARAM_INITIAL_MAX_STREAMS_BIDI, init_max_streams_bidi)               \
+    X(TPARAM_INITIAL_MAX_STREAMS_UNI, init_max_streams_uni)                 \
+    X(TPARAM_ACTIVE_CONN_ID_LIMIT, active_conn_id_limit)
+
+void ossl_quic_early_params_init(QUIC_EARLY_PARAMS *params)
+{
+    memset(params, 0, sizeof(*params));
+    params->active_conn_id_limit = DEFAULT_ACTIVE_CONN_ID_LIMIT;
+}
+
+int ossl_quic_early_params_encode(WPACKET *pkt,
+                                  const QUIC_EARLY_PARAMS *params)
+{
+#define ENCODE_PARAM(id, field)                             \
+    if (!WPACKET_quic_write_vlint(pkt, (id))                \
+        || !WPACKET_quic_write_vlint(pkt, params->field))   \
+        return 0;
+
+    FOR_EACH_PARAM(ENCODE_PARAM)
+#undef ENCODE_PARAM
+
+    return 1;
+}
+
+int ossl_quic_early_params_decode(PACKET *pkt, QUIC_EARLY_PARAMS *params)
+{
+    uint64_t id, value;
+
+    ossl_quic_early_params_init(params);
+
+    while (PACKET_remaining(pkt) > 0) {
+        if (!PACKET_get_quic_vlint(pkt, &id)
+            || !PACKET_get_quic_vlint(pkt, &value))
+            return 0;
+
+        switch (id) {
+#define DECODE_PARAM(tparam_id, field)  \
+        case tparam_id:                 \
+            params->field = value;      \
+            break;
+
+        FOR_EACH_PARAM(DECODE_PARAM)
+#undef DECODE_PARAM
+
+        default:
+            /* Ignore parameters added by later versions. */
+            break;
+        }
+    }
+
+    if (params->init_max_streams_bidi > MAX_STREAMS_LIMIT
+        || params->init_max_streams_uni > MAX_STREAMS_LIMIT
+        || params->active_conn_id_limit < DEFAULT_ACTIVE_CONN_ID_LIMIT)
+        return 0;
+
+    return 1;
+}
+
+int ossl_quic_early_params_compatible(const QUIC_EARLY_PARAMS *remembered,
+                                      const QUIC_EARLY_PARAMS *cur)
+{
+#define CHECK_PARAM(id, field)              \
+    if (cur->field < remembered->field)     \
+        return 0;
+
+    FOR_EACH_PARAM(CHECK_PARAM)
+#undef CHECK_PARAM
+
+    return 1;
+}
+
+/*
+ * Anti-Replay
+ * ===========
+ */
+
+/* Length of the fingerprints recorded; a truncated SHA-256 hash. */
+#define FP_LEN      16
+
+typedef struct ar_gen_st {
+    /* Open-addressed hash table; an all-zero fingerprint marks a free slot. */
+    unsigned char   (*fps)[FP_LEN];
+    size_t          num;
+    OSSL_TIME       start;
+} AR_GEN;
+
+struct quic_anti_replay_st {
+    CRYPTO_RWLOCK           *lock;
+    EVP_MD                  *md;
+
+    OSSL_TIME               (*now)(void *arg);
+    void                    *now_arg;
+
+    OSSL_TIME               window;
+
+    /*
+     * Number of slots in each table, a power of two at least twice the
+     * maximum number of entries so that probe sequences stay short.
+     */
+    size_t                  num_slots, max_entries;
+
+    /* gen[cur] is the generation new fingerprints are added to. */
+    AR_GEN                  gen[2];
+    unsigned char           cur;
+
+    QUIC_ANTI_REPLAY_STATS  stats;
+};
+
+static OSSL_TIME ar_get_time(QUIC_ANTI_REPLAY *ar)
+{
+    if (ar->now == NULL)
+        return ossl_time_now();
+
+    return ar->now(ar->now_arg);
+}
+
+QUIC_ANTI_REPLAY *ossl_quic_anti_replay_new(OSSL_LIB_CTX *libctx,
+                                            const char *propq,
+                                            OSSL_TIME window,
+                                            size_t max_entries,
+                                            OSSL_TIME (*now)(void *arg),
+                                            void *now_arg)
+{
+    QUIC_ANTI_REPLAY *ar;
+    size_t i;
+
+    if (ossl_time_is_zero(window) || max_entries == 0
+        || max_entries > SIZE_MAX / (4 * FP_LEN))
+        return NULL;
+
+    if ((ar = OPENSSL_zalloc(sizeof(*ar))) == NULL)
+        return NULL;
+
+    ar->now         = now;
+    ar->now_arg     = now_arg;
+    ar->window      = window;
+    ar->max_entries = max_entries;
+
+    for (ar->num_slots = 1; ar->num_slots < 2 * max_entries; ar->num_slots <<= 1)
+        ;
+
+    if ((ar->lock = CRYPTO_THREAD_lock_new()) == NULL
+        || (ar->md = EVP_MD_fetch(libctx, "SHA256", propq)) == NULL)
+        goto err;
+
+    for (i = 0; i < OSSL_NELEM(ar->gen); ++i)
+        if ((ar->gen[i].fps = OPENSSL_zalloc(ar->num_slots * FP_LEN)) == NULL)
+            goto err;
+
+    ar->gen[ar->cur].start = ar_get_time(ar);
+    return ar;
+
+err:
+    ossl_quic_anti_replay_free(ar);
+    return NULL;
+}
+
+void ossl_quic_anti_replay_free(QUIC_ANTI_REPLAY *ar)
+{
+    size_t i;
+
+    if (ar == NULL)
+        return;
+
+    for (i = 0; i < OSSL_NELEM(ar->gen); ++i)
+        OPENSSL_free(ar->gen[i].fps);
+
+    EVP_MD_free(ar->md);
+    CRYPTO_THREAD_lock_free(ar->lock);
+    OPENSSL_free(ar);
+}
+
+/*
+ * Finds fp in a generation. Returns the slot holding it, or the free slot
+ * where it would be inserted.
+ */
+static size_t ar_gen_find(QUIC_ANTI_REPLAY *ar, AR_GEN *gen,
+                          const unsigned char *fp, int *found)
+{
+    static const unsigned char zero[FP_LEN];
+    size_t i, mask = ar->num_slots - 1;
+
+    /* The fingerprint is a hash, so its leading bytes make a good index. */
+    i = (((size_t)fp[0] << 24) | ((size_t)fp[1] << 16)
+         | ((size_t)fp[2] << 8) | fp[3]) & mask;
+
+    for (;; i = (i + 1) & mask) {
+        if (memcmp(gen->fps[i], fp, FP_LEN) == 0) {
+            *found = 1;
+            return i;
+        }
+
+        if (memcmp(gen->fps[i], zero, FP_LEN) == 0) {
+            *found = 0;
+            return i;
+        }
+    }
+}
+
+/* Starts a new generation if the current one is a window old. */
+static void ar_rotate(QUIC_ANTI_REPLAY *ar, OSSL_TIME now)
+{
+    AR_GEN *gen = &ar->gen[ar->cur];
+
+    if (ossl_time_compare(ossl_time_subtract(now, gen->start), ar->window) < 0)
+        return;
+
+    ar->cur ^= 1;
+    gen = &ar->gen[ar->cur];
+    memset(gen->fps, 0, ar->num_slots * FP_LEN);
+    gen->num    = 0;
+    gen->start  = now;
+}
+
+int ossl_quic_anti_replay_check(QUIC_ANTI_REPLAY *ar,
+                                const unsigned char *id, size_t id_len,
+                                OSSL_TIME issued, OSSL_TIME client_age)
+{
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int md_len;
+    OSSL_TIME now, expected, skew;
+    AR_GEN *gen;
+    size_t i, slot;
+    int found, ok = 0;
+
+    if (!EVP_Digest(id, id_len, md, &md_len, ar->md, NULL)
+        || md_len < FP_LEN)
+        return 0;
+
+    /* Never all-zero, so that it cannot be mistaken for a free slot. */
+    md[0] |= 1;
+
+    if (!CRYPTO_THREAD_write_lock(ar->lock))
+        return 0;
+
+    now = ar_get_time(ar);
+
+    /* Freshness. */
+    expected = ossl_time_add(issued, client_age);
+    skew = ossl_time_compare(now, expected) > 0
+        ? ossl_time_subtract(now, expected)
+        : ossl_time_subtract(expected, now);
+    if (ossl_time_compare(skew, ossl_time_divide(ar->window, 2)) > 0) {
+        ++ar->stats.stale;
+        goto end;
+    }
+
+    ar_rotate(ar, now);
+
+    /* Uniqueness. */
+    for (i = 0; i < OSSL_NELEM(ar->gen); ++i) {
+        ar_gen_find(ar, &ar->gen[i], md, &found);
+        if (found) {
+            ++ar->stats.replayed;
+            goto end;
+        }
+    }
+
+    gen = &ar->gen[ar->cur];
+    if (gen->num >= ar->max_entries) {
+        ++ar->stats.full;
+        goto end;
+    }
+
+    slot = ar_gen_find(ar, gen, md, &found);
+    memcpy(gen->fps[slot], md, FP_LEN);
+    ++gen->num;
+    ++ar->stats.accepted;
+    ok = 1;
+
+end:
+    CRYPTO_THREAD_unlock(ar->lock);
+    return ok;
+}
+
+void ossl_quic_anti_replay_get_stats(QUIC_ANTI_REPLAY *ar,
+                                     QUIC_ANTI_REPLAY_STATS *stats)
+{
+    if (!CRYPTO_THREAD_read_lock(ar->lock)) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    *stats = ar->stats;
+    CRYPTO_THREAD_unlock(ar->lock);
+}
@@ -9,8 +9,10 @@
 
 #include "internal/quic_fc.h"
 #include "internal/quic_error.h"
+#include "internal/quic_trace.h"
 #include "internal/common.h"
 #include "internal/safe_math.h"
+#include <openssl/crypto.h>
 #include <assert.h>
 
 OSSL_SAFE_MATH_UNSIGNED(uint64_t, uint64_t)
@@ -78,8 +80,11 @@ int ossl_quic_txfc_consume_credit_local(QUIC_TXFC *txfc, uint64_t num_bytes)
         num_bytes = credit;
     }
 
-    if (num_bytes > 0 && num_bytes == credit)
+    if (num_bytes > 0 && num_bytes == credit) {
         txfc->has_become_blocked = 1;
+        QLOG_EVENT(flow_control_blocked, (txfc, txfc->parent != NULL,
+                                          txfc->cwm));
+    }
 
     txfc->swm += num_bytes;
     return ok;
@@ -139,7 +144,9 @@ int ossl_quic_rxfc_init(QUIC_RXFC *rxfc, QUIC_RXFC *conn_rxfc,
     rxfc->hwm               = 0;
     rxfc->cur_window_size   = initial_window_size;
     rxfc->max_window_size   = max_window_size;
+    rxfc->init_window_size  = initial_window_size;
     rxfc->parent            = conn_rxfc;
+    rxfc->budget            = NULL;
     rxfc->error_code        = 0;
     rxfc->has_cwm_changed   = 0;
     rxfc->epoch_start       = ossl_time_zero();
@@ -160,6 +167,128 @@ void ossl_quic_rxfc_set_max_window_size(QUIC_RXFC *rxfc,
     rxfc->max_window_size = max_window_size;
 }
 
+/*
+ * Memory Budget
+ * -------------
+ */
+struct quic_rxfc_budget_st {
+    CRYPTO_RWLOCK   *lock;
+    uint64_t        limit, used;
+    uint64_t        num_rxfcs;
+};
+
+/* Pressure threshold = 3/4 */
+#define BUDGET_PRESSURE_NUM 3
+#define BUDGET_PRESSURE_DEN 4
+
+QUIC_RXFC_BUDGET *ossl_quic_rxfc_budget_new(uint64_t limit)
+{
+    QUIC_RXFC_BUDGET *budget;
+
+    budget = OPENSSL_zalloc(sizeof(*budget));
+    if (budget == NULL)
+        return NULL;
+
+    if ((budget->lock = CRYPTO_THREAD_lock_new()) == NULL) {
+        OPENSSL_free(budget);
+        return NULL;
+    }
+
+    budget->limit = limit;
+    return budget;
+}
+
+void ossl_quic_rxfc_budget_free(QUIC_RXFC_BUDGET *budget)
+{
+    if (budget == NULL)
+        return;
+
+    assert(budget->num_rxfcs == 0);
+    CRYPTO_THREAD_lock_free(budget->lock);
+    OPENSSL_free(budget);
+}
+
+uint64_t ossl_quic_rxfc_budget_get_used(QUIC_RXFC_BUDGET *budget)
+{
+    uint64_t used;
+
+    if (!CRYPTO_THREAD_read_lock(budget->lock))
+        return 0;
+
+    used = budget->used;
+    CRYPTO_THREAD_unlock(budget->lock);
+    return used;
+}
+
+/*
+ * Replaces a charge of old_size bytes to the budget with one of at most
+ * new_size bytes, and returns the size charged.
+ */
+static uint64_t rxfc_budget_resize(QUIC_RXFC_BUDGET *budget, uint64_t old_size,
+                                   uint64_t new_size, uint64_t min_size)
+{
+    uint64_t cap, avail;
+
+    if (!CRYPTO_THREAD_write_lock(budget->lock))
+        return old_size;
+
+    /*
+     * Under pressure, give up memory beyond a fair share, gradually, so that
+     * a connection does not lose more credit than it can have in flight.
+     */
+    if (budget->used
+        > budget->limit / BUDGET_PRESSURE_DEN * BUDGET_PRESSURE_NUM) {
+        cap = budget->limit / budget->num_rxfcs;
+        if (cap < min_size)
+            cap = min_size;
+        if (old_size / 2 > cap)
+            cap = old_size / 2;
+        if (new_size > cap)
+            new_size = cap;
+    }
+
+    /* Grow by no more than what is left. */
+    if (new_size > old_size) {
+        avail = budget->limit > budget->used ? budget->limit - budget->used : 0;
+        if (new_size - old_size > avail)
+            new_size = old_size + avail;
+    }
+
+    budget->used = budget->used - old_size + new_size;
+    CRYPTO_THREAD_unlock(budget->lock);
+    return new_size;
+}
+
+int ossl_quic_rxfc_set_budget(QUIC_RXFC *rxfc, QUIC_RXFC_BUDGET *budget)
+{
+    if (rxfc->parent != NULL)
+        return 0;
+
+    if (rxfc->budget == budget)
+        return 1;
+
+    if (rxfc->budget != NULL
+        && CRYPTO_THREAD_write_lock(rxfc->budget->lock)) {
+        rxfc->budget->used -= rxfc->cur_window_size;
+        --rxfc->budget->num_rxfcs;
+        CRYPTO_THREAD_unlock(rxfc->budget->lock);
+    }
+
+    rxfc->budget = NULL;
+    if (budget == NULL)
+        return 1;
+
+    if (!CRYPTO_THREAD_write_lock(budget->lock))
+        return 0;
+
+    budget->used += rxfc->cur_window_size;
+    ++budget->num_rxfcs;
+    CRYPTO_THREAD_unlock(budget->lock);
+
+    rxfc->budget = budget;
+    return 1;
+}
+
 static void rxfc_start_epoch(QUIC_RXFC *rxfc)
 {
     rxfc->epoch_start   = rxfc->now(rxfc->now_arg);
@@ -233,56 +362,89 @@ static int rxfc_cwm_bump_desired(QUIC_RXFC *rxfc)
     return window_rem <= threshold;
 }
 
-static int rxfc_should_bump_window_size(QUIC_RXFC *rxfc, OSSL_TIME rtt)
+/* Maximum factor by which the window may grow in one epoch. */
+#define WINDOW_MAX_GROWTH 4
+
+static uint64_t mul_saturating(uint64_t a, uint64_t b)
+{
+    int err = 0;
+    uint64_t r = safe_mul_uint64_t(a, b, &err);
+
+    return err ? UINT64_MAX : r;
+}
+
+/*
+ * Returns the window size needed to keep up with the rate at which data has
+ * been retired this epoch, or 0 if there is nothing to go on.
+ */
+static uint64_t rxfc_get_target_window_size(QUIC_RXFC *rxfc, OSSL_TIME rtt)
 {
     /*
-     * dt: time since start of epoch
-     * b:  bytes of window consumed since start of epoch
-     * dw: proportion of window consumed since start of epoch
-     * T_window: time it will take to use up the entire window, based on dt, dw
-     * RTT: The current estimated RTT.
+     * dt:   time since start of epoch
+     * b:    bytes of window consumed since start of epoch
+     * rate: delivery rate, b / dt
+     * BDP:  bandwidth-delay product, rate * RTT
      *
-     * b        = rwm - esrwm
-     * dw       = b / window_size
-     * T_window = dt / dw
-     * T_window = dt / (b / window_size)
-     * T_window = (dt * window_size) / b
+     * The peer needs a window of at least one BDP to avoid being blocked on
+     * us, plus headroom for the time it takes our window updates to reach it
+     * and for variation in the rate. We aim for a window of 4 * BDP; that is,
+     * one which takes at least 4 RTTs to use up at the current rate.
      *
-     * We bump the window size if T_window < 4 * RTT.
-     *
-     * We leave the division by b on the LHS to reduce the risk of overflowing
-     * our 64-bit nanosecond representation, which will afford plenty of
-     * precision left over after the division anyway.
+     * An epoch ends when a window update is needed, so it spans at least a
+     * quarter of the window, which smooths out bursts in the rate.
      */
-    uint64_t  b = rxfc->rwm - rxfc->esrwm;
-    OSSL_TIME now, dt, t_window;
+    uint64_t  b = rxfc->rwm - rxfc->esrwm, bdp;
+    OSSL_TIME now, dt;
+    int err = 0;
 
-    if (b == 0)
+    if (b == 0 || ossl_time_is_zero(rtt))
         return 0;
 
-    now      = rxfc->now(rxfc->now_arg);
-    dt       = ossl_time_subtract(now, rxfc->epoch_start);
-    t_window = ossl_time_muldiv(dt, rxfc->cur_window_size, b);
+    now = rxfc->now(rxfc->now_arg);
+    dt  = ossl_time_subtract(now, rxfc->epoch_start);
+    if (ossl_time_is_zero(dt))
+        /* All at once, so the rate is too high to measure. */
+        return UINT64_MAX;
 
-    return ossl_time_compare(t_window, ossl_time_multiply(rtt, 4)) < 0;
+    bdp = safe_muldiv_uint64_t(b, ossl_time2ticks(rtt), ossl_time2ticks(dt),
+                               &err);
+    if (err)
+        return UINT64_MAX;
+
+    return mul_saturating(bdp, 4);
 }
 
 static void rxfc_adjust_window_size(QUIC_RXFC *rxfc, uint64_t min_window_size,
                                     OSSL_TIME rtt)
 {
-    /* Are we sending updates too often? */
-    uint64_t new_window_size;
+    uint64_t new_window_size, target, limit;
 
     new_window_size = rxfc->cur_window_size;
 
-    if (rxfc_should_bump_window_size(rxfc, rtt))
-        new_window_size *= 2;
+    /* Is the window too small to keep up with the peer? */
+    target = rxfc_get_target_window_size(rxfc, rtt);
+    if (target > new_window_size) {
+        limit = mul_saturating(new_window_size, WINDOW_MAX_GROWTH);
+        new_window_size = mul_saturating(new_window_size, 2);
+
+        if (target > new_window_size)
+            new_window_size = target;
+        if (new_window_size > limit)
+            new_window_size = limit;
+    }
 
     if (new_window_size < min_window_size)
         new_window_size = min_window_size;
     if (new_window_size > rxfc->max_window_size) /* takes precedence over min size */
         new_window_size = rxfc->max_window_size;
 
+    /* The memory budget takes precedence over both. */
+    if (rxfc->budget != NULL)
+        new_window_size = rxfc_budget_resize(rxfc->budget,
+                                             rxfc->cur_window_size,
+                                             new_window_size,
+                                             rxfc->init_window_size);
+
     rxfc->cur_window_size = new_window_size;
     rxfc_start_epoch(rxfc);
 }
@@ -301,6 +463,9 @@ static void rxfc_update_cwm(QUIC_RXFC *rxfc, uint64_t min_window_size,
     if (new_cwm > rxfc->cwm) {
         rxfc->cwm = new_cwm;
         rxfc->has_cwm_changed = 1;
+        QLOG_EVENT(flow_control_window_updated,
+                   (rxfc, rxfc->now(rxfc->now_arg), rxfc->parent != NULL,
+                    rxfc->cwm, rxfc->cur_window_size));
     }
 }
 
@@ -351,6 +516,11 @@ uint64_t ossl_quic_rxfc_get_rwm(QUIC_RXFC *rxfc)
     return rxfc->rwm;
 }
 
+uint64_t ossl_quic_rxfc_get_window_size(QUIC_RXFC *rxfc)
+{
+    return rxfc->cur_window_size;
+}
+
 int ossl_quic_rxfc_has_cwm_changed(QUIC_RXFC *rxfc, int clear)
 {
     int r = rxfc->has_cwm_changed;
@@ -275,3 +275,16 @@ OSSL_ACKM *ossl_quic_conn_set_akcm(QUIC_CONNECTION *qc)
 {
     return qc != NULL ? qc->ackm : NULL;
 }
+
+int ossl_quic_conn_set_path_mgr(QUIC_CONNECTION *qc, QUIC_PATH_MGR *pm)
+{
+    if (qc == NULL)
+        return 0;
+    qc->path_mgr = pm;
+    return 1;
+}
+
+QUIC_PATH_MGR *ossl_quic_conn_get_path_mgr(QUIC_CONNECTION *qc)
+{
+    return qc != NULL ? qc->path_mgr : NULL;
+}
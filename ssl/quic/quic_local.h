@@ -23,6 +23,7 @@ struct quic_conn_st {
     /* For QUIC, diverse handlers */
     OSSL_ACKM *ackm;
     OSSL_QRX *qrx;
+    QUIC_PATH_MGR *path_mgr;
 };
 
 # define QUIC_CONNECTION_FROM_SSL_int(ssl, c)   \
@@ -0,0 +1,722 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/rand.h>
+#include "internal/quic_path.h"
+#include "internal/bio_addr.h"
+#include "internal/quic_wire.h"
+#include "internal/common.h"
+
+/* RFC 9002 kInitialRtt value. */
+#define K_INITIAL_RTT   ossl_ms2time(333)
+
+/*
+ * Congestion control state of a path. This is allocated separately so that it
+ * can be handed from one path to another, as the controller keeps a pointer to
+ * mdpl.
+ */
+typedef struct path_cc_st {
+    OSSL_CC_DATA    *data;
+    size_t          mdpl;
+    OSSL_PARAM      changeables[2];
+} PATH_CC;
+
+struct quic_path_st {
+    BIO_ADDR        peer, local;
+    int             state;
+
+    OSSL_STATM      statm;
+    PATH_CC         *cc;
+
+    /* Bytes received and sent, for anti-amplification. */
+    uint64_t        bytes_rx, bytes_tx;
+    OSSL_TIME       last_rx;
+
+    /* Outstanding PATH_CHALLENGE values, oldest first. */
+    uint64_t        challenge[QUIC_PATH_MAX_CHALLENGES];
+    size_t          num_challenges;
+    unsigned int    challenge_pending   : 1;
+    OSSL_TIME       retx_deadline, validation_deadline;
+
+    /* PATH_RESPONSE frames to send, oldest first. */
+    uint64_t        response[QUIC_PATH_MAX_RESPONSES];
+    size_t          num_responses;
+};
+
+struct quic_path_mgr_st {
+    OSSL_LIB_CTX            *libctx;
+    const char              *propq;
+    OSSL_TIME               (*now)(void *arg);
+    void                    *now_arg;
+    const OSSL_CC_METHOD    *cc_method;
+    OSSL_ACKM               *ackm;
+    int                     is_server;
+
+    QUIC_PATH               **paths;
+    size_t                  num_paths, max_paths;
+
+    /* The path non-probing packets are sent on. */
+    QUIC_PATH               *active;
+
+    /* The last validated active path, reverted to if validation fails. */
+    QUIC_PATH               *fallback;
+
+    /*
+     * If the active path took over the RTT and congestion state of the
+     * previous active path, that path, which now has the fresh state the
+     * active path was created with. The state is swapped back if validation of
+     * the active path fails.
+     */
+    QUIC_PATH               *donor;
+
+    /* Largest PN of a non-probing packet received. */
+    QUIC_PN                 largest_pn;
+    int                     have_largest_pn;
+};
+
+static OSSL_TIME get_time(QUIC_PATH_MGR *pm)
+{
+    if (pm->now == NULL)
+        return ossl_time_now();
+
+    return pm->now(pm->now_arg);
+}
+
+int ossl_quic_addr_eq(const BIO_ADDR *a, const BIO_ADDR *b, int ignore_port)
+{
+    int fa = a != NULL ? BIO_ADDR_family(a) : AF_UNSPEC;
+    int fb = b != NULL ? BIO_ADDR_family(b) : AF_UNSPEC;
+    unsigned char ra[128], rb[128];
+    size_t la = 0, lb = 0;
+
+    if (fa != fb)
+        return 0;
+
+    if (fa == AF_UNSPEC)
+        return 1;
+
+    if (!ignore_port && BIO_ADDR_rawport(a) != BIO_ADDR_rawport(b))
+        return 0;
+
+    if (!BIO_ADDR_rawaddress(a, NULL, &la)
+        || !BIO_ADDR_rawaddress(b, NULL, &lb)
+        || la != lb || la > sizeof(ra)
+        || !BIO_ADDR_rawaddress(a, ra, &la)
+        || !BIO_ADDR_rawaddress(b, rb, &lb))
+        return 0;
+
+    return memcmp(ra, rb, la) == 0;
+}
+
+static void addr_set(BIO_ADDR *dst, const BIO_ADDR *src)
+{
+    if (src == NULL)
+        BIO_ADDR_clear(dst);
+    else
+        *dst = *src;
+}
+
+/*
+ * Path Lifecycle
+ * --------------
+ */
+static PATH_CC *path_cc_new(QUIC_PATH_MGR *pm)
+{
+    PATH_CC *cc;
+
+    cc = OPENSSL_zalloc(sizeof(*cc));
+    if (cc == NULL)
+        return NULL;
+
+    cc->mdpl = QUIC_MIN_INITIAL_DGRAM_LEN;
+    cc->changeables[0]
+        = OSSL_PARAM_construct_size_t(OSSL_CC_OPTION_MAX_DGRAM_PAYLOAD_LEN,
+                                      &cc->mdpl);
+    cc->changeables[1] = OSSL_PARAM_construct_end();
+
+    if ((cc->data = pm->cc_method->new(NULL, NULL, cc->changeables)) == NULL) {
+        OPENSSL_free(cc);
+        return NULL;
+    }
+
+    return cc;
+}
+
+static void path_free(QUIC_PATH_MGR *pm, QUIC_PATH *path)
+{
+    if (path == NULL)
+        return;
+
+    if (path->cc != NULL) {
+        pm->cc_method->free(path->cc->data);
+        OPENSSL_free(path->cc);
+    }
+
+    ossl_statm_destroy(&path->statm);
+    OPENSSL_free(path);
+}
+
+static QUIC_PATH *path_new(QUIC_PATH_MGR *pm, const BIO_ADDR *peer,
+                           const BIO_ADDR *local)
+{
+    QUIC_PATH *path;
+
+    path = OPENSSL_zalloc(sizeof(*path));
+    if (path == NULL)
+        return NULL;
+
+    addr_set(&path->peer, peer);
+    addr_set(&path->local, local);
+
+    if (!ossl_statm_init(&path->statm)
+        || (path->cc = path_cc_new(pm)) == NULL) {
+        path_free(pm, path);
+        return NULL;
+    }
+
+    path->last_rx = get_time(pm);
+    return path;
+}
+
+static QUIC_PATH *find_path(QUIC_PATH_MGR *pm, const BIO_ADDR *peer,
+                            const BIO_ADDR *local)
+{
+    size_t i;
+
+    for (i = 0; i < pm->num_paths; ++i)
+        if (ossl_quic_addr_eq(&pm->paths[i]->peer, peer, 0)
+            && ossl_quic_addr_eq(&pm->paths[i]->local, local, 0))
+            return pm->paths[i];
+
+    return NULL;
+}
+
+static void remove_path(QUIC_PATH_MGR *pm, QUIC_PATH *path)
+{
+    size_t i;
+
+    for (i = 0; i < pm->num_paths; ++i)
+        if (pm->paths[i] == path)
+            break;
+
+    if (!ossl_assert(i < pm->num_paths && path != pm->active
+                     && path != pm->fallback))
+        return;
+
+    memmove(&pm->paths[i], &pm->paths[i + 1],
+            (pm->num_paths - i - 1) * sizeof(*pm->paths));
+    --pm->num_paths;
+
+    if (pm->donor == path)
+        pm->donor = NULL;
+
+    path_free(pm, path);
+}
+
+/* Makes room for a new path if needed. Returns 0 if none can be made. */
+static int make_room(QUIC_PATH_MGR *pm)
+{
+    QUIC_PATH *victim = NULL;
+    size_t i;
+
+    if (pm->num_paths < pm->max_paths)
+        return 1;
+
+    for (i = 0; i < pm->num_paths; ++i) {
+        QUIC_PATH *p = pm->paths[i];
+
+        if (p == pm->active || p == pm->fallback)
+            continue;
+
+        if (victim == NULL || ossl_time_compare(p->last_rx, victim->last_rx) < 0)
+            victim = p;
+    }
+
+    if (victim == NULL)
+        return 0;
+
+    remove_path(pm, victim);
+    return 1;
+}
+
+static QUIC_PATH *add_path(QUIC_PATH_MGR *pm, const BIO_ADDR *peer,
+                           const BIO_ADDR *local)
+{
+    QUIC_PATH *path;
+
+    if (!make_room(pm) || (path = path_new(pm, peer, local)) == NULL)
+        return NULL;
+
+    pm->paths[pm->num_paths++] = path;
+    return path;
+}
+
+/*
+ * Path Validation
+ * ---------------
+ */
+
+/* PTO without backoff (RFC 9002 s. 6.2.1). */
+static OSSL_TIME get_pto(const OSSL_STATM *statm)
+{
+    OSSL_TIME pto;
+
+    pto = ossl_time_add(statm->smoothed_rtt,
+                        ossl_time_max(ossl_time_multiply(statm->rtt_variance, 4),
+                                      ossl_ms2time(1)));
+
+    if (!ossl_time_is_infinite(statm->max_ack_delay))
+        pto = ossl_time_add(pto, statm->max_ack_delay);
+
+    return pto;
+}
+
+static int add_challenge(QUIC_PATH_MGR *pm, QUIC_PATH *path)
+{
+    uint64_t data;
+
+    if (RAND_bytes_ex(pm->libctx, (unsigned char *)&data, sizeof(data), 0) != 1)
+        return 0;
+
+    /* Forget the oldest challenge if we have too many outstanding. */
+    if (path->num_challenges == QUIC_PATH_MAX_CHALLENGES) {
+        memmove(&path->challenge[0], &path->challenge[1],
+                (QUIC_PATH_MAX_CHALLENGES - 1) * sizeof(path->challenge[0]));
+        --path->num_challenges;
+    }
+
+    path->challenge[path->num_challenges++] = data;
+    path->challenge_pending = 1;
+    path->retx_deadline = ossl_time_add(get_time(pm), get_pto(&path->statm));
+    return 1;
+}
+
+static int start_validation(QUIC_PATH_MGR *pm, QUIC_PATH *path)
+{
+    OSSL_TIME pto, timeout;
+
+    path->state             = QUIC_PATH_STATE_VALIDATING;
+    path->num_challenges    = 0;
+
+    /*
+     * RFC 9000 s. 8.2.4: the larger of the PTO of the current and new paths,
+     * times three, but no less than 6*kInitialRtt.
+     */
+    pto = get_pto(&path->statm);
+    if (pm->active != NULL)
+        pto = ossl_time_max(pto, get_pto(&pm->active->statm));
+
+    timeout = ossl_time_max(ossl_time_multiply(pto, 3),
+                            ossl_time_multiply(K_INITIAL_RTT, 6));
+    path->validation_deadline = ossl_time_add(get_time(pm), timeout);
+
+    return add_challenge(pm, path);
+}
+
+/* Swaps the RTT and congestion state of two paths. */
+static void swap_path_state(QUIC_PATH *a, QUIC_PATH *b)
+{
+    OSSL_STATM statm = a->statm;
+    PATH_CC *cc = a->cc;
+
+    a->statm    = b->statm;
+    a->cc       = b->cc;
+    b->statm    = statm;
+    b->cc       = cc;
+}
+
+static void update_ackm(QUIC_PATH_MGR *pm)
+{
+    if (pm->ackm != NULL)
+        ossl_ackm_set_path_state(pm->ackm, &pm->active->statm,
+                                 pm->active->cc->data);
+}
+
+static void set_active(QUIC_PATH_MGR *pm, QUIC_PATH *path)
+{
+    QUIC_PATH *old = pm->active;
+
+    if (path == old)
+        return;
+
+    pm->donor = NULL;
+
+    /*
+     * RFC 9002 s. 9.4: a change of port only is most likely a NAT rebinding,
+     * which does not change the network path, so keep the RTT estimate and
+     * congestion window rather than starting over. A path which has RTT
+     * samples of its own keeps them.
+     */
+    if (!path->statm.have_first_sample
+        && ossl_quic_addr_eq(&path->peer, &old->peer, 1)
+        && ossl_quic_addr_eq(&path->local, &old->local, 1)) {
+        swap_path_state(path, old);
+        if (path->state != QUIC_PATH_STATE_VALIDATED)
+            pm->donor = old;
+    }
+
+    pm->active = path;
+    if (path->state == QUIC_PATH_STATE_VALIDATED)
+        pm->fallback = path;
+
+    update_ackm(pm);
+}
+
+static void on_validated(QUIC_PATH_MGR *pm, QUIC_PATH *path)
+{
+    path->state             = QUIC_PATH_STATE_VALIDATED;
+    path->num_challenges    = 0;
+    path->challenge_pending = 0;
+
+    if (path == pm->active) {
+        pm->fallback    = path;
+        pm->donor       = NULL;
+    }
+}
+
+static void on_failed(QUIC_PATH_MGR *pm, QUIC_PATH *path)
+{
+    path->state             = QUIC_PATH_STATE_FAILED;
+    path->num_challenges    = 0;
+    path->challenge_pending = 0;
+
+    if (path == pm->active) {
+        /* RFC 9000 s. 9.3.2: revert to the last validated path. */
+        if (pm->donor != NULL)
+            swap_path_state(path, pm->donor);
+
+        pm->donor   = NULL;
+        pm->active  = pm->fallback;
+        update_ackm(pm);
+    }
+
+    remove_path(pm, path);
+}
+
+/*
+ * Path Manager
+ * ------------
+ */
+QUIC_PATH_MGR *ossl_quic_path_mgr_new(const QUIC_PATH_MGR_ARGS *args)
+{
+    QUIC_PATH_MGR *pm;
+    QUIC_PATH *path;
+
+    pm = OPENSSL_zalloc(sizeof(*pm));
+    if (pm == NULL)
+        return NULL;
+
+    pm->libctx      = args->libctx;
+    pm->propq       = args->propq;
+    pm->now         = args->now;
+    pm->now_arg     = args->now_arg;
+    pm->cc_method   = args->cc_method != NULL ? args->cc_method
+                                              : &ossl_cc_dummy_method;
+    pm->ackm        = args->ackm;
+    pm->is_server   = args->is_server;
+    pm->max_paths   = args->max_paths > 0 ? args->max_paths
+                                          : QUIC_PATH_DEFAULT_MAX_PATHS;
+
+    pm->paths = OPENSSL_zalloc(pm->max_paths * sizeof(*pm->paths));
+    if (pm->paths == NULL)
+        goto err;
+
+    if ((path = add_path(pm, args->peer, args->local)) == NULL)
+        goto err;
+
+    path->state     = QUIC_PATH_STATE_VALIDATED;
+    pm->active      = path;
+    pm->fallback    = path;
+    return pm;
+
+err:
+    ossl_quic_path_mgr_free(pm);
+    return NULL;
+}
+
+void ossl_quic_path_mgr_free(QUIC_PATH_MGR *pm)
+{
+    size_t i;
+
+    if (pm == NULL)
+        return;
+
+    for (i = 0; i < pm->num_paths; ++i)
+        path_free(pm, pm->paths[i]);
+
+    OPENSSL_free(pm->paths);
+    OPENSSL_free(pm);
+}
+
+void ossl_quic_path_mgr_set_ackm(QUIC_PATH_MGR *pm, OSSL_ACKM *ackm)
+{
+    pm->ackm = ackm;
+}
+
+QUIC_PATH *ossl_quic_path_mgr_get0_active(QUIC_PATH_MGR *pm)
+{
+    return pm->active;
+}
+
+size_t ossl_quic_path_mgr_get_num_paths(const QUIC_PATH_MGR *pm)
+{
+    return pm->num_paths;
+}
+
+QUIC_PATH *ossl_quic_path_mgr_on_rx(QUIC_PATH_MGR *pm, const BIO_ADDR *peer,
+                                    const BIO_ADDR *local, size_t len)
+{
+    QUIC_PATH *path = find_path(pm, peer, local);
+
+    /*
+     * RFC 9000 s. 9: any change in the peer's address must be validated before
+     * more than a little data is sent to it.
+     */
+    if (path == NULL) {
+        if ((path = add_path(pm, peer, local)) == NULL)
+            return NULL;
+
+        if (!start_validation(pm, path)) {
+            remove_path(pm, path);
+            return NULL;
+        }
+    }
+
+    path->bytes_rx  += len;
+    path->last_rx   = get_time(pm);
+    return path;
+}
+
+void ossl_quic_path_mgr_on_path_challenge(QUIC_PATH_MGR *pm, QUIC_PATH *path,
+                                          uint64_t data)
+{
+    /*
+     * A peer may send many challenges in one packet; answering them all would
+     * let it use us as an amplifier, so drop any beyond the limit.
+     */
+    if (path->num_responses < QUIC_PATH_MAX_RESPONSES)
+        path->response[path->num_responses++] = data;
+}
+
+void ossl_quic_path_mgr_on_path_response(QUIC_PATH_MGR *pm, QUIC_PATH *path,
+                                         uint64_t data)
+{
+    size_t i, j;
+
+    for (i = 0; i < pm->num_paths; ++i) {
+        QUIC_PATH *p = pm->paths[i];
+
+        if (p->state != QUIC_PATH_STATE_VALIDATING)
+            continue;
+
+        for (j = 0; j < p->num_challenges; ++j)
+            if (p->challenge[j] == data) {
+                on_validated(pm, p);
+                return;
+            }
+    }
+}
+
+int ossl_quic_path_mgr_on_non_probing(QUIC_PATH_MGR *pm, QUIC_PATH *path,
+                                      QUIC_PN pn)
+{
+    /* RFC 9000 s. 9.3: only the highest-numbered packet causes migration. */
+    if (pm->have_largest_pn && pn <= pm->largest_pn)
+        return 0;
+
+    pm->largest_pn      = pn;
+    pm->have_largest_pn = 1;
+
+    if (!pm->is_server || path == pm->active
+        || path->state == QUIC_PATH_STATE_FAILED)
+        return 0;
+
+    set_active(pm, path);
+    return 1;
+}
+
+QUIC_PATH *ossl_quic_path_mgr_probe(QUIC_PATH_MGR *pm, const BIO_ADDR *peer,
+                                    const BIO_ADDR *local)
+{
+    QUIC_PATH *path = find_path(pm, peer, local);
+
+    if (path != NULL)
+        return path;
+
+    if ((path = add_path(pm, peer, local)) == NULL)
+        return NULL;
+
+    if (!start_validation(pm, path)) {
+        remove_path(pm, path);
+        return NULL;
+    }
+
+    return path;
+}
+
+int ossl_quic_path_mgr_migrate(QUIC_PATH_MGR *pm, QUIC_PATH *path)
+{
+    if (path->state == QUIC_PATH_STATE_FAILED)
+        return 0;
+
+    set_active(pm, path);
+    return 1;
+}
+
+void ossl_quic_path_mgr_tick(QUIC_PATH_MGR *pm)
+{
+    OSSL_TIME now = get_time(pm);
+    size_t i = 0;
+
+    while (i < pm->num_paths) {
+        QUIC_PATH *p = pm->paths[i];
+
+        if (p->state == QUIC_PATH_STATE_VALIDATING) {
+            if (ossl_time_compare(now, p->validation_deadline) >= 0) {
+                /* p is removed, so do not advance. */
+                on_failed(pm, p);
+                continue;
+            }
+
+            if (ossl_time_compare(now, p->retx_deadline) >= 0)
+                add_challenge(pm, p);
+        }
+
+        ++i;
+    }
+}
+
+OSSL_TIME ossl_quic_path_mgr_get_tick_deadline(QUIC_PATH_MGR *pm)
+{
+    OSSL_TIME deadline = ossl_time_infinite();
+    size_t i;
+
+    for (i = 0; i < pm->num_paths; ++i) {
+        QUIC_PATH *p = pm->paths[i];
+
+        if (p->state != QUIC_PATH_STATE_VALIDATING)
+            continue;
+
+        deadline = ossl_time_min(deadline, p->validation_deadline);
+        deadline = ossl_time_min(deadline, p->retx_deadline);
+    }
+
+    return deadline;
+}
+
+QUIC_PATH *ossl_quic_path_mgr_get_next_tx_path(QUIC_PATH_MGR *pm)
+{
+    size_t i;
+
+    for (i = 0; i < pm->num_paths; ++i)
+        if (pm->paths[i]->num_responses > 0
+            || pm->paths[i]->challenge_pending)
+            return pm->paths[i];
+
+    return NULL;
+}
+
+/* Writes a whole frame to wpkt, or nothing if it does not fit. */
+static int write_frame(WPACKET *wpkt, int is_challenge, uint64_t data)
+{
+    unsigned char buf[16];
+    WPACKET tmp;
+    size_t len = 0;
+    int ok;
+
+    if (!WPACKET_init_static_len(&tmp, buf, sizeof(buf), 0))
+        return 0;
+
+    ok = (is_challenge ? ossl_quic_wire_encode_frame_path_challenge(&tmp, data)
+                       : ossl_quic_wire_encode_frame_path_response(&tmp, data))
+         && WPACKET_get_total_written(&tmp, &len);
+    WPACKET_finish(&tmp);
+
+    return ok && WPACKET_memcpy(wpkt, buf, len);
+}
+
+int ossl_quic_path_mgr_write_frames(QUIC_PATH_MGR *pm, QUIC_PATH *path,
+                                    WPACKET *wpkt, size_t *num_frames)
+{
+    size_t i;
+
+    *num_frames = 0;
+
+    for (i = 0; i < path->num_responses; ++i) {
+        if (!write_frame(wpkt, 0, path->response[i]))
+            break;
+
+        ++*num_frames;
+    }
+
+    memmove(&path->response[0], &path->response[i],
+            (path->num_responses - i) * sizeof(path->response[0]));
+    path->num_responses -= i;
+
+    /* Send the most recent challenge. */
+    if (path->challenge_pending
+        && write_frame(wpkt, 1, path->challenge[path->num_challenges - 1])) {
+        path->challenge_pending = 0;
+        ++*num_frames;
+    }
+
+    return 1;
+}
+
+void ossl_quic_path_mgr_on_tx(QUIC_PATH_MGR *pm, QUIC_PATH *path, size_t len)
+{
+    path->bytes_tx += len;
+}
+
+/*
+ * Path Accessors
+ * --------------
+ */
+const BIO_ADDR *ossl_quic_path_get0_peer(const QUIC_PATH *path)
+{
+    return &path->peer;
+}
+
+const BIO_ADDR *ossl_quic_path_get0_local(const QUIC_PATH *path)
+{
+    return &path->local;
+}
+
+int ossl_quic_path_get_state(const QUIC_PATH *path)
+{
+    return path->state;
+}
+
+OSSL_STATM *ossl_quic_path_get0_statm(QUIC_PATH *path)
+{
+    return &path->statm;
+}
+
+OSSL_CC_DATA *ossl_quic_path_get0_cc_data(QUIC_PATH *path)
+{
+    return path->cc->data;
+}
+
+uint64_t ossl_quic_path_get_tx_allowance(const QUIC_PATH *path)
+{
+    uint64_t limit;
+
+    if (path->state == QUIC_PATH_STATE_VALIDATED)
+        return UINT64_MAX;
+
+    /* RFC 9000 s. 8: three times the bytes received. */
+    limit = path->bytes_rx * 3;
+    return limit > path->bytes_tx ? limit - path->bytes_tx : 0;
+}
+
+void ossl_quic_path_set_mdpl(QUIC_PATH *path, size_t mdpl)
+{
+    path->cc->mdpl = mdpl;
+}
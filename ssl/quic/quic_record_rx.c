@@ -8,6 +8,7 @@
  */
 
 #include "internal/quic_record_rx.h"
+#include "internal/quic_trace.h"
 #include "quic_record_shared.h"
 #include "internal/common.h"
 #include "../ssl_local.h"
@@ -173,6 +174,9 @@ struct ossl_qrx_st {
 
     /* Initial key phase. For debugging use only; always 0 in real use. */
     unsigned char                   init_key_phase_bit;
+
+    /* Whether 0-RTT packets are accepted. */
+    unsigned char                   allow_0rtt;
 };
 
 static void qrx_on_rx(QUIC_URXE *urxe, void *arg);
@@ -197,7 +201,9 @@ OSSL_QRX *ossl_qrx_new(const OSSL_QRX_ARGS *args)
     qrx->demux                  = args->demux;
     qrx->short_conn_id_len      = args->short_conn_id_len;
     qrx->init_key_phase_bit     = args->init_key_phase_bit;
+    qrx->allow_0rtt             = args->allow_0rtt != 0;
     qrx->max_deferred           = args->max_deferred;
+    qrx->el_set.cache           = args->cipher_cache;
     return qrx;
 }
 
@@ -412,10 +418,11 @@ static RXE *qrx_resize_rxe(RXE_LIST *rxl, RXE *rxe, size_t n)
             rxl->head = rxe2;
         if (rxl->tail == rxe)
             rxl->tail = rxe2;
-        if (rxe->prev != NULL)
-            rxe->prev->next = rxe2;
-        if (rxe->next != NULL)
-            rxe->next->prev = rxe2;
+        /* The links were moved with the RXE; rxe itself has been freed. */
+        if (rxe2->prev != NULL)
+            rxe2->prev->next = rxe2;
+        if (rxe2->next != NULL)
+            rxe2->next->prev = rxe2;
     }
 
     rxe2->alloc_len = n;
@@ -507,8 +514,8 @@ static int qrx_validate_hdr_early(OSSL_QRX *qrx, RXE *rxe,
         && rxe->hdr.version != QUIC_VERSION_NONE)
         return 0;
 
-    /* Clients should never receive 0-RTT packets. */
-    if (rxe->hdr.type == QUIC_PKT_TYPE_0RTT)
+    /* Only servers receive 0-RTT packets. */
+    if (rxe->hdr.type == QUIC_PKT_TYPE_0RTT && !qrx->allow_0rtt)
         return 0;
 
     /* Version negotiation and retry packets must be the first packet. */
@@ -931,6 +938,9 @@ static int qrx_process_pkt(OSSL_QRX *qrx, QUIC_URXE *urxe,
     rxe->local  = urxe->local;
     rxe->time   = urxe->time;
 
+    QLOG_EVENT(packet_received, (qrx, rxe->time, rxe->hdr.type, rxe->pn,
+                                 (size_t)(eop - sop)));
+
     /* Move RXE to pending. */
     rxe_remove(&qrx->rx_free, rxe);
     rxe_insert_tail(&qrx->rx_pending, rxe);
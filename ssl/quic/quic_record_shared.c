@@ -17,6 +17,30 @@ static const unsigned char quic_v1_ku_label[] = {
     0x71, 0x75, 0x69, 0x63, 0x20, 0x6b, 0x75 /* "quic ku" */
 };
 
+/*
+ * HKDF-Expand-Label using the hash function of an EL, via the cipher cache if
+ * it has the EL's suite.
+ */
+static int el_hkdf_expand(OSSL_QRL_ENC_LEVEL_SET *els,
+                          OSSL_QRL_ENC_LEVEL *el,
+                          const unsigned char *secret,
+                          const unsigned char *label, size_t label_len,
+                          unsigned char *out, size_t out_len)
+{
+    if (els->cache != NULL
+        && ossl_qrl_cipher_cache_have_suite(els->cache, el->suite_id))
+        return ossl_qrl_cipher_cache_hkdf_expand(els->cache, el->suite_id,
+                                                 secret, label, label_len,
+                                                 out, out_len);
+
+    return tls13_hkdf_expand_ex(el->libctx, el->propq,
+                                el->md,
+                                secret,
+                                label, label_len,
+                                NULL, 0,
+                                out, out_len, 0);
+}
+
 OSSL_QRL_ENC_LEVEL *ossl_qrl_enc_level_set_get(OSSL_QRL_ENC_LEVEL_SET *els,
                                                uint32_t enc_level,
                                                int require_prov)
@@ -130,28 +154,29 @@ static int el_setup_keyslot(OSSL_QRL_ENC_LEVEL_SET *els,
     assert(el->cctx[keyslot] == NULL);
 
     /* Derive "quic iv" key. */
-    if (!tls13_hkdf_expand_ex(el->libctx, el->propq,
-                              el->md,
-                              secret,
-                              quic_v1_iv_label,
-                              sizeof(quic_v1_iv_label),
-                              NULL, 0,
-                              el->iv[keyslot], iv_len, 0))
+    if (!el_hkdf_expand(els, el, secret,
+                        quic_v1_iv_label, sizeof(quic_v1_iv_label),
+                        el->iv[keyslot], iv_len))
         goto err;
 
     /* Derive "quic key" key. */
-    if (!tls13_hkdf_expand_ex(el->libctx, el->propq,
-                              el->md,
-                              secret,
-                              quic_v1_key_label,
-                              sizeof(quic_v1_key_label),
-                              NULL, 0,
-                              key, key_len, 0))
+    if (!el_hkdf_expand(els, el, secret,
+                        quic_v1_key_label, sizeof(quic_v1_key_label),
+                        key, key_len))
         goto err;
 
     /* Create and initialise cipher context. */
-    if ((cipher = EVP_CIPHER_fetch(el->libctx, cipher_name, el->propq)) == NULL)
+    if (els->cache != NULL
+        && (cipher = ossl_qrl_cipher_cache_get0_cipher(els->cache,
+                                                       el->suite_id)) != NULL) {
+        if (!EVP_CIPHER_up_ref(cipher)) {
+            cipher = NULL;
+            goto err;
+        }
+    } else if ((cipher = EVP_CIPHER_fetch(el->libctx, cipher_name,
+                                          el->propq)) == NULL) {
         goto err;
+    }
 
     if ((cctx = EVP_CIPHER_CTX_new()) == NULL)
         goto err;
@@ -195,6 +220,8 @@ int ossl_qrl_enc_level_set_provide_secret(OSSL_QRL_ENC_LEVEL_SET *els,
     int have_ks0 = 0, have_ks1 = 0, own_md = 0;
     const char *md_name = ossl_qrl_get_suite_md_name(suite_id);
     size_t hpr_key_len, init_keyslot;
+    EVP_CIPHER *hpr_cipher;
+    uint32_t hpr_cipher_id;
 
     if (el == NULL || el->state != QRL_EL_STATE_UNPROV || md_name == NULL
         || init_key_phase_bit > 1 || is_tx < 0 || is_tx > 1)
@@ -206,9 +233,16 @@ int ossl_qrl_enc_level_set_provide_secret(OSSL_QRL_ENC_LEVEL_SET *els,
         return 0;
 
     if (md == NULL) {
-        md = EVP_MD_fetch(libctx, md_name, propq);
-        if (md == NULL)
-            return 0;
+        if (els->cache != NULL
+            && (md = ossl_qrl_cipher_cache_get0_md(els->cache,
+                                                   suite_id)) != NULL) {
+            if (!EVP_MD_up_ref(md))
+                return 0;
+        } else {
+            md = EVP_MD_fetch(libctx, md_name, propq);
+            if (md == NULL)
+                return 0;
+        }
 
         own_md = 1;
     }
@@ -223,13 +257,9 @@ int ossl_qrl_enc_level_set_provide_secret(OSSL_QRL_ENC_LEVEL_SET *els,
     el->is_tx       = (unsigned char)is_tx;
 
     /* Derive "quic hp" key. */
-    if (!tls13_hkdf_expand_ex(libctx, propq,
-                              md,
-                              secret,
-                              quic_v1_hp_label,
-                              sizeof(quic_v1_hp_label),
-                              NULL, 0,
-                              hpr_key, hpr_key_len, 0))
+    if (!el_hkdf_expand(els, el, secret,
+                        quic_v1_hp_label, sizeof(quic_v1_hp_label),
+                        hpr_key, hpr_key_len))
         goto err;
 
     /* Setup KS0 (or KS1 if init_key_phase_bit), our initial keyslot. */
@@ -241,13 +271,9 @@ int ossl_qrl_enc_level_set_provide_secret(OSSL_QRL_ENC_LEVEL_SET *els,
 
     if (enc_level == QUIC_ENC_LEVEL_1RTT) {
         /* Derive "quic ku" key (the epoch 1 secret). */
-        if (!tls13_hkdf_expand_ex(libctx, propq,
-                                  md,
-                                  secret,
-                                  quic_v1_ku_label,
-                                  sizeof(quic_v1_ku_label),
-                                  NULL, 0,
-                                  is_tx ? el->ku : ku_key, secret_len, 0))
+        if (!el_hkdf_expand(els, el, secret,
+                            quic_v1_ku_label, sizeof(quic_v1_ku_label),
+                            is_tx ? el->ku : ku_key, secret_len))
             goto err;
 
         if (!is_tx) {
@@ -259,23 +285,28 @@ int ossl_qrl_enc_level_set_provide_secret(OSSL_QRL_ENC_LEVEL_SET *els,
             have_ks1 = 1;
 
             /* Derive NEXT "quic ku" key (the epoch 2 secret). */
-            if (!tls13_hkdf_expand_ex(libctx, propq,
-                                      md,
-                                      ku_key,
-                                      quic_v1_ku_label,
-                                      sizeof(quic_v1_ku_label),
-                                      NULL, 0,
-                                      el->ku, secret_len, 0))
+            if (!el_hkdf_expand(els, el, ku_key,
+                                quic_v1_ku_label, sizeof(quic_v1_ku_label),
+                                el->ku, secret_len))
                 goto err;
         }
     }
 
     /* Setup header protection context. */
-    if (!ossl_quic_hdr_protector_init(&el->hpr,
-                                      libctx, propq,
-                                      ossl_qrl_get_suite_hdr_prot_cipher_id(suite_id),
-                                      hpr_key, hpr_key_len))
+    hpr_cipher_id = ossl_qrl_get_suite_hdr_prot_cipher_id(suite_id);
+    hpr_cipher = els->cache != NULL
+        ? ossl_qrl_cipher_cache_get0_hdr_prot_cipher(els->cache, suite_id)
+        : NULL;
+    if (hpr_cipher != NULL) {
+        if (!ossl_quic_hdr_protector_init_with_cipher(&el->hpr, hpr_cipher_id,
+                                                      hpr_cipher,
+                                                      hpr_key, hpr_key_len))
+            goto err;
+    } else if (!ossl_quic_hdr_protector_init(&el->hpr, libctx, propq,
+                                             hpr_cipher_id,
+                                             hpr_key, hpr_key_len)) {
         goto err;
+    }
 
     /*
      * We are now provisioned: KS0 has our current key (for key epoch 0), KS1
@@ -331,12 +362,9 @@ int ossl_qrl_enc_level_set_key_update(OSSL_QRL_ENC_LEVEL_SET *els,
     secret_len = ossl_qrl_get_suite_secret_len(el->suite_id);
 
     /* Derive NEXT "quic ku" key (the epoch n+1 secret). */
-    if (!tls13_hkdf_expand_ex(el->libctx, el->propq,
-                              el->md, el->ku,
-                              quic_v1_ku_label,
-                              sizeof(quic_v1_ku_label),
-                              NULL, 0,
-                              new_ku, secret_len, 0))
+    if (!el_hkdf_expand(els, el, el->ku,
+                        quic_v1_ku_label, sizeof(quic_v1_ku_label),
+                        new_ku, secret_len))
         return 0;
 
     el_teardown_keyslot(els, enc_level, 0);
@@ -396,13 +424,9 @@ int ossl_qrl_enc_level_set_key_cooldown_done(OSSL_QRL_ENC_LEVEL_SET *els,
         return 0;
 
     /* Derive NEXT "quic ku" key (the epoch n+1 secret). */
-    if (!tls13_hkdf_expand_ex(el->libctx, el->propq,
-                              el->md,
-                              el->ku,
-                              quic_v1_ku_label,
-                              sizeof(quic_v1_ku_label),
-                              NULL, 0,
-                              new_ku, secret_len, 0)) {
+    if (!el_hkdf_expand(els, el, el->ku,
+                        quic_v1_ku_label, sizeof(quic_v1_ku_label),
+                        new_ku, secret_len)) {
         el_teardown_keyslot(els, enc_level, ~el->key_epoch & 1);
         return 0;
     }
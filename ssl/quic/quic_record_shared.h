@@ -13,6 +13,7 @@
 # include <openssl/ssl.h>
 # include "internal/quic_types.h"
 # include "internal/quic_wire_pkt.h"
+# include "internal/quic_record_util.h"
 
 /*
  * QUIC Record Layer EL Management Utilities
@@ -85,6 +86,9 @@ typedef struct ossl_qrl_enc_level_st {
 
 typedef struct ossl_qrl_enc_level_set_st {
     OSSL_QRL_ENC_LEVEL el[QUIC_ENC_LEVEL_NUM];
+
+    /* Optional cache of algorithms used to provision ELs. Not owned. */
+    OSSL_QRL_CIPHER_CACHE *cache;
 } OSSL_QRL_ENC_LEVEL_SET;
 
 /*
@@ -7,7 +7,10 @@
  * https://www.openssl.org/source/license.html
  */
 
+#include <errno.h>
 #include "internal/quic_record_tx.h"
+#include "internal/quic_path.h"
+#include "internal/quic_trace.h"
 #include "internal/bio_addr.h"
 #include "internal/common.h"
 #include "quic_record_shared.h"
@@ -79,6 +82,17 @@ static void txe_insert_tail(TXE_LIST *l, TXE *e)
  * QTX
  * ===
  */
+
+/*
+ * Limits on the pacing parameters, which keep the token bucket arithmetic
+ * within 64 bits. The rate limit corresponds to about 80 Gbit/s.
+ */
+#define QTX_MAX_PACING_RATE     ((uint64_t)10000000000)
+#define QTX_MAX_PACING_BURST    ((size_t)0xffffffff)
+
+/* Maximum number of packets awaiting header protection. */
+#define QTX_HP_BATCH_LEN        32
+
 struct ossl_qtx_st {
     OSSL_LIB_CTX               *libctx;
     const char                 *propq;
@@ -89,9 +103,22 @@ struct ossl_qtx_st {
     /* TX BIO. */
     BIO                        *bio;
 
+    /*
+     * Maximum number of datagrams the BIO can send as a single message using
+     * segmentation offload, or 0 if unsupported. gso_buf is used to coalesce
+     * datagrams for this purpose and is allocated on first use. gso_works is
+     * set once a segmented message has been sent successfully.
+     */
+    size_t                      gso_segs;
+    unsigned char              *gso_buf;
+    int                         gso_works;
+
     /* TX maximum datagram payload length. */
     size_t                      mdpl;
 
+    /* Optional pool from which TXEs are allocated. */
+    QUIC_SLAB_POOL             *pool;
+
     /*
      * List of TXEs which are not currently in use. These are moved to the
      * pending list (possibly via tx_cons first) as they are filled.
@@ -119,8 +146,38 @@ struct ossl_qtx_st {
      * confidentiality limit.
      */
     uint64_t                    epoch_pkt_count;
+
+    /*
+     * Packets which have been encrypted but not yet header protected, and the
+     * header protector for each. Header protection is applied in batches, as
+     * the masks for many packets can be generated in a single cipher call. It
+     * must be applied before any datagram leaves the QTX, and before the
+     * buffers holding these packets move.
+     */
+    QUIC_PKT_HDR_PTRS           hp_ptrs[QTX_HP_BATCH_LEN];
+    QUIC_HDR_PROTECTOR         *hp_hpr[QTX_HP_BATCH_LEN];
+    size_t                      hp_count;
+
+    /* Time source for pacing. */
+    OSSL_TIME                 (*now)(void *arg);
+    void                       *now_arg;
+
+    /*
+     * Pacing state. Datagrams are released against a token bucket which fills
+     * at pacing_rate bytes per second up to pacing_burst bytes. pacing_rate is
+     * 0 if pacing is disabled.
+     */
+    uint64_t                    pacing_rate;
+    size_t                      pacing_burst;
+    size_t                      pacing_tokens;
+    OSSL_TIME                   pacing_last;
 };
 
+static size_t qtx_get_gso_segs(BIO *bio)
+{
+    return bio != NULL ? BIO_dgram_get_segment_cap(bio) : 0;
+}
+
 /* Instantiates a new QTX. */
 OSSL_QTX *ossl_qtx_new(const OSSL_QTX_ARGS *args)
 {
@@ -138,16 +195,29 @@ OSSL_QTX *ossl_qtx_new(const OSSL_QTX_ARGS *args)
     qtx->libctx             = args->libctx;
     qtx->propq              = args->propq;
     qtx->bio                = args->bio;
+    qtx->gso_segs           = qtx_get_gso_segs(args->bio);
     qtx->mdpl               = args->mdpl;
+    qtx->now                = args->now;
+    qtx->now_arg            = args->now_arg;
+    qtx->pool               = args->pool;
+    qtx->el_set.cache       = args->cipher_cache;
     return qtx;
 }
 
-static void qtx_cleanup_txl(TXE_LIST *l)
+static void qtx_free_txe(OSSL_QTX *qtx, TXE *txe)
+{
+    if (qtx->pool != NULL)
+        ossl_quic_slab_free(qtx->pool, txe);
+    else
+        OPENSSL_free(txe);
+}
+
+static void qtx_cleanup_txl(OSSL_QTX *qtx, TXE_LIST *l)
 {
     TXE *e, *enext;
     for (e = l->head; e != NULL; e = enext) {
         enext = e->next;
-        OPENSSL_free(e);
+        qtx_free_txe(qtx, e);
     }
     l->head = l->tail = NULL;
 }
@@ -158,14 +228,16 @@ void ossl_qtx_free(OSSL_QTX *qtx)
     uint32_t i;
 
     /* Free TXE queue data. */
-    qtx_cleanup_txl(&qtx->pending);
-    qtx_cleanup_txl(&qtx->free);
-    OPENSSL_free(qtx->cons);
+    qtx_cleanup_txl(qtx, &qtx->pending);
+    qtx_cleanup_txl(qtx, &qtx->free);
+    qtx_free_txe(qtx, qtx->cons);
 
     /* Drop keying material and crypto resources. */
     for (i = 0; i < QUIC_ENC_LEVEL_NUM; ++i)
         ossl_qrl_enc_level_set_discard(&qtx->el_set, i);
 
+    BIO_free(qtx->bio);
+    OPENSSL_free(qtx->gso_buf);
     OPENSSL_free(qtx);
 }
 
@@ -191,26 +263,78 @@ int ossl_qtx_provide_secret(OSSL_QTX              *qtx,
                                                  /*is_tx=*/1);
 }
 
+static void qtx_pending_to_free(OSSL_QTX *qtx);
+
+/*
+ * Applies header protection to all packets awaiting it. Consecutive packets
+ * using the same header protector are protected in a single call.
+ */
+static int qtx_flush_hp(OSSL_QTX *qtx)
+{
+    size_t i, j;
+
+    for (i = 0; i < qtx->hp_count; i = j) {
+        for (j = i + 1; j < qtx->hp_count && qtx->hp_hpr[j] == qtx->hp_hpr[i];
+             ++j);
+
+        if (!ossl_quic_hdr_protector_encrypt_many(qtx->hp_hpr[i],
+                                                  qtx->hp_ptrs + i, j - i))
+            goto err;
+    }
+
+    qtx->hp_count = 0;
+    return 1;
+
+err:
+    /*
+     * Some packets are not protected and must not be sent. This should never
+     * happen; discard everything queued, which the ACK manager will later
+     * consider lost.
+     */
+    while (qtx->pending.head != NULL)
+        qtx_pending_to_free(qtx);
+
+    if (qtx->cons != NULL) {
+        qtx->cons->data_len = 0;
+        qtx->cons_count     = 0;
+    }
+
+    qtx->hp_count = 0;
+    return 0;
+}
+
 int ossl_qtx_discard_enc_level(OSSL_QTX *qtx, uint32_t enc_level)
 {
     if (enc_level >= QUIC_ENC_LEVEL_NUM)
         return 0;
 
+    /* Packets awaiting header protection may use this EL's protector. */
+    qtx_flush_hp(qtx);
+
     ossl_qrl_enc_level_set_discard(&qtx->el_set, enc_level);
     return 1;
 }
 
 /* Allocate a new TXE. */
-static TXE *qtx_alloc_txe(size_t alloc_len)
+static TXE *qtx_alloc_txe(OSSL_QTX *qtx, size_t alloc_len)
 {
     TXE *txe;
 
     if (alloc_len >= SIZE_MAX - sizeof(TXE))
         return NULL;
 
-    txe = OPENSSL_malloc(sizeof(TXE) + alloc_len);
-    if (txe == NULL)
-        return NULL;
+    if (qtx->pool != NULL) {
+        txe = ossl_quic_slab_alloc(qtx->pool, sizeof(TXE) + alloc_len);
+        if (txe == NULL)
+            return NULL;
+
+        /* Use all of the space the size class gives us. */
+        alloc_len = ossl_quic_slab_usable_size(txe) - sizeof(TXE);
+    } else {
+        txe = OPENSSL_malloc(sizeof(TXE) + alloc_len);
+        if (txe == NULL)
+            return NULL;
+    }
 
     txe->prev = txe->next = NULL;
     txe->alloc_len = alloc_len;
@@ -232,7 +356,7 @@ static TXE *qtx_ensure_free_txe(OSSL_QTX *qtx, size_t alloc_len)
     if (qtx->free.head != NULL)
         return qtx->free.head;
 
-    txe = qtx_alloc_txe(alloc_len);
+    txe = qtx_alloc_txe(qtx, alloc_len);
     if (txe == NULL)
         return NULL;
 
@@ -256,24 +380,46 @@ static TXE *qtx_resize_txe(OSSL_QTX *qtx, TXE_LIST *txl, TXE *txe, size_t n)
     if (n >= SIZE_MAX - sizeof(TXE))
         return NULL;
 
-    /*
-     * NOTE: We do not clear old memory, although it does contain decrypted
-     * data.
-     */
-    txe2 = OPENSSL_realloc(txe, sizeof(TXE) + n);
-    if (txe2 == NULL)
-        /* original TXE is still in tact unchanged */
+    /* Packets awaiting header protection may be in this TXE. */
+    if (!qtx_flush_hp(qtx))
         return NULL;
 
+    if (qtx->pool != NULL) {
+        /* The size class may already have room, in which case nothing moves. */
+        if (ossl_quic_slab_usable_size(txe) >= sizeof(TXE) + n) {
+            txe->alloc_len = ossl_quic_slab_usable_size(txe) - sizeof(TXE);
+            return txe;
+        }
+
+        txe2 = qtx_alloc_txe(qtx, n);
+        if (txe2 == NULL)
+            /* original TXE is still in tact unchanged */
+            return NULL;
+
+        n = txe2->alloc_len;
+        memcpy(txe2, txe, sizeof(TXE) + txe->data_len);
+        qtx_free_txe(qtx, txe);
+    } else {
+        /*
+         * NOTE: We do not clear old memory, although it does contain decrypted
+         * data.
+         */
+        txe2 = OPENSSL_realloc(txe, sizeof(TXE) + n);
+        if (txe2 == NULL)
+            /* original TXE is still in tact unchanged */
+            return NULL;
+    }
+
     if (txl != NULL && txe != txe2) {
         if (txl->head == txe)
             txl->head = txe2;
         if (txl->tail == txe)
             txl->tail = txe2;
-        if (txe->prev != NULL)
-            txe->prev->next = txe2;
-        if (txe->next != NULL)
-            txe->next->prev = txe2;
+        /* The old TXE is no longer valid, so use the copied links. */
+        if (txe2->prev != NULL)
+            txe2->prev->next = txe2;
+        if (txe2->next != NULL)
+            txe2->next->prev = txe2;
     }
 
     if (qtx->cons == txe)
@@ -507,14 +653,26 @@ static int qtx_encrypt_into_txe(OSSL_QTX *qtx, struct iovec_cur *cur, TXE *txe,
 
     txe->data_len += el->tag_len;
 
-    /* Apply header protection. */
-    if (!ossl_quic_hdr_protector_encrypt(&el->hpr, ptrs))
+    /*
+     * Queue the packet for header protection, which the caller has ensured
+     * there is room for.
+     */
+    if (!ossl_assert(qtx->hp_count < QTX_HP_BATCH_LEN))
         return 0;
 
+    qtx->hp_ptrs[qtx->hp_count] = *ptrs;
+    qtx->hp_hpr[qtx->hp_count]  = &el->hpr;
+    ++qtx->hp_count;
+
     ++el->op_count;
     return 1;
 }
 
+static OSSL_TIME qtx_now(OSSL_QTX *qtx)
+{
+    return qtx->now != NULL ? qtx->now(qtx->now_arg) : ossl_time_now();
+}
+
 /*
  * Append a packet to the TXE buffer, serializing and encrypting it in the
  * process.
@@ -627,6 +785,8 @@ static int qtx_write(OSSL_QTX *qtx, const OSSL_QTX_PKT *pkt, TXE *txe,
         assert(txe->data_len - orig_data_len == pkt_len);
     }
 
+    QLOG_EVENT(packet_sent, (qtx, qtx_now(qtx), pkt->hdr->type, pkt->pn,
+                             txe->data_len - orig_data_len));
     return 1;
 
 err:
@@ -658,9 +818,11 @@ static TXE *qtx_ensure_cons(OSSL_QTX *qtx)
 
 static int addr_eq(const BIO_ADDR *a, const BIO_ADDR *b)
 {
-    return ((a == NULL || BIO_ADDR_family(a) == AF_UNSPEC)
-            && (b == NULL || BIO_ADDR_family(b) == AF_UNSPEC))
-        || (a != NULL && b != NULL && memcmp(a, b, sizeof(*a)) == 0);
+    /*
+     * Compare the addresses rather than the bytes of the BIO_ADDRs, which
+     * may differ in parts unused by the address family.
+     */
+    return ossl_quic_addr_eq(a, b, 0);
 }
 
 int ossl_qtx_write_pkt(OSSL_QTX *qtx, const OSSL_QTX_PKT *pkt)
@@ -675,6 +837,10 @@ int ossl_qtx_write_pkt(OSSL_QTX *qtx, const OSSL_QTX_PKT *pkt)
     if (pkt->hdr == NULL)
         return 0;
 
+    /* Make room to queue this packet for header protection. */
+    if (qtx->hp_count == QTX_HP_BATCH_LEN && !qtx_flush_hp(qtx))
+        return 0;
+
     enc_level = ossl_quic_pkt_type_to_enc_level(pkt->hdr->type);
 
     /* Some packet types must be in a packet all by themselves. */
@@ -710,7 +876,8 @@ int ossl_qtx_write_pkt(OSSL_QTX *qtx, const OSSL_QTX_PKT *pkt)
          * Ensure TXE has at least MDPL bytes allocated. This should only be
          * possible if the MDPL has increased.
          */
-        if (!qtx_reserve_txe(qtx, NULL, txe, qtx->mdpl))
+        txe = qtx_reserve_txe(qtx, NULL, txe, qtx->mdpl);
+        if (txe == NULL)
             return 0;
 
         if (!was_coalescing) {
@@ -799,46 +966,302 @@ static void txe_to_msg(TXE *txe, BIO_MSG *msg)
         = BIO_ADDR_family(&txe->local) != AF_UNSPEC ? &txe->local : NULL;
 }
 
+/* Adds tokens to the pacing bucket for the time elapsed since the last call. */
+static void qtx_pacer_refill(OSSL_QTX *qtx, OSSL_TIME now)
+{
+    uint64_t elapsed, added;
+
+    if (ossl_time_compare(now, qtx->pacing_last) <= 0)
+        return;
+
+    elapsed = ossl_time2ticks(ossl_time_subtract(now, qtx->pacing_last));
+    if (elapsed >= OSSL_TIME_SECOND) {
+        added = SIZE_MAX;
+    } else {
+        added = (qtx->pacing_rate * elapsed) / OSSL_TIME_SECOND;
+        if (added == 0)
+            return;
+    }
+
+    if (added >= qtx->pacing_burst - qtx->pacing_tokens) {
+        qtx->pacing_tokens  = qtx->pacing_burst;
+        qtx->pacing_last    = now;
+    } else {
+        /*
+         * Only advance by the time the added tokens correspond to, so that the
+         * fractional remainder is carried over to the next refill.
+         */
+        qtx->pacing_tokens += (size_t)added;
+        qtx->pacing_last    = ossl_time_add(qtx->pacing_last,
+                                            ossl_ticks2time(added
+                                                            * OSSL_TIME_SECOND
+                                                            / qtx->pacing_rate));
+    }
+}
+
+/*
+ * Returns the number of bytes the pacer allows us to release now, or SIZE_MAX
+ * if pacing is disabled.
+ */
+static size_t qtx_pacer_budget(OSSL_QTX *qtx)
+{
+    if (qtx->pacing_rate == 0)
+        return SIZE_MAX;
+
+    qtx_pacer_refill(qtx, qtx_now(qtx));
+    return qtx->pacing_tokens;
+}
+
+/*
+ * Returns 1 if a datagram of len bytes may be released given the remaining
+ * budget. A datagram larger than the burst size is released whenever the
+ * bucket is full, so that it cannot block the queue forever.
+ */
+static int qtx_pacer_allows(OSSL_QTX *qtx, size_t budget, size_t len)
+{
+    return len <= budget
+        || (qtx->pacing_rate != 0 && budget == qtx->pacing_burst);
+}
+
+static void qtx_pacer_consume(OSSL_QTX *qtx, size_t len)
+{
+    if (qtx->pacing_rate == 0)
+        return;
+
+    if (len >= qtx->pacing_tokens)
+        qtx->pacing_tokens = 0;
+    else
+        qtx->pacing_tokens -= len;
+}
+
+int ossl_qtx_set_pacing_rate(OSSL_QTX *qtx, uint64_t rate, size_t burst)
+{
+    if (rate > QTX_MAX_PACING_RATE || burst > QTX_MAX_PACING_BURST
+        || (rate != 0 && burst == 0))
+        return 0;
+
+    /* Start with a full bucket when pacing is enabled. */
+    if (qtx->pacing_rate == 0) {
+        qtx->pacing_tokens  = burst;
+        qtx->pacing_last    = qtx_now(qtx);
+    } else if (qtx->pacing_tokens > burst) {
+        qtx->pacing_tokens  = burst;
+    }
+
+    qtx->pacing_rate    = rate;
+    qtx->pacing_burst   = burst;
+    return 1;
+}
+
+OSSL_TIME ossl_qtx_get_flush_deadline(OSSL_QTX *qtx)
+{
+    TXE *txe = qtx->pending.head;
+    OSSL_TIME now;
+    uint64_t need;
+
+    if (txe == NULL)
+        return ossl_time_infinite();
+
+    if (qtx->pacing_rate == 0)
+        return ossl_time_zero();
+
+    now = qtx_now(qtx);
+    qtx_pacer_refill(qtx, now);
+
+    need = txe->data_len < qtx->pacing_burst ? txe->data_len
+                                              : qtx->pacing_burst;
+    if (qtx->pacing_tokens >= need)
+        return ossl_time_zero();
+
+    /* Round up so that the bucket is sufficiently full at the deadline. */
+    need -= qtx->pacing_tokens;
+    return ossl_time_add(qtx->pacing_last,
+                         ossl_ticks2time((need * OSSL_TIME_SECOND
+                                          + qtx->pacing_rate - 1)
+                                         / qtx->pacing_rate));
+}
+
 #define MAX_MSGS_PER_SEND   32
 
+/*
+ * Segmentation offload. Runs of pending datagrams with the same addresses and
+ * the same length (except that the last may be shorter) are copied into
+ * gso_buf and passed to the BIO as a single message, which the kernel splits
+ * back into datagrams. This saves most of the per-datagram cost of the network
+ * stack when sending at high rates.
+ */
+#define QTX_GSO_BUF_LEN     (128 * 1024)
+#define QTX_GSO_MAX_MSG_LEN 65507 /* maximum UDP payload over IPv4 */
+
+static int qtx_gso_ready(OSSL_QTX *qtx)
+{
+    if (qtx->gso_segs < 2)
+        return 0;
+
+    if (qtx->gso_buf == NULL
+        && (qtx->gso_buf = OPENSSL_malloc(QTX_GSO_BUF_LEN)) == NULL) {
+        qtx->gso_segs = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Returns 1 if a failed send was refused because the path cannot do
+ * segmentation offload. The kernel reports this with EIO (the device cannot
+ * checksum segments) or EINVAL (UDP_SEGMENT is not accepted). As these are only
+ * conclusive before any segmented send has worked, we do not believe them
+ * afterwards, and other errors such as EAGAIN or ENOBUFS are transient anyway.
+ */
+static int qtx_gso_refused(OSSL_QTX *qtx)
+{
+    unsigned long err = ERR_peek_last_error();
+
+    if (qtx->gso_works || !ERR_SYSTEM_ERROR(err))
+        return 0;
+
+    return ERR_GET_REASON(err) == EIO || ERR_GET_REASON(err) == EINVAL;
+}
+
+static void qtx_pacer_spend(size_t *budget, size_t len)
+{
+    *budget -= len < *budget ? len : *budget;
+}
+
+/*
+ * Fills msg with up to MAX_MSGS_PER_SEND messages for the datagrams at the
+ * head of the pending queue which the pacer allows to be sent. txe_count[i] is
+ * set to the number of datagrams covered by msg[i]. Returns the number of
+ * messages.
+ */
+static size_t qtx_build_msgs(OSSL_QTX *qtx, BIO_MSG *msg, size_t *txe_count,
+                             int use_gso)
+{
+    size_t budget = qtx_pacer_budget(qtx), num_msg = 0, gso_used = 0;
+    size_t seg, len;
+    TXE *txe = qtx->pending.head, *first;
+    unsigned char *p;
+    int shorter;
+
+    while (txe != NULL && num_msg < MAX_MSGS_PER_SEND) {
+        if (!qtx_pacer_allows(qtx, budget, txe->data_len))
+            break;
+
+        qtx_pacer_spend(&budget, txe->data_len);
+        txe_to_msg(txe, &msg[num_msg]);
+        txe_count[num_msg] = 1;
+        first   = txe;
+        txe     = txe->next;
+        seg     = first->data_len;
+        len     = seg;
+        p       = qtx->gso_buf + gso_used;
+
+        if (use_gso && seg <= BIO_MSG_SEGMENT_SIZE_MASK) {
+            while (txe != NULL
+                   && txe_count[num_msg] < qtx->gso_segs
+                   && txe->data_len <= seg
+                   && len + txe->data_len <= QTX_GSO_MAX_MSG_LEN
+                   && gso_used + len + txe->data_len <= QTX_GSO_BUF_LEN
+                   && addr_eq(&txe->peer, &first->peer)
+                   && addr_eq(&txe->local, &first->local)
+                   && qtx_pacer_allows(qtx, budget, txe->data_len)) {
+                if (txe_count[num_msg] == 1)
+                    memcpy(p, txe_data(first), seg);
+
+                memcpy(p + len, txe_data(txe), txe->data_len);
+                len += txe->data_len;
+                qtx_pacer_spend(&budget, txe->data_len);
+                ++txe_count[num_msg];
+
+                /* Only the last segment may be shorter. */
+                shorter = txe->data_len < seg;
+                txe = txe->next;
+                if (shorter)
+                    break;
+            }
+
+            if (txe_count[num_msg] > 1) {
+                msg[num_msg].data       = p;
+                msg[num_msg].data_len   = len;
+                msg[num_msg].flags      = seg;
+                gso_used += len;
+            }
+        }
+
+        ++num_msg;
+    }
+
+    return num_msg;
+}
+
 void ossl_qtx_flush_net(OSSL_QTX *qtx)
 {
     BIO_MSG msg[MAX_MSGS_PER_SEND];
-    size_t wr, i;
-    TXE *txe;
+    size_t txe_count[MAX_MSGS_PER_SEND];
+    size_t wr, i, j, num_msg;
+    int use_gso;
 
-    if (qtx->bio == NULL)
+    if (qtx->bio == NULL || !qtx_flush_hp(qtx))
         return;
 
     for (;;) {
-        for (txe = qtx->pending.head, i = 0;
-             txe != NULL && i < OSSL_NELEM(msg);
-             txe = txe->next, ++i)
-            txe_to_msg(txe, &msg[i]);
-
-        if (!i)
+        use_gso = qtx_gso_ready(qtx);
+        num_msg = qtx_build_msgs(qtx, msg, txe_count, use_gso);
+        if (num_msg == 0)
             /* Nothing to send. */
             return;
 
-        if (!BIO_sendmmsg(qtx->bio, msg, sizeof(BIO_MSG), i, 0, &wr) || wr == 0)
+        if (use_gso)
+            ERR_set_mark();
+
+        if (!BIO_sendmmsg(qtx->bio, msg, sizeof(BIO_MSG), num_msg, 0, &wr)
+            || wr == 0) {
+            if (use_gso && qtx_gso_refused(qtx)) {
+                /*
+                 * The path does not support segmentation offload. Stop using
+                 * it and send the same datagrams again without it.
+                 */
+                ERR_pop_to_mark();
+                qtx->gso_segs = 0;
+                continue;
+            }
+
+            if (use_gso)
+                ERR_clear_last_mark();
+
             /*
              * We did not get anything, so further calls will probably not
-             * succeed either.
+             * succeed either. The datagrams stay queued for the next flush.
              */
             break;
+        } else if (use_gso) {
+            ERR_pop_to_mark();
+        }
 
         /*
          * Remove everything which was successfully sent from the pending queue.
          */
-        for (i = 0; i < wr; ++i)
-            qtx_pending_to_free(qtx);
+        for (i = 0; i < wr; ++i) {
+            if (txe_count[i] > 1)
+                qtx->gso_works = 1;
+
+            for (j = 0; j < txe_count[i]; ++j) {
+                qtx_pacer_consume(qtx, qtx->pending.head->data_len);
+                qtx_pending_to_free(qtx);
+            }
+        }
     }
 }
 
 int ossl_qtx_pop_net(OSSL_QTX *qtx, BIO_MSG *msg)
 {
-    TXE *txe = qtx->pending.head;
+    TXE *txe;
+
+    if (!qtx_flush_hp(qtx))
+        return 0;
 
+    txe = qtx->pending.head;
     if (txe == NULL)
         return 0;
 
@@ -853,7 +1276,9 @@ int ossl_qtx_set1_bio(OSSL_QTX *qtx, BIO *bio)
         return 0;
 
     BIO_free(qtx->bio);
-    qtx->bio = bio;
+    qtx->bio        = bio;
+    qtx->gso_segs   = qtx_get_gso_segs(bio);
+    qtx->gso_works  = 0;
     return 1;
 }
 
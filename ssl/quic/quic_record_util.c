@@ -69,32 +69,16 @@ static const unsigned char quic_v1_initial_salt[] = {
     0x9a, 0xe6, 0xa4, 0xc8, 0x0c, 0xad, 0xcc, 0xbb, 0x7f, 0x0a
 };
 
-int ossl_quic_provide_initial_secret(OSSL_LIB_CTX *libctx,
-                                     const char *propq,
-                                     const QUIC_CONN_ID *dst_conn_id,
-                                     int is_server,
-                                     struct ossl_qrx_st *qrx,
-                                     struct ossl_qtx_st *qtx)
+/* Derives the Initial secrets requested for a DCID without a cache. */
+static int derive_initial_secrets(OSSL_LIB_CTX *libctx,
+                                  const char *propq,
+                                  const EVP_MD *sha256,
+                                  const QUIC_CONN_ID *dst_conn_id,
+                                  unsigned char *client_initial_secret,
+                                  unsigned char *server_initial_secret)
 {
     unsigned char initial_secret[32];
-    unsigned char client_initial_secret[32], server_initial_secret[32];
-    unsigned char *rx_secret, *tx_secret;
-    EVP_MD *sha256;
-
-    if (qrx == NULL && qtx == NULL)
-        return 1;
-
-    /* Initial encryption always uses SHA-256. */
-    if ((sha256 = EVP_MD_fetch(libctx, "SHA256", propq)) == NULL)
-        return 0;
-
-    if (is_server) {
-        rx_secret = client_initial_secret;
-        tx_secret = server_initial_secret;
-    } else {
-        rx_secret = server_initial_secret;
-        tx_secret = client_initial_secret;
-    }
+    int ok = 0;
 
     /* Derive initial secret from destination connection ID. */
     if (!ossl_quic_hkdf_extract(libctx, propq,
@@ -108,31 +92,100 @@ int ossl_quic_provide_initial_secret(OSSL_LIB_CTX *libctx,
         goto err;
 
     /* Derive "client in" secret. */
-    if (((qtx != NULL && tx_secret == client_initial_secret)
-         || (qrx != NULL && rx_secret == client_initial_secret))
+    if (client_initial_secret != NULL
         && !tls13_hkdf_expand_ex(libctx, propq,
                                  sha256,
                                  initial_secret,
                                  quic_client_in_label,
                                  sizeof(quic_client_in_label),
                                  NULL, 0,
-                                 client_initial_secret,
-                                 sizeof(client_initial_secret), 0))
+                                 client_initial_secret, 32, 0))
         goto err;
 
     /* Derive "server in" secret. */
-    if (((qtx != NULL && tx_secret == server_initial_secret)
-         || (qrx != NULL && rx_secret == server_initial_secret))
+    if (server_initial_secret != NULL
         && !tls13_hkdf_expand_ex(libctx, propq,
                                  sha256,
                                  initial_secret,
                                  quic_server_in_label,
                                  sizeof(quic_server_in_label),
                                  NULL, 0,
-                                 server_initial_secret,
-                                 sizeof(server_initial_secret), 0))
+                                 server_initial_secret, 32, 0))
         goto err;
 
+    ok = 1;
+err:
+    OPENSSL_cleanse(initial_secret, sizeof(initial_secret));
+    return ok;
+}
+
+static int cache_get_initial_secrets(OSSL_QRL_CIPHER_CACHE *cache,
+                                     const QUIC_CONN_ID *dst_conn_id,
+                                     unsigned char *client_initial_secret,
+                                     unsigned char *server_initial_secret);
+
+int ossl_quic_provide_initial_secret(OSSL_LIB_CTX *libctx,
+                                     const char *propq,
+                                     const QUIC_CONN_ID *dst_conn_id,
+                                     int is_server,
+                                     struct ossl_qrx_st *qrx,
+                                     struct ossl_qtx_st *qtx)
+{
+    return ossl_quic_provide_initial_secret_ex(libctx, propq, NULL,
+                                               dst_conn_id, is_server,
+                                               qrx, qtx);
+}
+
+int ossl_quic_provide_initial_secret_ex(OSSL_LIB_CTX *libctx,
+                                        const char *propq,
+                                        OSSL_QRL_CIPHER_CACHE *cache,
+                                        const QUIC_CONN_ID *dst_conn_id,
+                                        int is_server,
+                                        struct ossl_qrx_st *qrx,
+                                        struct ossl_qtx_st *qtx)
+{
+    unsigned char client_initial_secret[32], server_initial_secret[32];
+    unsigned char *rx_secret, *tx_secret;
+    EVP_MD *sha256;
+    int ok = 0;
+
+    if (qrx == NULL && qtx == NULL)
+        return 1;
+
+    if (is_server) {
+        rx_secret = client_initial_secret;
+        tx_secret = server_initial_secret;
+    } else {
+        rx_secret = server_initial_secret;
+        tx_secret = client_initial_secret;
+    }
+
+    if (cache != NULL
+        && ossl_qrl_cipher_cache_have_suite(cache, QRL_SUITE_AES128GCM)) {
+        sha256 = ossl_qrl_cipher_cache_get0_md(cache, QRL_SUITE_AES128GCM);
+        if (!EVP_MD_up_ref(sha256))
+            return 0;
+
+        if (!cache_get_initial_secrets(cache, dst_conn_id,
+                                       client_initial_secret,
+                                       server_initial_secret))
+            goto err;
+    } else {
+        /* Initial encryption always uses SHA-256. */
+        if ((sha256 = EVP_MD_fetch(libctx, "SHA256", propq)) == NULL)
+            return 0;
+
+        /* Only derive the secrets we need. */
+        if (!derive_initial_secrets(libctx, propq, sha256, dst_conn_id,
+                                    (qtx != NULL && !is_server)
+                                    || (qrx != NULL && is_server)
+                                    ? client_initial_secret : NULL,
+                                    (qtx != NULL && is_server)
+                                    || (qrx != NULL && !is_server)
+                                    ? server_initial_secret : NULL))
+            goto err;
+    }
+
     /* Setup RX EL. Initial encryption always uses AES-128-GCM. */
     if (qrx != NULL
         && !ossl_qrx_provide_secret(qrx, QUIC_ENC_LEVEL_INITIAL,
@@ -161,11 +214,13 @@ int ossl_quic_provide_initial_secret(OSSL_LIB_CTX *libctx,
                                     sizeof(server_initial_secret)))
         goto err;
 
-    return 1;
-
+    ok = 1;
+    sha256 = NULL;
 err:
     EVP_MD_free(sha256);
-    return 0;
+    OPENSSL_cleanse(client_initial_secret, sizeof(client_initial_secret));
+    OPENSSL_cleanse(server_initial_secret, sizeof(server_initial_secret));
+    return ok;
 }
 
 /*
@@ -275,3 +330,329 @@ uint64_t ossl_qrl_get_suite_max_forged_pkt(uint32_t suite_id)
     const struct suite_info *c = get_suite(suite_id);
     return c != NULL ? c->max_forged_pkt : UINT64_MAX;
 }
+
+/*
+ * QUIC Record Layer Cipher Cache
+ * ==============================
+ */
+#define NUM_SUITES  3
+
+struct qrl_cache_suite {
+    EVP_CIPHER      *cipher, *hdr_prot_cipher;
+    EVP_MD          *md;
+
+    /* TLS 1.3 KDF in expand-only mode, with digest and label prefix set. */
+    EVP_KDF_CTX     *expand;
+    size_t          md_size;
+};
+
+struct qrl_cache_initial {
+    QUIC_CONN_ID    dcid;
+    unsigned char   valid;
+    unsigned char   client_secret[32], server_secret[32];
+};
+
+struct ossl_qrl_cipher_cache_st {
+    struct qrl_cache_suite      suite[NUM_SUITES];
+
+    /* HKDF in extract-only mode, with SHA256 and the Initial salt set. */
+    EVP_KDF_CTX                 *initial_extract;
+
+    /* Initial secrets of recent DCIDs, indexed by a hash of the DCID. */
+    CRYPTO_RWLOCK               *lock;
+    struct qrl_cache_initial    initial[QRL_CIPHER_CACHE_NUM_INITIAL];
+};
+
+static const char tls13_label_prefix[] = "tls13 ";
+
+static const struct qrl_cache_suite *
+cache_get_suite(const OSSL_QRL_CIPHER_CACHE *cache, uint32_t suite_id)
+{
+    const struct qrl_cache_suite *s;
+
+    if (suite_id < 1 || suite_id > NUM_SUITES)
+        return NULL;
+
+    s = &cache->suite[suite_id - 1];
+    return s->expand != NULL ? s : NULL;
+}
+
+static void cache_suite_cleanup(struct qrl_cache_suite *s)
+{
+    EVP_KDF_CTX_free(s->expand);
+    EVP_MD_free(s->md);
+    EVP_CIPHER_free(s->hdr_prot_cipher);
+    EVP_CIPHER_free(s->cipher);
+    memset(s, 0, sizeof(*s));
+}
+
+static int cache_suite_init(struct qrl_cache_suite *s, OSSL_LIB_CTX *libctx,
+                            const char *propq, uint32_t suite_id)
+{
+    const char *hdr_prot_cipher_name;
+    EVP_KDF *kdf = NULL;
+    OSSL_PARAM params[4], *p = params;
+    int mode = EVP_PKEY_HKDEF_MODE_EXPAND_ONLY, md_size;
+
+    switch (ossl_qrl_get_suite_hdr_prot_cipher_id(suite_id)) {
+        case QUIC_HDR_PROT_CIPHER_AES_128:
+            hdr_prot_cipher_name = "AES-128-ECB";
+            break;
+        case QUIC_HDR_PROT_CIPHER_AES_256:
+            hdr_prot_cipher_name = "AES-256-ECB";
+            break;
+        case QUIC_HDR_PROT_CIPHER_CHACHA:
+            hdr_prot_cipher_name = "ChaCha20";
+            break;
+        default:
+            return 0;
+    }
+
+    /* A fetch failure just means the suite is not cached; clear the error. */
+    ERR_set_mark();
+    s->cipher = EVP_CIPHER_fetch(libctx,
+                                 ossl_qrl_get_suite_cipher_name(suite_id),
+                                 propq);
+    s->hdr_prot_cipher = EVP_CIPHER_fetch(libctx, hdr_prot_cipher_name, propq);
+    s->md = EVP_MD_fetch(libctx, ossl_qrl_get_suite_md_name(suite_id), propq);
+    kdf = EVP_KDF_fetch(libctx, OSSL_KDF_NAME_TLS1_3_KDF, propq);
+    ERR_pop_to_mark();
+
+    if (s->cipher == NULL || s->hdr_prot_cipher == NULL || s->md == NULL
+        || kdf == NULL
+        || (md_size = EVP_MD_get_size(s->md)) <= 0
+        || (s->expand = EVP_KDF_CTX_new(kdf)) == NULL)
+        goto err;
+
+    *p++ = OSSL_PARAM_construct_int(OSSL_KDF_PARAM_MODE, &mode);
+    *p++ = OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST,
+                                            (char *)EVP_MD_get0_name(s->md),
+                                            0);
+    *p++ = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_PREFIX,
+                                             (unsigned char *)tls13_label_prefix,
+                                             sizeof(tls13_label_prefix) - 1);
+    *p++ = OSSL_PARAM_construct_end();
+
+    if (!EVP_KDF_CTX_set_params(s->expand, params))
+        goto err;
+
+    s->md_size = (size_t)md_size;
+    EVP_KDF_free(kdf);
+    return 1;
+
+err:
+    EVP_KDF_free(kdf);
+    cache_suite_cleanup(s);
+    return 0;
+}
+
+OSSL_QRL_CIPHER_CACHE *ossl_qrl_cipher_cache_new(OSSL_LIB_CTX *libctx,
+                                                 const char *propq)
+{
+    OSSL_QRL_CIPHER_CACHE *cache;
+    EVP_KDF *kdf = NULL;
+    OSSL_PARAM params[4], *p = params;
+    int mode = EVP_PKEY_HKDEF_MODE_EXTRACT_ONLY;
+    uint32_t i;
+
+    cache = OPENSSL_zalloc(sizeof(*cache));
+    if (cache == NULL)
+        return NULL;
+
+    if ((cache->lock = CRYPTO_THREAD_lock_new()) == NULL)
+        goto err;
+
+    for (i = 0; i < NUM_SUITES; ++i)
+        cache_suite_init(&cache->suite[i], libctx, propq, i + 1);
+
+    /* Initial secrets are only cached if the Initial suite is. */
+    if (cache_get_suite(cache, QRL_SUITE_AES128GCM) == NULL)
+        return cache;
+
+    if ((kdf = EVP_KDF_fetch(libctx, OSSL_KDF_NAME_HKDF, propq)) == NULL
+        || (cache->initial_extract = EVP_KDF_CTX_new(kdf)) == NULL)
+        goto err;
+
+    *p++ = OSSL_PARAM_construct_int(OSSL_KDF_PARAM_MODE, &mode);
+    *p++ = OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST,
+                                            (char *)ossl_qrl_get_suite_md_name(QRL_SUITE_AES128GCM),
+                                            0);
+    *p++ = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT,
+                                             (unsigned char *)quic_v1_initial_salt,
+                                             sizeof(quic_v1_initial_salt));
+    *p++ = OSSL_PARAM_construct_end();
+
+    if (!EVP_KDF_CTX_set_params(cache->initial_extract, params))
+        goto err;
+
+    EVP_KDF_free(kdf);
+    return cache;
+
+err:
+    EVP_KDF_free(kdf);
+    ossl_qrl_cipher_cache_free(cache);
+    return NULL;
+}
+
+void ossl_qrl_cipher_cache_free(OSSL_QRL_CIPHER_CACHE *cache)
+{
+    size_t i;
+
+    if (cache == NULL)
+        return;
+
+    for (i = 0; i < NUM_SUITES; ++i)
+        cache_suite_cleanup(&cache->suite[i]);
+
+    EVP_KDF_CTX_free(cache->initial_extract);
+    CRYPTO_THREAD_lock_free(cache->lock);
+    OPENSSL_clear_free(cache, sizeof(*cache));
+}
+
+int ossl_qrl_cipher_cache_have_suite(const OSSL_QRL_CIPHER_CACHE *cache,
+                                     uint32_t suite_id)
+{
+    return cache_get_suite(cache, suite_id) != NULL;
+}
+
+EVP_CIPHER *ossl_qrl_cipher_cache_get0_cipher(const OSSL_QRL_CIPHER_CACHE *cache,
+                                              uint32_t suite_id)
+{
+    const struct qrl_cache_suite *s = cache_get_suite(cache, suite_id);
+
+    return s != NULL ? s->cipher : NULL;
+}
+
+EVP_CIPHER *
+ossl_qrl_cipher_cache_get0_hdr_prot_cipher(const OSSL_QRL_CIPHER_CACHE *cache,
+                                           uint32_t suite_id)
+{
+    const struct qrl_cache_suite *s = cache_get_suite(cache, suite_id);
+
+    return s != NULL ? s->hdr_prot_cipher : NULL;
+}
+
+EVP_MD *ossl_qrl_cipher_cache_get0_md(const OSSL_QRL_CIPHER_CACHE *cache,
+                                      uint32_t suite_id)
+{
+    const struct qrl_cache_suite *s = cache_get_suite(cache, suite_id);
+
+    return s != NULL ? s->md : NULL;
+}
+
+int ossl_qrl_cipher_cache_hkdf_expand(const OSSL_QRL_CIPHER_CACHE *cache,
+                                      uint32_t suite_id,
+                                      const unsigned char *secret,
+                                      const unsigned char *label,
+                                      size_t label_len,
+                                      unsigned char *out, size_t out_len)
+{
+    const struct qrl_cache_suite *s = cache_get_suite(cache, suite_id);
+    EVP_KDF_CTX *kctx;
+    OSSL_PARAM params[3], *p = params;
+    int ok;
+
+    /*
+     * The template is shared between threads, so derive using a copy of it,
+     * which is still much cheaper than fetching and configuring a new one.
+     */
+    if (s == NULL || (kctx = EVP_KDF_CTX_dup(s->expand)) == NULL)
+        return 0;
+
+    *p++ = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY,
+                                             (unsigned char *)secret,
+                                             s->md_size);
+    *p++ = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_LABEL,
+                                             (unsigned char *)label,
+                                             label_len);
+    *p++ = OSSL_PARAM_construct_end();
+
+    ok = EVP_KDF_derive(kctx, out, out_len, params) > 0;
+    EVP_KDF_CTX_free(kctx);
+    return ok;
+}
+
+static size_t cache_initial_slot(const QUIC_CONN_ID *dcid)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < dcid->id_len; ++i)
+        h = (h ^ dcid->id[i]) * 16777619;
+
+    return (h ^ (h >> 16)) % QRL_CIPHER_CACHE_NUM_INITIAL;
+}
+
+static int cache_get_initial_secrets(OSSL_QRL_CIPHER_CACHE *cache,
+                                     const QUIC_CONN_ID *dst_conn_id,
+                                     unsigned char *client_initial_secret,
+                                     unsigned char *server_initial_secret)
+{
+    struct qrl_cache_initial *ent
+        = &cache->initial[cache_initial_slot(dst_conn_id)];
+    unsigned char initial_secret[32];
+    OSSL_PARAM params[2];
+    EVP_KDF_CTX *kctx = NULL;
+    int hit = 0, ok = 0;
+
+    if (cache->initial_extract == NULL
+        || dst_conn_id->id_len > QUIC_MAX_CONN_ID_LEN)
+        return 0;
+
+    if (!CRYPTO_THREAD_read_lock(cache->lock))
+        return 0;
+
+    if (ent->valid && ossl_quic_conn_id_eq(&ent->dcid, dst_conn_id)) {
+        memcpy(client_initial_secret, ent->client_secret,
+               sizeof(ent->client_secret));
+        memcpy(server_initial_secret, ent->server_secret,
+               sizeof(ent->server_secret));
+        hit = 1;
+    }
+
+    CRYPTO_THREAD_unlock(cache->lock);
+    if (hit)
+        return 1;
+
+    /* Derive initial secret from destination connection ID. */
+    params[0] = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY,
+                                                  (unsigned char *)dst_conn_id->id,
+                                                  dst_conn_id->id_len);
+    params[1] = OSSL_PARAM_construct_end();
+
+    if ((kctx = EVP_KDF_CTX_dup(cache->initial_extract)) == NULL
+        || EVP_KDF_derive(kctx, initial_secret, sizeof(initial_secret),
+                          params) <= 0)
+        goto err;
+
+    /* Derive "client in" and "server in" secrets. */
+    if (!ossl_qrl_cipher_cache_hkdf_expand(cache, QRL_SUITE_AES128GCM,
+                                           initial_secret,
+                                           quic_client_in_label,
+                                           sizeof(quic_client_in_label),
+                                           client_initial_secret, 32)
+        || !ossl_qrl_cipher_cache_hkdf_expand(cache, QRL_SUITE_AES128GCM,
+                                              initial_secret,
+                                              quic_server_in_label,
+                                              sizeof(quic_server_in_label),
+                                              server_initial_secret, 32))
+        goto err;
+
+    /* A DCID which shares the slot is simply replaced. */
+    if (!CRYPTO_THREAD_write_lock(cache->lock))
+        goto err;
+
+    ent->dcid   = *dst_conn_id;
+    ent->valid  = 1;
+    memcpy(ent->client_secret, client_initial_secret,
+           sizeof(ent->client_secret));
+    memcpy(ent->server_secret, server_initial_secret,
+           sizeof(ent->server_secret));
+    CRYPTO_THREAD_unlock(cache->lock);
+
+    ok = 1;
+err:
+    EVP_KDF_CTX_free(kctx);
+    OPENSSL_cleanse(initial_secret, sizeof(initial_secret));
+    return ok;
+}
@@ -14,7 +14,7 @@
 #include "internal/quic_ackm.h"
 #include "internal/quic_rx_depack.h"
 
-#include "quic_record_rx_wrap.h"
+#include "internal/quic_record_rx_wrap.h"
 #include "quic_local.h"
 #include "../ssl_local.h"
 
@@ -25,6 +25,7 @@
  */
 #define GET_CONN_ACKM(c)        ((c)->ackm)
 #define GET_CONN_QRX(c)         ((c)->qrx)
+#define GET_CONN_PATH_MGR(c)    ((c)->path_mgr)
 #define GET_CONN_STATEM(c)      ((c)->ssl.statem)
 
 #if 0                            /* Currently unimplemented */
@@ -74,6 +75,10 @@ static int ssl_get_stream_type(QUIC_STREAM *stream)
  * we get the reference counting QRX packet wrapper so it can increment the
  * reference count.  When the data is consumed (i.e. as a result of, say,
  * SSL_read()), ossl_qrx_pkt_wrap_free() must be called.
+ *
+ * The QUIC_RSTREAM (see internal/quic_stream.h) does exactly this, so once
+ * QUIC_STREAM exists, this should simply call ossl_quic_rstream_queue_data()
+ * on its receive part.
  */
 static int ssl_queue_data(QUIC_STREAM *stream, OSSL_QRX_PKT_WRAP *pkt_wrap,
                           const unsigned char *data, uint64_t data_len,
@@ -474,6 +479,7 @@ static int depack_do_frame_retire_conn_id(PACKET *pkt,
 
 static int depack_do_frame_path_challenge(PACKET *pkt,
                                           QUIC_CONNECTION *connection,
+                                          QUIC_PATH *path,
                                           OSSL_ACKM_RX_PKT *ackm_data)
 {
     uint64_t frame_data = 0;
@@ -484,13 +490,17 @@ static int depack_do_frame_path_challenge(PACKET *pkt,
     /* This frame makes the packet ACK eliciting */
     ackm_data->is_ack_eliciting = 1;
 
-    /* TODO(QUIC): ADD CODE to send |frame_data| to the connection manager */
+    /* The response is sent on the path the challenge arrived on. */
+    if (path != NULL)
+        ossl_quic_path_mgr_on_path_challenge(GET_CONN_PATH_MGR(connection),
+                                             path, frame_data);
 
     return 1;
 }
 
 static int depack_do_frame_path_response(PACKET *pkt,
                                          QUIC_CONNECTION *connection,
+                                         QUIC_PATH *path,
                                          OSSL_ACKM_RX_PKT *ackm_data)
 {
     uint64_t frame_data = 0;
@@ -501,7 +511,9 @@ static int depack_do_frame_path_response(PACKET *pkt,
     /* This frame makes the packet ACK eliciting */
     ackm_data->is_ack_eliciting = 1;
 
-    /* TODO(QUIC): ADD CODE to send |frame_data| to the connection manager */
+    if (path != NULL)
+        ossl_quic_path_mgr_on_path_response(GET_CONN_PATH_MGR(connection),
+                                            path, frame_data);
 
     return 1;
 }
@@ -559,16 +571,26 @@ static int depack_do_frame_unknown_extension(PACKET *pkt,
 
 static int depack_process_frames(QUIC_CONNECTION *connection, PACKET *pkt,
                                  OSSL_QRX_PKT_WRAP *parent_pkt, int packet_space,
-                                 OSSL_TIME received, OSSL_ACKM_RX_PKT *ackm_data)
+                                 OSSL_TIME received, OSSL_ACKM_RX_PKT *ackm_data,
+                                 QUIC_PATH *path, int *probing_only)
 {
     uint32_t pkt_type = parent_pkt->pkt->hdr->type;
 
+    *probing_only = 1;
+
     while (PACKET_remaining(pkt) > 0) {
         uint64_t frame_type;
 
         if (!ossl_quic_wire_peek_frame_header(pkt, &frame_type))
             return 0;
 
+        /* RFC 9000 s. 9.1: probing frames do not cause migration. */
+        if (frame_type != OSSL_QUIC_FRAME_TYPE_PADDING
+            && frame_type != OSSL_QUIC_FRAME_TYPE_PATH_CHALLENGE
+            && frame_type != OSSL_QUIC_FRAME_TYPE_PATH_RESPONSE
+            && frame_type != OSSL_QUIC_FRAME_TYPE_NEW_CONN_ID)
+            *probing_only = 0;
+
         switch (frame_type) {
         case OSSL_QUIC_FRAME_TYPE_PING:
             /* Allowed in all packet types */
@@ -712,14 +734,16 @@ static int depack_process_frames(QUIC_CONNECTION *connection, PACKET *pkt,
             if (pkt_type != QUIC_PKT_TYPE_0RTT
                 && pkt_type != QUIC_PKT_TYPE_1RTT)
                 return 0;
-            if (!depack_do_frame_path_challenge(pkt, connection, ackm_data))
+            if (!depack_do_frame_path_challenge(pkt, connection, path,
+                                                ackm_data))
                 return 0;
             break;
         case OSSL_QUIC_FRAME_TYPE_PATH_RESPONSE:
             /* PATH_RESPONSE frames are valid in 1RTT packets */
             if (pkt_type != QUIC_PKT_TYPE_1RTT)
                 return 0;
-            if (!depack_do_frame_path_response(pkt, connection, ackm_data))
+            if (!depack_do_frame_path_response(pkt, connection, path,
+                                               ackm_data))
                 return 0;
             break;
 
@@ -760,6 +784,8 @@ int ossl_quic_handle_frames(QUIC_CONNECTION *connection, OSSL_QRX_PKT *qpacket)
     PACKET pkt;
     OSSL_ACKM_RX_PKT ackm_data;
     OSSL_QRX_PKT_WRAP *qpkt_wrap = NULL;
+    QUIC_PATH *path = NULL;
+    int probing_only = 1;
     /*
      * ok has three states:
      * -1 error with ackm_data uninitialized
@@ -805,13 +831,29 @@ int ossl_quic_handle_frames(QUIC_CONNECTION *connection, OSSL_QRX_PKT *qpacket)
         goto success;
     }
 
+    /*
+     * Find the path the packet arrived on. Only the payload length is counted
+     * towards the anti-amplification limit, as other packets in the same
+     * datagram are reported separately.
+     */
+    if (GET_CONN_PATH_MGR(connection) != NULL)
+        path = ossl_quic_path_mgr_on_rx(GET_CONN_PATH_MGR(connection),
+                                        qpacket->peer, qpacket->local,
+                                        qpacket->hdr->len);
+
     /* Now that special cases are out of the way, parse frames */
     if (!PACKET_buf_init(&pkt, qpacket->hdr->data, qpacket->hdr->len)
         || !depack_process_frames(connection, &pkt, qpkt_wrap,
                                   ackm_data.pkt_space, qpacket->time,
-                                  &ackm_data))
+                                  &ackm_data, path, &probing_only))
         goto end;
 
+    /* A non-probing packet from a new address may mean the peer migrated. */
+    if (path != NULL && !probing_only
+        && qpacket->hdr->type == QUIC_PKT_TYPE_1RTT)
+        ossl_quic_path_mgr_on_non_probing(GET_CONN_PATH_MGR(connection),
+                                          path, qpacket->pn);
+
  success:
     ok = 1;
  end:
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include "internal/quic_slab.h"
+#include "internal/common.h"
+
+#if defined(OPENSSL_SYS_LINUX)
+# include <sys/mman.h>
+# if defined(MADV_HUGEPAGE) && defined(MAP_ANONYMOUS)
+#  define SLAB_USE_MMAP
+# endif
+#endif
+
+/*
+ * Each object is preceded by a header recording its size class, so that the
+ * class need not be passed back to us on free. The header is 16 bytes so that
+ * objects remain suitably aligned.
+ */
+typedef union slab_obj_hdr_u {
+    size_t          cls;
+    long double     align1;
+    void           *align2;
+    uint64_t        align3;
+} SLAB_OBJ_HDR;
+
+/* While an object is free, its memory holds the free list link. */
+typedef struct slab_free_st {
+    struct slab_free_st    *next;
+} SLAB_FREE;
+
+/* Each slab starts with this header; objects are carved from the remainder. */
+typedef union slab_hdr_u {
+    struct {
+        union slab_hdr_u   *next;
+        size_t              len;
+        int                 mapped;
+    } s;
+    SLAB_OBJ_HDR            align;
+} SLAB_HDR;
+
+#define SLAB_NUM_CLASSES    10 /* 256 bytes to 128 KiB */
+#define SLAB_LEN            (64 * 1024)
+#define SLAB_HUGE_LEN       (2 * 1024 * 1024)
+#define SLAB_MIN_OBJS       4
+
+typedef struct slab_class_st {
+    SLAB_FREE              *free;
+
+    /* Uncarved remainder of the most recently obtained slab. */
+    unsigned char          *bump, *bump_end;
+} SLAB_CLASS;
+
+struct quic_slab_pool_st {
+    CRYPTO_RWLOCK          *lock;
+    uint32_t                flags;
+    size_t                  max_bytes;
+    SLAB_HDR               *slabs;
+    SLAB_CLASS              classes[SLAB_NUM_CLASSES];
+    QUIC_SLAB_STATS         stats;
+};
+
+static ossl_inline size_t slab_class_len(size_t cls)
+{
+    return (size_t)QUIC_SLAB_MIN_OBJ_LEN << cls;
+}
+
+static ossl_inline size_t slab_obj_len(size_t cls)
+{
+    return sizeof(SLAB_OBJ_HDR) + slab_class_len(cls);
+}
+
+static int slab_class_for_len(size_t len, size_t *cls)
+{
+    size_t i;
+
+    for (i = 0; i < SLAB_NUM_CLASSES; ++i)
+        if (len <= slab_class_len(i)) {
+            *cls = i;
+            return 1;
+        }
+
+    return 0;
+}
+
+QUIC_SLAB_POOL *ossl_quic_slab_pool_new(size_t max_bytes, uint32_t flags)
+{
+    QUIC_SLAB_POOL *pool;
+
+    pool = OPENSSL_zalloc(sizeof(QUIC_SLAB_POOL));
+    if (pool == NULL)
+        return NULL;
+
+    if ((flags & QUIC_SLAB_FLAG_THREAD_SAFE) != 0) {
+        pool->lock = CRYPTO_THREAD_lock_new();
+        if (pool->lock == NULL) {
+            OPENSSL_free(pool);
+            return NULL;
+        }
+    }
+
+    pool->flags     = flags;
+    pool->max_bytes = max_bytes;
+    return pool;
+}
+
+#ifdef SLAB_USE_MMAP
+/*
+ * Map a hugepage-aligned region and advise the kernel to back it with
+ * transparent hugepages. Over-allocate and trim so the region is aligned.
+ */
+static void *slab_map_huge(size_t len)
+{
+    unsigned char *p, *q;
+    size_t head;
+
+    p = mmap(NULL, len + SLAB_HUGE_LEN, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    q = (unsigned char *)(((uintptr_t)p + SLAB_HUGE_LEN - 1)
+                          & ~(uintptr_t)(SLAB_HUGE_LEN - 1));
+    head = q - p;
+    if (head > 0)
+        munmap(p, head);
+    munmap(q + len, SLAB_HUGE_LEN - head);
+
+    /* Only advisory; the slab is still usable if this fails. */
+    (void)madvise(q, len, MADV_HUGEPAGE);
+    return q;
+}
+#endif
+
+/* Obtain a new slab for a class. Called with the lock held. */
+static int slab_grow(QUIC_SLAB_POOL *pool, size_t cls)
+{
+    size_t len = SLAB_LEN, min_len;
+    SLAB_HDR *slab = NULL;
+    int mapped = 0;
+
+    min_len = sizeof(SLAB_HDR) + slab_obj_len(cls);
+    if (len < sizeof(SLAB_HDR) + SLAB_MIN_OBJS * slab_obj_len(cls))
+        len = sizeof(SLAB_HDR) + SLAB_MIN_OBJS * slab_obj_len(cls);
+
+    if ((pool->flags & QUIC_SLAB_FLAG_HUGEPAGES) != 0)
+        len = SLAB_HUGE_LEN;
+
+    /* Enforce the limit, using a smaller slab if that would fit. */
+    if (pool->max_bytes != 0) {
+        if (pool->stats.bytes_reserved > pool->max_bytes
+            || pool->max_bytes - pool->stats.bytes_reserved < min_len)
+            return 0;
+
+        if (pool->max_bytes - pool->stats.bytes_reserved < len)
+            len = pool->max_bytes - pool->stats.bytes_reserved;
+    }
+
+#ifdef SLAB_USE_MMAP
+    if (len == SLAB_HUGE_LEN) {
+        slab = slab_map_huge(len);
+        mapped = (slab != NULL);
+    }
+#endif
+
+    if (slab == NULL)
+        slab = OPENSSL_malloc(len);
+
+    if (slab == NULL)
+        return 0;
+
+    slab->s.len     = len;
+    slab->s.mapped  = mapped;
+    slab->s.next    = pool->slabs;
+    pool->slabs     = slab;
+
+    pool->classes[cls].bump     = (unsigned char *)&slab[1];
+    pool->classes[cls].bump_end = (unsigned char *)slab + len;
+
+    ++pool->stats.num_slabs;
+    pool->stats.bytes_reserved += len;
+    return 1;
+}
+
+void ossl_quic_slab_pool_free(QUIC_SLAB_POOL *pool)
+{
+    SLAB_HDR *slab, *snext;
+
+    if (pool == NULL)
+        return;
+
+    for (slab = pool->slabs; slab != NULL; slab = snext) {
+        snext = slab->s.next;
+#ifdef SLAB_USE_MMAP
+        if (slab->s.mapped) {
+            munmap(slab, slab->s.len);
+            continue;
+        }
+#endif
+        OPENSSL_free(slab);
+    }
+
+    CRYPTO_THREAD_lock_free(pool->lock);
+    OPENSSL_free(pool);
+}
+
+static int slab_lock(QUIC_SLAB_POOL *pool)
+{
+    return pool->lock == NULL || CRYPTO_THREAD_write_lock(pool->lock);
+}
+
+static void slab_unlock(QUIC_SLAB_POOL *pool)
+{
+    if (pool->lock != NULL)
+        CRYPTO_THREAD_unlock(pool->lock);
+}
+
+void *ossl_quic_slab_alloc(QUIC_SLAB_POOL *pool, size_t len)
+{
+    SLAB_CLASS *c;
+    SLAB_OBJ_HDR *hdr = NULL;
+    size_t cls;
+
+    if (!slab_class_for_len(len, &cls) || !slab_lock(pool))
+        return NULL;
+
+    c = &pool->classes[cls];
+    if (c->free != NULL) {
+        hdr = (SLAB_OBJ_HDR *)c->free - 1;
+        c->free = c->free->next;
+    } else if ((size_t)(c->bump_end - c->bump) >= slab_obj_len(cls)
+               || slab_grow(pool, cls)) {
+        hdr = (SLAB_OBJ_HDR *)c->bump;
+        c->bump += slab_obj_len(cls);
+    }
+
+    if (hdr == NULL) {
+        ++pool->stats.num_alloc_fail;
+        slab_unlock(pool);
+        return NULL;
+    }
+
+    hdr->cls = cls;
+    ++pool->stats.num_alloc;
+    pool->stats.bytes_in_use += slab_class_len(cls);
+    slab_unlock(pool);
+    return &hdr[1];
+}
+
+void ossl_quic_slab_free(QUIC_SLAB_POOL *pool, void *p)
+{
+    SLAB_OBJ_HDR *hdr;
+    SLAB_FREE *f = p;
+
+    if (p == NULL)
+        return;
+
+    hdr = (SLAB_OBJ_HDR *)p - 1;
+    if (!ossl_assert(hdr->cls < SLAB_NUM_CLASSES) || !slab_lock(pool))
+        return;
+
+    f->next = pool->classes[hdr->cls].free;
+    pool->classes[hdr->cls].free = f;
+
+    ++pool->stats.num_free;
+    pool->stats.bytes_in_use -= slab_class_len(hdr->cls);
+    slab_unlock(pool);
+}
+
+size_t ossl_quic_slab_usable_size(const void *p)
+{
+    const SLAB_OBJ_HDR *hdr = (const SLAB_OBJ_HDR *)p - 1;
+
+    return slab_class_len(hdr->cls);
+}
+
+void ossl_quic_slab_get_stats(QUIC_SLAB_POOL *pool, QUIC_SLAB_STATS *stats)
+{
+    if (!slab_lock(pool)) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    *stats = pool->stats;
+    slab_unlock(pool);
+}
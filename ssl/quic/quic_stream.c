@@ -0,0 +1,471 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include "internal/quic_stream.h"
+#include "internal/quic_error.h"
+#include "internal/common.h"
+
+/*
+ * A queued STREAM frame, or the part of one not duplicating data already
+ * queued. Frames are kept in a list sorted by offset and never overlap; all
+ * frames begin at or after the read offset. The list thus doubles as the map
+ * of which ranges of the stream have been received.
+ */
+typedef struct stream_frame_st {
+    struct stream_frame_st *prev, *next;
+
+    /* Logical range of the stream covered, [start, end). */
+    uint64_t                start, end;
+
+    /*
+     * Packet holding the data, or NULL. If in_rbuf is set, the data was copied
+     * into the ring buffer instead.
+     */
+    OSSL_QRX_PKT_WRAP      *pkt;
+    const unsigned char    *data;
+    unsigned int            in_rbuf :1;
+} STREAM_FRAME;
+
+#define FINAL_SIZE_UNKNOWN  UINT64_MAX
+
+struct quic_rstream_st {
+    OSSL_QRX               *qrx;
+    QUIC_RXFC              *rxfc;
+    OSSL_STATM             *statm;
+    STREAM_FRAME           *head, *tail;
+
+    /* Logical offset of the next byte to be consumed. */
+    uint64_t                read_off;
+
+    /*
+     * End of the data received contiguously from read_off; data beyond this
+     * is out of order.
+     */
+    uint64_t                contig_end;
+
+    /* Highest offset of any data received, and the final size, if known. */
+    uint64_t                max_end;
+    uint64_t                final_size;
+
+    /*
+     * Ring buffer for data received out of order, allocated on first use. The
+     * byte at logical offset n is stored at rbuf[n % max_buf]; as only data in
+     * [read_off, read_off + max_buf) is kept, offsets never collide.
+     */
+    unsigned char          *rbuf;
+    size_t                  max_buf;
+
+    QUIC_RSTREAM_STATS      stats;
+};
+
+QUIC_RSTREAM *ossl_quic_rstream_new(OSSL_QRX *qrx, QUIC_RXFC *rxfc,
+                                    OSSL_STATM *statm, size_t max_buf)
+{
+    QUIC_RSTREAM *qrs;
+
+    qrs = OPENSSL_zalloc(sizeof(QUIC_RSTREAM));
+    if (qrs == NULL)
+        return NULL;
+
+    qrs->qrx        = qrx;
+    qrs->rxfc       = rxfc;
+    qrs->statm      = statm;
+    qrs->max_buf    = max_buf;
+    qrs->final_size = FINAL_SIZE_UNKNOWN;
+    return qrs;
+}
+
+static void rstream_unlink(QUIC_RSTREAM *qrs, STREAM_FRAME *f)
+{
+    if (f->prev != NULL)
+        f->prev->next = f->next;
+    else
+        qrs->head = f->next;
+
+    if (f->next != NULL)
+        f->next->prev = f->prev;
+    else
+        qrs->tail = f->prev;
+
+    f->prev = f->next = NULL;
+}
+
+static void rstream_frame_free(QUIC_RSTREAM *qrs, STREAM_FRAME *f)
+{
+    if (f->pkt != NULL)
+        ossl_qrx_pkt_wrap_free(qrs->qrx, f->pkt);
+
+    OPENSSL_free(f);
+}
+
+void ossl_quic_rstream_free(QUIC_RSTREAM *qrs)
+{
+    STREAM_FRAME *f, *fnext;
+
+    if (qrs == NULL)
+        return;
+
+    for (f = qrs->head; f != NULL; f = fnext) {
+        fnext = f->next;
+        rstream_frame_free(qrs, f);
+    }
+
+    OPENSSL_free(qrs->rbuf);
+    OPENSSL_free(qrs);
+}
+
+/*
+ * Merges two adjacent frames held in the ring buffer if they are contiguous in
+ * it, so that out-of-order data coalesces into as few frames as possible.
+ */
+static void rstream_try_merge(QUIC_RSTREAM *qrs, STREAM_FRAME *a)
+{
+    STREAM_FRAME *b = a->next;
+
+    if (b == NULL || !a->in_rbuf || !b->in_rbuf || a->end != b->start
+        || a->data + (a->end - a->start) != b->data)
+        return;
+
+    a->end = b->end;
+    rstream_unlink(qrs, b);
+    rstream_frame_free(qrs, b);
+}
+
+static int rstream_rxfc_check(QUIC_RXFC *rxfc)
+{
+    QUIC_RXFC *parent = ossl_quic_rxfc_get_parent(rxfc);
+
+    return ossl_quic_rxfc_get_error(rxfc, 0) == QUIC_ERR_NO_ERROR
+        && (parent == NULL
+            || ossl_quic_rxfc_get_error(parent, 0) == QUIC_ERR_NO_ERROR);
+}
+
+int ossl_quic_rstream_queue_data(QUIC_RSTREAM *qrs, OSSL_QRX_PKT_WRAP *pkt_wrap,
+                                 uint64_t offset,
+                                 const unsigned char *data, uint64_t data_len,
+                                 int is_fin)
+{
+    STREAM_FRAME *f[2] = { NULL, NULL }, *prev, *next, *nnext;
+    uint64_t start = offset, end;
+    size_t pos = 0, len, num_f = 1, i;
+    int copy;
+
+    if (data_len > UINT64_MAX - offset)
+        return 0;
+
+    end = offset + data_len;
+
+    if (qrs->rxfc != NULL
+        && (!ossl_quic_rxfc_on_rx_stream_frame(qrs->rxfc, end, is_fin)
+            || !rstream_rxfc_check(qrs->rxfc)))
+        return 0;
+
+    /* Enforce the final size rules of RFC 9000 s. 4.5. */
+    if (qrs->final_size != FINAL_SIZE_UNKNOWN) {
+        if (end > qrs->final_size || (is_fin && end != qrs->final_size))
+            return 0;
+    } else if (is_fin) {
+        if (qrs->max_end > end)
+            return 0;
+
+        qrs->final_size = end;
+    }
+
+    if (end > qrs->max_end)
+        qrs->max_end = end;
+
+    /*
+     * Never hold more than max_buf bytes beyond the read offset. A peer
+     * respecting the flow control credit we extend never sends more, so
+     * anything beyond is dropped; it will be retransmitted.
+     */
+    if (qrs->max_buf != 0 && end > qrs->read_off
+        && end - qrs->read_off > qrs->max_buf) {
+        qrs->stats.bytes_dropped += end - (qrs->read_off + qrs->max_buf);
+        end = qrs->read_off + qrs->max_buf;
+    }
+
+    /* Discard anything already consumed. */
+    if (end <= qrs->read_off || end <= start)
+        return 1;
+
+    if (start < qrs->read_off) {
+        data  += qrs->read_off - start;
+        start  = qrs->read_off;
+    }
+
+    /*
+     * Find the last frame starting at or before this one. Data usually arrives
+     * in order, so search from the tail.
+     */
+    for (prev = qrs->tail; prev != NULL && prev->start > start; prev = prev->prev);
+
+    next = (prev != NULL) ? prev->next : qrs->head;
+
+    /* Trim the front of the new data against the previous frame. */
+    if (prev != NULL && prev->end > start) {
+        if (prev->end >= end)
+            return 1; /* duplicate */
+
+        data  += prev->end - start;
+        start  = prev->end;
+    }
+
+    /*
+     * The new data will replace any following frames it wholly covers, and is
+     * trimmed to end where the first remaining one begins.
+     */
+    for (nnext = next; nnext != NULL && nnext->end <= end; nnext = nnext->next);
+
+    if (nnext != NULL && nnext->start < end) {
+        end = nnext->start;
+        if (end <= start)
+            return 1; /* duplicate */
+    }
+
+    /*
+     * Data which cannot yet be read because of a gap before it is copied into
+     * the ring buffer, so that packets are not pinned in memory, potentially
+     * for several round trips, while waiting for a retransmission. Data which
+     * can be read now is referenced in place. If the ring buffer cannot be
+     * allocated, fall back to referencing the packet.
+     */
+    copy = start > qrs->contig_end && qrs->max_buf != 0;
+    if (copy && qrs->rbuf == NULL
+        && (qrs->rbuf = OPENSSL_malloc(qrs->max_buf)) == NULL)
+        copy = 0;
+
+    len = (size_t)(end - start);
+    if (copy) {
+        /* Data which wraps around the end of the ring needs two frames. */
+        pos = (size_t)(start % qrs->max_buf);
+        if (len > qrs->max_buf - pos)
+            num_f = 2;
+    }
+
+    for (i = 0; i < num_f; ++i)
+        if ((f[i] = OPENSSL_zalloc(sizeof(STREAM_FRAME))) == NULL)
+            goto err;
+
+    if (!copy && pkt_wrap != NULL && !ossl_qrx_pkt_wrap_up_ref(pkt_wrap))
+        goto err;
+
+    for (; next != NULL && next->end <= end; next = nnext) {
+        nnext = next->next;
+        rstream_unlink(qrs, next);
+        rstream_frame_free(qrs, next);
+    }
+
+    if (copy) {
+        f[0]->start     = start;
+        f[0]->end       = start + (num_f == 1 ? len : qrs->max_buf - pos);
+        f[0]->data      = qrs->rbuf + pos;
+        f[0]->in_rbuf   = 1;
+        memcpy(qrs->rbuf + pos, data, (size_t)(f[0]->end - f[0]->start));
+
+        if (num_f == 2) {
+            f[1]->start     = f[0]->end;
+            f[1]->end       = end;
+            f[1]->data      = qrs->rbuf;
+            f[1]->in_rbuf   = 1;
+            memcpy(qrs->rbuf, data + (f[0]->end - f[0]->start),
+                   (size_t)(end - f[1]->start));
+        }
+
+        qrs->stats.bytes_copied += len;
+    } else {
+        f[0]->start     = start;
+        f[0]->end       = end;
+        f[0]->pkt       = pkt_wrap;
+        f[0]->data      = data;
+    }
+
+    for (i = 0; i < num_f; ++i) {
+        f[i]->prev = prev;
+        f[i]->next = next;
+        if (prev != NULL)
+            prev->next = f[i];
+        else
+            qrs->head = f[i];
+
+        if (next != NULL)
+            next->prev = f[i];
+        else
+            qrs->tail = f[i];
+
+        prev = f[i];
+    }
+
+    /* Extend the contiguous region if this filled a gap. */
+    if (start == qrs->contig_end)
+        for (next = f[0]; next != NULL && next->start == qrs->contig_end;
+             next = next->next)
+            qrs->contig_end = next->end;
+
+    if (copy) {
+        rstream_try_merge(qrs, f[num_f - 1]);
+        if (f[0]->prev != NULL)
+            rstream_try_merge(qrs, f[0]->prev);
+    }
+
+    return 1;
+
+err:
+    OPENSSL_free(f[0]);
+    OPENSSL_free(f[1]);
+    return 0;
+}
+
+int ossl_quic_rstream_get_record(QUIC_RSTREAM *qrs,
+                                 const unsigned char **record, size_t *rec_len,
+                                 int *fin)
+{
+    STREAM_FRAME *f = qrs->head;
+
+    if (f == NULL || f->start != qrs->read_off) {
+        *record     = NULL;
+        *rec_len    = 0;
+        *fin        = (qrs->read_off == qrs->final_size);
+        return 1;
+    }
+
+    *record     = f->data;
+    *rec_len    = (size_t)(f->end - f->start);
+    *fin        = (f->end == qrs->final_size);
+    return 1;
+}
+
+int ossl_quic_rstream_release_record(QUIC_RSTREAM *qrs, size_t read_len)
+{
+    STREAM_FRAME *f = qrs->head;
+    uint64_t avail;
+
+    if (f == NULL || f->start != qrs->read_off)
+        return read_len == 0 || read_len == SIZE_MAX;
+
+    avail = f->end - f->start;
+    if (read_len == SIZE_MAX)
+        read_len = (size_t)avail;
+    else if (read_len > avail)
+        return 0;
+
+    qrs->read_off += read_len;
+    if (read_len == avail) {
+        rstream_unlink(qrs, f);
+        rstream_frame_free(qrs, f);
+    } else {
+        f->start    += read_len;
+        f->data     += read_len;
+    }
+
+    /* Tell flow control the data has been passed to the application. */
+    if (qrs->rxfc != NULL && read_len > 0) {
+        OSSL_RTT_INFO rtt_info;
+        OSSL_TIME rtt = ossl_time_zero();
+
+        if (qrs->statm != NULL) {
+            ossl_statm_get_rtt_info(qrs->statm, &rtt_info);
+            rtt = rtt_info.smoothed_rtt;
+        }
+
+        if (!ossl_quic_rxfc_on_retire(qrs->rxfc, read_len, rtt))
+            return 0;
+    }
+
+    return 1;
+}
+
+int ossl_quic_rstream_read(QUIC_RSTREAM *qrs, unsigned char *buf, size_t size,
+                           size_t *readbytes, int *fin)
+{
+    const unsigned char *record;
+    size_t rec_len, n;
+
+    *readbytes = 0;
+
+    while (size > 0) {
+        if (!ossl_quic_rstream_get_record(qrs, &record, &rec_len, fin))
+            return 0;
+
+        if (rec_len == 0)
+            break;
+
+        n = rec_len < size ? rec_len : size;
+        memcpy(buf, record, n);
+        if (!ossl_quic_rstream_release_record(qrs, n))
+            return 0;
+
+        buf         += n;
+        size        -= n;
+        *readbytes  += n;
+    }
+
+    *fin = (qrs->read_off == qrs->final_size);
+    return 1;
+}
+
+int ossl_quic_rstream_peek(QUIC_RSTREAM *qrs, unsigned char *buf, size_t size,
+                           size_t *readbytes, int *fin)
+{
+    STREAM_FRAME *f;
+    uint64_t off = qrs->read_off;
+    size_t n;
+
+    *readbytes = 0;
+
+    for (f = qrs->head; f != NULL && f->start == off && size > 0; f = f->next) {
+        n = (f->end - f->start) < size ? (size_t)(f->end - f->start) : size;
+        memcpy(buf, f->data, n);
+
+        buf         += n;
+        size        -= n;
+        *readbytes  += n;
+        off         += n;
+    }
+
+    *fin = (off == qrs->final_size);
+    return 1;
+}
+
+int ossl_quic_rstream_available(QUIC_RSTREAM *qrs, size_t *avail, int *fin)
+{
+    STREAM_FRAME *f;
+    uint64_t off = qrs->read_off;
+
+    for (f = qrs->head; f != NULL && f->start == off; f = f->next)
+        off = f->end;
+
+    *avail  = (size_t)(off - qrs->read_off);
+    *fin    = (off == qrs->final_size);
+    return 1;
+}
+
+uint64_t ossl_quic_rstream_get_read_offset(const QUIC_RSTREAM *qrs)
+{
+    return qrs->read_off;
+}
+
+void ossl_quic_rstream_get_stats(const QUIC_RSTREAM *qrs,
+                                 QUIC_RSTREAM_STATS *stats)
+{
+    STREAM_FRAME *f;
+
+    *stats = qrs->stats;
+    stats->num_frames = 0;
+    stats->bytes_in_place = stats->bytes_in_rbuf = 0;
+
+    for (f = qrs->head; f != NULL; f = f->next) {
+        ++stats->num_frames;
+        if (f->in_rbuf)
+            stats->bytes_in_rbuf += f->end - f->start;
+        else
+            stats->bytes_in_place += f->end - f->start;
+    }
+}
@@ -0,0 +1,585 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "internal/quic_token.h"
+#include "internal/quic_wire_pkt.h"
+#include "internal/packet.h"
+
+#define TOKEN_KEY_LEN       32
+#define TOKEN_NONCE_LEN     12
+#define TOKEN_TAG_LEN       16
+#define TOKEN_HDR_LEN       (2 + TOKEN_NONCE_LEN)
+
+/* Largest plaintext: issue time and two connection IDs. */
+#define TOKEN_MAX_PT_LEN    (8 + 2 * (1 + QUIC_MAX_CONN_ID_LEN))
+
+/* Key ID, type, nonce, family, port and the largest (IPv6) raw address. */
+#define TOKEN_MAX_AAD_LEN   (TOKEN_HDR_LEN + 1 + 2 + 16)
+
+/* Length of the SCIDs we choose for Retry packets. */
+#define RETRY_SCID_LEN      8
+
+/* Clients must pad Initial datagrams to at least this size. */
+#define MIN_INITIAL_DGRAM_LEN   1200
+
+typedef struct token_key_st {
+    EVP_CIPHER_CTX  *enc, *dec;
+    OSSL_TIME       created;
+    unsigned char   id;
+    unsigned int    valid   : 1;
+} TOKEN_KEY;
+
+struct quic_token_engine_st {
+    OSSL_LIB_CTX    *libctx;
+    const char      *propq;
+    EVP_CIPHER      *cipher;
+
+    /* Pre-keyed context for the integrity tags of the Retry packets we send. */
+    EVP_CIPHER_CTX  *retry_cctx;
+
+    OSSL_TIME       (*now)(void *arg);
+    void            *now_arg;
+
+    OSSL_TIME       retry_lifetime, new_token_lifetime, rotation_interval;
+
+    /*
+     * Keys are held in the slot given by the low bit of their ID, so the
+     * current and previous keys are always in different slots.
+     */
+    TOKEN_KEY       keys[2];
+    unsigned char   cur_id;
+
+    /* Retry filter. */
+    QUIC_DEMUX                          *demux;
+    BIO                                 *net_bio;
+    ossl_quic_token_validated_cb_fn     *cb;
+    void                                *cb_arg;
+    unsigned int                        require_retry   : 1;
+    QUIC_TOKEN_ENGINE_STATS             stats;
+};
+
+static void retry_filter(QUIC_URXE *e, void *arg);
+
+static OSSL_TIME get_time(QUIC_TOKEN_ENGINE *eng)
+{
+    if (eng->now == NULL)
+        return ossl_time_now();
+
+    return eng->now(eng->now_arg);
+}
+
+static void token_key_cleanup(TOKEN_KEY *key)
+{
+    EVP_CIPHER_CTX_free(key->enc);
+    EVP_CIPHER_CTX_free(key->dec);
+    key->enc    = NULL;
+    key->dec    = NULL;
+    key->valid  = 0;
+}
+
+static int token_key_init(QUIC_TOKEN_ENGINE *eng, TOKEN_KEY *key,
+                          unsigned char id, OSSL_TIME now)
+{
+    unsigned char secret[TOKEN_KEY_LEN];
+    int ok = 0;
+
+    token_key_cleanup(key);
+
+    if (RAND_priv_bytes_ex(eng->libctx, secret, sizeof(secret), 0) != 1)
+        goto err;
+
+    /* The cipher is keyed once; only the nonce is set for each token. */
+    if ((key->enc = EVP_CIPHER_CTX_new()) == NULL
+        || (key->dec = EVP_CIPHER_CTX_new()) == NULL
+        || !EVP_CipherInit_ex(key->enc, eng->cipher, NULL, secret, NULL, 1)
+        || !EVP_CipherInit_ex(key->dec, eng->cipher, NULL, secret, NULL, 0))
+        goto err;
+
+    key->id         = id;
+    key->created    = now;
+    key->valid      = 1;
+    ok = 1;
+err:
+    OPENSSL_cleanse(secret, sizeof(secret));
+    if (!ok)
+        token_key_cleanup(key);
+    return ok;
+}
+
+static int token_rotate(QUIC_TOKEN_ENGINE *eng, OSSL_TIME now)
+{
+    unsigned char id = (unsigned char)(eng->cur_id + 1);
+
+    if (!token_key_init(eng, &eng->keys[id & 1], id, now))
+        return 0;
+
+    eng->cur_id = id;
+    return 1;
+}
+
+/* Returns the current key, rotating first if it is due. */
+static TOKEN_KEY *token_cur_key(QUIC_TOKEN_ENGINE *eng, OSSL_TIME now)
+{
+    TOKEN_KEY *key = &eng->keys[eng->cur_id & 1];
+
+    if (ossl_time_compare(now, ossl_time_add(key->created,
+                                             eng->rotation_interval)) >= 0
+        && !token_rotate(eng, now))
+        return NULL;
+
+    return &eng->keys[eng->cur_id & 1];
+}
+
+QUIC_TOKEN_ENGINE *ossl_quic_token_engine_new(OSSL_LIB_CTX *libctx,
+                                              const char *propq,
+                                              OSSL_TIME (*now)(void *arg),
+                                              void *now_arg)
+{
+    QUIC_TOKEN_ENGINE *eng;
+
+    eng = OPENSSL_zalloc(sizeof(*eng));
+    if (eng == NULL)
+        return NULL;
+
+    eng->libctx             = libctx;
+    eng->propq              = propq;
+    eng->now                = now;
+    eng->now_arg            = now_arg;
+    eng->retry_lifetime
+        = ossl_ticks2time(QUIC_TOKEN_DEFAULT_RETRY_LIFETIME);
+    eng->new_token_lifetime
+        = ossl_ticks2time(QUIC_TOKEN_DEFAULT_NEW_TOKEN_LIFETIME);
+    eng->rotation_interval
+        = ossl_ticks2time(QUIC_TOKEN_DEFAULT_ROTATION_INTERVAL);
+    eng->require_retry      = 1;
+
+    eng->cipher = EVP_CIPHER_fetch(libctx, "AES-256-GCM", propq);
+    eng->retry_cctx = ossl_quic_retry_integrity_ctx_new(libctx, propq);
+    if (eng->cipher == NULL
+        || eng->retry_cctx == NULL
+        || !token_key_init(eng, &eng->keys[0], 0, get_time(eng))) {
+        ossl_quic_token_engine_free(eng);
+        return NULL;
+    }
+
+    return eng;
+}
+
+void ossl_quic_token_engine_free(QUIC_TOKEN_ENGINE *eng)
+{
+    if (eng == NULL)
+        return;
+
+    if (eng->demux != NULL) {
+        ossl_quic_demux_cb_fn *cb;
+        void *cb_arg;
+
+        /* Only uninstall the filter if nothing has been put in front of it. */
+        ossl_quic_demux_get_default_handler(eng->demux, &cb, &cb_arg);
+        if (cb == retry_filter && cb_arg == eng)
+            ossl_quic_demux_set_default_handler(eng->demux, NULL, NULL);
+    }
+
+    token_key_cleanup(&eng->keys[0]);
+    token_key_cleanup(&eng->keys[1]);
+    EVP_CIPHER_free(eng->cipher);
+    EVP_CIPHER_CTX_free(eng->retry_cctx);
+    OPENSSL_free(eng);
+}
+
+int ossl_quic_token_engine_set_lifetimes(QUIC_TOKEN_ENGINE *eng,
+                                         OSSL_TIME retry_lifetime,
+                                         OSSL_TIME new_token_lifetime,
+                                         OSSL_TIME rotation_interval)
+{
+    if (ossl_time_is_zero(retry_lifetime)
+        || ossl_time_is_zero(new_token_lifetime)
+        || ossl_time_is_zero(rotation_interval))
+        return 0;
+
+    eng->retry_lifetime     = retry_lifetime;
+    eng->new_token_lifetime = new_token_lifetime;
+    eng->rotation_interval  = rotation_interval;
+    return 1;
+}
+
+int ossl_quic_token_engine_rotate(QUIC_TOKEN_ENGINE *eng)
+{
+    return token_rotate(eng, get_time(eng));
+}
+
+/*
+ * Builds the AAD for a token: its key ID, type and nonce, which are sent in
+ * the clear, and the address of the client. Only Retry tokens are bound to the
+ * client's port, as a client returning with a NEW_TOKEN token is likely to use
+ * a new one.
+ */
+static int token_aad(const unsigned char *hdr, const BIO_ADDR *peer,
+                     unsigned char *aad, size_t *aad_len)
+{
+    size_t addr_len = 0;
+    unsigned short port = 0;
+    int family = AF_UNSPEC;
+
+    memcpy(aad, hdr, TOKEN_HDR_LEN);
+
+    if (peer != NULL) {
+        family = BIO_ADDR_family(peer);
+        if (family != AF_UNSPEC) {
+            if (!BIO_ADDR_rawaddress(peer, NULL, &addr_len)
+                || addr_len > 16
+                || !BIO_ADDR_rawaddress(peer, aad + TOKEN_HDR_LEN + 3,
+                                        &addr_len))
+                return 0;
+
+            if (hdr[1] == QUIC_TOKEN_TYPE_RETRY)
+                port = BIO_ADDR_rawport(peer);
+        }
+    }
+
+    aad[TOKEN_HDR_LEN]      = (unsigned char)family;
+    aad[TOKEN_HDR_LEN + 1]  = (unsigned char)(port >> 8);
+    aad[TOKEN_HDR_LEN + 2]  = (unsigned char)port;
+    *aad_len = TOKEN_HDR_LEN + 3 + addr_len;
+    return 1;
+}
+
+static int token_seal(QUIC_TOKEN_ENGINE *eng, const BIO_ADDR *peer, int type,
+                      const QUIC_CONN_ID *odcid, const QUIC_CONN_ID *retry_scid,
+                      unsigned char *buf, size_t buf_len, size_t *out_len)
+{
+    unsigned char pt[TOKEN_MAX_PT_LEN], aad[TOKEN_MAX_AAD_LEN];
+    size_t pt_len, aad_len, token_len;
+    uint64_t issued;
+    OSSL_TIME now = get_time(eng);
+    TOKEN_KEY *key;
+    WPACKET wpkt;
+    int l, ok = 0;
+
+    if ((key = token_cur_key(eng, now)) == NULL)
+        return 0;
+
+    issued = ossl_time2ticks(now);
+    if (!WPACKET_init_static_len(&wpkt, pt, sizeof(pt), 0))
+        return 0;
+
+    if (!WPACKET_put_bytes_u64(&wpkt, issued)
+        || !WPACKET_put_bytes_u8(&wpkt, odcid->id_len)
+        || !WPACKET_memcpy(&wpkt, odcid->id, odcid->id_len)
+        || !WPACKET_put_bytes_u8(&wpkt, retry_scid->id_len)
+        || !WPACKET_memcpy(&wpkt, retry_scid->id, retry_scid->id_len)
+        || !WPACKET_get_total_written(&wpkt, &pt_len)
+        || !WPACKET_finish(&wpkt)) {
+        WPACKET_cleanup(&wpkt);
+        goto err;
+    }
+
+    token_len = TOKEN_HDR_LEN + pt_len + TOKEN_TAG_LEN;
+    if (buf_len < token_len)
+        goto err;
+
+    buf[0] = key->id;
+    buf[1] = (unsigned char)type;
+    if (RAND_bytes_ex(eng->libctx, buf + 2, TOKEN_NONCE_LEN, 0) != 1
+        || !token_aad(buf, peer, aad, &aad_len))
+        goto err;
+
+    if (!EVP_CipherInit_ex(key->enc, NULL, NULL, NULL, buf + 2, 1)
+        || !EVP_CipherUpdate(key->enc, NULL, &l, aad, (int)aad_len)
+        || !EVP_CipherUpdate(key->enc, buf + TOKEN_HDR_LEN, &l, pt,
+                             (int)pt_len)
+        || !EVP_CipherFinal_ex(key->enc, NULL, &l)
+        || !EVP_CIPHER_CTX_ctrl(key->enc, EVP_CTRL_AEAD_GET_TAG, TOKEN_TAG_LEN,
+                                buf + TOKEN_HDR_LEN + pt_len))
+        goto err;
+
+    *out_len = token_len;
+    ok = 1;
+err:
+    OPENSSL_cleanse(pt, sizeof(pt));
+    return ok;
+}
+
+int ossl_quic_token_engine_gen_retry_token(QUIC_TOKEN_ENGINE *eng,
+                                           const BIO_ADDR *peer,
+                                           const QUIC_CONN_ID *odcid,
+                                           const QUIC_CONN_ID *retry_scid,
+                                           unsigned char *buf, size_t buf_len,
+                                           size_t *out_len)
+{
+    if (odcid->id_len > QUIC_MAX_CONN_ID_LEN
+        || retry_scid->id_len > QUIC_MAX_CONN_ID_LEN)
+        return 0;
+
+    return token_seal(eng, peer, QUIC_TOKEN_TYPE_RETRY, odcid, retry_scid,
+                      buf, buf_len, out_len);
+}
+
+int ossl_quic_token_engine_gen_new_token(QUIC_TOKEN_ENGINE *eng,
+                                         const BIO_ADDR *peer,
+                                         unsigned char *buf, size_t buf_len,
+                                         size_t *out_len)
+{
+    static const QUIC_CONN_ID empty_cid = { 0 };
+
+    return token_seal(eng, peer, QUIC_TOKEN_TYPE_NEW_TOKEN, &empty_cid,
+                      &empty_cid, buf, buf_len, out_len);
+}
+
+static int get_conn_id(PACKET *pkt, QUIC_CONN_ID *cid)
+{
+    unsigned int len;
+
+    if (!PACKET_get_1(pkt, &len)
+        || len > QUIC_MAX_CONN_ID_LEN
+        || !PACKET_copy_bytes(pkt, cid->id, len))
+        return 0;
+
+    cid->id_len = (unsigned char)len;
+    return 1;
+}
+
+/*
+ * Authenticates and decrypts a token, without checking whether it has
+ * expired. Returns 1 if the token was generated by this engine with a current
+ * or previous key, for the given peer.
+ */
+static int token_open(QUIC_TOKEN_ENGINE *eng, const BIO_ADDR *peer,
+                      const unsigned char *token, size_t token_len,
+                      QUIC_TOKEN_INFO *info)
+{
+    unsigned char pt[TOKEN_MAX_PT_LEN], aad[TOKEN_MAX_AAD_LEN];
+    size_t pt_len, aad_len;
+    unsigned int type;
+    uint64_t issued;
+    TOKEN_KEY *key;
+    PACKET pkt;
+    int l, ok = 0;
+
+    if (token_len < TOKEN_HDR_LEN + TOKEN_TAG_LEN
+        || token_len > TOKEN_HDR_LEN + TOKEN_MAX_PT_LEN + TOKEN_TAG_LEN)
+        return 0;
+
+    type = token[1];
+    if (type != QUIC_TOKEN_TYPE_RETRY && type != QUIC_TOKEN_TYPE_NEW_TOKEN)
+        return 0;
+
+    key = &eng->keys[token[0] & 1];
+    if (!key->valid || key->id != token[0])
+        return 0;
+
+    pt_len = token_len - TOKEN_HDR_LEN - TOKEN_TAG_LEN;
+    if (!token_aad(token, peer, aad, &aad_len))
+        return 0;
+
+    if (!EVP_CipherInit_ex(key->dec, NULL, NULL, NULL, token + 2, 0)
+        || !EVP_CipherUpdate(key->dec, NULL, &l, aad, (int)aad_len)
+        || !EVP_CipherUpdate(key->dec, pt, &l, token + TOKEN_HDR_LEN,
+                             (int)pt_len)
+        || !EVP_CIPHER_CTX_ctrl(key->dec, EVP_CTRL_AEAD_SET_TAG, TOKEN_TAG_LEN,
+                                (unsigned char *)token + TOKEN_HDR_LEN + pt_len)
+        || EVP_CipherFinal_ex(key->dec, NULL, &l) != 1)
+        goto err;
+
+    /* Authentic, so a parse failure here would be a bug in token_seal. */
+    if (!PACKET_buf_init(&pkt, pt, pt_len)
+        || !PACKET_get_net_8(&pkt, &issued)
+        || !get_conn_id(&pkt, &info->odcid)
+        || !get_conn_id(&pkt, &info->retry_scid)
+        || PACKET_remaining(&pkt) != 0)
+        goto err;
+
+    info->type      = (int)type;
+    info->issued    = ossl_ticks2time(issued);
+    ok = 1;
+err:
+    OPENSSL_cleanse(pt, sizeof(pt));
+    return ok;
+}
+
+static int token_expired(QUIC_TOKEN_ENGINE *eng, const QUIC_TOKEN_INFO *info,
+                         OSSL_TIME now)
+{
+    OSSL_TIME lifetime = info->type == QUIC_TOKEN_TYPE_RETRY
+                         ? eng->retry_lifetime : eng->new_token_lifetime;
+
+    return ossl_time_compare(now, ossl_time_add(info->issued, lifetime)) >= 0;
+}
+
+int ossl_quic_token_engine_validate(QUIC_TOKEN_ENGINE *eng,
+                                    const BIO_ADDR *peer,
+                                    const unsigned char *token,
+                                    size_t token_len,
+                                    QUIC_TOKEN_INFO *info)
+{
+    QUIC_TOKEN_INFO tmp;
+    OSSL_TIME now = get_time(eng);
+
+    /* Rotate if due, so that keys older than the previous one are refused. */
+    if (token_cur_key(eng, now) == NULL)
+        return 0;
+
+    if (info == NULL)
+        info = &tmp;
+
+    return token_open(eng, peer, token, token_len, info)
+           && !token_expired(eng, info, now);
+}
+
+/*
+ * Stateless Retry Filter
+ * ======================
+ */
+static int send_retry(QUIC_TOKEN_ENGINE *eng, QUIC_URXE *e,
+                      const QUIC_PKT_HDR *hdr)
+{
+    unsigned char buf[1 + 4 + 2 * (1 + QUIC_MAX_CONN_ID_LEN)
+                      + QUIC_TOKEN_MAX_LEN + QUIC_RETRY_INTEGRITY_TAG_LEN];
+    unsigned char token[QUIC_TOKEN_MAX_LEN];
+    size_t token_len, written;
+    QUIC_PKT_HDR rhdr;
+    WPACKET wpkt;
+    BIO_MSG msg;
+
+    memset(&rhdr, 0, sizeof(rhdr));
+    rhdr.type                   = QUIC_PKT_TYPE_RETRY;
+    rhdr.fixed                  = 1;
+    rhdr.version                = hdr->version;
+    rhdr.dst_conn_id            = hdr->src_conn_id;
+    rhdr.src_conn_id.id_len     = RETRY_SCID_LEN;
+
+    if (RAND_bytes_ex(eng->libctx, rhdr.src_conn_id.id, RETRY_SCID_LEN, 0) != 1
+        || !ossl_quic_token_engine_gen_retry_token(eng, &e->peer,
+                                                   &hdr->dst_conn_id,
+                                                   &rhdr.src_conn_id,
+                                                   token, sizeof(token),
+                                                   &token_len))
+        return 0;
+
+    rhdr.len = token_len + QUIC_RETRY_INTEGRITY_TAG_LEN;
+
+    if (!WPACKET_init_static_len(&wpkt, buf, sizeof(buf), 0))
+        return 0;
+
+    if (!ossl_quic_wire_encode_pkt_hdr(&wpkt, 0, &rhdr, NULL)
+        || !WPACKET_memcpy(&wpkt, token, token_len)
+        || !WPACKET_get_total_written(&wpkt, &written)
+        || !ossl_quic_calculate_retry_integrity_tag_ctx(eng->retry_cctx,
+                                                        buf, written,
+                                                        &hdr->dst_conn_id,
+                                                        buf + written)
+        || !WPACKET_allocate_bytes(&wpkt, QUIC_RETRY_INTEGRITY_TAG_LEN, NULL)
+        || !WPACKET_get_total_written(&wpkt, &written)
+        || !WPACKET_finish(&wpkt)) {
+        WPACKET_cleanup(&wpkt);
+        return 0;
+    }
+
+    msg.data        = buf;
+    msg.data_len    = written;
+    msg.flags       = 0;
+    msg.peer        = BIO_ADDR_family(&e->peer) != AF_UNSPEC ? &e->peer : NULL;
+    msg.local       = NULL;
+
+    /* If the send fails, the client will retransmit its Initial. */
+    if (!BIO_sendmmsg(eng->net_bio, &msg, sizeof(msg), 1, 0, &written))
+        return 0;
+
+    ++eng->stats.retry_sent;
+    return 1;
+}
+
+static void retry_filter(QUIC_URXE *e, void *arg)
+{
+    QUIC_TOKEN_ENGINE *eng = arg;
+    QUIC_TOKEN_INFO info;
+    QUIC_PKT_HDR hdr;
+    PACKET pkt;
+    OSSL_TIME now;
+
+    /*
+     * Only QUIC v1 Initial packets are of interest. Anything else which
+     * arrives for an unknown connection ID is left to the next handler.
+     */
+    if (!eng->require_retry
+        || !PACKET_buf_init(&pkt, ossl_quic_urxe_data(e), e->data_len)
+        || !ossl_quic_wire_decode_pkt_hdr(&pkt, SIZE_MAX, 1, &hdr, NULL)
+        || hdr.type != QUIC_PKT_TYPE_INITIAL
+        || hdr.version != QUIC_VERSION_1) {
+        eng->cb(e, NULL, eng->cb_arg);
+        return;
+    }
+
+    /* Responding to an unpadded Initial would amplify (RFC 9000 s. 14.1). */
+    if (e->data_len < MIN_INITIAL_DGRAM_LEN)
+        goto drop;
+
+    if (hdr.token_len > 0) {
+        memset(&info, 0, sizeof(info));
+        now = get_time(eng);
+        if (token_cur_key(eng, now) != NULL
+            && token_open(eng, &e->peer, hdr.token, hdr.token_len, &info)
+            && !token_expired(eng, &info, now)
+            && (info.type != QUIC_TOKEN_TYPE_RETRY
+                || ossl_quic_conn_id_eq(&info.retry_scid, &hdr.dst_conn_id))) {
+            ++eng->stats.token_valid;
+            eng->cb(e, &info, eng->cb_arg);
+            return;
+        }
+
+        ++eng->stats.token_invalid;
+
+        /*
+         * A client which has received a Retry will not act on another one, so
+         * an Initial bearing a bad Retry token can only be dropped; without
+         * the Initial keys, we cannot send it an INVALID_TOKEN error. A bad
+         * NEW_TOKEN token, or one we cannot authenticate at all, is treated as
+         * though there were no token (RFC 9000 s. 8.1.3).
+         */
+        if (info.type == QUIC_TOKEN_TYPE_RETRY)
+            goto drop;
+    }
+
+    send_retry(eng, e, &hdr);
+
+drop:
+    ++eng->stats.dropped;
+    ossl_quic_demux_release_urxe(eng->demux, e);
+}
+
+int ossl_quic_token_engine_set_retry_filter(QUIC_TOKEN_ENGINE *eng,
+                                            QUIC_DEMUX *demux, BIO *net_bio,
+                                            ossl_quic_token_validated_cb_fn *cb,
+                                            void *cb_arg)
+{
+    if (demux == NULL || net_bio == NULL || cb == NULL)
+        return 0;
+
+    eng->demux      = demux;
+    eng->net_bio    = net_bio;
+    eng->cb         = cb;
+    eng->cb_arg     = cb_arg;
+    ossl_quic_demux_set_default_handler(demux, retry_filter, eng);
+    return 1;
+}
+
+void ossl_quic_token_engine_set_require_retry(QUIC_TOKEN_ENGINE *eng,
+                                              int require)
+{
+    eng->require_retry = (require != 0);
+}
+
+void ossl_quic_token_engine_get_stats(const QUIC_TOKEN_ENGINE *eng,
+                                      QUIC_TOKEN_ENGINE_STATS *stats)
+{
+    *stats = eng->stats;
+}
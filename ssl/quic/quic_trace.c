@@ -0,0 +1,180 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <openssl/bio.h>
+#include "internal/quic_trace.h"
+#include "internal/quic_wire_pkt.h"
+
+#if !defined(OPENSSL_NO_TRACE) && !defined(FIPS_MODULE)
+
+/* JSON text sequence record separator (RFC 7464). */
+# define QLOG_RS     "\x1e"
+
+static const char *pkt_type_name(int pkt_type)
+{
+    switch (pkt_type) {
+    case QUIC_PKT_TYPE_INITIAL:
+        return "initial";
+    case QUIC_PKT_TYPE_0RTT:
+        return "0RTT";
+    case QUIC_PKT_TYPE_HANDSHAKE:
+        return "handshake";
+    case QUIC_PKT_TYPE_RETRY:
+        return "retry";
+    case QUIC_PKT_TYPE_1RTT:
+        return "1RTT";
+    case QUIC_PKT_TYPE_VERSION_NEG:
+        return "version_negotiation";
+    default:
+        return "unknown";
+    }
+}
+
+static const char *pkt_space_name(int pkt_space)
+{
+    switch (pkt_space) {
+    case QUIC_PN_SPACE_INITIAL:
+        return "initial";
+    case QUIC_PN_SPACE_HANDSHAKE:
+        return "handshake";
+    case QUIC_PN_SPACE_APP:
+        return "1RTT";
+    default:
+        return "unknown";
+    }
+}
+
+/*
+ * Writes the fields common to all events, leaving the data object open. Times
+ * are in milliseconds with nanosecond precision.
+ */
+static void write_event_start(BIO *out, const void *group, OSSL_TIME t,
+                              const char *name)
+{
+    uint64_t ticks = ossl_time2ticks(t);
+
+    BIO_printf(out, QLOG_RS "{\"time\":%llu.%06llu,\"name\":\"%s\","
+               "\"group_id\":\"%p\",\"data\":{",
+               (unsigned long long)(ticks / OSSL_TIME_MS),
+               (unsigned long long)(ticks % OSSL_TIME_MS), name, group);
+}
+
+static void write_event_end(BIO *out)
+{
+    BIO_printf(out, "}}\n");
+}
+
+/* Writes the RTT metric named name, in milliseconds. */
+static void write_ms(BIO *out, const char *name, OSSL_TIME t)
+{
+    uint64_t ticks = ossl_time2ticks(t);
+
+    BIO_printf(out, "\"%s\":%llu.%06llu,", name,
+               (unsigned long long)(ticks / OSSL_TIME_MS),
+               (unsigned long long)(ticks % OSSL_TIME_MS));
+}
+
+static void write_packet_event(const void *group, OSSL_TIME now,
+                               const char *name, const char *pkt_type,
+                               QUIC_PN pn, size_t len)
+{
+    OSSL_TRACE_BEGIN(QUIC) {
+        write_event_start(trc_out, group, now, name);
+        BIO_printf(trc_out, "\"header\":{\"packet_type\":\"%s\"", pkt_type);
+        if (pn != QUIC_PN_INVALID)
+            BIO_printf(trc_out, ",\"packet_number\":%llu",
+                       (unsigned long long)pn);
+        BIO_printf(trc_out, "}");
+        if (len > 0)
+            BIO_printf(trc_out, ",\"raw\":{\"length\":%zu}", len);
+        write_event_end(trc_out);
+    } OSSL_TRACE_END(QUIC);
+}
+
+void ossl_qlog_packet_sent(const void *group, OSSL_TIME now, int pkt_type,
+                           QUIC_PN pn, size_t len)
+{
+    if (!ossl_quic_pkt_type_has_pn(pkt_type))
+        pn = QUIC_PN_INVALID;
+
+    write_packet_event(group, now, "transport:packet_sent",
+                       pkt_type_name(pkt_type), pn, len);
+}
+
+void ossl_qlog_packet_received(const void *group, OSSL_TIME now, int pkt_type,
+                               QUIC_PN pn, size_t len)
+{
+    if (!ossl_quic_pkt_type_has_pn(pkt_type))
+        pn = QUIC_PN_INVALID;
+
+    write_packet_event(group, now, "transport:packet_received",
+                       pkt_type_name(pkt_type), pn, len);
+}
+
+void ossl_qlog_packet_lost(const void *group, OSSL_TIME now, int pkt_space,
+                           QUIC_PN pn)
+{
+    write_packet_event(group, now, "recovery:packet_lost",
+                       pkt_space_name(pkt_space), pn, 0);
+}
+
+void ossl_qlog_metrics_updated(const void *group, OSSL_TIME now,
+                               OSSL_STATM *statm, uint64_t cwnd,
+                               uint64_t bytes_in_flight)
+{
+    OSSL_RTT_INFO rtt;
+
+    ossl_statm_get_rtt_info(statm, &rtt);
+
+    OSSL_TRACE_BEGIN(QUIC) {
+        write_event_start(trc_out, group, now, "recovery:metrics_updated");
+        write_ms(trc_out, "min_rtt", rtt.min_rtt);
+        write_ms(trc_out, "smoothed_rtt", rtt.smoothed_rtt);
+        write_ms(trc_out, "latest_rtt", rtt.latest_rtt);
+        write_ms(trc_out, "rtt_variance", rtt.rtt_variance);
+        BIO_printf(trc_out, "\"congestion_window\":%llu,"
+                   "\"bytes_in_flight\":%llu",
+                   (unsigned long long)cwnd,
+                   (unsigned long long)bytes_in_flight);
+        write_event_end(trc_out);
+    } OSSL_TRACE_END(QUIC);
+}
+
+void ossl_qlog_flow_control_blocked(const void *group, int is_stream,
+                                    uint64_t limit)
+{
+    OSSL_TRACE_BEGIN(QUIC) {
+        write_event_start(trc_out, group, ossl_time_now(),
+                          "flow_control:blocked");
+        BIO_printf(trc_out, "\"level\":\"%s\",\"limit\":%llu",
+                   is_stream ? "stream" : "connection",
+                   (unsigned long long)limit);
+        write_event_end(trc_out);
+    } OSSL_TRACE_END(QUIC);
+}
+
+void ossl_qlog_flow_control_window_updated(const void *group, OSSL_TIME now,
+                                           int is_stream, uint64_t limit,
+                                           uint64_t window)
+{
+    OSSL_TRACE_BEGIN(QUIC) {
+        write_event_start(trc_out, group, now, "flow_control:window_updated");
+        BIO_printf(trc_out, "\"level\":\"%s\",\"limit\":%llu,"
+                   "\"window\":%llu",
+                   is_stream ? "stream" : "connection",
+                   (unsigned long long)limit, (unsigned long long)window);
+        write_event_end(trc_out);
+    } OSSL_TRACE_END(QUIC);
+}
+
+#else
+
+NON_EMPTY_TRANSLATION_UNIT
+
+#endif
@@ -461,9 +461,23 @@ int ossl_quic_wire_decode_frame_ack(PACKET *pkt,
     for (i = 0; i < ack_range_count; ++i) {
         uint64_t gap, len;
 
-        if (!PACKET_get_quic_vlint(pkt, &gap)
-                || !PACKET_get_quic_vlint(pkt, &len))
+        if (PACKET_remaining(pkt) >= 16) {
+            /*
+             * Both fields of the range are available, whatever their lengths,
+             * so decode them with a single bounds check.
+             */
+            const unsigned char *p = PACKET_data(pkt);
+            size_t gap_enclen, len_enclen;
+
+            gap = ossl_quic_vlint_decode_unchecked8(p, &gap_enclen);
+            len = ossl_quic_vlint_decode_unchecked8(p + gap_enclen,
+                                                    &len_enclen);
+            if (!PACKET_forward(pkt, gap_enclen + len_enclen))
+                return 0;
+        } else if (!PACKET_get_quic_vlint(pkt, &gap)
+                   || !PACKET_get_quic_vlint(pkt, &len)) {
             return 0;
+        }
 
         end = start - gap - 2;
         if (start < gap + 2 || len > end)
@@ -7,6 +7,7 @@
  * https://www.openssl.org/source/license.html
  */
 
+#include <string.h>
 #include "internal/quic_wire_pkt.h"
 
 int ossl_quic_hdr_protector_init(QUIC_HDR_PROTECTOR *hpr,
@@ -17,6 +18,8 @@ int ossl_quic_hdr_protector_init(QUIC_HDR_PROTECTOR *hpr,
                                  size_t quic_hp_key_len)
 {
     const char *cipher_name = NULL;
+    EVP_CIPHER *cipher;
+    int ok;
 
     switch (cipher_id) {
         case QUIC_HDR_PROT_CIPHER_AES_128:
@@ -32,21 +35,45 @@ int ossl_quic_hdr_protector_init(QUIC_HDR_PROTECTOR *hpr,
             return 0;
     }
 
-    hpr->cipher_ctx = EVP_CIPHER_CTX_new();
-    if (hpr->cipher_ctx == NULL)
+    cipher = EVP_CIPHER_fetch(libctx, cipher_name, propq);
+    if (cipher == NULL)
+        return 0;
+
+    ok = ossl_quic_hdr_protector_init_with_cipher(hpr, cipher_id, cipher,
+                                                  quic_hp_key,
+                                                  quic_hp_key_len);
+    EVP_CIPHER_free(cipher);
+    if (!ok)
+        return 0;
+
+    hpr->libctx     = libctx;
+    hpr->propq      = propq;
+    return 1;
+}
+
+int ossl_quic_hdr_protector_init_with_cipher(QUIC_HDR_PROTECTOR *hpr,
+                                             uint32_t cipher_id,
+                                             EVP_CIPHER *cipher,
+                                             const unsigned char *quic_hp_key,
+                                             size_t quic_hp_key_len)
+{
+    if (cipher_id < QUIC_HDR_PROT_CIPHER_AES_128
+        || cipher_id > QUIC_HDR_PROT_CIPHER_CHACHA
+        || quic_hp_key_len != (size_t)EVP_CIPHER_get_key_length(cipher)
+        || !EVP_CIPHER_up_ref(cipher))
         return 0;
 
-    hpr->cipher = EVP_CIPHER_fetch(libctx, cipher_name, propq);
-    if (hpr->cipher == NULL
-        || quic_hp_key_len != (size_t)EVP_CIPHER_get_key_length(hpr->cipher))
+    hpr->cipher     = cipher;
+    hpr->cipher_ctx = EVP_CIPHER_CTX_new();
+    if (hpr->cipher_ctx == NULL)
         goto err;
 
     if (!EVP_CipherInit_ex(hpr->cipher_ctx, hpr->cipher, NULL,
                            quic_hp_key, NULL, 1))
         goto err;
 
-    hpr->libctx     = libctx;
-    hpr->propq      = propq;
+    hpr->libctx     = NULL;
+    hpr->propq      = NULL;
     hpr->cipher_id  = cipher_id;
     return 1;
 
@@ -140,22 +167,80 @@ int ossl_quic_hdr_protector_encrypt(QUIC_HDR_PROTECTOR *hpr,
                                                   ptrs->raw_pn);
 }
 
+static void hdr_encrypt_with_mask(const unsigned char *mask,
+                                  unsigned char *first_byte,
+                                  unsigned char *pn_bytes)
+{
+    unsigned char pn_len, i;
+
+    pn_len = (*first_byte & 0x3) + 1;
+    for (i = 0; i < pn_len; ++i)
+        pn_bytes[i] ^= mask[i + 1];
+
+    *first_byte ^= mask[0] & ((*first_byte & 0x80) != 0 ? 0xf : 0x1f);
+}
+
 int ossl_quic_hdr_protector_encrypt_fields(QUIC_HDR_PROTECTOR *hpr,
                                            const unsigned char *sample,
                                            size_t sample_len,
                                            unsigned char *first_byte,
                                            unsigned char *pn_bytes)
 {
-    unsigned char mask[5], pn_len, i;
+    unsigned char mask[5];
 
     if (!hdr_generate_mask(hpr, sample, sample_len, mask))
         return 0;
 
-    pn_len = (*first_byte & 0x3) + 1;
-    for (i = 0; i < pn_len; ++i)
-        pn_bytes[i] ^= mask[i + 1];
+    hdr_encrypt_with_mask(mask, first_byte, pn_bytes);
+    return 1;
+}
+
+/* Number of samples encrypted per call to the ECB cipher. */
+#define HP_BATCH_LEN    32
+
+int ossl_quic_hdr_protector_encrypt_many(QUIC_HDR_PROTECTOR *hpr,
+                                         QUIC_PKT_HDR_PTRS *ptrs,
+                                         size_t num_ptrs)
+{
+    unsigned char samples[HP_BATCH_LEN * 16], masks[HP_BATCH_LEN * 16];
+    size_t i, n;
+    int l = 0;
+
+    if (hpr->cipher_id == QUIC_HDR_PROT_CIPHER_CHACHA) {
+        /* Each sample is a different nonce, so there is nothing to batch. */
+        for (i = 0; i < num_ptrs; ++i)
+            if (!ossl_quic_hdr_protector_encrypt(hpr, &ptrs[i]))
+                return 0;
+
+        return 1;
+    }
+
+    /*
+     * For AES, the mask is the encryption of the sample as a single block, so
+     * the masks for many packets are the ECB encryption of their samples laid
+     * out one after another.
+     */
+    for (; num_ptrs > 0; ptrs += n, num_ptrs -= n) {
+        n = num_ptrs < HP_BATCH_LEN ? num_ptrs : HP_BATCH_LEN;
+
+        for (i = 0; i < n; ++i) {
+            if (ptrs[i].raw_sample_len < 16)
+                return 0;
+
+            memcpy(samples + i * 16, ptrs[i].raw_sample, 16);
+        }
+
+        if (!EVP_CipherInit_ex(hpr->cipher_ctx, NULL, NULL, NULL, NULL, 1)
+            || !EVP_CipherUpdate(hpr->cipher_ctx, masks, &l, samples,
+                                 (int)(n * 16))
+            || (size_t)l != n * 16)
+            return 0;
+
+        for (i = 0; i < n; ++i)
+            hdr_encrypt_with_mask(masks + i * 16, ptrs[i].raw_start,
+                                  ptrs[i].raw_pn);
+    }
 
-    *first_byte ^= mask[0] & ((*first_byte & 0x80) != 0 ? 0xf : 0x1f);
     return 1;
 }
 
@@ -744,3 +829,102 @@ int ossl_quic_wire_encode_pkt_hdr_pn(QUIC_PN pn,
 
     return 1;
 }
+
+/* Fixed key and nonce for QUIC v1 Retry packets (RFC 9001 s. 5.8). */
+static const unsigned char retry_integrity_key[16] = {
+    0xbe, 0x0c, 0x69, 0x0b, 0x9f, 0x66, 0x57, 0x5a,
+    0x1d, 0x76, 0x6b, 0x54, 0xe3, 0x68, 0xc8, 0x4e
+};
+
+static const unsigned char retry_integrity_nonce[12] = {
+    0x46, 0x15, 0x99, 0xd3, 0x5d, 0x63, 0x2b, 0xf2,
+    0x23, 0x98, 0x25, 0xbb
+};
+
+EVP_CIPHER_CTX *ossl_quic_retry_integrity_ctx_new(OSSL_LIB_CTX *libctx,
+                                                  const char *propq)
+{
+    EVP_CIPHER *cipher;
+    EVP_CIPHER_CTX *cctx = NULL;
+
+    if ((cipher = EVP_CIPHER_fetch(libctx, "AES-128-GCM", propq)) == NULL)
+        return NULL;
+
+    if ((cctx = EVP_CIPHER_CTX_new()) == NULL
+        || !EVP_CipherInit_ex(cctx, cipher, NULL, retry_integrity_key,
+                              retry_integrity_nonce, /*enc=*/1)) {
+        EVP_CIPHER_CTX_free(cctx);
+        cctx = NULL;
+    }
+
+    EVP_CIPHER_free(cipher);
+    return cctx;
+}
+
+int ossl_quic_calculate_retry_integrity_tag_ctx(EVP_CIPHER_CTX *cctx,
+                                                const unsigned char *pkt,
+                                                size_t pkt_len,
+                                                const QUIC_CONN_ID *odcid,
+                                                unsigned char *tag)
+{
+    int l = 0;
+    unsigned char odcid_len;
+
+    if (odcid->id_len > QUIC_MAX_CONN_ID_LEN || pkt_len > INT_MAX)
+        return 0;
+
+    /* The key is already set; only the nonce is needed to start again. */
+    if (!EVP_CipherInit_ex(cctx, NULL, NULL, NULL, retry_integrity_nonce,
+                           /*enc=*/1))
+        return 0;
+
+    /*
+     * The tag is that of an empty plaintext, with the Retry pseudo-packet as
+     * the AAD: the ODCID, prefixed by its length, followed by the Retry packet.
+     */
+    odcid_len = (unsigned char)odcid->id_len;
+    return EVP_CipherUpdate(cctx, NULL, &l, &odcid_len, 1)
+        && (odcid->id_len == 0
+            || EVP_CipherUpdate(cctx, NULL, &l, odcid->id,
+                                (int)odcid->id_len))
+        && EVP_CipherUpdate(cctx, NULL, &l, pkt, (int)pkt_len)
+        && EVP_CipherFinal_ex(cctx, NULL, &l)
+        && EVP_CIPHER_CTX_ctrl(cctx, EVP_CTRL_AEAD_GET_TAG,
+                               QUIC_RETRY_INTEGRITY_TAG_LEN, tag);
+}
+
+int ossl_quic_calculate_retry_integrity_tag(OSSL_LIB_CTX *libctx,
+                                            const char *propq,
+                                            const unsigned char *pkt,
+                                            size_t pkt_len,
+                                            const QUIC_CONN_ID *odcid,
+                                            unsigned char *tag)
+{
+    int ok;
+    EVP_CIPHER_CTX *cctx;
+
+    if ((cctx = ossl_quic_retry_integrity_ctx_new(libctx, propq)) == NULL)
+        return 0;
+
+    ok = ossl_quic_calculate_retry_integrity_tag_ctx(cctx, pkt, pkt_len,
+                                                     odcid, tag);
+    EVP_CIPHER_CTX_free(cctx);
+    return ok;
+}
+
+int ossl_quic_validate_retry_integrity_tag(OSSL_LIB_CTX *libctx,
+                                           const char *propq,
+                                           const unsigned char *pkt,
+                                           size_t pkt_len,
+                                           const QUIC_CONN_ID *odcid)
+{
+    unsigned char tag[QUIC_RETRY_INTEGRITY_TAG_LEN];
+
+    if (pkt_len < QUIC_RETRY_INTEGRITY_TAG_LEN
+        || !ossl_quic_calculate_retry_integrity_tag(libctx, propq, pkt,
+                                                    pkt_len - sizeof(tag),
+                                                    odcid, tag))
+        return 0;
+
+    return CRYPTO_memcmp(tag, pkt + pkt_len - sizeof(tag), sizeof(tag)) == 0;
+}
@@ -372,12 +372,7 @@ int dtls1_read_bytes(SSL *s, int type, int *recvd_type, unsigned char *buf,
             if (rr->length == 0)
                 ssl_release_record(sc, rr);
         } else {
-            if (sc->options & SSL_OP_CLEANSE_PLAINTEXT)
-                OPENSSL_cleanse(&(rr->data[rr->off]), n);
-            rr->length -= n;
-            rr->off += n;
-            if (rr->length == 0)
-                ssl_release_record(sc, rr);
+            ssl_consume_record(sc, rr, n);
         }
 #ifndef OPENSSL_NO_SCTP
         /*
@@ -32,6 +32,9 @@ void RECORD_LAYER_clear(RECORD_LAYER *rl)
     rl->wpend_type = 0;
     rl->wpend_ret = 0;
     rl->wpend_buf = NULL;
+    OPENSSL_free(rl->wvbuf);
+    rl->wvbuf = NULL;
+    rl->wvbuf_len = 0;
 
     ssl3_release_write_buffer(rl->s);
 
@@ -56,6 +59,9 @@ void RECORD_LAYER_release(RECORD_LAYER *rl)
 {
     if (rl->numwpipes > 0)
         ssl3_release_write_buffer(rl->s);
+    OPENSSL_free(rl->wvbuf);
+    rl->wvbuf = NULL;
+    rl->wvbuf_len = 0;
 }
 
 /* Checks if we have unprocessed read ahead data pending */
@@ -178,20 +184,104 @@ static int tls_write_check_pending(SSL_CONNECTION *s, int type,
     return 1;
 }
 
+/* Position in the data described by an array of SSL_IOVEC */
+typedef struct {
+    const SSL_IOVEC *iov;
+    size_t iovcnt;
+    /* The current buffer, and the offset into it */
+    size_t idx;
+    size_t off;
+} IOV_CURSOR;
+
+static void iov_cursor_init(IOV_CURSOR *cur, const SSL_IOVEC *iov,
+                            size_t iovcnt, size_t skip)
+{
+    cur->iov = iov;
+    cur->iovcnt = iovcnt;
+    cur->idx = 0;
+    while (cur->idx + 1 < iovcnt && skip >= iov[cur->idx].data_len) {
+        skip -= iov[cur->idx].data_len;
+        cur->idx++;
+    }
+    cur->off = skip;
+}
+
+/*
+ * Returns a pointer to the next |n| bytes of data and moves past them. The
+ * data is returned in place if it lies within one buffer. Otherwise it is
+ * gathered at |*stage|, which is advanced by |n|.
+ */
+static const unsigned char *iov_cursor_take(IOV_CURSOR *cur, size_t n,
+                                            unsigned char **stage)
+{
+    const unsigned char *ret;
+    unsigned char *dst;
+    size_t avail;
+
+    while (cur->idx + 1 < cur->iovcnt
+           && cur->off == cur->iov[cur->idx].data_len) {
+        cur->idx++;
+        cur->off = 0;
+    }
+
+    if (n <= cur->iov[cur->idx].data_len - cur->off) {
+        ret = (const unsigned char *)cur->iov[cur->idx].data + cur->off;
+        cur->off += n;
+        return ret;
+    }
+
+    ret = dst = *stage;
+    *stage += n;
+    while (n > 0) {
+        avail = cur->iov[cur->idx].data_len - cur->off;
+        if (avail == 0) {
+            cur->idx++;
+            cur->off = 0;
+            continue;
+        }
+        if (avail > n)
+            avail = n;
+        memcpy(dst, (const unsigned char *)cur->iov[cur->idx].data + cur->off,
+               avail);
+        dst += avail;
+        cur->off += avail;
+        n -= avail;
+    }
+    return ret;
+}
+
 /*
  * Call this to write data in records of type 'type' It will return <= 0 if
  * not all data has been sent or non-blocking IO.
  */
-int ssl3_write_bytes(SSL *ssl, int type, const void *buf_, size_t len,
+int ssl3_write_bytes(SSL *ssl, int type, const void *buf, size_t len,
                      size_t *written)
 {
-    const unsigned char *buf = buf_;
+    SSL_IOVEC iov;
+
+    iov.data = buf;
+    iov.data_len = len;
+    return ssl3_writev_bytes(ssl, type, &iov, 1, len, written);
+}
+
+/*
+ * As ssl3_write_bytes(), but the |len| bytes of data are taken from the
+ * |iovcnt| buffers in |iov| in turn. Records are filled across buffer
+ * boundaries, so that writing many small buffers does not produce many small
+ * records. A record is only copied to the staging buffer if it spans buffers.
+ */
+int ssl3_writev_bytes(SSL *ssl, int type, const SSL_IOVEC *iov, size_t iovcnt,
+                      size_t len, size_t *written)
+{
+    const unsigned char *buf = iovcnt > 0 ? iov[0].data : NULL;
     size_t tot;
     size_t n, max_send_fragment, split_send_fragment, maxpipes;
     int i;
     SSL_CONNECTION *s = SSL_CONNECTION_FROM_SSL_ONLY(ssl);
     OSSL_RECORD_TEMPLATE tmpls[SSL_MAX_PIPELINES];
     unsigned int recversion;
+    IOV_CURSOR cur;
+    unsigned char *stage;
 
     if (s == NULL)
         return -1;
@@ -315,9 +405,11 @@ int ssl3_write_bytes(SSL *ssl, int type, const void *buf_, size_t len,
             && s->hello_retry_request == SSL_HRR_NONE)
         recversion = TLS1_VERSION;
 
+    iov_cursor_init(&cur, iov, iovcnt, tot);
+
     for (;;) {
         size_t tmppipelen, remain;
-        size_t j, lensofar = 0;
+        size_t j;
 
         /*
         * Ask the record layer how it would like to split the amount of data
@@ -343,6 +435,23 @@ int ssl3_write_bytes(SSL *ssl, int type, const void *buf_, size_t len,
             return -1;
         }
 
+        /*
+         * No more than maxpipes * split_send_fragment bytes go out in one go,
+         * so that is as much as we may have to gather.
+         */
+        if (iovcnt > 1
+                && s->rlayer.wvbuf_len < maxpipes * split_send_fragment) {
+            OPENSSL_free(s->rlayer.wvbuf);
+            s->rlayer.wvbuf_len = 0;
+            s->rlayer.wvbuf = OPENSSL_malloc(maxpipes * split_send_fragment);
+            if (s->rlayer.wvbuf == NULL) {
+                SSLfatal(s, SSL_AD_INTERNAL_ERROR, ERR_R_MALLOC_FAILURE);
+                return -1;
+            }
+            s->rlayer.wvbuf_len = maxpipes * split_send_fragment;
+        }
+        stage = s->rlayer.wvbuf;
+
         if (n / maxpipes >= split_send_fragment) {
             /*
              * We have enough data to completely fill all available
@@ -351,7 +460,8 @@ int ssl3_write_bytes(SSL *ssl, int type, const void *buf_, size_t len,
             for (j = 0; j < maxpipes; j++) {
                 tmpls[j].type = type;
                 tmpls[j].version = recversion;
-                tmpls[j].buf = &(buf[tot]) + (j * split_send_fragment);
+                tmpls[j].buf = iov_cursor_take(&cur, split_send_fragment,
+                                               &stage);
                 tmpls[j].buflen = split_send_fragment;
             }
             /* Remember how much data we are going to be sending */
@@ -369,9 +479,8 @@ int ssl3_write_bytes(SSL *ssl, int type, const void *buf_, size_t len,
             for (j = 0; j < maxpipes; j++) {
                 tmpls[j].type = type;
                 tmpls[j].version = recversion;
-                tmpls[j].buf = &(buf[tot]) + lensofar;
+                tmpls[j].buf = iov_cursor_take(&cur, tmppipelen, &stage);
                 tmpls[j].buflen = tmppipelen;
-                lensofar += tmppipelen;
                 if (j + 1 == remain)
                     tmppipelen--;
             }
@@ -472,6 +581,33 @@ void ssl_release_record(SSL_CONNECTION *s, TLS_RECORD *rr)
     s->rlayer.curr_rec++;
 }
 
+/*
+ * Returns the application data record at the front of the queue, as left
+ * there by a peek, or NULL if there is none.
+ */
+TLS_RECORD *ssl_peeked_app_record(SSL_CONNECTION *s)
+{
+    TLS_RECORD *rr;
+
+    if (s->rlayer.curr_rec >= s->rlayer.num_recs)
+        return NULL;
+    rr = &s->rlayer.tlsrecs[s->rlayer.curr_rec];
+    if (rr->type != SSL3_RT_APPLICATION_DATA || rr->length == 0)
+        return NULL;
+    return rr;
+}
+
+/* Marks |n| bytes at the front of |rr| as read, releasing it once empty */
+void ssl_consume_record(SSL_CONNECTION *s, TLS_RECORD *rr, size_t n)
+{
+    if (s->options & SSL_OP_CLEANSE_PLAINTEXT)
+        OPENSSL_cleanse(&(rr->data[rr->off]), n);
+    rr->length -= n;
+    rr->off += n;
+    if (rr->length == 0)
+        ssl_release_record(s, rr);
+}
+
 /*-
  * Return up to 'len' payload bytes received in 'type' records.
  * 'type' is one of the following:
@@ -684,12 +820,7 @@ int ssl3_read_bytes(SSL *ssl, int type, int *recvd_type, unsigned char *buf,
                 if (rr->length == 0)
                     ssl_release_record(s, rr);
             } else {
-                if (s->options & SSL_OP_CLEANSE_PLAINTEXT)
-                    OPENSSL_cleanse(&(rr->data[rr->off]), n);
-                rr->length -= n;
-                rr->off += n;
-                if (rr->length == 0)
-                    ssl_release_record(s, rr);
+                ssl_consume_record(s, rr, n);
             }
             if (rr->length == 0
                 || (peek && n == rr->length)) {
@@ -168,6 +168,9 @@ typedef struct record_layer_st {
     /* number of bytes submitted */
     size_t wpend_ret;
     const unsigned char *wpend_buf;
+    /* Records gathered from several SSL_writev_ex() buffers are built here */
+    unsigned char *wvbuf;
+    size_t wvbuf_len;
 
     unsigned char write_sequence[SEQ_NUM_SIZE];
     /* Count of the number of consecutive warning alerts received */
@@ -222,6 +225,8 @@ int RECORD_LAYER_is_sslv2_record(RECORD_LAYER *rl);
 __owur size_t ssl3_pending(const SSL *s);
 __owur int ssl3_write_bytes(SSL *s, int type, const void *buf, size_t len,
                             size_t *written);
+__owur int ssl3_writev_bytes(SSL *s, int type, const SSL_IOVEC *iov,
+                             size_t iovcnt, size_t len, size_t *written);
 __owur int ssl3_read_bytes(SSL *s, int type, int *recvd_type,
                            unsigned char *buf, size_t len, int peek,
                            size_t *readbytes);
@@ -251,6 +256,8 @@ int do_dtls1_write(SSL_CONNECTION *s, int type, const unsigned char *buf,
                    size_t len, int create_empty_fragment, size_t *written);
 void dtls1_reset_seq_numbers(SSL_CONNECTION *s, int rw);
 void ssl_release_record(SSL_CONNECTION *s, TLS_RECORD *rr);
+TLS_RECORD *ssl_peeked_app_record(SSL_CONNECTION *s);
+void ssl_consume_record(SSL_CONNECTION *s, TLS_RECORD *rr, size_t n);
 
 # define HANDLE_RLAYER_READ_RETURN(s, ret) \
     ossl_tls_handle_rlayer_return(s, 0, ret, OPENSSL_FILE, OPENSSL_LINE)
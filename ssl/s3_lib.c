@@ -3851,37 +3851,20 @@ long ssl3_ctx_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
     case SSL_CTRL_GET_TLSEXT_TICKET_KEYS:
         {
             unsigned char *keys = parg;
-            long tick_keylen = (sizeof(ctx->ext.tick_key_name) +
-                                sizeof(ctx->ext.secure->tick_hmac_key) +
-                                sizeof(ctx->ext.secure->tick_aes_key));
+            long tick_keylen = TLSEXT_KEYNAME_LENGTH
+                               + sizeof(ctx->ext.secure->tick_hmac_key[0])
+                               + sizeof(ctx->ext.secure->tick_aes_key[0]);
+
             if (keys == NULL)
                 return tick_keylen;
             if (larg != tick_keylen) {
                 ERR_raise(ERR_LIB_SSL, SSL_R_INVALID_TICKET_KEYS_LENGTH);
                 return 0;
             }
-            if (cmd == SSL_CTRL_SET_TLSEXT_TICKET_KEYS) {
-                memcpy(ctx->ext.tick_key_name, keys,
-                       sizeof(ctx->ext.tick_key_name));
-                memcpy(ctx->ext.secure->tick_hmac_key,
-                       keys + sizeof(ctx->ext.tick_key_name),
-                       sizeof(ctx->ext.secure->tick_hmac_key));
-                memcpy(ctx->ext.secure->tick_aes_key,
-                       keys + sizeof(ctx->ext.tick_key_name) +
-                       sizeof(ctx->ext.secure->tick_hmac_key),
-                       sizeof(ctx->ext.secure->tick_aes_key));
-            } else {
-                memcpy(keys, ctx->ext.tick_key_name,
-                       sizeof(ctx->ext.tick_key_name));
-                memcpy(keys + sizeof(ctx->ext.tick_key_name),
-                       ctx->ext.secure->tick_hmac_key,
-                       sizeof(ctx->ext.secure->tick_hmac_key));
-                memcpy(keys + sizeof(ctx->ext.tick_key_name) +
-                       sizeof(ctx->ext.secure->tick_hmac_key),
-                       ctx->ext.secure->tick_aes_key,
-                       sizeof(ctx->ext.secure->tick_aes_key));
-            }
-            return 1;
+            if (cmd == SSL_CTRL_SET_TLSEXT_TICKET_KEYS)
+                return ssl_tick_keys_set(ctx, keys);
+            else
+                return ssl_tick_keys_get(ctx, keys);
         }
 
     case SSL_CTRL_GET_TLSEXT_STATUS_REQ_TYPE:
@@ -4496,6 +4479,30 @@ int ssl3_write(SSL *s, const void *buf, size_t len, size_t *written)
                                       written);
 }
 
+int ssl3_writev(SSL *s, const SSL_IOVEC *iov, size_t iovcnt, size_t *written)
+{
+    SSL_CONNECTION *sc = SSL_CONNECTION_FROM_SSL_ONLY(s);
+    size_t i, len = 0;
+
+    if (sc == NULL)
+        return 0;
+
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].data_len > SIZE_MAX - len) {
+            ERR_raise(ERR_LIB_SSL, SSL_R_BAD_LENGTH);
+            return -1;
+        }
+        len += iov[i].data_len;
+    }
+
+    clear_sys_error();
+    if (sc->s3.renegotiate)
+        ssl3_renegotiate_check(s, 0);
+
+    return ssl3_writev_bytes(s, SSL3_RT_APPLICATION_DATA, iov, iovcnt, len,
+                             written);
+}
+
 static int ssl3_read_internal(SSL *s, void *buf, size_t len, int peek,
                               size_t *readbytes)
 {
@@ -91,10 +91,11 @@ struct ssl_async_args {
     SSL *s;
     void *buf;
     size_t num;
-    enum { READFUNC, WRITEFUNC, OTHERFUNC } type;
+    enum { READFUNC, WRITEFUNC, WRITEVFUNC, OTHERFUNC } type;
     union {
         int (*func_read) (SSL *, void *, size_t, size_t *);
         int (*func_write) (SSL *, const void *, size_t, size_t *);
+        int (*func_writev) (SSL *, const SSL_IOVEC *, size_t, size_t *);
         int (*func_other) (SSL *);
     } f;
 };
@@ -994,7 +995,7 @@ int SSL_has_matching_session_id(const SSL *ssl, const unsigned char *id,
      * any new session built out of this id/id_len and the ssl_version in use
      * by this SSL.
      */
-    SSL_SESSION r, *p;
+    SSL_SESSION r;
     const SSL_CONNECTION *sc = SSL_CONNECTION_FROM_CONST_SSL(ssl);
 
     if (sc == NULL || id_len > sizeof(r.session_id))
@@ -1004,11 +1005,7 @@ int SSL_has_matching_session_id(const SSL *ssl, const unsigned char *id,
     r.session_id_length = id_len;
     memcpy(r.session_id, id, id_len);
 
-    if (!CRYPTO_THREAD_read_lock(sc->session_ctx->lock))
-        return 0;
-    p = lh_SSL_SESSION_retrieve(sc->session_ctx->sessions, &r);
-    CRYPTO_THREAD_unlock(sc->session_ctx->lock);
-    return (p != NULL);
+    return ssl_session_cache_has(sc->session_ctx, &r);
 }
 
 int SSL_CTX_set_purpose(SSL_CTX *s, int purpose)
@@ -2135,6 +2132,8 @@ static int ssl_io_intern(void *vargs)
         return args->f.func_read(s, buf, num, &sc->asyncrw);
     case WRITEFUNC:
         return args->f.func_write(s, buf, num, &sc->asyncrw);
+    case WRITEVFUNC:
+        return args->f.func_writev(s, buf, num, &sc->asyncrw);
     case OTHERFUNC:
         return args->f.func_other(s);
     }
@@ -2353,13 +2352,67 @@ int SSL_peek_ex(SSL *s, void *buf, size_t num, size_t *readbytes)
     return ret;
 }
 
-int ssl_write_internal(SSL *s, const void *buf, size_t num, size_t *written)
+int SSL_peek_record_buffer(SSL *s, const unsigned char **data, size_t *len)
 {
-    SSL_CONNECTION *sc = SSL_CONNECTION_FROM_SSL(s);
+    SSL_CONNECTION *sc = SSL_CONNECTION_FROM_SSL_ONLY(s);
+    TLS_RECORD *rr;
+    unsigned char c;
+    size_t readbytes;
 
-    if (sc == NULL)
+    /* QUIC has no records to lend out. */
+    if (sc == NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+        return 0;
+    }
+
+    /*
+     * Peeking a single byte drives the handshake and deals with any non
+     * application data records just like SSL_read() does, and leaves the
+     * record that byte came from at the front of the queue.
+     */
+    if (ssl_peek_internal(s, &c, 1, &readbytes) <= 0)
         return 0;
 
+    rr = ssl_peeked_app_record(sc);
+    if (rr == NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_INTERNAL_ERROR);
+        return 0;
+    }
+    *data = rr->data + rr->off;
+    *len = rr->length;
+    return 1;
+}
+
+int SSL_release_record_buffer(SSL *s, size_t len)
+{
+    SSL_CONNECTION *sc = SSL_CONNECTION_FROM_SSL_ONLY(s);
+    TLS_RECORD *rr;
+
+    /* QUIC has no records to lend out. */
+    if (sc == NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+        return 0;
+    }
+
+    rr = ssl_peeked_app_record(sc);
+    if (rr == NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+        return 0;
+    }
+    if (len > rr->length) {
+        ERR_raise(ERR_LIB_SSL, SSL_R_BAD_LENGTH);
+        return 0;
+    }
+    ssl_consume_record(sc, rr, len);
+    return 1;
+}
+
+/*
+ * Checks that application data may be written on sc, as is common to all the
+ * write functions. Returns 1 if so, or else the value they are to return.
+ */
+static int ssl_write_check(SSL_CONNECTION *sc)
+{
     if (sc->handshake_func == NULL) {
         ERR_raise(ERR_LIB_SSL, SSL_R_UNINITIALIZED);
         return -1;
@@ -2380,8 +2433,21 @@ int ssl_write_internal(SSL *s, const void *buf, size_t num, size_t *written)
     /* If we are a client and haven't sent the Finished we better do that */
     ossl_statem_check_finish_init(sc, 1);
 
+    return 1;
+}
+
+int ssl_write_internal(SSL *s, const void *buf, size_t num, size_t *written)
+{
+    SSL_CONNECTION *sc = SSL_CONNECTION_FROM_SSL(s);
+    int ret;
+
+    if (sc == NULL)
+        return 0;
+
+    if ((ret = ssl_write_check(sc)) != 1)
+        return ret;
+
     if ((sc->mode & SSL_MODE_ASYNC) && ASYNC_get_current_job() == NULL) {
-        int ret;
         struct ssl_async_args args;
 
         args.s = s;
@@ -2497,6 +2563,43 @@ int SSL_write_ex(SSL *s, const void *buf, size_t num, size_t *written)
     return ret;
 }
 
+int SSL_writev_ex(SSL *s, const SSL_IOVEC *iov, size_t iovcnt, size_t *written)
+{
+    SSL_CONNECTION *sc = SSL_CONNECTION_FROM_SSL_ONLY(s);
+    int ret;
+
+    /*
+     * This fills TLS records across buffers. QUIC does not use TLS records,
+     * and DTLS records map to datagrams, so cannot be filled this way.
+     */
+    if (sc == NULL || SSL_CONNECTION_IS_DTLS(sc)) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+        return 0;
+    }
+
+    if (ssl_write_check(sc) != 1)
+        return 0;
+
+    if ((sc->mode & SSL_MODE_ASYNC) && ASYNC_get_current_job() == NULL) {
+        struct ssl_async_args args;
+
+        args.s = s;
+        args.buf = (void *)iov;
+        args.num = iovcnt;
+        args.type = WRITEVFUNC;
+        args.f.func_writev = ssl3_writev;
+
+        ret = ssl_start_async_job(s, &args, ssl_io_intern);
+        *written = sc->asyncrw;
+    } else {
+        ret = ssl3_writev(s, iov, iovcnt, written);
+    }
+
+    if (ret < 0)
+        ret = 0;
+    return ret;
+}
+
 int SSL_write_early_data(SSL *s, const void *buf, size_t num, size_t *written)
 {
     int ret, early_data_state;
@@ -2868,7 +2971,11 @@ long SSL_callback_ctrl(SSL *s, int cmd, void (*fp) (void))
 
 LHASH_OF(SSL_SESSION) *SSL_CTX_sessions(SSL_CTX *ctx)
 {
-    return ctx->sessions;
+    /* A sharded cache has no single hash table to return. */
+    if (ctx->num_sess_shards != 1)
+        return NULL;
+
+    return ctx->sess_shards[0].sessions;
 }
 
 static int ssl_tsan_load(SSL_CTX *ctx, TSAN_QUALIFIER int *stat)
@@ -2928,14 +3035,30 @@ long SSL_CTX_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg)
     case SSL_CTRL_GET_SESS_CACHE_SIZE:
         return (long)ctx->session_cache_size;
     case SSL_CTRL_SET_SESS_CACHE_MODE:
+        /*
+         * If the cache cannot be resharded, leave the mode as it is. The
+         * previous mode is still returned, so callers wanting to know should
+         * use SSL_CTRL_SET_SESS_CACHE_SHARDED instead.
+         */
+        if (!ssl_session_cache_set_sharded(ctx,
+                                           (larg & SSL_SESS_CACHE_SHARDED) != 0))
+            return ctx->session_cache_mode;
         l = ctx->session_cache_mode;
         ctx->session_cache_mode = larg;
         return l;
     case SSL_CTRL_GET_SESS_CACHE_MODE:
         return ctx->session_cache_mode;
+    case SSL_CTRL_SET_SESS_CACHE_SHARDED:
+        if (!ssl_session_cache_set_sharded(ctx, larg != 0))
+            return 0;
+        if (larg != 0)
+            ctx->session_cache_mode |= SSL_SESS_CACHE_SHARDED;
+        else
+            ctx->session_cache_mode &= ~SSL_SESS_CACHE_SHARDED;
+        return 1;
 
     case SSL_CTRL_SESS_NUMBER:
-        return lh_SSL_SESSION_num_items(ctx->sessions);
+        return (long)ssl_session_cache_num(ctx);
     case SSL_CTRL_SESS_CONNECT:
         return ssl_tsan_load(ctx, &ctx->stats.sess_connect);
     case SSL_CTRL_SESS_CONNECT_GOOD:
@@ -3615,42 +3738,6 @@ int SSL_export_keying_material_early(SSL *s, unsigned char *out, size_t olen,
                                               context, contextlen);
 }
 
-static unsigned long ssl_session_hash(const SSL_SESSION *a)
-{
-    const unsigned char *session_id = a->session_id;
-    unsigned long l;
-    unsigned char tmp_storage[4];
-
-    if (a->session_id_length < sizeof(tmp_storage)) {
-        memset(tmp_storage, 0, sizeof(tmp_storage));
-        memcpy(tmp_storage, a->session_id, a->session_id_length);
-        session_id = tmp_storage;
-    }
-
-    l = (unsigned long)
-        ((unsigned long)session_id[0]) |
-        ((unsigned long)session_id[1] << 8L) |
-        ((unsigned long)session_id[2] << 16L) |
-        ((unsigned long)session_id[3] << 24L);
-    return l;
-}
-
-/*
- * NB: If this function (or indeed the hash function which uses a sort of
- * coarser function than this one) is changed, ensure
- * SSL_CTX_has_matching_session_id() is checked accordingly. It relies on
- * being able to construct an SSL_SESSION that will collide with any existing
- * session with a matching session ID.
- */
-static int ssl_session_cmp(const SSL_SESSION *a, const SSL_SESSION *b)
-{
-    if (a->ssl_version != b->ssl_version)
-        return 1;
-    if (a->session_id_length != b->session_id_length)
-        return 1;
-    return memcmp(a->session_id, b->session_id, a->session_id_length);
-}
-
 /*
  * These wrapper functions should remain rather than redeclaring
  * SSL_SESSION_hash and SSL_SESSION_cmp for void* types and casting each
@@ -3716,8 +3803,7 @@ SSL_CTX *SSL_CTX_new_ex(OSSL_LIB_CTX *libctx, const char *propq,
     if ((ret->cert = ssl_cert_new()) == NULL)
         goto err;
 
-    ret->sessions = lh_SSL_SESSION_new(ssl_session_hash, ssl_session_cmp);
-    if (ret->sessions == NULL)
+    if (!ssl_session_cache_init(ret))
         goto err;
     ret->cert_store = X509_STORE_new();
     if (ret->cert_store == NULL)
@@ -3782,12 +3868,9 @@ SSL_CTX *SSL_CTX_new_ex(OSSL_LIB_CTX *libctx, const char *propq,
     ret->split_send_fragment = SSL3_RT_MAX_PLAIN_LENGTH;
 
     /* Setup RFC5077 ticket keys */
-    if ((RAND_bytes_ex(libctx, ret->ext.tick_key_name,
-                       sizeof(ret->ext.tick_key_name), 0) <= 0)
-        || (RAND_priv_bytes_ex(libctx, ret->ext.secure->tick_hmac_key,
-                               sizeof(ret->ext.secure->tick_hmac_key), 0) <= 0)
-        || (RAND_priv_bytes_ex(libctx, ret->ext.secure->tick_aes_key,
-                               sizeof(ret->ext.secure->tick_aes_key), 0) <= 0))
+    if ((ret->ext.tick_lock = CRYPTO_THREAD_lock_new()) == NULL)
+        goto err;
+    if (!ssl_tick_keys_init(ret))
         ret->options |= SSL_OP_NO_TICKET;
 
     if (RAND_priv_bytes_ex(libctx, ret->ext.cookie_hmac_key,
@@ -3912,11 +3995,12 @@ void SSL_CTX_free(SSL_CTX *a)
      * free ex_data, then finally free the cache.
      * (See ticket [openssl.org #212].)
      */
-    if (a->sessions != NULL)
+    if (a->sess_shards != NULL)
         SSL_CTX_flush_sessions(a, 0);
 
     CRYPTO_free_ex_data(CRYPTO_EX_INDEX_SSL_CTX, a, &a->ex_data);
-    lh_SSL_SESSION_free(a->sessions);
+    ssl_session_cache_free(a);
+    SSL_SESS_SHM_free(a->sess_shm);
     X509_STORE_free(a->cert_store);
 #ifndef OPENSSL_NO_CT
     CTLOG_STORE_free(a->ctlog_store);
@@ -3943,6 +4027,7 @@ void SSL_CTX_free(SSL_CTX *a)
     OPENSSL_free(a->ext.supportedgroups);
     OPENSSL_free(a->ext.supported_groups_default);
     OPENSSL_free(a->ext.alpn);
+    ssl_tick_keys_free(a);
     OPENSSL_secure_free(a->ext.secure);
 
     ssl_evp_md_free(a->md5);
@@ -650,6 +650,23 @@ struct ssl_session_st {
 /* Extended master secret support */
 # define SSL_SESS_FLAG_EXTMS             0x1
 
+/*
+ * A shard of the session cache of an SSL_CTX: a hash table of sessions and a
+ * list of the same sessions ordered by expiry, under a lock of their own. The
+ * cache has a single shard unless SSL_SESS_CACHE_SHARDED is set, in which case
+ * sessions are spread over SSL_SESS_CACHE_NUM_SHARDS shards by their ID. The
+ * cache size limit applies to all shards together, and a session is evicted
+ * from the shard being added to when possible.
+ */
+typedef struct ssl_sess_shard_st {
+    CRYPTO_RWLOCK *lock;
+    LHASH_OF(SSL_SESSION) *sessions;
+    struct ssl_session_st *session_cache_head;
+    struct ssl_session_st *session_cache_tail;
+} SSL_SESS_SHARD;
+
+# define SSL_SESS_CACHE_NUM_SHARDS       16
+
 # ifndef OPENSSL_NO_SRP
 
 typedef struct srp_ctx_st {
@@ -786,11 +803,30 @@ DEFINE_LHASH_OF_EX(X509_NAME);
 # define TLSEXT_KEYNAME_LENGTH  16
 # define TLSEXT_TICK_KEY_LENGTH 32
 
+/* Slots of the built-in ticket key ring */
+# define SSL_TICK_KEY_PREV      0
+# define SSL_TICK_KEY_CUR       1
+# define SSL_TICK_KEY_NEXT      2
+# define SSL_TICK_KEY_NUM       3
+
 typedef struct ssl_ctx_ext_secure_st {
-    unsigned char tick_hmac_key[TLSEXT_TICK_KEY_LENGTH];
-    unsigned char tick_aes_key[TLSEXT_TICK_KEY_LENGTH];
+    unsigned char tick_hmac_key[SSL_TICK_KEY_NUM][TLSEXT_TICK_KEY_LENGTH];
+    unsigned char tick_aes_key[SSL_TICK_KEY_NUM][TLSEXT_TICK_KEY_LENGTH];
 } SSL_CTX_EXT_SECURE;
 
+/*
+ * A key of the built-in ticket key ring. Its secrets are kept in the slot of
+ * the same index in SSL_CTX_EXT_SECURE. The contexts are keyed the first
+ * time the key is used and then duplicated for each ticket, so that the
+ * algorithms are not fetched and the key schedules not computed every time.
+ */
+typedef struct ssl_tick_key_st {
+    int valid;
+    unsigned char name[TLSEXT_KEYNAME_LENGTH];
+    EVP_MAC_CTX *mac;
+    EVP_CIPHER_CTX *enc, *dec;
+} SSL_TICK_KEY;
+
 /*
  * Helper function for HMAC
  * The structure should be considered opaque, it will change once the low
@@ -817,6 +853,19 @@ int ssl_hmac_final(SSL_HMAC *ctx, unsigned char *md, size_t *len,
                    size_t max_size);
 size_t ssl_hmac_size(const SSL_HMAC *ctx);
 
+__owur int ssl_tick_keys_init(SSL_CTX *ctx);
+void ssl_tick_keys_free(SSL_CTX *ctx);
+__owur int ssl_tick_keys_set(SSL_CTX *ctx, const unsigned char *keys);
+__owur int ssl_tick_keys_get(SSL_CTX *ctx, unsigned char *keys);
+__owur int ssl_tick_keys_encrypt_init(SSL_CTX *ctx, unsigned char *key_name,
+                                      unsigned char *iv, int *iv_len,
+                                      EVP_CIPHER_CTX *cctx, SSL_HMAC **hctx);
+__owur int ssl_tick_keys_decrypt_init(SSL_CTX *ctx,
+                                      const unsigned char *key_name,
+                                      const unsigned char *iv,
+                                      EVP_CIPHER_CTX *cctx, SSL_HMAC **hctx,
+                                      int *renew);
+
 int ssl_get_EC_curve_nid(const EVP_PKEY *pkey);
 __owur int tls13_set_encoded_pub_key(EVP_PKEY *pkey,
                                      const unsigned char *enckey,
@@ -855,14 +904,16 @@ struct ssl_ctx_st {
     /* TLSv1.3 specific ciphersuites */
     STACK_OF(SSL_CIPHER) *tls13_ciphersuites;
     struct x509_store_st /* X509_STORE */ *cert_store;
-    LHASH_OF(SSL_SESSION) *sessions;
+    /* The session cache, split into one or more shards. */
+    SSL_SESS_SHARD *sess_shards;
+    size_t num_sess_shards;
+    /* Number of sessions in all shards, updated atomically. */
+    int sess_cache_num;
     /*
      * Most session-ids that will be cached, default is
      * SSL_SESSION_CACHE_MAX_SIZE_DEFAULT. 0 is unlimited.
      */
     size_t session_cache_size;
-    struct ssl_session_st *session_cache_head;
-    struct ssl_session_st *session_cache_tail;
     /*
      * This can have one of 2 values, ored together, SSL_SESS_CACHE_CLIENT,
      * SSL_SESS_CACHE_SERVER, Default is SSL_SESSION_CACHE_SERVER, which
@@ -889,6 +940,18 @@ struct ssl_ctx_st {
     SSL_SESSION *(*get_session_cb) (struct ssl_st *ssl,
                                     const unsigned char *data, int len,
                                     int *copy);
+    /*
+     * Cache shared with other processes, if set by
+     * SSL_CTX_set1_session_shm(). It is reached through new_session_cb and
+     * get_session_cb, while removals are passed on by SSL_CTX_remove_session().
+     * The callbacks set before it was attached are kept here, called after
+     * the shared cache and restored when it is detached.
+     */
+    SSL_SESS_SHM *sess_shm;
+    int (*sess_shm_user_new_cb) (struct ssl_st *ssl, SSL_SESSION *sess);
+    SSL_SESSION *(*sess_shm_user_get_cb) (struct ssl_st *ssl,
+                                          const unsigned char *data, int len,
+                                          int *copy);
     struct {
         TSAN_QUALIFIER int sess_connect;       /* SSL new conn - started */
         TSAN_QUALIFIER int sess_connect_renegotiate; /* SSL reneg - requested */
@@ -1044,9 +1107,17 @@ struct ssl_ctx_st {
         /* TLS extensions servername callback */
         int (*servername_cb) (SSL *, int *, void *);
         void *servername_arg;
-        /* RFC 4507 session ticket keys */
-        unsigned char tick_key_name[TLSEXT_KEYNAME_LENGTH];
+        /*
+         * RFC 4507 session ticket keys, used unless a ticket key callback is
+         * set. Tickets are issued with the current key and accepted with any
+         * valid key. The ring moves on by one slot every tick_key_interval,
+         * if that is not zero. tick_lock guards all of this.
+         */
+        SSL_TICK_KEY tick_keys[SSL_TICK_KEY_NUM];
         SSL_CTX_EXT_SECURE *secure;
+        CRYPTO_RWLOCK *tick_lock;
+        OSSL_TIME tick_key_interval;
+        OSSL_TIME tick_rotate_at;
 # ifndef OPENSSL_NO_DEPRECATED_3_0
         /* Callback to support customisation of ticket key setting */
         int (*ticket_key_cb) (SSL *ssl,
@@ -2458,6 +2529,12 @@ __owur SSL_SESSION *lookup_sess_in_cache(SSL_CONNECTION *s,
                                          size_t sess_id_len);
 __owur int ssl_get_prev_session(SSL_CONNECTION *s, CLIENTHELLO_MSG *hello);
 __owur SSL_SESSION *ssl_session_dup(const SSL_SESSION *src, int ticket);
+__owur int ssl_session_cache_init(SSL_CTX *ctx);
+void ssl_session_cache_free(SSL_CTX *ctx);
+__owur int ssl_session_cache_set_sharded(SSL_CTX *ctx, int sharded);
+size_t ssl_session_cache_num(SSL_CTX *ctx);
+__owur int ssl_session_cache_has(SSL_CTX *ctx, const SSL_SESSION *key);
+void ssl_sess_shm_remove(SSL_SESS_SHM *shm, const SSL_SESSION *sess);
 __owur int ssl_cipher_id_cmp(const SSL_CIPHER *a, const SSL_CIPHER *b);
 DECLARE_OBJ_BSEARCH_GLOBAL_CMP_FN(SSL_CIPHER, SSL_CIPHER, ssl_cipher_id);
 __owur int ssl_cipher_ptr_id_cmp(const SSL_CIPHER *const *ap,
@@ -2587,6 +2664,8 @@ void ssl3_free(SSL *s);
 __owur int ssl3_read(SSL *s, void *buf, size_t len, size_t *readbytes);
 __owur int ssl3_peek(SSL *s, void *buf, size_t len, size_t *readbytes);
 __owur int ssl3_write(SSL *s, const void *buf, size_t len, size_t *written);
+__owur int ssl3_writev(SSL *s, const SSL_IOVEC *iov, size_t iovcnt,
+                       size_t *written);
 __owur int ssl3_shutdown(SSL *s);
 int ssl3_clear(SSL *s);
 __owur long ssl3_ctrl(SSL *s, int cmd, long larg, void *parg);
@@ -20,8 +20,9 @@
 #include "ssl_local.h"
 #include "statem/statem_local.h"
 
-static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s);
-static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESSION *s);
+static void SSL_SESSION_list_remove(SSL_SESS_SHARD *sh, SSL_SESSION *s);
+static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESS_SHARD *sh,
+                                 SSL_SESSION *s);
 static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION *c, int lck);
 
 DEFINE_STACK_OF(SSL_SESSION)
@@ -40,6 +41,30 @@ __owur static ossl_inline int timeoutcmp(SSL_SESSION *a, SSL_SESSION *b)
     return ossl_time_compare(a->calc_timeout, b->calc_timeout);
 }
 
+/*
+ * Returns the shard of the session cache of ctx which holds sessions with the
+ * ID of s. The fourth byte of the ID is the top byte of the hash used by the
+ * hash table of each shard, so choosing the shard by it leaves the low bits,
+ * which select the bucket, evenly distributed within the shard.
+ */
+static SSL_SESS_SHARD *sess_shard(SSL_CTX *ctx, const SSL_SESSION *s)
+{
+    if (ctx->num_sess_shards == 1 || s->session_id_length < 4)
+        return &ctx->sess_shards[0];
+
+    return &ctx->sess_shards[s->session_id[3] % ctx->num_sess_shards];
+}
+
+/* Adds n to the number of sessions in the cache of ctx and returns the sum. */
+static int sess_cache_count(SSL_CTX *ctx, int n)
+{
+    int ret = 0;
+
+    if (!CRYPTO_atomic_add(&ctx->sess_cache_num, n, &ret, ctx->lock))
+        return 0;
+    return ret;
+}
+
 /*
  * Calculates effective timeout
  * Locking must be done by the caller of this function
@@ -467,6 +492,7 @@ SSL_SESSION *lookup_sess_in_cache(SSL_CONNECTION *s,
     if ((s->session_ctx->session_cache_mode
          & SSL_SESS_CACHE_NO_INTERNAL_LOOKUP) == 0) {
         SSL_SESSION data;
+        SSL_SESS_SHARD *sh;
 
         data.ssl_version = s->version;
         if (!ossl_assert(sess_id_len <= SSL_MAX_SSL_SESSION_ID_LENGTH))
@@ -475,14 +501,15 @@ SSL_SESSION *lookup_sess_in_cache(SSL_CONNECTION *s,
         memcpy(data.session_id, sess_id, sess_id_len);
         data.session_id_length = sess_id_len;
 
-        if (!CRYPTO_THREAD_read_lock(s->session_ctx->lock))
+        sh = sess_shard(s->session_ctx, &data);
+        if (!CRYPTO_THREAD_read_lock(sh->lock))
             return NULL;
-        ret = lh_SSL_SESSION_retrieve(s->session_ctx->sessions, &data);
+        ret = lh_SSL_SESSION_retrieve(sh->sessions, &data);
         if (ret != NULL) {
             /* don't allow other threads to steal it: */
             SSL_SESSION_up_ref(ret);
         }
-        CRYPTO_THREAD_unlock(s->session_ctx->lock);
+        CRYPTO_THREAD_unlock(sh->lock);
         if (ret == NULL)
             ssl_tsan_counter(s->session_ctx, &s->session_ctx->stats.sess_miss);
     }
@@ -678,10 +705,190 @@ int ssl_get_prev_session(SSL_CONNECTION *s, CLIENTHELLO_MSG *hello)
     return 0;
 }
 
+static unsigned long ssl_session_hash(const SSL_SESSION *a)
+{
+    const unsigned char *session_id = a->session_id;
+    unsigned long l;
+    unsigned char tmp_storage[4];
+
+    if (a->session_id_length < sizeof(tmp_storage)) {
+        memset(tmp_storage, 0, sizeof(tmp_storage));
+        memcpy(tmp_storage, a->session_id, a->session_id_length);
+        session_id = tmp_storage;
+    }
+
+    l = (unsigned long)
+        ((unsigned long)session_id[0]) |
+        ((unsigned long)session_id[1] << 8L) |
+        ((unsigned long)session_id[2] << 16L) |
+        ((unsigned long)session_id[3] << 24L);
+    return l;
+}
+
+/*
+ * NB: If this function (or indeed the hash function which uses a sort of
+ * coarser function than this one) is changed, ensure
+ * SSL_CTX_has_matching_session_id() is checked accordingly. It relies on
+ * being able to construct an SSL_SESSION that will collide with any existing
+ * session with a matching session ID.
+ */
+static int ssl_session_cmp(const SSL_SESSION *a, const SSL_SESSION *b)
+{
+    if (a->ssl_version != b->ssl_version)
+        return 1;
+    if (a->session_id_length != b->session_id_length)
+        return 1;
+    return memcmp(a->session_id, b->session_id, a->session_id_length);
+}
+
+static void sess_shards_free(SSL_SESS_SHARD *shards, size_t num)
+{
+    size_t i;
+
+    if (shards == NULL)
+        return;
+
+    for (i = 0; i < num; i++) {
+        lh_SSL_SESSION_free(shards[i].sessions);
+        CRYPTO_THREAD_lock_free(shards[i].lock);
+    }
+    OPENSSL_free(shards);
+}
+
+static SSL_SESS_SHARD *sess_shards_new(size_t num)
+{
+    SSL_SESS_SHARD *shards;
+    size_t i;
+
+    if ((shards = OPENSSL_zalloc(num * sizeof(*shards))) == NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_MALLOC_FAILURE);
+        return NULL;
+    }
+
+    for (i = 0; i < num; i++) {
+        shards[i].lock = CRYPTO_THREAD_lock_new();
+        shards[i].sessions = lh_SSL_SESSION_new(ssl_session_hash,
+                                                ssl_session_cmp);
+        if (shards[i].lock == NULL || shards[i].sessions == NULL) {
+            ERR_raise(ERR_LIB_SSL, ERR_R_MALLOC_FAILURE);
+            sess_shards_free(shards, num);
+            return NULL;
+        }
+    }
+    return shards;
+}
+
+int ssl_session_cache_init(SSL_CTX *ctx)
+{
+    if ((ctx->sess_shards = sess_shards_new(1)) == NULL)
+        return 0;
+
+    ctx->num_sess_shards = 1;
+    return 1;
+}
+
+/* The cache must have been flushed first. */
+void ssl_session_cache_free(SSL_CTX *ctx)
+{
+    sess_shards_free(ctx->sess_shards, ctx->num_sess_shards);
+    ctx->sess_shards = NULL;
+    ctx->num_sess_shards = 0;
+}
+
+/*
+ * Switches the cache of ctx between a single shard and
+ * SSL_SESS_CACHE_NUM_SHARDS shards, moving the sessions already cached. This
+ * must not be done while ctx is in use by other threads.
+ */
+int ssl_session_cache_set_sharded(SSL_CTX *ctx, int sharded)
+{
+    SSL_SESS_SHARD *shards, *old = ctx->sess_shards, *sh;
+    size_t i, num = sharded ? SSL_SESS_CACHE_NUM_SHARDS : 1;
+    size_t old_num = ctx->num_sess_shards;
+    SSL_SESSION *s;
+
+    if (num == old_num)
+        return 1;
+
+    if ((shards = sess_shards_new(num)) == NULL)
+        return 0;
+
+    ctx->sess_shards = shards;
+    ctx->num_sess_shards = num;
+
+    for (i = 0; i < old_num; i++) {
+        while ((s = old[i].session_cache_tail) != NULL) {
+            lh_SSL_SESSION_delete(old[i].sessions, s);
+            SSL_SESSION_list_remove(&old[i], s);
+
+            sh = sess_shard(ctx, s);
+            if (lh_SSL_SESSION_insert(sh->sessions, s) == NULL
+                && lh_SSL_SESSION_retrieve(sh->sessions, s) == NULL) {
+                /* Out of memory, so drop the session and the cache's ref. */
+                sess_cache_count(ctx, -1);
+                s->not_resumable = 1;
+                if (ctx->remove_session_cb != NULL)
+                    ctx->remove_session_cb(ctx, s);
+                SSL_SESSION_free(s);
+                continue;
+            }
+            SSL_SESSION_list_add(ctx, sh, s);
+        }
+    }
+
+    sess_shards_free(old, old_num);
+    return 1;
+}
+
+size_t ssl_session_cache_num(SSL_CTX *ctx)
+{
+    return (size_t)sess_cache_count(ctx, 0);
+}
+
+/*
+ * Trims the cache of ctx down below its size limit by dropping the sessions
+ * closest to expiry from shards other than sh, whose lock must not be held.
+ * This is only needed when sh itself had no session left to drop.
+ */
+static void sess_cache_trim_others(SSL_CTX *ctx, SSL_SESS_SHARD *sh)
+{
+    size_t i, first = (size_t)(sh - ctx->sess_shards);
+    SSL_SESS_SHARD *other;
+
+    for (i = 1; i < ctx->num_sess_shards; i++) {
+        other = &ctx->sess_shards[(first + i) % ctx->num_sess_shards];
+        if (!CRYPTO_THREAD_write_lock(other->lock))
+            return;
+        while ((size_t)sess_cache_count(ctx, 0) >= ctx->session_cache_size
+               && remove_session_lock(ctx, other->session_cache_tail, 0))
+            ssl_tsan_counter(ctx, &ctx->stats.sess_cache_full);
+        CRYPTO_THREAD_unlock(other->lock);
+
+        if ((size_t)sess_cache_count(ctx, 0) < ctx->session_cache_size)
+            return;
+    }
+}
+
+/* Returns 1 if a session with the ID and version of key is in the cache. */
+int ssl_session_cache_has(SSL_CTX *ctx, const SSL_SESSION *key)
+{
+    SSL_SESS_SHARD *sh = sess_shard(ctx, key);
+    SSL_SESSION *p;
+
+    if (!CRYPTO_THREAD_read_lock(sh->lock))
+        return 0;
+    p = lh_SSL_SESSION_retrieve(sh->sessions, key);
+    CRYPTO_THREAD_unlock(sh->lock);
+    return p != NULL;
+}
+
 int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 {
     int ret = 0;
     SSL_SESSION *s;
+    SSL_SESS_SHARD *sh = sess_shard(ctx, c);
+    size_t num;
+    int trim_others = 0;
 
     /*
      * add just 1 reference count for the SSL_CTX's session cache even though
@@ -693,21 +900,22 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
      * if session c is in already in cache, we take back the increment later
      */
 
-    if (!CRYPTO_THREAD_write_lock(ctx->lock)) {
+    if (!CRYPTO_THREAD_write_lock(sh->lock)) {
         SSL_SESSION_free(c);
         return 0;
     }
-    s = lh_SSL_SESSION_insert(ctx->sessions, c);
+    s = lh_SSL_SESSION_insert(sh->sessions, c);
 
     /*
      * s != NULL iff we already had a session with the given PID. In this
      * case, s == c should hold (then we did not really modify
-     * ctx->sessions), or we're in trouble.
+     * sh->sessions), or we're in trouble.
      */
     if (s != NULL && s != c) {
         /* We *are* in trouble ... */
-        SSL_SESSION_list_remove(ctx, s);
+        SSL_SESSION_list_remove(sh, s);
         SSL_SESSION_free(s);
+        sess_cache_count(ctx, -1);
         /*
          * ... so pretend the other session did not exist in cache (we cannot
          * handle two SSL_SESSION structures with identical session ID in the
@@ -716,7 +924,7 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
          */
         s = NULL;
     } else if (s == NULL &&
-               lh_SSL_SESSION_retrieve(ctx->sessions, c) == NULL) {
+               lh_SSL_SESSION_retrieve(sh->sessions, c) == NULL) {
         /* s == NULL can also mean OOM error in lh_SSL_SESSION_insert ... */
 
         /*
@@ -740,17 +948,24 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
 
         ret = 1;
 
-        if (SSL_CTX_sess_get_cache_size(ctx) > 0) {
-            while (SSL_CTX_sess_number(ctx) >= SSL_CTX_sess_get_cache_size(ctx)) {
-                if (!remove_session_lock(ctx, ctx->session_cache_tail, 0))
-                    break;
-                else
-                    ssl_tsan_counter(ctx, &ctx->stats.sess_cache_full);
+        /*
+         * The size limit applies to the cache as a whole. Room is made in
+         * this shard if it can be, and otherwise in the others once its lock
+         * has been released, as only one shard lock is held at a time.
+         */
+        num = (size_t)sess_cache_count(ctx, 1);
+        while (ctx->session_cache_size > 0
+               && num >= ctx->session_cache_size) {
+            if (!remove_session_lock(ctx, sh->session_cache_tail, 0)) {
+                trim_others = ctx->num_sess_shards > 1;
+                break;
             }
+            ssl_tsan_counter(ctx, &ctx->stats.sess_cache_full);
+            num = (size_t)sess_cache_count(ctx, 0);
         }
     }
 
-    SSL_SESSION_list_add(ctx, c);
+    SSL_SESSION_list_add(ctx, sh, c);
 
     if (s != NULL) {
         /*
@@ -761,34 +976,47 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *c)
         SSL_SESSION_free(s);    /* s == c */
         ret = 0;
     }
-    CRYPTO_THREAD_unlock(ctx->lock);
+    CRYPTO_THREAD_unlock(sh->lock);
+
+    if (trim_others)
+        sess_cache_trim_others(ctx, sh);
     return ret;
 }
 
 int SSL_CTX_remove_session(SSL_CTX *ctx, SSL_SESSION *c)
 {
+    /*
+     * Sessions evicted or timed out here may still be good in the shared
+     * cache, so only explicit removals are passed on.
+     */
+    if (ctx->sess_shm != NULL && c != NULL)
+        ssl_sess_shm_remove(ctx->sess_shm, c);
     return remove_session_lock(ctx, c, 1);
 }
 
+/* If lck is zero, the lock of the shard holding c must be held. */
 static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION *c, int lck)
 {
     SSL_SESSION *r;
+    SSL_SESS_SHARD *sh;
     int ret = 0;
 
     if ((c != NULL) && (c->session_id_length != 0)) {
+        sh = sess_shard(ctx, c);
         if (lck) {
-            if (!CRYPTO_THREAD_write_lock(ctx->lock))
+            if (!CRYPTO_THREAD_write_lock(sh->lock))
                 return 0;
         }
-        if ((r = lh_SSL_SESSION_retrieve(ctx->sessions, c)) != NULL) {
+        if ((r = lh_SSL_SESSION_retrieve(sh->sessions, c)) != NULL) {
             ret = 1;
-            r = lh_SSL_SESSION_delete(ctx->sessions, r);
-            SSL_SESSION_list_remove(ctx, r);
+            r = lh_SSL_SESSION_delete(sh->sessions, r);
+            SSL_SESSION_list_remove(sh, r);
+            sess_cache_count(ctx, -1);
         }
         c->not_resumable = 1;
 
         if (lck)
-            CRYPTO_THREAD_unlock(ctx->lock);
+            CRYPTO_THREAD_unlock(sh->lock);
 
         if (ctx->remove_session_cb != NULL)
             ctx->remove_session_cb(ctx, c);
@@ -887,12 +1115,14 @@ long SSL_SESSION_set_timeout(SSL_SESSION *s, long t)
     if (s == NULL || t < 0)
         return 0;
     if (s->owner != NULL) {
-        if (!CRYPTO_THREAD_write_lock(s->owner->lock))
+        SSL_SESS_SHARD *sh = sess_shard(s->owner, s);
+
+        if (!CRYPTO_THREAD_write_lock(sh->lock))
             return 0;
         s->timeout = new_timeout;
         ssl_session_calculate_timeout(s);
-        SSL_SESSION_list_add(s->owner, s);
-        CRYPTO_THREAD_unlock(s->owner->lock);
+        SSL_SESSION_list_add(s->owner, sh, s);
+        CRYPTO_THREAD_unlock(sh->lock);
     } else {
         s->timeout = new_timeout;
         ssl_session_calculate_timeout(s);
@@ -921,12 +1151,14 @@ long SSL_SESSION_set_time(SSL_SESSION *s, long t)
     if (s == NULL)
         return 0;
     if (s->owner != NULL) {
-        if (!CRYPTO_THREAD_write_lock(s->owner->lock))
+        SSL_SESS_SHARD *sh = sess_shard(s->owner, s);
+
+        if (!CRYPTO_THREAD_write_lock(sh->lock))
             return 0;
         s->time = new_time;
         ssl_session_calculate_timeout(s);
-        SSL_SESSION_list_add(s->owner, s);
-        CRYPTO_THREAD_unlock(s->owner->lock);
+        SSL_SESSION_list_add(s->owner, sh, s);
+        CRYPTO_THREAD_unlock(sh->lock);
     } else {
         s->time = new_time;
         ssl_session_calculate_timeout(s);
@@ -1140,47 +1372,54 @@ void SSL_CTX_flush_sessions(SSL_CTX *s, long t)
 {
     STACK_OF(SSL_SESSION) *sk;
     SSL_SESSION *current;
+    SSL_SESS_SHARD *sh;
     unsigned long i;
+    size_t n;
     const OSSL_TIME timeout = ossl_time_from_time_t(t);
 
-    if (!CRYPTO_THREAD_write_lock(s->lock))
-        return;
-
     sk = sk_SSL_SESSION_new_null();
-    i = lh_SSL_SESSION_get_down_load(s->sessions);
-    lh_SSL_SESSION_set_down_load(s->sessions, 0);
 
-    /*
-     * Iterate over the list from the back (oldest), and stop
-     * when a session can no longer be removed.
-     * Add the session to a temporary list to be freed outside
-     * the SSL_CTX lock.
-     * But still do the remove_session_cb() within the lock.
-     */
-    while (s->session_cache_tail != NULL) {
-        current = s->session_cache_tail;
-        if (t == 0 || sess_timedout(timeout, current)) {
-            lh_SSL_SESSION_delete(s->sessions, current);
-            SSL_SESSION_list_remove(s, current);
-            current->not_resumable = 1;
-            if (s->remove_session_cb != NULL)
-                s->remove_session_cb(s, current);
-            /*
-             * Throw the session on a stack, it's entirely plausible
-             * that while freeing outside the critical section, the
-             * session could be re-added, so avoid using the next/prev
-             * pointers. If the stack failed to create, or the session
-             * couldn't be put on the stack, just free it here
-             */
-            if (sk == NULL || !sk_SSL_SESSION_push(sk, current))
-                SSL_SESSION_free(current);
-        } else {
+    for (n = 0; n < s->num_sess_shards; n++) {
+        sh = &s->sess_shards[n];
+        if (!CRYPTO_THREAD_write_lock(sh->lock))
             break;
+
+        i = lh_SSL_SESSION_get_down_load(sh->sessions);
+        lh_SSL_SESSION_set_down_load(sh->sessions, 0);
+
+        /*
+         * Iterate over the list from the back (oldest), and stop
+         * when a session can no longer be removed.
+         * Add the session to a temporary list to be freed outside
+         * the lock.
+         * But still do the remove_session_cb() within the lock.
+         */
+        while (sh->session_cache_tail != NULL) {
+            current = sh->session_cache_tail;
+            if (t == 0 || sess_timedout(timeout, current)) {
+                if (lh_SSL_SESSION_delete(sh->sessions, current) != NULL)
+                    sess_cache_count(s, -1);
+                SSL_SESSION_list_remove(sh, current);
+                current->not_resumable = 1;
+                if (s->remove_session_cb != NULL)
+                    s->remove_session_cb(s, current);
+                /*
+                 * Throw the session on a stack, it's entirely plausible
+                 * that while freeing outside the critical section, the
+                 * session could be re-added, so avoid using the next/prev
+                 * pointers. If the stack failed to create, or the session
+                 * couldn't be put on the stack, just free it here
+                 */
+                if (sk == NULL || !sk_SSL_SESSION_push(sk, current))
+                    SSL_SESSION_free(current);
+            } else {
+                break;
+            }
         }
-    }
 
-    lh_SSL_SESSION_set_down_load(s->sessions, i);
-    CRYPTO_THREAD_unlock(s->lock);
+        lh_SSL_SESSION_set_down_load(sh->sessions, i);
+        CRYPTO_THREAD_unlock(sh->lock);
+    }
 
     sk_SSL_SESSION_pop_free(sk, SSL_SESSION_free);
 }
@@ -1197,27 +1436,27 @@ int ssl_clear_bad_session(SSL_CONNECTION *s)
         return 0;
 }
 
-/* locked by SSL_CTX in the calling function */
-static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s)
+/* locked by the shard in the calling function */
+static void SSL_SESSION_list_remove(SSL_SESS_SHARD *sh, SSL_SESSION *s)
 {
     if ((s->next == NULL) || (s->prev == NULL))
         return;
 
-    if (s->next == (SSL_SESSION *)&(ctx->session_cache_tail)) {
+    if (s->next == (SSL_SESSION *)&(sh->session_cache_tail)) {
         /* last element in list */
-        if (s->prev == (SSL_SESSION *)&(ctx->session_cache_head)) {
+        if (s->prev == (SSL_SESSION *)&(sh->session_cache_head)) {
             /* only one element in list */
-            ctx->session_cache_head = NULL;
-            ctx->session_cache_tail = NULL;
+            sh->session_cache_head = NULL;
+            sh->session_cache_tail = NULL;
         } else {
-            ctx->session_cache_tail = s->prev;
-            s->prev->next = (SSL_SESSION *)&(ctx->session_cache_tail);
+            sh->session_cache_tail = s->prev;
+            s->prev->next = (SSL_SESSION *)&(sh->session_cache_tail);
         }
     } else {
-        if (s->prev == (SSL_SESSION *)&(ctx->session_cache_head)) {
+        if (s->prev == (SSL_SESSION *)&(sh->session_cache_head)) {
             /* first element in list */
-            ctx->session_cache_head = s->next;
-            s->next->prev = (SSL_SESSION *)&(ctx->session_cache_head);
+            sh->session_cache_head = s->next;
+            s->next->prev = (SSL_SESSION *)&(sh->session_cache_head);
         } else {
             /* middle of list */
             s->next->prev = s->prev;
@@ -1228,41 +1467,42 @@ static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *s)
     s->owner = NULL;
 }
 
-static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESSION *s)
+static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESS_SHARD *sh,
+                                 SSL_SESSION *s)
 {
     SSL_SESSION *next;
 
     if ((s->next != NULL) && (s->prev != NULL))
-        SSL_SESSION_list_remove(ctx, s);
+        SSL_SESSION_list_remove(sh, s);
 
-    if (ctx->session_cache_head == NULL) {
-        ctx->session_cache_head = s;
-        ctx->session_cache_tail = s;
-        s->prev = (SSL_SESSION *)&(ctx->session_cache_head);
-        s->next = (SSL_SESSION *)&(ctx->session_cache_tail);
+    if (sh->session_cache_head == NULL) {
+        sh->session_cache_head = s;
+        sh->session_cache_tail = s;
+        s->prev = (SSL_SESSION *)&(sh->session_cache_head);
+        s->next = (SSL_SESSION *)&(sh->session_cache_tail);
     } else {
-        if (timeoutcmp(s, ctx->session_cache_head) >= 0) {
+        if (timeoutcmp(s, sh->session_cache_head) >= 0) {
             /*
              * if we timeout after (or the same time as) the first
              * session, put us first - usual case
              */
-            s->next = ctx->session_cache_head;
+            s->next = sh->session_cache_head;
             s->next->prev = s;
-            s->prev = (SSL_SESSION *)&(ctx->session_cache_head);
-            ctx->session_cache_head = s;
-        } else if (timeoutcmp(s, ctx->session_cache_tail) < 0) {
+            s->prev = (SSL_SESSION *)&(sh->session_cache_head);
+            sh->session_cache_head = s;
+        } else if (timeoutcmp(s, sh->session_cache_tail) < 0) {
             /* if we timeout before the last session, put us last */
-            s->prev = ctx->session_cache_tail;
+            s->prev = sh->session_cache_tail;
             s->prev->next = s;
-            s->next = (SSL_SESSION *)&(ctx->session_cache_tail);
-            ctx->session_cache_tail = s;
+            s->next = (SSL_SESSION *)&(sh->session_cache_tail);
+            sh->session_cache_tail = s;
         } else {
             /*
              * we timeout somewhere in-between - if there is only
              * one session in the cache it will be caught above
              */
-            next = ctx->session_cache_head->next;
-            while (next != (SSL_SESSION*)&(ctx->session_cache_tail)) {
+            next = sh->session_cache_head->next;
+            while (next != (SSL_SESSION*)&(sh->session_cache_tail)) {
                 if (timeoutcmp(s, next) >= 0) {
                     s->next = next;
                     s->prev = next->prev;
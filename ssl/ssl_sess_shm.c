@@ -0,0 +1,657 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/*
+ * A session cache shared between processes, kept in a memory mapping and
+ * plugged in behind the new and get session callbacks of an SSL_CTX.
+ *
+ * The mapping holds a small header followed by a set associative table of
+ * fixed size slots: a session id hashes to a bucket of SESS_SHM_WAYS slots,
+ * each holding one DER encoded session. Every slot is guarded by a sequence
+ * counter, which is odd while the slot is being written. Readers never block:
+ * they copy the slot and retry if the counter changed underneath them. Writers
+ * claim a slot by making its counter odd with a compare-and-swap and give up
+ * if another writer holds it, as dropping an update is harmless for a cache.
+ * The time a writer claimed the slot is kept in the same word as the counter,
+ * so that a slot left claimed by a process which died mid-write can be taken
+ * over once it has been held for longer than any write takes, rather than
+ * staying unusable. This needs nothing from the processes sharing the cache
+ * but a common clock.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <openssl/err.h>
+#include "ssl_local.h"
+
+#if defined(__apple_build_version__) && __apple_build_version__ < 6000000
+/* See crypto/threads_pthread.c */
+# define BROKEN_CLANG_ATOMICS
+#endif
+
+#if defined(OPENSSL_SYS_UNIX) && defined(__GNUC__) \
+    && defined(__ATOMIC_ACQ_REL) && !defined(BROKEN_CLANG_ATOMICS)
+# define SESS_SHM_IMPLEMENTED
+#endif
+
+#ifdef SESS_SHM_IMPLEMENTED
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# if !defined(MAP_ANON) && defined(MAP_ANONYMOUS)
+#  define MAP_ANON MAP_ANONYMOUS
+# endif
+# ifndef O_NOFOLLOW
+#  define O_NOFOLLOW 0
+# endif
+
+# define SESS_SHM_MAGIC             0x4f53534c53484d31ULL /* "OSSLSHM1" */
+# define SESS_SHM_HDR_LEN           64
+# define SESS_SHM_WAYS              4
+# define SESS_SHM_READ_TRIES        4
+# define SESS_SHM_MIN_LEN           128
+# define SESS_SHM_MAX_LEN           65536
+# define SESS_SHM_DEFAULT_LEN       1024
+/* Seconds after which a slot claimed for writing is presumed abandoned. */
+# define SESS_SHM_LEASE             10
+
+/* Kept at the start of the mapping. */
+typedef struct {
+    uint64_t magic;
+    uint64_t num_buckets;
+    uint64_t slot_len;
+} SESS_SHM_HDR;
+
+/*
+ * Followed by up to max_len bytes of DER. The low 32 bits of seq are the
+ * sequence counter and the high 32 bits the low 32 bits of the time(), in
+ * seconds, at which the last writer claimed the slot.
+ */
+typedef struct {
+    uint64_t seq;
+    int64_t expires;                /* 0 if the slot is unused */
+    uint32_t id_len;
+    uint32_t der_len;
+    unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+} SESS_SHM_SLOT;
+
+struct ssl_sess_shm_st {
+    unsigned char *base;
+    size_t map_len;
+    size_t num_buckets, slot_len, max_len;
+    CRYPTO_REF_COUNT references;
+    CRYPTO_RWLOCK *lock;
+};
+
+static size_t slot_len_for(size_t max_len)
+{
+    return (sizeof(SESS_SHM_SLOT) + max_len + 63) & ~(size_t)63;
+}
+
+static SESS_SHM_SLOT *shm_slot(const SSL_SESS_SHM *shm, size_t bucket,
+                               size_t way)
+{
+    return (SESS_SHM_SLOT *)(shm->base + SESS_SHM_HDR_LEN
+                             + (bucket * SESS_SHM_WAYS + way) * shm->slot_len);
+}
+
+static unsigned char *slot_der(SESS_SHM_SLOT *slot)
+{
+    return (unsigned char *)(slot + 1);
+}
+
+/* FNV-1a, as session ids need not be random if generated by the application */
+static size_t shm_bucket(const SSL_SESS_SHM *shm, const unsigned char *id,
+                         size_t id_len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < id_len; i++) {
+        h ^= id[i];
+        h *= 0x100000001b3ULL;
+    }
+    return (size_t)(h % shm->num_buckets);
+}
+
+static int slot_has_id(const SESS_SHM_SLOT *slot, const unsigned char *id,
+                       size_t id_len)
+{
+    return slot->id_len == id_len && memcmp(slot->id, id, id_len) == 0;
+}
+
+/*
+ * Whether a slot claimed for writing has been held for so long that its writer
+ * must have died. The difference is signed so that a clock stepped backwards
+ * delays a takeover rather than causing one.
+ */
+static int slot_lease_expired(uint64_t seq, int64_t now)
+{
+    return (int32_t)((uint32_t)now - (uint32_t)(seq >> 32)) > SESS_SHM_LEASE;
+}
+
+/*
+ * Claims the slot for writing and returns its new sequence word, whose counter
+ * is odd, or 0 if another writer holds it. A slot whose lease has expired is
+ * taken over, moving its counter on by two so it stays odd but changes.
+ */
+static uint64_t slot_begin_write(SESS_SHM_SLOT *slot, int64_t now)
+{
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED), new_seq;
+    uint32_t ctr = (uint32_t)seq;
+
+    if ((ctr & 1) != 0 && !slot_lease_expired(seq, now))
+        return 0;
+
+    ctr += (ctr & 1) != 0 ? 2 : 1;
+    new_seq = ((uint64_t)(uint32_t)now << 32) | ctr;
+    if (!__atomic_compare_exchange_n(&slot->seq, &seq, new_seq, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return 0;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return new_seq;
+}
+
+/*
+ * Releases the slot, unless it was taken over from us in the meantime because
+ * we held it past the lease and were thought to have died.
+ */
+static void slot_end_write(SESS_SHM_SLOT *slot, uint64_t seq)
+{
+    __atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, 0,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/*
+ * Copies the DER of the unexpired session with the given id into der, which
+ * must have room for max_len bytes.
+ */
+static int shm_lookup(SSL_SESS_SHM *shm, const unsigned char *id,
+                      size_t id_len, unsigned char *der, size_t *der_len)
+{
+    size_t bucket = shm_bucket(shm, id, id_len), way, len;
+    int64_t now = (int64_t)time(NULL);
+    SESS_SHM_SLOT *slot;
+    uint64_t seq;
+    int tries, match;
+
+    for (way = 0; way < SESS_SHM_WAYS; way++) {
+        slot = shm_slot(shm, bucket, way);
+
+        for (tries = 0; tries < SESS_SHM_READ_TRIES; tries++) {
+            seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+            if ((seq & 1) != 0) {
+                /* A slot abandoned mid-write holds nothing we can use. */
+                if (slot_lease_expired(seq, now))
+                    break;
+                continue;
+            }
+
+            len = slot->der_len;
+            match = slot_has_id(slot, id, id_len) && slot->expires > now
+                    && len <= shm->max_len;
+            if (match)
+                memcpy(der, slot_der(slot), len);
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+                continue;
+
+            if (!match)
+                break;
+
+            *der_len = len;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void shm_store(SSL_SESS_SHM *shm, const unsigned char *id,
+                      size_t id_len, int64_t expires,
+                      const unsigned char *der, size_t der_len)
+{
+    size_t bucket = shm_bucket(shm, id, id_len), way;
+    SESS_SHM_SLOT *slot, *victim = NULL;
+    uint64_t seq;
+
+    /*
+     * Replace the same session if it is there, otherwise the slot expiring
+     * first. Unused slots have expired at time 0. These reads race with other
+     * writers, but only decide which slot to claim.
+     */
+    for (way = 0; way < SESS_SHM_WAYS; way++) {
+        slot = shm_slot(shm, bucket, way);
+        if (slot_has_id(slot, id, id_len)) {
+            victim = slot;
+            break;
+        }
+        if (victim == NULL || slot->expires < victim->expires)
+            victim = slot;
+    }
+
+    if ((seq = slot_begin_write(victim, (int64_t)time(NULL))) == 0)
+        return;
+
+    victim->expires = expires;
+    victim->id_len = (uint32_t)id_len;
+    memcpy(victim->id, id, id_len);
+    victim->der_len = (uint32_t)der_len;
+    memcpy(slot_der(victim), der, der_len);
+    slot_end_write(victim, seq);
+}
+
+void ssl_sess_shm_remove(SSL_SESS_SHM *shm, const SSL_SESSION *sess)
+{
+    size_t id_len = sess->session_id_length;
+    size_t bucket, way;
+    int64_t now = (int64_t)time(NULL);
+    SESS_SHM_SLOT *slot;
+    uint64_t seq;
+
+    if (id_len == 0)
+        return;
+
+    bucket = shm_bucket(shm, sess->session_id, id_len);
+    for (way = 0; way < SESS_SHM_WAYS; way++) {
+        slot = shm_slot(shm, bucket, way);
+        if (!slot_has_id(slot, sess->session_id, id_len)
+            || (seq = slot_begin_write(slot, now)) == 0)
+            continue;
+
+        /* Check again now that no one else can change the slot. */
+        if (slot_has_id(slot, sess->session_id, id_len)) {
+            slot->expires = 0;
+            slot->id_len = 0;
+        }
+        slot_end_write(slot, seq);
+    }
+}
+
+static void shm_new_session(SSL_CONNECTION *sc, SSL_SESS_SHM *shm,
+                            SSL_SESSION *sess)
+{
+    unsigned char *der, *p;
+    int der_len;
+
+    if (!sc->server || sess->session_id_length == 0)
+        return;
+
+    /* Stateless TLSv1.3 tickets are never looked up by id. */
+    if (sess->ssl_version == TLS1_3_VERSION
+        && (sc->options & SSL_OP_NO_TICKET) == 0)
+        return;
+
+    der_len = i2d_SSL_SESSION(sess, NULL);
+    if (der_len <= 0 || (size_t)der_len > shm->max_len)
+        return;
+
+    if ((der = OPENSSL_malloc(der_len)) == NULL)
+        return;
+
+    p = der;
+    if (i2d_SSL_SESSION(sess, &p) == der_len)
+        shm_store(shm, sess->session_id, sess->session_id_length,
+                  (int64_t)ossl_time2seconds(sess->calc_timeout),
+                  der, der_len);
+
+    OPENSSL_free(der);
+}
+
+static SSL_SESSION *shm_get_session(SSL_SESS_SHM *shm,
+                                    const unsigned char *id, int id_len)
+{
+    SSL_SESSION *ret = NULL;
+    unsigned char *der;
+    const unsigned char *p;
+    size_t der_len;
+
+    if (id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH
+        || (der = OPENSSL_malloc(shm->max_len)) == NULL)
+        return NULL;
+
+    if (shm_lookup(shm, id, id_len, der, &der_len)) {
+        p = der;
+        ret = d2i_SSL_SESSION(NULL, &p, (long)der_len);
+        if (ret != NULL
+            && (ret->session_id_length != (size_t)id_len
+                || memcmp(ret->session_id, id, id_len) != 0)) {
+            SSL_SESSION_free(ret);
+            ret = NULL;
+        }
+    }
+
+    OPENSSL_clear_free(der, shm->max_len);
+    return ret;
+}
+
+static int sess_shm_new_cb(SSL *s, SSL_SESSION *sess)
+{
+    SSL_CONNECTION *sc = SSL_CONNECTION_FROM_SSL(s);
+    SSL_CTX *ctx;
+
+    if (sc == NULL)
+        return 0;
+
+    ctx = sc->session_ctx;
+    if (ctx->sess_shm != NULL)
+        shm_new_session(sc, ctx->sess_shm, sess);
+
+    /* The cache keeps its own copy, so only the user's callback keeps sess. */
+    return ctx->sess_shm_user_new_cb != NULL
+           ? ctx->sess_shm_user_new_cb(s, sess) : 0;
+}
+
+static SSL_SESSION *sess_shm_get_cb(SSL *s, const unsigned char *id,
+                                    int id_len, int *copy)
+{
+    SSL_CONNECTION *sc = SSL_CONNECTION_FROM_SSL(s);
+    SSL_SESSION *ret;
+    SSL_CTX *ctx;
+
+    if (sc == NULL)
+        return NULL;
+
+    ctx = sc->session_ctx;
+    if (ctx->sess_shm != NULL
+        && (ret = shm_get_session(ctx->sess_shm, id, id_len)) != NULL) {
+        /* A fresh copy, whose reference we hand over. */
+        *copy = 0;
+        return ret;
+    }
+
+    return ctx->sess_shm_user_get_cb != NULL
+           ? ctx->sess_shm_user_get_cb(s, id, id_len, copy) : NULL;
+}
+
+/*
+ * Creates the cache file under a temporary name, initialises it and only then
+ * links it to path, so that no process can open it half initialised. link()
+ * rather than rename() so that a file another process created meanwhile is not
+ * replaced. Returns 1 on success, -1 if path already exists or 0 on error.
+ */
+static int shm_create_file(SSL_SESS_SHM *shm, const char *path, size_t map_len)
+{
+    size_t tmp_len = strlen(path) + sizeof(".XXXXXX");
+    SESS_SHM_HDR *hdr;
+    void *base = MAP_FAILED;
+    char *tmp;
+    int fd, ret = 0;
+
+    if ((tmp = OPENSSL_malloc(tmp_len)) == NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    BIO_snprintf(tmp, tmp_len, "%s.XXXXXX", path);
+
+    /* mkstemp() creates the file exclusively, with mode 0600. */
+    if ((fd = mkstemp(tmp)) < 0) {
+        ERR_raise_data(ERR_LIB_SYS, errno, "calling mkstemp(%s)", tmp);
+        OPENSSL_free(tmp);
+        return 0;
+    }
+
+    if (ftruncate(fd, (off_t)map_len) != 0) {
+        ERR_raise_data(ERR_LIB_SYS, errno, "calling ftruncate(%s)", tmp);
+        goto err;
+    }
+    base = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ERR_raise_data(ERR_LIB_SYS, errno, "calling mmap(%s)", tmp);
+        goto err;
+    }
+
+    hdr = (SESS_SHM_HDR *)base;
+    hdr->magic = SESS_SHM_MAGIC;
+    hdr->num_buckets = shm->num_buckets;
+    hdr->slot_len = shm->slot_len;
+
+    if (link(tmp, path) != 0) {
+        if (errno == EEXIST)
+            ret = -1;
+        else
+            ERR_raise_data(ERR_LIB_SYS, errno, "calling link(%s)", path);
+        goto err;
+    }
+
+    shm->base = base;
+    shm->map_len = map_len;
+    base = MAP_FAILED;
+    ret = 1;
+
+ err:
+    if (base != MAP_FAILED)
+        munmap(base, map_len);
+    unlink(tmp);
+    close(fd);
+    OPENSSL_free(tmp);
+    return ret;
+}
+
+static int shm_map_file(SSL_SESS_SHM *shm, const char *path, size_t map_len)
+{
+    SESS_SHM_HDR *hdr;
+    struct stat st;
+    void *base;
+    int fd, ret;
+
+    /*
+     * Sessions read from the file are trusted, so we refuse to follow a
+     * symlink and only use a regular file we own which no one else can write
+     * to. If there is no file yet we create one, unless another process beats
+     * us to it, in which case we use theirs.
+     */
+    fd = open(path, O_RDWR | O_NOFOLLOW);
+    if (fd < 0 && errno == ENOENT) {
+        if ((ret = shm_create_file(shm, path, map_len)) >= 0)
+            return ret;
+        fd = open(path, O_RDWR | O_NOFOLLOW);
+    }
+    if (fd < 0) {
+        ERR_raise_data(ERR_LIB_SYS, errno, "calling open(%s)", path);
+        return 0;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        ERR_raise_data(ERR_LIB_SYS, errno, "calling fstat(%s)", path);
+        goto err;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_uid != geteuid()
+        || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        ERR_raise_data(ERR_LIB_SSL, ERR_R_PASSED_INVALID_ARGUMENT,
+                       "%s must be a regular file owned by the current user"
+                       " and writable only by them", path);
+        goto err;
+    }
+
+    /* An existing cache keeps the geometry it was created with. */
+    if ((uint64_t)st.st_size < SESS_SHM_HDR_LEN) {
+        ERR_raise_data(ERR_LIB_SSL, ERR_R_PASSED_INVALID_ARGUMENT,
+                       "%s is not a session cache", path);
+        goto err;
+    }
+    map_len = (size_t)st.st_size;
+
+    base = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ERR_raise_data(ERR_LIB_SYS, errno, "calling mmap(%s)", path);
+        goto err;
+    }
+    close(fd);
+
+    shm->base = base;
+    shm->map_len = map_len;
+    hdr = (SESS_SHM_HDR *)shm->base;
+    if (hdr->magic != SESS_SHM_MAGIC
+        || hdr->num_buckets == 0
+        || hdr->slot_len < slot_len_for(SESS_SHM_MIN_LEN)
+        || hdr->slot_len > slot_len_for(SESS_SHM_MAX_LEN)
+        || hdr->num_buckets > (map_len - SESS_SHM_HDR_LEN)
+                              / (SESS_SHM_WAYS * hdr->slot_len)) {
+        ERR_raise_data(ERR_LIB_SSL, ERR_R_PASSED_INVALID_ARGUMENT,
+                       "%s is not a session cache", path);
+        return 0;
+    }
+    shm->num_buckets = (size_t)hdr->num_buckets;
+    shm->slot_len = (size_t)hdr->slot_len;
+    shm->max_len = shm->slot_len - sizeof(SESS_SHM_SLOT);
+    return 1;
+
+ err:
+    close(fd);
+    return 0;
+}
+
+SSL_SESS_SHM *SSL_SESS_SHM_new(const char *path, size_t num, size_t max_len)
+{
+    SSL_SESS_SHM *shm;
+    size_t map_len;
+    void *base;
+
+    if (max_len == 0)
+        max_len = SESS_SHM_DEFAULT_LEN;
+    if (num == 0 || max_len < SESS_SHM_MIN_LEN || max_len > SESS_SHM_MAX_LEN) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_PASSED_INVALID_ARGUMENT);
+        return NULL;
+    }
+
+    if ((shm = OPENSSL_zalloc(sizeof(*shm))) == NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_MALLOC_FAILURE);
+        return NULL;
+    }
+
+    shm->references = 1;
+    shm->lock = CRYPTO_THREAD_lock_new();
+    if (shm->lock == NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_MALLOC_FAILURE);
+        goto err;
+    }
+
+    shm->num_buckets = (num + SESS_SHM_WAYS - 1) / SESS_SHM_WAYS;
+    shm->slot_len = slot_len_for(max_len);
+    shm->max_len = shm->slot_len - sizeof(SESS_SHM_SLOT);
+    if (shm->num_buckets > (SIZE_MAX / 2 - SESS_SHM_HDR_LEN)
+                           / (SESS_SHM_WAYS * shm->slot_len)) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_PASSED_INVALID_ARGUMENT);
+        goto err;
+    }
+    map_len = SESS_SHM_HDR_LEN
+              + shm->num_buckets * SESS_SHM_WAYS * shm->slot_len;
+
+    if (path != NULL) {
+        if (!shm_map_file(shm, path, map_len))
+            goto err;
+    } else {
+        /* Shared with the children forked after this point. */
+        base = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANON, -1, 0);
+        if (base == MAP_FAILED) {
+            ERR_raise_data(ERR_LIB_SYS, errno, "calling mmap()");
+            goto err;
+        }
+        shm->base = base;
+        shm->map_len = map_len;
+    }
+    return shm;
+
+ err:
+    SSL_SESS_SHM_free(shm);
+    return NULL;
+}
+
+int SSL_SESS_SHM_up_ref(SSL_SESS_SHM *shm)
+{
+    int i;
+
+    if (CRYPTO_UP_REF(&shm->references, &i, shm->lock) <= 0)
+        return 0;
+
+    REF_PRINT_COUNT("SSL_SESS_SHM", shm);
+    REF_ASSERT_ISNT(i < 2);
+    return i > 1 ? 1 : 0;
+}
+
+void SSL_SESS_SHM_free(SSL_SESS_SHM *shm)
+{
+    int i;
+
+    if (shm == NULL)
+        return;
+
+    CRYPTO_DOWN_REF(&shm->references, &i, shm->lock);
+    REF_PRINT_COUNT("SSL_SESS_SHM", shm);
+    if (i > 0)
+        return;
+    REF_ASSERT_ISNT(i < 0);
+
+    if (shm->base != NULL)
+        munmap(shm->base, shm->map_len);
+    CRYPTO_THREAD_lock_free(shm->lock);
+    OPENSSL_free(shm);
+}
+
+int SSL_CTX_set1_session_shm(SSL_CTX *ctx, SSL_SESS_SHM *shm)
+{
+    if (shm != NULL && !SSL_SESS_SHM_up_ref(shm))
+        return 0;
+
+    if (ctx->sess_shm == NULL && shm != NULL) {
+        ctx->sess_shm_user_new_cb = ctx->new_session_cb;
+        ctx->sess_shm_user_get_cb = ctx->get_session_cb;
+        ctx->new_session_cb = sess_shm_new_cb;
+        ctx->get_session_cb = sess_shm_get_cb;
+    } else if (ctx->sess_shm != NULL && shm == NULL) {
+        /* Give the user's callbacks back, unless they were replaced since. */
+        if (ctx->new_session_cb == sess_shm_new_cb)
+            ctx->new_session_cb = ctx->sess_shm_user_new_cb;
+        if (ctx->get_session_cb == sess_shm_get_cb)
+            ctx->get_session_cb = ctx->sess_shm_user_get_cb;
+        ctx->sess_shm_user_new_cb = NULL;
+        ctx->sess_shm_user_get_cb = NULL;
+    }
+
+    SSL_SESS_SHM_free(ctx->sess_shm);
+    ctx->sess_shm = shm;
+    return 1;
+}
+
+#else
+
+SSL_SESS_SHM *SSL_SESS_SHM_new(const char *path, size_t num, size_t max_len)
+{
+    ERR_raise(ERR_LIB_SSL, ERR_R_UNSUPPORTED);
+    return NULL;
+}
+
+int SSL_SESS_SHM_up_ref(SSL_SESS_SHM *shm)
+{
+    return 0;
+}
+
+void SSL_SESS_SHM_free(SSL_SESS_SHM *shm)
+{
+}
+
+int SSL_CTX_set1_session_shm(SSL_CTX *ctx, SSL_SESS_SHM *shm)
+{
+    if (shm != NULL) {
+        ERR_raise(ERR_LIB_SSL, ERR_R_UNSUPPORTED);
+        return 0;
+    }
+    return 1;
+}
+
+void ssl_sess_shm_remove(SSL_SESS_SHM *shm, const SSL_SESSION *sess)
+{
+}
+
+#endif
@@ -1909,11 +1909,6 @@ SSL_TICKET_STATUS tls_decrypt_ticket(SSL_CONNECTION *s,
     }
 
     /* Initialize session ticket encryption and HMAC contexts */
-    hctx = ssl_hmac_new(tctx);
-    if (hctx == NULL) {
-        ret = SSL_TICKET_FATAL_ERR_MALLOC;
-        goto end;
-    }
     ctx = EVP_CIPHER_CTX_new();
     if (ctx == NULL) {
         ret = SSL_TICKET_FATAL_ERR_MALLOC;
@@ -1928,6 +1923,12 @@ SSL_TICKET_STATUS tls_decrypt_ticket(SSL_CONNECTION *s,
         unsigned char *nctick = (unsigned char *)etick;
         int rv = 0;
 
+        hctx = ssl_hmac_new(tctx);
+        if (hctx == NULL) {
+            ret = SSL_TICKET_FATAL_ERR_MALLOC;
+            goto end;
+        }
+
         if (tctx->ext.ticket_key_evp_cb != NULL)
             rv = tctx->ext.ticket_key_evp_cb(SSL_CONNECTION_GET_SSL(s), nctick,
                                              nctick + TLSEXT_KEYNAME_LENGTH,
@@ -1952,30 +1953,19 @@ SSL_TICKET_STATUS tls_decrypt_ticket(SSL_CONNECTION *s,
         if (rv == 2)
             renew_ticket = 1;
     } else {
-        EVP_CIPHER *aes256cbc = NULL;
-        SSL_CTX *sctx = SSL_CONNECTION_GET_CTX(s);
+        /* Find the key by name; tickets from older keys are renewed */
+        int rv = ssl_tick_keys_decrypt_init(tctx, etick,
+                                            etick + TLSEXT_KEYNAME_LENGTH,
+                                            ctx, &hctx, &renew_ticket);
 
-        /* Check key name matches */
-        if (memcmp(etick, tctx->ext.tick_key_name,
-                   TLSEXT_KEYNAME_LENGTH) != 0) {
-            ret = SSL_TICKET_NO_DECRYPT;
+        if (rv < 0) {
+            ret = SSL_TICKET_FATAL_ERR_OTHER;
             goto end;
         }
-
-        aes256cbc = EVP_CIPHER_fetch(sctx->libctx, "AES-256-CBC",
-                                     sctx->propq);
-        if (aes256cbc == NULL
-            || ssl_hmac_init(hctx, tctx->ext.secure->tick_hmac_key,
-                             sizeof(tctx->ext.secure->tick_hmac_key),
-                             "SHA256") <= 0
-            || EVP_DecryptInit_ex(ctx, aes256cbc, NULL,
-                                  tctx->ext.secure->tick_aes_key,
-                                  etick + TLSEXT_KEYNAME_LENGTH) <= 0) {
-            EVP_CIPHER_free(aes256cbc);
-            ret = SSL_TICKET_FATAL_ERR_OTHER;
+        if (rv == 0) {
+            ret = SSL_TICKET_NO_DECRYPT;
             goto end;
         }
-        EVP_CIPHER_free(aes256cbc);
         if (SSL_CONNECTION_IS_TLS13(s))
             renew_ticket = 1;
     }
@@ -0,0 +1,363 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/*
+ * The built-in ring of session ticket keys: the previous, current and next
+ * keys. New tickets are protected with the current key. Tickets protected
+ * with any key of the ring are accepted, and renewed unless the key was the
+ * current one. When rotation is enabled the ring moves on by one slot at
+ * each interval, making room for a new random next key.
+ */
+
+#include <string.h>
+#include <openssl/core_names.h>
+#include <openssl/rand.h>
+#include "ssl_local.h"
+
+/* Frees the contexts of a key and forgets its secrets */
+static void tick_key_clear(SSL_CTX *ctx, size_t slot)
+{
+    SSL_TICK_KEY *key = &ctx->ext.tick_keys[slot];
+
+    EVP_MAC_CTX_free(key->mac);
+    EVP_CIPHER_CTX_free(key->enc);
+    EVP_CIPHER_CTX_free(key->dec);
+    memset(key, 0, sizeof(*key));
+    OPENSSL_cleanse(ctx->ext.secure->tick_hmac_key[slot],
+                    sizeof(ctx->ext.secure->tick_hmac_key[slot]));
+    OPENSSL_cleanse(ctx->ext.secure->tick_aes_key[slot],
+                    sizeof(ctx->ext.secure->tick_aes_key[slot]));
+}
+
+static int tick_key_generate(SSL_CTX *ctx, size_t slot)
+{
+    SSL_TICK_KEY *key = &ctx->ext.tick_keys[slot];
+
+    tick_key_clear(ctx, slot);
+    if (RAND_bytes_ex(ctx->libctx, key->name, sizeof(key->name), 0) <= 0
+        || RAND_priv_bytes_ex(ctx->libctx, ctx->ext.secure->tick_hmac_key[slot],
+                              sizeof(ctx->ext.secure->tick_hmac_key[slot]),
+                              0) <= 0
+        || RAND_priv_bytes_ex(ctx->libctx, ctx->ext.secure->tick_aes_key[slot],
+                              sizeof(ctx->ext.secure->tick_aes_key[slot]),
+                              0) <= 0) {
+        tick_key_clear(ctx, slot);
+        return 0;
+    }
+    key->valid = 1;
+    return 1;
+}
+
+/* Keys the contexts of a valid key. Must be called with the write lock. */
+static int tick_key_setup(SSL_CTX *ctx, size_t slot)
+{
+    SSL_TICK_KEY *key = &ctx->ext.tick_keys[slot];
+    EVP_CIPHER *cipher = NULL;
+    EVP_MAC *mac = NULL;
+    OSSL_PARAM params[2];
+    int ok = 0;
+
+    cipher = EVP_CIPHER_fetch(ctx->libctx, "AES-256-CBC", ctx->propq);
+    mac = EVP_MAC_fetch(ctx->libctx, "HMAC", ctx->propq);
+    if (cipher == NULL || mac == NULL)
+        goto err;
+
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                 "SHA256", 0);
+    params[1] = OSSL_PARAM_construct_end();
+
+    if ((key->mac = EVP_MAC_CTX_new(mac)) == NULL
+        || (key->enc = EVP_CIPHER_CTX_new()) == NULL
+        || (key->dec = EVP_CIPHER_CTX_new()) == NULL
+        || !EVP_MAC_init(key->mac, ctx->ext.secure->tick_hmac_key[slot],
+                         sizeof(ctx->ext.secure->tick_hmac_key[slot]), params)
+        || !EVP_EncryptInit_ex(key->enc, cipher, NULL,
+                               ctx->ext.secure->tick_aes_key[slot], NULL)
+        || !EVP_DecryptInit_ex(key->dec, cipher, NULL,
+                               ctx->ext.secure->tick_aes_key[slot], NULL))
+        goto err;
+
+    ok = 1;
+ err:
+    if (!ok) {
+        EVP_MAC_CTX_free(key->mac);
+        EVP_CIPHER_CTX_free(key->enc);
+        EVP_CIPHER_CTX_free(key->dec);
+        key->mac = NULL;
+        key->enc = key->dec = NULL;
+    }
+    EVP_CIPHER_free(cipher);
+    EVP_MAC_free(mac);
+    return ok;
+}
+
+static void tick_key_move(SSL_CTX *ctx, size_t to, size_t from)
+{
+    SSL_CTX_EXT_SECURE *sec = ctx->ext.secure;
+
+    tick_key_clear(ctx, to);
+    ctx->ext.tick_keys[to] = ctx->ext.tick_keys[from];
+    memcpy(sec->tick_hmac_key[to], sec->tick_hmac_key[from],
+           sizeof(sec->tick_hmac_key[to]));
+    memcpy(sec->tick_aes_key[to], sec->tick_aes_key[from],
+           sizeof(sec->tick_aes_key[to]));
+
+    /* The contexts now belong to the new slot */
+    memset(&ctx->ext.tick_keys[from], 0, sizeof(ctx->ext.tick_keys[from]));
+    tick_key_clear(ctx, from);
+}
+
+static void tick_keys_schedule(SSL_CTX *ctx)
+{
+    if (ossl_time_is_zero(ctx->ext.tick_key_interval))
+        ctx->ext.tick_rotate_at = ossl_time_infinite();
+    else
+        ctx->ext.tick_rotate_at = ossl_time_add(ossl_time_now(),
+                                                ctx->ext.tick_key_interval);
+}
+
+/* Must be called with the write lock. */
+static int tick_keys_rotate(SSL_CTX *ctx)
+{
+    /* The current key must stay valid, so fail if there is nothing next */
+    if (!ctx->ext.tick_keys[SSL_TICK_KEY_NEXT].valid
+        && !tick_key_generate(ctx, SSL_TICK_KEY_NEXT))
+        return 0;
+
+    tick_key_move(ctx, SSL_TICK_KEY_PREV, SSL_TICK_KEY_CUR);
+    tick_key_move(ctx, SSL_TICK_KEY_CUR, SSL_TICK_KEY_NEXT);
+
+    /* If this fails, it is tried again at the next rotation */
+    tick_key_generate(ctx, SSL_TICK_KEY_NEXT);
+    tick_keys_schedule(ctx);
+    return 1;
+}
+
+/* Returns the slot of the valid key with the given name, or -1 */
+static int tick_key_find(SSL_CTX *ctx, const unsigned char *name)
+{
+    int i;
+
+    if (name == NULL)
+        return ctx->ext.tick_keys[SSL_TICK_KEY_CUR].valid
+               ? SSL_TICK_KEY_CUR : -1;
+
+    for (i = 0; i < SSL_TICK_KEY_NUM; i++)
+        if (ctx->ext.tick_keys[i].valid
+            && memcmp(ctx->ext.tick_keys[i].name, name,
+                      TLSEXT_KEYNAME_LENGTH) == 0)
+            return i;
+    return -1;
+}
+
+/*
+ * Locks the ring and finds the key with the given name, or the current key if
+ * name is NULL. The ring is rotated first if that is due, and the contexts of
+ * the key are set up if they are not yet. On success 1 is returned with the
+ * lock held and *slot set, to -1 if there is no such key.
+ */
+static int tick_keys_lock(SSL_CTX *ctx, const unsigned char *name, int *slot)
+{
+    OSSL_TIME now = ossl_time_now();
+    int i;
+
+    if (!CRYPTO_THREAD_read_lock(ctx->ext.tick_lock))
+        return 0;
+    if (ossl_time_compare(now, ctx->ext.tick_rotate_at) < 0) {
+        i = tick_key_find(ctx, name);
+        if (i < 0 || ctx->ext.tick_keys[i].mac != NULL) {
+            *slot = i;
+            return 1;
+        }
+    }
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+
+    if (!CRYPTO_THREAD_write_lock(ctx->ext.tick_lock))
+        return 0;
+    /* Someone else may have done the work in the meantime */
+    if (ossl_time_compare(now, ctx->ext.tick_rotate_at) >= 0
+        && !tick_keys_rotate(ctx))
+        goto err;
+    i = tick_key_find(ctx, name);
+    if (i >= 0 && ctx->ext.tick_keys[i].mac == NULL
+        && !tick_key_setup(ctx, i))
+        goto err;
+    *slot = i;
+    return 1;
+
+ err:
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+    return 0;
+}
+
+static SSL_HMAC *tick_key_hmac(const SSL_TICK_KEY *key)
+{
+    SSL_HMAC *ret = OPENSSL_zalloc(sizeof(*ret));
+
+    if (ret == NULL)
+        return NULL;
+    if ((ret->ctx = EVP_MAC_CTX_dup(key->mac)) == NULL) {
+        OPENSSL_free(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+int ssl_tick_keys_init(SSL_CTX *ctx)
+{
+    ctx->ext.tick_rotate_at = ossl_time_infinite();
+    return tick_key_generate(ctx, SSL_TICK_KEY_CUR)
+           && tick_key_generate(ctx, SSL_TICK_KEY_NEXT);
+}
+
+void ssl_tick_keys_free(SSL_CTX *ctx)
+{
+    size_t i;
+
+    if (ctx->ext.secure != NULL)
+        for (i = 0; i < SSL_TICK_KEY_NUM; i++)
+            tick_key_clear(ctx, i);
+    CRYPTO_THREAD_lock_free(ctx->ext.tick_lock);
+    ctx->ext.tick_lock = NULL;
+}
+
+/*
+ * Replaces the ring by the single key in keys: the name followed by the HMAC
+ * and AES keys, as for SSL_CTX_set_tlsext_ticket_keys().
+ */
+int ssl_tick_keys_set(SSL_CTX *ctx, const unsigned char *keys)
+{
+    SSL_TICK_KEY *key = &ctx->ext.tick_keys[SSL_TICK_KEY_CUR];
+    SSL_CTX_EXT_SECURE *sec = ctx->ext.secure;
+    size_t i;
+
+    if (!CRYPTO_THREAD_write_lock(ctx->ext.tick_lock))
+        return 0;
+
+    for (i = 0; i < SSL_TICK_KEY_NUM; i++)
+        tick_key_clear(ctx, i);
+
+    memcpy(key->name, keys, sizeof(key->name));
+    keys += sizeof(key->name);
+    memcpy(sec->tick_hmac_key[SSL_TICK_KEY_CUR], keys,
+           sizeof(sec->tick_hmac_key[SSL_TICK_KEY_CUR]));
+    keys += sizeof(sec->tick_hmac_key[SSL_TICK_KEY_CUR]);
+    memcpy(sec->tick_aes_key[SSL_TICK_KEY_CUR], keys,
+           sizeof(sec->tick_aes_key[SSL_TICK_KEY_CUR]));
+    key->valid = 1;
+
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+    return 1;
+}
+
+/* Writes the current key to keys in the format of ssl_tick_keys_set() */
+int ssl_tick_keys_get(SSL_CTX *ctx, unsigned char *keys)
+{
+    const SSL_TICK_KEY *key = &ctx->ext.tick_keys[SSL_TICK_KEY_CUR];
+    const SSL_CTX_EXT_SECURE *sec = ctx->ext.secure;
+
+    if (!CRYPTO_THREAD_read_lock(ctx->ext.tick_lock))
+        return 0;
+
+    memcpy(keys, key->name, sizeof(key->name));
+    keys += sizeof(key->name);
+    memcpy(keys, sec->tick_hmac_key[SSL_TICK_KEY_CUR],
+           sizeof(sec->tick_hmac_key[SSL_TICK_KEY_CUR]));
+    keys += sizeof(sec->tick_hmac_key[SSL_TICK_KEY_CUR]);
+    memcpy(keys, sec->tick_aes_key[SSL_TICK_KEY_CUR],
+           sizeof(sec->tick_aes_key[SSL_TICK_KEY_CUR]));
+
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+    return 1;
+}
+
+/*
+ * Sets up cctx and a new *hctx to protect a ticket with the current key,
+ * and writes the key name and a random IV of *iv_len bytes.
+ */
+int ssl_tick_keys_encrypt_init(SSL_CTX *ctx, unsigned char *key_name,
+                               unsigned char *iv, int *iv_len,
+                               EVP_CIPHER_CTX *cctx, SSL_HMAC **hctx)
+{
+    const SSL_TICK_KEY *key;
+    int slot, ok;
+
+    if (!tick_keys_lock(ctx, NULL, &slot))
+        return 0;
+    if (slot < 0) {
+        CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+        return 0;
+    }
+
+    key = &ctx->ext.tick_keys[slot];
+    memcpy(key_name, key->name, sizeof(key->name));
+    ok = EVP_CIPHER_CTX_copy(cctx, key->enc)
+         && (*hctx = tick_key_hmac(key)) != NULL;
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+
+    return ok
+           && (*iv_len = EVP_CIPHER_CTX_get_iv_length(cctx)) >= 0
+           && RAND_bytes_ex(ctx->libctx, iv, *iv_len, 0) > 0
+           && EVP_EncryptInit_ex(cctx, NULL, NULL, NULL, iv);
+}
+
+/*
+ * Sets up cctx and a new *hctx to check and decrypt a ticket protected with
+ * the key named key_name. Returns 1 on success, setting *renew if a new
+ * ticket should be issued, 0 if the key is not known and -1 on error.
+ */
+int ssl_tick_keys_decrypt_init(SSL_CTX *ctx, const unsigned char *key_name,
+                               const unsigned char *iv,
+                               EVP_CIPHER_CTX *cctx, SSL_HMAC **hctx,
+                               int *renew)
+{
+    const SSL_TICK_KEY *key;
+    int slot, ok;
+
+    if (!tick_keys_lock(ctx, key_name, &slot))
+        return -1;
+    if (slot < 0) {
+        CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+        return 0;
+    }
+
+    key = &ctx->ext.tick_keys[slot];
+    ok = EVP_CIPHER_CTX_copy(cctx, key->dec)
+         && (*hctx = tick_key_hmac(key)) != NULL;
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+
+    if (!ok || !EVP_DecryptInit_ex(cctx, NULL, NULL, NULL, iv))
+        return -1;
+
+    *renew = slot != SSL_TICK_KEY_CUR;
+    return 1;
+}
+
+int SSL_CTX_set_ticket_key_rotation(SSL_CTX *ctx, uint64_t interval)
+{
+    if (!CRYPTO_THREAD_write_lock(ctx->ext.tick_lock))
+        return 0;
+
+    ctx->ext.tick_key_interval = ossl_seconds2time(interval);
+    tick_keys_schedule(ctx);
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+    return 1;
+}
+
+int SSL_CTX_rotate_ticket_keys(SSL_CTX *ctx)
+{
+    int ret;
+
+    if (!CRYPTO_THREAD_write_lock(ctx->ext.tick_lock))
+        return 0;
+
+    ret = tick_keys_rotate(ctx);
+    CRYPTO_THREAD_unlock(ctx->ext.tick_lock);
+    return ret;
+}
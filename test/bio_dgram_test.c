@@ -451,6 +451,126 @@ static int test_bio_dgram(int idx)
                                bio_dgram_cases[idx].local);
 }
 
+/*
+ * Sends a message made up of several datagrams using segmentation offload and
+ * checks that it is received as individual datagrams, or as coalesced
+ * datagrams when GRO is enabled.
+ */
+#define GSO_SEG_LEN     100
+#define GSO_MSG_LEN     (4 * GSO_SEG_LEN + GSO_SEG_LEN / 2)
+
+static int test_bio_dgram_gso(void)
+{
+    int testresult = 0, fd1 = -1, fd2 = -1, enabled = 0;
+    BIO *b1 = NULL, *b2 = NULL;
+    BIO_ADDR *addr1 = NULL, *addr2 = NULL;
+    union BIO_sock_info_u info1 = {0}, info2 = {0};
+    struct in_addr ina;
+    unsigned char tx_buf[GSO_MSG_LEN], rx_buf[8][GSO_MSG_LEN];
+    BIO_MSG tx_msg = {0}, rx_msg[8];
+    size_t i, num_processed = 0, total, seg;
+
+    ina.s_addr = htonl(0x7f000001UL);
+
+    if (!TEST_ptr(addr1 = BIO_ADDR_new())
+        || !TEST_ptr(addr2 = BIO_ADDR_new())
+        || !TEST_int_eq(BIO_ADDR_rawmake(addr1, AF_INET, &ina, sizeof(ina), 0), 1)
+        || !TEST_int_eq(BIO_ADDR_rawmake(addr2, AF_INET, &ina, sizeof(ina), 0), 1)
+        || !TEST_int_ge(fd1 = BIO_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, 0), 0)
+        || !TEST_int_ge(fd2 = BIO_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, 0), 0)
+        || !TEST_int_gt(BIO_bind(fd1, addr1, 0), 0)
+        || !TEST_int_gt(BIO_bind(fd2, addr2, 0), 0))
+        goto err;
+
+    info1.addr = addr1;
+    info2.addr = addr2;
+    if (!TEST_int_gt(BIO_sock_info(fd1, BIO_SOCK_INFO_ADDRESS, &info1), 0)
+        || !TEST_int_gt(BIO_sock_info(fd2, BIO_SOCK_INFO_ADDRESS, &info2), 0)
+        || !TEST_ptr(b1 = BIO_new_dgram(fd1, 0))
+        || !TEST_ptr(b2 = BIO_new_dgram(fd2, 0)))
+        goto err;
+
+    if (BIO_dgram_get_segment_cap(b1) == 0) {
+        TEST_skip("segmentation offload not supported");
+        testresult = 1;
+        goto err;
+    }
+
+    for (i = 0; i < sizeof(tx_buf); ++i)
+        tx_buf[i] = (unsigned char)i;
+
+    tx_msg.data     = tx_buf;
+    tx_msg.data_len = sizeof(tx_buf);
+    tx_msg.peer     = addr2;
+    tx_msg.flags    = GSO_SEG_LEN;
+
+    /* Without GRO, the receiver sees each datagram separately. */
+    if (!TEST_true(BIO_dgram_get_gro_enable(b2, &enabled))
+        || !TEST_false(enabled)
+        || !TEST_true(do_sendmmsg(b1, &tx_msg, 1, 0, &num_processed)))
+        goto err;
+
+    memset(rx_msg, 0, sizeof(rx_msg));
+    for (i = 0; i < 5; ++i) {
+        rx_msg[i].data      = rx_buf[i];
+        rx_msg[i].data_len  = sizeof(rx_buf[i]);
+    }
+
+    if (!TEST_true(do_recvmmsg(b2, rx_msg, 5, 0, &num_processed)))
+        goto err;
+
+    for (i = 0; i < 5; ++i)
+        if (!TEST_mem_eq(rx_msg[i].data, rx_msg[i].data_len,
+                         tx_buf + i * GSO_SEG_LEN,
+                         i < 4 ? GSO_SEG_LEN : GSO_SEG_LEN / 2)
+            || !TEST_uint64_t_eq(rx_msg[i].flags, 0))
+            goto err;
+
+    /* With GRO, the datagrams may be delivered together. */
+    if (!TEST_true(BIO_dgram_set_gro_enable(b2, 1))
+        || !TEST_true(BIO_dgram_get_gro_enable(b2, &enabled))
+        || !TEST_true(enabled)
+        || !TEST_true(do_sendmmsg(b1, &tx_msg, 1, 0, &num_processed)))
+        goto err;
+
+    for (total = 0; total < sizeof(tx_buf); total += rx_msg[0].data_len) {
+        memset(rx_msg, 0, sizeof(rx_msg[0]));
+        rx_msg[0].data      = rx_buf[0];
+        rx_msg[0].data_len  = sizeof(rx_buf[0]);
+        if (!TEST_true(do_recvmmsg(b2, rx_msg, 1, 0, &num_processed))
+            || !TEST_size_t_le(total + rx_msg[0].data_len, sizeof(tx_buf))
+            || !TEST_mem_eq(rx_msg[0].data, rx_msg[0].data_len,
+                            tx_buf + total, rx_msg[0].data_len))
+            goto err;
+
+        /* Only the final datagram sent is shorter than a segment. */
+        seg = (size_t)(rx_msg[0].flags & BIO_MSG_SEGMENT_SIZE_MASK);
+        if (seg != 0
+            && (!TEST_size_t_eq(seg, GSO_SEG_LEN)
+                || !TEST_true(rx_msg[0].data_len % seg == 0
+                              || total + rx_msg[0].data_len == sizeof(tx_buf))))
+            goto err;
+    }
+
+    /* A message with too many segments is rejected. */
+    tx_msg.flags = 1;
+    if (!TEST_false(BIO_sendmmsg(b1, &tx_msg, sizeof(BIO_MSG), 1, 0,
+                                 &num_processed)))
+        goto err;
+
+    testresult = 1;
+err:
+    BIO_free(b1);
+    BIO_free(b2);
+    if (fd1 >= 0)
+        BIO_closesocket(fd1);
+    if (fd2 >= 0)
+        BIO_closesocket(fd2);
+    BIO_ADDR_free(addr1);
+    BIO_ADDR_free(addr2);
+    return testresult;
+}
+
 static int random_data(const uint32_t *key, uint8_t *data, size_t data_len, size_t offset)
 {
     int ret = 0, outl;
@@ -755,6 +875,7 @@ int setup_tests(void)
 
 #if !defined(OPENSSL_NO_DGRAM) && !defined(OPENSSL_NO_SOCK)
     ADD_ALL_TESTS(test_bio_dgram, OSSL_NELEM(bio_dgram_cases));
+    ADD_TEST(test_bio_dgram_gso);
     ADD_TEST(test_bio_dgram_pair);
 #endif
 
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/*
+ * Microbenchmark comparing the binary heap and timer wheel backends of
+ * OSSL_EVENT_QUEUE.
+ *
+ * A fixed population of timers, 100k by default, is kept live, modelling the
+ * loss detection, idle and ACK delay timers of many connections. Each step
+ * advances a simulated clock by 10us, reschedules a number of random timers
+ * (as happens whenever a packet is sent or acknowledged) and runs whatever has
+ * fallen due, restarting each expired timer so the population stays constant.
+ * Timers are scheduled between 1ms and 1s ahead.
+ *
+ * This is not run as part of the test suite.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/crypto.h>
+#include "internal/event_queue.h"
+
+static OSSL_TIME fake_time;
+static uint32_t rng_state = 1;
+
+/* The event queue reads the clock through this; replace it with ours. */
+OSSL_TIME ossl_time_now(void)
+{
+    return fake_time;
+}
+
+/* ossl_time_now() is simulated above, so measure CPU time instead. */
+static uint64_t cpu_us(void)
+{
+    return (uint64_t)clock() * 1000000 / CLOCKS_PER_SEC;
+}
+
+/* Deterministic, so both backends see the same sequence. */
+static uint32_t bench_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static OSSL_TIME random_when(void)
+{
+    return ossl_time_add(fake_time,
+                         ossl_us2time(1000 + bench_rand() % 999000));
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n #timers] [-s #steps] [-r reschedules/step] "
+            "[-t wheel-tick-us]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static int run(const char *name, int wheel, size_t num_timers, size_t steps,
+               size_t resched, uint64_t tick_us)
+{
+    OSSL_EVENT_QUEUE *q;
+    OSSL_EVENT *events, *e;
+    size_t i, j;
+    uint64_t expired = 0, start, us;
+    int ok = 0;
+
+    rng_state = 1;
+    fake_time = ossl_seconds2time(1);
+
+    events = OPENSSL_zalloc(sizeof(*events) * num_timers);
+    q = wheel ? ossl_event_queue_new_wheel(ossl_us2time(tick_us))
+              : ossl_event_queue_new();
+    if (events == NULL || q == NULL)
+        goto err;
+
+    for (i = 0; i < num_timers; ++i)
+        if (!ossl_event_queue_add(q, &events[i], 0, 0, random_when(),
+                                  NULL, NULL, 0))
+            goto err;
+
+    start = cpu_us();
+
+    for (i = 0; i < steps; ++i) {
+        fake_time = ossl_time_add(fake_time, ossl_us2time(10));
+
+        for (j = 0; j < resched; ++j)
+            if (!ossl_event_queue_postpone_until(q,
+                                                 &events[bench_rand() % num_timers],
+                                                 random_when()))
+                goto err;
+
+        for (;;) {
+            if (!ossl_event_queue_get1_next_event(q, &e))
+                goto err;
+            if (e == NULL)
+                break;
+            ++expired;
+            if (!ossl_event_queue_add(q, e, 0, 0, random_when(), NULL, NULL, 0))
+                goto err;
+        }
+
+        /* As an event loop would, to decide how long to sleep. */
+        (void)ossl_event_queue_time_until_next(q);
+    }
+
+    us = cpu_us() - start;
+    if (us == 0)
+        us = 1;
+
+    printf("%-6s %llu.%06llu s, %.2f M steps/s, %llu expired\n", name,
+           (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000),
+           (double)steps / (double)us, (unsigned long long)expired);
+    ok = 1;
+err:
+    if (!ok)
+        fprintf(stderr, "%s: benchmark failed\n", name);
+    ossl_event_queue_free(q);
+    OPENSSL_free(events);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    size_t num_timers = 100000, steps = 100000, resched = 4;
+    uint64_t tick_us = 1000;
+    int c;
+
+    for (c = 1; c < argc; c += 2) {
+        if (c + 1 >= argc || argv[c][0] != '-' || argv[c][2] != '\0')
+            usage(argv[0]);
+
+        switch (argv[c][1]) {
+        case 'n':
+            num_timers = (size_t)strtoull(argv[c + 1], NULL, 0);
+            break;
+        case 's':
+            steps = (size_t)strtoull(argv[c + 1], NULL, 0);
+            break;
+        case 'r':
+            resched = (size_t)strtoull(argv[c + 1], NULL, 0);
+            break;
+        case 't':
+            tick_us = strtoull(argv[c + 1], NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (num_timers == 0 || tick_us == 0)
+        usage(argv[0]);
+
+    printf("timers: %zu, steps: %zu, reschedules/step: %zu, wheel tick: %llu us\n",
+           num_timers, steps, resched, (unsigned long long)tick_us);
+
+    if (!run("heap", 0, num_timers, steps, resched, tick_us)
+        || !run("wheel", 1, num_timers, steps, resched, tick_us))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
@@ -20,7 +20,7 @@ OSSL_TIME ossl_time_now(void)
 
 #define PAYLOAD(s)  s, strlen(s) + 1
 
-static int event_test(void)
+static int event_test(int wheel)
 {
     int res = 0;
     size_t len = 0;
@@ -29,8 +29,11 @@ static int event_test(void)
     void *p;
     static char payload[] = "payload";
 
+    cur_time = ossl_ticks2time(100);
+
     /* Create an event queue and add some events */
-    if (!TEST_ptr(q = ossl_event_queue_new())
+    if (!TEST_ptr(q = wheel ? ossl_event_queue_new_wheel(ossl_ticks2time(16))
+                            : ossl_event_queue_new())
             || !TEST_ptr(e1 = ossl_event_queue_add_new(q, 1, 10,
                                                        ossl_ticks2time(1100),
                                                        "ctx 1",
@@ -105,8 +108,137 @@ static int event_test(void)
     return res;
 }
 
+/*
+ * Drive a heap based queue and a timer wheel based one through the same
+ * random sequence of additions, postponements, removals and clock advances,
+ * some of them far enough in the future to need several wheel levels, and
+ * check that the same events fall due at the same times.
+ */
+#define NUM_EVENTS  2000
+
+static uint32_t rng_state = 1;
+
+static uint32_t test_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static OSSL_TIME random_when(void)
+{
+    uint64_t delta;
+
+    switch (test_rand() % 4) {
+    case 0:
+        delta = test_rand() % 256;
+        break;
+    case 1:
+        delta = test_rand() % 100000;
+        break;
+    case 2:
+        delta = test_rand() % 20000000;
+        break;
+    default:
+        delta = ((uint64_t)test_rand() << 12) + test_rand() % 4096;
+        break;
+    }
+    return ossl_time_add(cur_time, ossl_ticks2time(delta));
+}
+
+static int wheel_vs_heap_test(void)
+{
+    int res = 0;
+    static OSSL_EVENT ev[2][NUM_EVENTS];
+    static unsigned char queued[NUM_EVENTS];
+    OSSL_EVENT_QUEUE *q[2] = { NULL, NULL };
+    OSSL_EVENT *ep;
+    OSSL_TIME when;
+    size_t i, j, k, n[2], fired = 0;
+    int cancel;
+
+    cur_time = ossl_ticks2time(1000);
+    if (!TEST_ptr(q[0] = ossl_event_queue_new())
+            || !TEST_ptr(q[1] = ossl_event_queue_new_wheel(ossl_ticks2time(10))))
+        goto err;
+
+    for (i = 0; i < NUM_EVENTS; ++i) {
+        when = random_when();
+        for (j = 0; j < 2; ++j)
+            if (!TEST_true(ossl_event_queue_add(q[j], &ev[j][i], 0, 0, when,
+                                                NULL, NULL, 0)))
+                goto err;
+        queued[i] = 1;
+    }
+
+    for (k = 0; k < 20000; ++k) {
+        /* Reschedule, cancel or restart a random event. */
+        i = test_rand() % NUM_EVENTS;
+        when = random_when();
+        cancel = queued[i] && test_rand() % 8 == 0;
+        for (j = 0; j < 2; ++j) {
+            if (cancel) {
+                if (!TEST_true(ossl_event_queue_remove(q[j], &ev[j][i])))
+                    goto err;
+            } else if (queued[i]) {
+                if (!TEST_true(ossl_event_queue_postpone_until(q[j], &ev[j][i],
+                                                               when)))
+                    goto err;
+            } else {
+                if (!TEST_true(ossl_event_queue_add(q[j], &ev[j][i], 0, 0, when,
+                                                    NULL, NULL, 0)))
+                    goto err;
+            }
+        }
+        queued[i] = !cancel;
+
+        /* The wheel may report an earlier time, but never a later one. */
+        if (!TEST_uint64_t_le(ossl_time2ticks(ossl_event_queue_time_until_next(q[1])),
+                              ossl_time2ticks(ossl_event_queue_time_until_next(q[0]))))
+            goto err;
+
+        /* Advance the clock, sometimes by a lot, and run what is due. */
+        cur_time = ossl_time_add(cur_time,
+                                 ossl_ticks2time(test_rand() % 8 == 0
+                                                 ? test_rand() % 3000000
+                                                 : test_rand() % 300));
+        for (j = 0; j < 2; ++j) {
+            n[j] = 0;
+            for (;;) {
+                if (!TEST_true(ossl_event_queue_get1_next_event(q[j], &ep)))
+                    goto err;
+                if (ep == NULL)
+                    break;
+                if (!TEST_true(ossl_time_compare(ep->when, cur_time) <= 0))
+                    goto err;
+                i = ep - ev[j];
+                if (j == 0)
+                    queued[i] = 0;
+                else if (!TEST_false(queued[i]))
+                    goto err;
+                ++n[j];
+            }
+        }
+        if (!TEST_size_t_eq(n[0], n[1]))
+            goto err;
+        fired += n[0];
+    }
+
+    /* Make sure the test did exercise expiry. */
+    if (!TEST_size_t_gt(fired, NUM_EVENTS))
+        goto err;
+
+    res = 1;
+ err:
+    ossl_event_queue_free(q[0]);
+    ossl_event_queue_free(q[1]);
+    return res;
+}
+
 int setup_tests(void)
 {
-    ADD_TEST(event_test);
+    ADD_ALL_TESTS(event_test, 2);
+    ADD_TEST(wheel_vs_heap_test);
     return 1;
 }
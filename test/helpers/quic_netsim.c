@@ -0,0 +1,315 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include "quic_netsim.h"
+
+#define NETSIM_MAX_LINKS    8
+#define NETSIM_MAX_DGRAM    65536
+
+/* Size of the buffers of the datagram BIO pairs feeding the links. */
+#define NETSIM_BIO_BUF_LEN  (1024 * 1024)
+
+typedef struct netsim_dgram_st {
+    OSSL_TIME       deliver_at;
+    uint64_t        seq;        /* breaks ties, so delivery order is stable */
+    size_t          link, len;
+    unsigned char   data[1];
+} NETSIM_DGRAM;
+
+typedef struct netsim_link_st {
+    NETSIM_LINK_ARGS    args;
+    QUIC_DEMUX          *dst;
+    BIO                 *bio_in, *bio_out;
+
+    /* Time at which the bottleneck finishes sending what it has queued. */
+    OSSL_TIME           busy_until;
+    NETSIM_LINK_STATS   stats;
+} NETSIM_LINK;
+
+struct netsim_st {
+    OSSL_TIME       now;
+    uint64_t        rng, next_seq;
+
+    NETSIM_LINK     links[NETSIM_MAX_LINKS];
+    size_t          num_links;
+
+    /* Binary min-heap of datagrams in flight, by delivery time. */
+    NETSIM_DGRAM    **heap;
+    size_t          heap_len, heap_alloc;
+
+    unsigned char   buf[NETSIM_MAX_DGRAM];
+};
+
+NETSIM *netsim_new(uint64_t seed, OSSL_TIME start)
+{
+    NETSIM *sim;
+
+    if ((sim = OPENSSL_zalloc(sizeof(*sim))) == NULL)
+        return NULL;
+
+    sim->now = start;
+    /* The generator must not be seeded with zero. */
+    sim->rng = seed != 0 ? seed : 1;
+    return sim;
+}
+
+void netsim_free(NETSIM *sim)
+{
+    size_t i;
+
+    if (sim == NULL)
+        return;
+
+    for (i = 0; i < sim->num_links; ++i) {
+        BIO_free(sim->links[i].bio_in);
+        BIO_free(sim->links[i].bio_out);
+    }
+
+    for (i = 0; i < sim->heap_len; ++i)
+        OPENSSL_free(sim->heap[i]);
+
+    OPENSSL_free(sim->heap);
+    OPENSSL_free(sim);
+}
+
+OSSL_TIME netsim_now(void *arg)
+{
+    NETSIM *sim = arg;
+
+    return sim->now;
+}
+
+/* xorshift64* */
+static uint64_t netsim_rand(NETSIM *sim)
+{
+    sim->rng ^= sim->rng >> 12;
+    sim->rng ^= sim->rng << 25;
+    sim->rng ^= sim->rng >> 27;
+    return sim->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static int netsim_chance(NETSIM *sim, uint32_t ppm)
+{
+    return ppm > 0 && netsim_rand(sim) % 1000000 < ppm;
+}
+
+int netsim_add_link(NETSIM *sim, const NETSIM_LINK_ARGS *args,
+                    QUIC_DEMUX *dst, BIO **pbio, size_t *pidx)
+{
+    NETSIM_LINK *link;
+
+    if (sim->num_links == NETSIM_MAX_LINKS)
+        return 0;
+
+    link = &sim->links[sim->num_links];
+    memset(link, 0, sizeof(*link));
+    if (!BIO_new_bio_dgram_pair(&link->bio_in, NETSIM_BIO_BUF_LEN,
+                                &link->bio_out, NETSIM_BIO_BUF_LEN))
+        return 0;
+
+    link->args          = *args;
+    link->dst           = dst;
+    link->busy_until    = sim->now;
+
+    *pbio = link->bio_in;
+    if (pidx != NULL)
+        *pidx = sim->num_links;
+
+    ++sim->num_links;
+    return 1;
+}
+
+static int dgram_before(const NETSIM_DGRAM *a, const NETSIM_DGRAM *b)
+{
+    int r = ossl_time_compare(a->deliver_at, b->deliver_at);
+
+    return r < 0 || (r == 0 && a->seq < b->seq);
+}
+
+static int heap_push(NETSIM *sim, NETSIM_DGRAM *d)
+{
+    size_t i, parent;
+
+    if (sim->heap_len == sim->heap_alloc) {
+        size_t new_alloc = sim->heap_alloc == 0 ? 64 : sim->heap_alloc * 2;
+        NETSIM_DGRAM **heap;
+
+        heap = OPENSSL_realloc(sim->heap, new_alloc * sizeof(*heap));
+        if (heap == NULL)
+            return 0;
+
+        sim->heap       = heap;
+        sim->heap_alloc = new_alloc;
+    }
+
+    for (i = sim->heap_len++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (!dgram_before(d, sim->heap[parent]))
+            break;
+        sim->heap[i] = sim->heap[parent];
+    }
+
+    sim->heap[i] = d;
+    return 1;
+}
+
+static NETSIM_DGRAM *heap_pop(NETSIM *sim)
+{
+    NETSIM_DGRAM *top = sim->heap[0], *last;
+    size_t i = 0, child;
+
+    last = sim->heap[--sim->heap_len];
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= sim->heap_len)
+            break;
+        if (child + 1 < sim->heap_len
+            && dgram_before(sim->heap[child + 1], sim->heap[child]))
+            ++child;
+        if (!dgram_before(sim->heap[child], last))
+            break;
+        sim->heap[i] = sim->heap[child];
+        i = child;
+    }
+
+    if (sim->heap_len > 0)
+        sim->heap[i] = last;
+
+    return top;
+}
+
+/* Sends a datagram written at the current time over a link. */
+static int link_send(NETSIM *sim, size_t idx, const unsigned char *data,
+                     size_t len)
+{
+    NETSIM_LINK *link = &sim->links[idx];
+    NETSIM_DGRAM *d;
+    OSSL_TIME start, tx_time = ossl_time_zero();
+    uint64_t backlog;
+
+    ++link->stats.dgrams_sent;
+    link->stats.bytes_sent += len;
+
+    start = ossl_time_max(sim->now, link->busy_until);
+    if (link->args.bandwidth > 0) {
+        /* Bytes waiting in the queue ahead of this datagram. */
+        backlog = ossl_time2ticks(ossl_time_subtract(start, sim->now))
+                  * link->args.bandwidth / OSSL_TIME_SECOND;
+        if (link->args.queue_limit > 0
+            && backlog + len > link->args.queue_limit) {
+            ++link->stats.dgrams_dropped;
+            return 1;
+        }
+
+        tx_time = ossl_ticks2time(len * OSSL_TIME_SECOND
+                                  / link->args.bandwidth);
+    }
+
+    /* Lost datagrams still occupy the bottleneck. */
+    link->busy_until = ossl_time_add(start, tx_time);
+    if (netsim_chance(sim, link->args.loss_ppm)) {
+        ++link->stats.dgrams_lost;
+        return 1;
+    }
+
+    if ((d = OPENSSL_malloc(sizeof(*d) + len)) == NULL)
+        return 0;
+
+    d->deliver_at   = ossl_time_add(link->busy_until, link->args.latency);
+    d->seq          = sim->next_seq++;
+    d->link         = idx;
+    d->len          = len;
+    memcpy(d->data, data, len);
+
+    if (netsim_chance(sim, link->args.reorder_ppm)) {
+        ++link->stats.dgrams_reordered;
+        d->deliver_at = ossl_time_add(d->deliver_at, link->args.reorder_delay);
+    }
+
+    if (!heap_push(sim, d)) {
+        OPENSSL_free(d);
+        return 0;
+    }
+
+    return 1;
+}
+
+int netsim_poll(NETSIM *sim)
+{
+    size_t i, processed;
+    BIO_MSG msg;
+    int ok = 1;
+
+    /* An empty BIO pair raises an error, which is expected here. */
+    ERR_set_mark();
+    for (i = 0; ok && i < sim->num_links; ++i)
+        for (;;) {
+            memset(&msg, 0, sizeof(msg));
+            msg.data        = sim->buf;
+            msg.data_len    = sizeof(sim->buf);
+
+            if (!BIO_recvmmsg(sim->links[i].bio_out, &msg, sizeof(msg), 1, 0,
+                              &processed)
+                || processed == 0)
+                break;
+
+            if (!link_send(sim, i, sim->buf, msg.data_len)) {
+                ok = 0;
+                break;
+            }
+        }
+
+    ERR_pop_to_mark();
+    return ok;
+}
+
+OSSL_TIME netsim_next_event(NETSIM *sim)
+{
+    if (!netsim_poll(sim) || sim->heap_len == 0)
+        return ossl_time_infinite();
+
+    return sim->heap[0]->deliver_at;
+}
+
+int netsim_advance(NETSIM *sim, OSSL_TIME t)
+{
+    NETSIM_DGRAM *d;
+    NETSIM_LINK *link;
+    int ok;
+
+    if (ossl_time_compare(t, sim->now) < 0 || !netsim_poll(sim))
+        return 0;
+
+    while (sim->heap_len > 0
+           && ossl_time_compare(sim->heap[0]->deliver_at, t) <= 0) {
+        d = heap_pop(sim);
+        link = &sim->links[d->link];
+
+        /* Receivers see the time the datagram arrived. */
+        sim->now = d->deliver_at;
+        ++link->stats.dgrams_delivered;
+        link->stats.bytes_delivered += d->len;
+
+        ok = ossl_quic_demux_inject(link->dst, d->data, d->len, NULL, NULL);
+        OPENSSL_free(d);
+        if (!ok)
+            return 0;
+    }
+
+    sim->now = t;
+    return 1;
+}
+
+void netsim_get_link_stats(NETSIM *sim, size_t idx, NETSIM_LINK_STATS *stats)
+{
+    *stats = sim->links[idx].stats;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#ifndef OSSL_TEST_QUIC_NETSIM_H
+# define OSSL_TEST_QUIC_NETSIM_H
+
+# include <openssl/bio.h>
+# include "internal/time.h"
+# include "internal/quic_demux.h"
+
+/*
+ * Deterministic network simulator
+ * ===============================
+ *
+ * A simulator is a set of unidirectional links and a virtual clock. Each link
+ * is fed by one end of a datagram BIO pair, which is given to the sender (for
+ * example as the BIO of a QTX), and delivers the datagrams written to it to a
+ * QUIC_DEMUX with ossl_quic_demux_inject() once they have crossed the link.
+ * The demuxers should use netsim_now() as their now() function, so that the
+ * receive times of packets are in virtual time.
+ *
+ * A link is modelled as a drop-tail queue in front of a bottleneck of a given
+ * bandwidth, followed by a fixed propagation delay. Datagrams may also be lost
+ * or delayed (and thus reordered) at random. The random choices are made by a
+ * generator seeded when the simulator is created, so a run is reproducible
+ * for a given seed, independently of the real time it takes.
+ *
+ * Time only advances when netsim_advance() is called, which is how the caller
+ * steps its event loop from one event to the next: the next delivery is given
+ * by netsim_next_event(), which the caller combines with its own timers.
+ */
+typedef struct netsim_st NETSIM;
+
+typedef struct netsim_link_args_st {
+    OSSL_TIME   latency;        /* one-way propagation delay */
+    uint64_t    bandwidth;      /* in bytes per second; 0 means unlimited */
+    size_t      queue_limit;    /* in bytes; 0 means unlimited */
+    uint32_t    loss_ppm;       /* chance of loss, in parts per million */
+    uint32_t    reorder_ppm;    /* chance of extra delay, in ppm */
+    OSSL_TIME   reorder_delay;  /* extra delay of reordered datagrams */
+} NETSIM_LINK_ARGS;
+
+typedef struct netsim_link_stats_st {
+    uint64_t    dgrams_sent, bytes_sent;
+    uint64_t    dgrams_delivered, bytes_delivered;
+    uint64_t    dgrams_lost;        /* lost at random */
+    uint64_t    dgrams_dropped;     /* dropped at the queue */
+    uint64_t    dgrams_reordered;
+} NETSIM_LINK_STATS;
+
+/* Creates a simulator whose clock starts at start. */
+NETSIM *netsim_new(uint64_t seed, OSSL_TIME start);
+
+/* Frees a simulator and the BIOs of its links. No-op if sim is NULL. */
+void netsim_free(NETSIM *sim);
+
+/* A now() function giving the virtual time of the simulator arg. */
+OSSL_TIME netsim_now(void *arg);
+
+/*
+ * Adds a link delivering to dst. The BIO which the sender must write to is
+ * returned in *pbio and remains owned by the simulator. The link's index, for
+ * use with netsim_get_link_stats(), is returned in *pidx if pidx is non-NULL.
+ * Returns 1 on success or 0 on failure.
+ */
+int netsim_add_link(NETSIM *sim, const NETSIM_LINK_ARGS *args,
+                    QUIC_DEMUX *dst, BIO **pbio, size_t *pidx);
+
+/*
+ * Takes the datagrams written to the links since the last call into the
+ * simulation, timestamped with the current virtual time. This is done by
+ * netsim_next_event() and netsim_advance() too, but should also be called
+ * after each write if several are made at the same virtual time, to keep the
+ * BIO pairs from filling up. Returns 1 on success or 0 on failure.
+ */
+int netsim_poll(NETSIM *sim);
+
+/*
+ * Returns the virtual time at which the next datagram will be delivered, or
+ * ossl_time_infinite() if none are in flight.
+ */
+OSSL_TIME netsim_next_event(NETSIM *sim);
+
+/*
+ * Advances the clock to t, delivering in order all of the datagrams due by
+ * then. t must not be earlier than the current time. Returns 1 on success or
+ * 0 on failure.
+ */
+int netsim_advance(NETSIM *sim, OSSL_TIME t);
+
+/* Retrieves the statistics of a link. */
+void netsim_get_link_stats(NETSIM *sim, size_t idx, NETSIM_LINK_STATS *stats);
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/*
+ * Microbenchmark for ACK processing in the QUIC ACK manager.
+ *
+ * A sender ACKM transmits packets at a simulated rate of one per microsecond
+ * (1M packets/s) to a receiver ACKM. The simulated network reorders and drops
+ * a proportion of packets, and every ACK frame generated by the receiver is
+ * delivered to the sender after a fixed delay, so that tens of thousands of
+ * packets are in flight. The time spent in the ACK manager is measured against
+ * the wall clock; a rate well above 1M packets/s is needed for the ACK manager
+ * not to be a bottleneck at that packet rate.
+ *
+ * With -b, ACK frames arrive in bursts, as they would when read with GRO or
+ * recvmmsg, and each burst of up to that many frames is passed to the sender
+ * in a single call.
+ *
+ * This is not run as part of the test suite.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include "internal/quic_ackm.h"
+#include "internal/quic_cc.h"
+#include "internal/time.h"
+
+#define MAX_RANGES      32
+#define REORDER_WINDOW  8
+#define MAX_BATCH       64
+
+typedef struct bench_ack_st {
+    uint64_t            deliver_at;    /* in packets sent */
+    size_t              num_ranges;
+    OSSL_QUIC_ACK_RANGE ranges[MAX_RANGES];
+} BENCH_ACK;
+
+static OSSL_TIME fake_time;
+static uint32_t rng_state = 1;
+static uint64_t num_acked, num_lost;
+
+static OSSL_TIME fake_now(void *arg)
+{
+    return fake_time;
+}
+
+/* Deterministic, so runs are comparable. */
+static uint32_t bench_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void on_acked(void *arg)
+{
+    ((OSSL_ACKM_TX_PKT *)arg)->cb_arg = NULL;
+    ++num_acked;
+}
+
+static void on_lost(void *arg)
+{
+    ((OSSL_ACKM_TX_PKT *)arg)->cb_arg = NULL;
+    ++num_lost;
+}
+
+static void on_discarded(void *arg)
+{
+    ((OSSL_ACKM_TX_PKT *)arg)->cb_arg = NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n #pkts] [-r reorder%%] [-l loss%%] "
+            "[-d delay-us] [-b batch]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t num_pkts = 5000000, delay = 20000, sent;
+    unsigned int reorder_pct = 5, loss_pct = 1;
+    size_t tx_cap = 1 << 17, ack_cap, ack_head = 0, ack_tail = 0;
+    size_t window_len = 0, j, batch = 1, num_batch;
+    QUIC_PN window[REORDER_WINDOW];
+    OSSL_ACKM_TX_PKT *txs = NULL, *tx;
+    BENCH_ACK *acks = NULL, *a;
+    OSSL_STATM statm_tx, statm_rx;
+    OSSL_CC_DATA *cc_tx = NULL, *cc_rx = NULL;
+    OSSL_ACKM *ackm_tx = NULL, *ackm_rx = NULL;
+    OSSL_ACKM_RX_PKT rx;
+    OSSL_QUIC_FRAME_ACK batch_acks[MAX_BATCH];
+    const OSSL_QUIC_FRAME_ACK *rx_ack;
+    OSSL_TIME start, elapsed;
+    uint64_t num_ack_frames = 0, num_batches = 0, us;
+    int c, ret = EXIT_FAILURE;
+
+    for (c = 1; c < argc; c += 2) {
+        if (c + 1 >= argc || argv[c][0] != '-' || argv[c][2] != '\0')
+            usage(argv[0]);
+
+        switch (argv[c][1]) {
+        case 'n':
+            num_pkts = strtoull(argv[c + 1], NULL, 0);
+            break;
+        case 'r':
+            reorder_pct = (unsigned int)atoi(argv[c + 1]);
+            break;
+        case 'l':
+            loss_pct = (unsigned int)atoi(argv[c + 1]);
+            break;
+        case 'd':
+            delay = strtoull(argv[c + 1], NULL, 0);
+            break;
+        case 'b':
+            batch = (size_t)atoi(argv[c + 1]);
+            if (batch < 1 || batch > MAX_BATCH)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    /*
+     * TX packet structures are reused in a ring, which must exceed the number
+     * of packets which can be in flight.
+     */
+    while (tx_cap < 4 * delay)
+        tx_cap <<= 1;
+
+    ack_cap = delay + REORDER_WINDOW + 1;
+
+    txs  = OPENSSL_zalloc(sizeof(*txs) * tx_cap);
+    acks = OPENSSL_zalloc(sizeof(*acks) * ack_cap);
+    if (txs == NULL || acks == NULL)
+        goto err;
+
+    fake_time = ossl_ticks2time(OSSL_TIME_SECOND);
+
+    if (!ossl_statm_init(&statm_tx) || !ossl_statm_init(&statm_rx))
+        goto err;
+
+    cc_tx = ossl_cc_dummy_method.new(NULL, NULL, NULL);
+    cc_rx = ossl_cc_dummy_method.new(NULL, NULL, NULL);
+    if (cc_tx == NULL || cc_rx == NULL)
+        goto err;
+
+    ackm_tx = ossl_ackm_new(fake_now, NULL, &statm_tx,
+                            &ossl_cc_dummy_method, cc_tx);
+    ackm_rx = ossl_ackm_new(fake_now, NULL, &statm_rx,
+                            &ossl_cc_dummy_method, cc_rx);
+    if (ackm_tx == NULL || ackm_rx == NULL)
+        goto err;
+
+    start = ossl_time_now();
+
+    for (sent = 0; sent < num_pkts; ++sent) {
+        fake_time = ossl_time_add(fake_time, ossl_us2time(1));
+
+        /* Transmit. */
+        tx = &txs[sent & (tx_cap - 1)];
+        if (tx->cb_arg != NULL) {
+            fprintf(stderr, "TX ring overrun at packet %llu\n",
+                    (unsigned long long)sent);
+            goto err;
+        }
+
+        memset(tx, 0, sizeof(*tx));
+        tx->pkt_num             = sent;
+        tx->pkt_space           = QUIC_PN_SPACE_APP;
+        tx->num_bytes           = 1200;
+        tx->time                = fake_time;
+        tx->largest_acked       = QUIC_PN_INVALID;
+        tx->is_inflight         = 1;
+        tx->is_ack_eliciting    = 1;
+        tx->on_acked            = on_acked;
+        tx->on_lost             = on_lost;
+        tx->on_discarded        = on_discarded;
+        tx->cb_arg              = tx;
+
+        if (!ossl_ackm_on_tx_packet(ackm_tx, tx))
+            goto err;
+
+        /* Network: drop some packets and hold back others to reorder them. */
+        if (bench_rand() % 100 < loss_pct)
+            goto deliver_acks;
+
+        window[window_len++] = sent;
+        if (window_len < REORDER_WINDOW && bench_rand() % 100 < reorder_pct)
+            goto deliver_acks;
+
+        /* Receive whatever is in the window, with the newest first. */
+        for (j = window_len; j-- > 0;) {
+            memset(&rx, 0, sizeof(rx));
+            rx.pkt_num          = window[j];
+            rx.pkt_space        = QUIC_PN_SPACE_APP;
+            rx.time             = fake_time;
+            rx.is_ack_eliciting = 1;
+
+            if (ossl_ackm_is_rx_pn_processable(ackm_rx, rx.pkt_num,
+                                               QUIC_PN_SPACE_APP)
+                && !ossl_ackm_on_rx_packet(ackm_rx, &rx))
+                goto err;
+        }
+
+        window_len = 0;
+
+        if (ossl_ackm_is_ack_desired(ackm_rx, QUIC_PN_SPACE_APP)) {
+            rx_ack = ossl_ackm_get_ack_frame(ackm_rx, QUIC_PN_SPACE_APP);
+            if (rx_ack == NULL || (ack_tail + 1) % ack_cap == ack_head)
+                goto err;
+
+            a = &acks[ack_tail];
+            ack_tail = (ack_tail + 1) % ack_cap;
+
+            /* The receiver ACKs every other packet, so bursts span 2 * batch. */
+            a->deliver_at = (sent + delay + 2 * batch - 1) / (2 * batch)
+                            * (2 * batch);
+            a->num_ranges = rx_ack->num_ack_ranges;
+            if (a->num_ranges > MAX_RANGES)
+                a->num_ranges = MAX_RANGES;
+
+            memcpy(a->ranges, rx_ack->ack_ranges,
+                   a->num_ranges * sizeof(a->ranges[0]));
+        }
+
+    deliver_acks:
+        for (;;) {
+            num_batch = 0;
+            while (num_batch < batch && ack_head != ack_tail
+                   && acks[ack_head].deliver_at <= sent) {
+                a = &acks[ack_head];
+                ack_head = (ack_head + 1) % ack_cap;
+
+                memset(&batch_acks[num_batch], 0, sizeof(batch_acks[0]));
+                batch_acks[num_batch].ack_ranges      = a->ranges;
+                batch_acks[num_batch].num_ack_ranges  = a->num_ranges;
+                ++num_batch;
+            }
+
+            if (num_batch == 0)
+                break;
+
+            if (!ossl_ackm_on_rx_ack_frames(ackm_tx, batch_acks, num_batch,
+                                            QUIC_PN_SPACE_APP, fake_time))
+                goto err;
+
+            num_ack_frames += num_batch;
+            ++num_batches;
+        }
+    }
+
+    elapsed = ossl_time_subtract(ossl_time_now(), start);
+    us = ossl_time2us(elapsed);
+    if (us == 0)
+        us = 1;
+
+    printf("packets:      %llu (reorder %u%%, loss %u%%, delay %llu us)\n",
+           (unsigned long long)num_pkts, reorder_pct, loss_pct,
+           (unsigned long long)delay);
+    printf("ack frames:   %llu in %llu batches\n",
+           (unsigned long long)num_ack_frames, (unsigned long long)num_batches);
+    printf("acked/lost:   %llu/%llu\n", (unsigned long long)num_acked,
+           (unsigned long long)num_lost);
+    printf("elapsed:      %llu.%06llu s\n",
+           (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000));
+    printf("rate:         %.2f Mpkts/s\n", (double)num_pkts / (double)us);
+
+    ret = EXIT_SUCCESS;
+err:
+    if (ret != EXIT_SUCCESS)
+        fprintf(stderr, "benchmark failed\n");
+
+    /* The ACKMs must go before the packets they reference. */
+    ossl_ackm_free(ackm_tx);
+    ossl_ackm_free(ackm_rx);
+    if (cc_tx != NULL)
+        ossl_cc_dummy_method.free(cc_tx);
+    if (cc_rx != NULL)
+        ossl_cc_dummy_method.free(cc_rx);
+    OPENSSL_free(acks);
+    OPENSSL_free(txs);
+    return ret;
+}
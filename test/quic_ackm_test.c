@@ -44,6 +44,31 @@ static void on_discarded(void *arg)
     ++info->discarded;
 }
 
+/*
+ * Congestion controller which counts notifications and otherwise behaves like
+ * the dummy controller.
+ */
+static OSSL_CC_METHOD counting_cc_method;
+static size_t cc_num_acked_calls, cc_num_lost_calls;
+
+static int counting_cc_on_data_acked(OSSL_CC_DATA *cc, OSSL_TIME now,
+                                     uint64_t last_pn_acked,
+                                     size_t num_bytes)
+{
+    ++cc_num_acked_calls;
+    return ossl_cc_dummy_method.on_data_acked(cc, now, last_pn_acked,
+                                              num_bytes);
+}
+
+static void counting_cc_on_data_lost(OSSL_CC_DATA *cc, uint64_t largest_pn_lost,
+                                     uint64_t largest_pn_sent,
+                                     size_t num_bytes, int persistent)
+{
+    ++cc_num_lost_calls;
+    ossl_cc_dummy_method.on_data_lost(cc, largest_pn_lost, largest_pn_sent,
+                                      num_bytes, persistent);
+}
+
 struct helper {
     OSSL_ACKM *ackm;
     struct pkt_info *pkts;
@@ -98,13 +123,18 @@ static int helper_init(struct helper *h, size_t num_pkts)
     h->have_statm = 1;
 
     /* Initialise congestion controller. */
-    h->ccdata = ossl_cc_dummy_method.new(NULL, NULL, NULL);
+    counting_cc_method                  = ossl_cc_dummy_method;
+    counting_cc_method.on_data_acked    = counting_cc_on_data_acked;
+    counting_cc_method.on_data_lost     = counting_cc_on_data_lost;
+    cc_num_acked_calls = cc_num_lost_calls = 0;
+
+    h->ccdata = counting_cc_method.new(NULL, NULL, NULL);
     if (!TEST_ptr(h->ccdata))
         goto err;
 
     /* Initialise ACK manager. */
     h->ackm = ossl_ackm_new(fake_now, NULL, &h->statm,
-                            &ossl_cc_dummy_method, h->ccdata);
+                            &counting_cc_method, h->ccdata);
     if (!TEST_ptr(h->ackm))
         goto err;
 
@@ -607,6 +637,168 @@ err:
     return testresult;
 }
 
+/*
+ * TX ACK Test With Many Packets
+ * ******************************************************************
+ *
+ * Send enough packets that the TX history must grow several times, skipping a
+ * PN now and then as a sender would to detect optimistic ACKs. The peer ACKs
+ * every third run of packets, so each ACK frame carries many ranges. ACK
+ * frames arrive in two halves, and the first is then repeated, as if
+ * reordered; each packet must be reported as either ACKed or lost exactly
+ * once.
+ *
+ * The frames are delivered either one at a time, oldest first, or as a single
+ * batch, newest first. A batch must notify the congestion controller once.
+ */
+#define TX_MANY_NUM_PKTS    2000
+
+static int tx_many_want_ack(size_t i)
+{
+    return (i / 16) % 3 != 2;
+}
+
+/* Fills ranges with the ACK ranges for packets [lo, hi), in descending order. */
+static size_t tx_many_make_ranges(struct helper *h, size_t lo, size_t hi,
+                                  OSSL_QUIC_ACK_RANGE *ranges)
+{
+    size_t i, n = 0;
+    QUIC_PN pn;
+
+    for (i = hi; i-- > lo;) {
+        if (!tx_many_want_ack(i))
+            continue;
+
+        pn = h->pkts[i].pkt->pkt_num;
+        if (n > 0 && ranges[n - 1].start == pn + 1) {
+            ranges[n - 1].start = pn;
+        } else {
+            ranges[n].start = ranges[n].end = pn;
+            ++n;
+        }
+    }
+
+    return n;
+}
+
+static int test_tx_ack_many(int batch)
+{
+    int testresult = 0;
+    struct helper h;
+    size_t i, num_lo, num_hi;
+    QUIC_PN pn = 0;
+    OSSL_ACKM_TX_PKT *tx;
+    OSSL_QUIC_ACK_RANGE *lo = NULL, *hi = NULL;
+    OSSL_QUIC_FRAME_ACK ack = {0}, acks[3] = {{0}};
+
+    if (!TEST_int_eq(helper_init(&h, TX_MANY_NUM_PKTS), 1))
+        goto err;
+
+    for (i = 0; i < TX_MANY_NUM_PKTS; ++i) {
+        h.pkts[i].pkt = tx = OPENSSL_zalloc(sizeof(*tx));
+        if (!TEST_ptr(tx))
+            goto err;
+
+        if (i % 7 == 3)
+            ++pn; /* skipped PN */
+
+        tx->pkt_num             = pn++;
+        tx->pkt_space           = QUIC_PN_SPACE_APP;
+        tx->is_inflight         = 1;
+        tx->is_ack_eliciting    = 1;
+        tx->num_bytes           = 123;
+        tx->largest_acked       = QUIC_PN_INVALID;
+        tx->on_lost             = on_lost;
+        tx->on_acked            = on_acked;
+        tx->on_discarded        = on_discarded;
+        tx->cb_arg              = &h.pkts[i];
+        tx->time                = fake_time;
+
+        if (!TEST_int_eq(ossl_ackm_on_tx_packet(h.ackm, tx), 1))
+            goto err;
+    }
+
+    lo = OPENSSL_malloc(sizeof(*lo) * TX_MANY_NUM_PKTS);
+    hi = OPENSSL_malloc(sizeof(*hi) * TX_MANY_NUM_PKTS);
+    if (!TEST_ptr(lo) || !TEST_ptr(hi))
+        goto err;
+
+    num_lo = tx_many_make_ranges(&h, 0, TX_MANY_NUM_PKTS / 2, lo);
+    num_hi = tx_many_make_ranges(&h, TX_MANY_NUM_PKTS / 2, TX_MANY_NUM_PKTS,
+                                 hi);
+    if (!TEST_size_t_gt(num_lo, 3) || !TEST_size_t_gt(num_hi, 3))
+        goto err;
+
+    if (batch) {
+        acks[0].ack_ranges      = hi;
+        acks[0].num_ack_ranges  = num_hi;
+        acks[1].ack_ranges      = lo;
+        acks[1].num_ack_ranges  = num_lo;
+        acks[2]                 = acks[1];
+
+        /* A batch with a malformed frame is rejected without effect. */
+        acks[2].num_ack_ranges  = 0;
+        if (!TEST_int_eq(ossl_ackm_on_rx_ack_frames(h.ackm, acks,
+                                                    OSSL_NELEM(acks),
+                                                    QUIC_PN_SPACE_APP,
+                                                    fake_time), 0)
+            || !TEST_size_t_eq(cc_num_acked_calls, 0)
+            || !TEST_size_t_eq(cc_num_lost_calls, 0))
+            goto err;
+
+        for (i = 0; i < TX_MANY_NUM_PKTS; ++i)
+            if (!TEST_false(h.pkts[i].acked || h.pkts[i].lost))
+                goto err;
+
+        acks[2]                 = acks[1];
+        if (!TEST_int_eq(ossl_ackm_on_rx_ack_frames(h.ackm, acks,
+                                                    OSSL_NELEM(acks),
+                                                    QUIC_PN_SPACE_APP,
+                                                    fake_time), 1)
+            || !TEST_size_t_eq(cc_num_acked_calls, 1)
+            || !TEST_size_t_eq(cc_num_lost_calls, 1))
+            goto err;
+    } else {
+        ack.ack_ranges      = lo;
+        ack.num_ack_ranges  = num_lo;
+        if (!TEST_int_eq(ossl_ackm_on_rx_ack_frame(h.ackm, &ack,
+                                                   QUIC_PN_SPACE_APP,
+                                                   fake_time), 1))
+            goto err;
+
+        ack.ack_ranges      = hi;
+        ack.num_ack_ranges  = num_hi;
+        if (!TEST_int_eq(ossl_ackm_on_rx_ack_frame(h.ackm, &ack,
+                                                   QUIC_PN_SPACE_APP,
+                                                   fake_time), 1))
+            goto err;
+
+        ack.ack_ranges      = lo;
+        ack.num_ack_ranges  = num_lo;
+        if (!TEST_int_eq(ossl_ackm_on_rx_ack_frame(h.ackm, &ack,
+                                                   QUIC_PN_SPACE_APP,
+                                                   fake_time), 1))
+            goto err;
+    }
+
+    for (i = 0; i < TX_MANY_NUM_PKTS; ++i) {
+        if (!TEST_int_eq(h.pkts[i].acked, tx_many_want_ack(i))
+            || !TEST_int_eq(h.pkts[i].lost, !tx_many_want_ack(i))
+            || !TEST_int_eq(h.pkts[i].discarded, 0)) {
+            TEST_info("packet %zu (PN %llu)", i,
+                      (unsigned long long)h.pkts[i].pkt->pkt_num);
+            goto err;
+        }
+    }
+
+    testresult = 1;
+err:
+    OPENSSL_free(lo);
+    OPENSSL_free(hi);
+    helper_destroy(&h);
+    return testresult;
+}
+
 /*
  * RX ACK Test
  * ******************************************************************
@@ -827,10 +1019,50 @@ static const struct rx_test_op rx_script_3[] = {
     RX_OP_END
 };
 
+/* RX 4. Reordered Packets Producing Many Ranges */
+static const OSSL_QUIC_ACK_RANGE rx_ack_ranges_4a[] = {
+    { 8, 8 }, { 6, 6 }, { 4, 4 }, { 2, 2 }, { 0, 0 }
+};
+
+static const OSSL_QUIC_ACK_RANGE rx_ack_ranges_4b[] = {
+    { 8, 8 }, { 4, 6 }, { 0, 2 }
+};
+
+static const struct rx_test_op rx_script_4[] = {
+    RX_OP_PKT           (0, 8, 1)
+    RX_OP_PKT           (0, 0, 1)
+    RX_OP_PKT           (0, 4, 1)
+    RX_OP_PKT           (0, 2, 1)
+    RX_OP_PKT           (0, 6, 1)
+    RX_OP_CHECK_ACKS    (0, rx_ack_ranges_4a)
+    RX_OP_CHECK_PROC    (0, 1, 1)
+    RX_OP_CHECK_PROC    (0, 7, 1)
+
+    /* Fill in some of the gaps, merging ranges. */
+    RX_OP_PKT           (0, 5, 1)
+    RX_OP_PKT           (0, 1, 1)
+    RX_OP_CHECK_ACKS    (0, rx_ack_ranges_4b)
+    RX_OP_CHECK_UNPROC  (0, 0, 3)
+    RX_OP_CHECK_PROC    (0, 3, 1)
+    RX_OP_CHECK_UNPROC  (0, 4, 3)
+    RX_OP_CHECK_PROC    (0, 7, 1)
+    RX_OP_CHECK_UNPROC  (0, 8, 1)
+
+    /* Once an ACK of everything is itself ACKed, there is nothing to ACK. */
+    RX_OP_TX            (0, 0, 8)
+    RX_OP_RX_ACK        (0, 0, 1)
+    RX_OP_CHECK_NO_ACKS (0)
+    RX_OP_CHECK_UNPROC  (0, 0, 3)
+    RX_OP_CHECK_PROC    (0, 9, 1)
+
+    RX_OP_END
+};
+
 static const struct rx_test_op *const rx_test_scripts[] = {
     rx_script_1,
     rx_script_2,
-    rx_script_3
+    rx_script_3,
+    rx_script_4
 };
 
 static void on_ack_deadline_callback(OSSL_TIME deadline,
@@ -1038,6 +1270,7 @@ int setup_tests(void)
     ADD_ALL_TESTS(test_tx_ack_case,
                   OSSL_NELEM(tx_ack_cases) * MODE_NUM * QUIC_PN_SPACE_NUM);
     ADD_ALL_TESTS(test_tx_ack_time_script, OSSL_NELEM(tx_ack_time_scripts));
+    ADD_ALL_TESTS(test_tx_ack_many, 2);
     ADD_ALL_TESTS(test_rx_ack, OSSL_NELEM(rx_test_scripts) * QUIC_PN_SPACE_NUM);
     return 1;
 }
@@ -0,0 +1,317 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <openssl/bio.h>
+#include "internal/packet.h"
+#include "internal/quic_admit.h"
+#include "internal/quic_wire_pkt.h"
+#include "testutil.h"
+
+#define DGRAM_LEN   1200
+
+static OSSL_TIME fake_time;
+
+static OSSL_TIME fake_now(void *arg)
+{
+    return fake_time;
+}
+
+/*
+ * The rate limit slot of each prefix depends on a random hash key. Use a fixed
+ * one, so that whether the prefixes used here share a slot does not vary.
+ */
+static OSSL_LIB_CTX *fixed_libctx;
+static OSSL_PROVIDER *fake_rand;
+
+static int fixed_bytes(unsigned char *out, size_t outlen,
+                       const char *name, EVP_RAND_CTX *ctx)
+{
+    memset(out, 0x5a, outlen);
+    return 1;
+}
+
+static QUIC_DEMUX *demux;
+static int num_received;
+
+static void server_cb(QUIC_URXE *e, void *arg)
+{
+    ++num_received;
+    ossl_quic_demux_release_urxe(demux, e);
+}
+
+static void server_token_cb(QUIC_URXE *e, const QUIC_TOKEN_INFO *info,
+                            void *arg)
+{
+    server_cb(e, arg);
+}
+
+static const unsigned char v4_a[] = { 192, 0, 2, 1 };
+static const unsigned char v4_a2[] = { 192, 0, 2, 200 };
+static const unsigned char v4_b[] = { 198, 51, 100, 1 };
+static const unsigned char v6_a[] = {
+    0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+};
+static const unsigned char v6_a2[] = {
+    0x20, 0x01, 0x0d, 0xb8, 0, 0, 0xff, 0xff, 0, 0, 0, 0, 0, 0, 0, 1
+};
+static const unsigned char v6_b[] = {
+    0x20, 0x01, 0x0d, 0xb8, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+};
+
+#define ADDR(a)     a, sizeof(a)
+
+static const QUIC_CONN_ID dcid = { 8, { 0xa0, 1, 2, 3, 4, 5, 6, 7 } };
+static const QUIC_CONN_ID scid = { 4, { 0xc0, 1, 2, 3 } };
+
+/* Injects an Initial packet from the given source, padded to DGRAM_LEN. */
+static int inject_initial(const unsigned char *ip, size_t ip_len)
+{
+    unsigned char buf[DGRAM_LEN];
+    QUIC_PKT_HDR hdr = {0};
+    BIO_ADDR *peer = NULL;
+    WPACKET wpkt;
+    int hdr_len, ok = 0;
+
+    hdr.type        = QUIC_PKT_TYPE_INITIAL;
+    hdr.fixed       = 1;
+    hdr.version     = QUIC_VERSION_1;
+    hdr.pn_len      = 1;
+    hdr.dst_conn_id = dcid;
+    hdr.src_conn_id = scid;
+    hdr.len         = 1000;
+
+    memset(buf, 0, sizeof(buf));
+    if (!TEST_int_gt(hdr_len = ossl_quic_wire_get_encoded_pkt_hdr_len(0,
+                                                                      &hdr), 0)
+        || !TEST_ptr(peer = BIO_ADDR_new())
+        || !TEST_true(BIO_ADDR_rawmake(peer, ip_len == 4 ? AF_INET : AF_INET6,
+                                       ip, ip_len, htons(4433))))
+        goto err;
+
+    hdr.len = sizeof(buf) - hdr_len;
+    if (!TEST_true(WPACKET_init_static_len(&wpkt, buf, sizeof(buf), 0)))
+        goto err;
+
+    ok = TEST_true(ossl_quic_wire_encode_pkt_hdr(&wpkt, 0, &hdr, NULL))
+         && TEST_true(WPACKET_allocate_bytes(&wpkt, hdr.len, NULL))
+         && TEST_true(ossl_quic_demux_inject(demux, buf, sizeof(buf), peer,
+                                             NULL));
+    WPACKET_cleanup(&wpkt);
+err:
+    BIO_ADDR_free(peer);
+    return ok;
+}
+
+/* Injects num Initial datagrams and checks how many were admitted. */
+static int expect_admitted(const unsigned char *ip, size_t ip_len, int num,
+                           int expect)
+{
+    int i, before = num_received;
+
+    for (i = 0; i < num; ++i)
+        if (!inject_initial(ip, ip_len))
+            return 0;
+
+    return TEST_int_eq(num_received - before, expect);
+}
+
+static int test_admit_rate_limit(void)
+{
+    int testresult = 0;
+    QUIC_ADMIT *admit = NULL;
+    QUIC_ADMIT_STATS stats;
+    unsigned char short_pkt[64] = { 0x40 };
+
+    fake_time = ossl_seconds2time(1000);
+    num_received = 0;
+
+    if (!TEST_ptr(demux = ossl_quic_demux_new(NULL, 8, 1500, NULL, NULL))
+        || !TEST_ptr(admit = ossl_quic_admit_new(fixed_libctx, fake_now,
+                                                  NULL)))
+        goto err;
+
+    /* Nothing to be placed in front of yet. */
+    if (!TEST_false(ossl_quic_admit_install(admit, demux)))
+        goto err;
+
+    ossl_quic_demux_set_default_handler(demux, server_cb, NULL);
+    if (!TEST_true(ossl_quic_admit_install(admit, demux))
+        || !TEST_false(ossl_quic_admit_set_rate_limit(admit, 10, 0, 24, 48))
+        || !TEST_false(ossl_quic_admit_set_rate_limit(admit, 10, 5, 33, 48))
+        || !TEST_true(ossl_quic_admit_set_rate_limit(admit, 10, 5, 24, 48)))
+        goto err;
+
+    /* A burst of 5 is allowed for each prefix. */
+    if (!expect_admitted(ADDR(v4_a), 6, 5)
+        || !expect_admitted(ADDR(v4_a2), 1, 0)
+        || !expect_admitted(ADDR(v4_b), 6, 5)
+        || !expect_admitted(ADDR(v6_a), 6, 5)
+        || !expect_admitted(ADDR(v6_a2), 1, 0)
+        || !expect_admitted(ADDR(v6_b), 6, 5))
+        goto err;
+
+    /* Other packets are not limited. */
+    if (!TEST_true(ossl_quic_demux_inject(demux, short_pkt, sizeof(short_pkt),
+                                          NULL, NULL))
+        || !TEST_int_eq(num_received, 21))
+        goto err;
+
+    /* Thereafter, one Initial datagram per 100ms. */
+    fake_time = ossl_time_add(fake_time, ossl_ms2time(100));
+    if (!expect_admitted(ADDR(v4_a), 2, 1))
+        goto err;
+
+    /* The full burst is available again after an idle period. */
+    fake_time = ossl_time_add(fake_time, ossl_seconds2time(1));
+    if (!expect_admitted(ADDR(v4_a), 6, 5))
+        goto err;
+
+    /* With the limit removed, everything is admitted. */
+    if (!TEST_true(ossl_quic_admit_set_rate_limit(admit, 0, 0, 0, 0))
+        || !expect_admitted(ADDR(v4_a), 6, 6))
+        goto err;
+
+    ossl_quic_admit_get_stats(admit, &stats);
+    if (!TEST_uint64_t_eq(stats.admitted, 32)
+        || !TEST_uint64_t_eq(stats.dropped_rate, 8)
+        || !TEST_uint64_t_eq(stats.dropped_cap, 0))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_admit_free(admit);
+    ossl_quic_demux_free(demux);
+    demux = NULL;
+    return testresult;
+}
+
+static int test_admit_max_handshakes(void)
+{
+    int testresult = 0;
+    QUIC_ADMIT *admit = NULL;
+    QUIC_ADMIT_STATS stats;
+
+    num_received = 0;
+
+    if (!TEST_ptr(demux = ossl_quic_demux_new(NULL, 8, 1500, NULL, NULL))
+        || !TEST_ptr(admit = ossl_quic_admit_new(fixed_libctx, fake_now,
+                                                  NULL)))
+        goto err;
+
+    ossl_quic_demux_set_default_handler(demux, server_cb, NULL);
+    if (!TEST_true(ossl_quic_admit_install(admit, demux)))
+        goto err;
+
+    ossl_quic_admit_set_max_handshakes(admit, 2);
+    ossl_quic_admit_on_handshake_start(admit);
+    if (!expect_admitted(ADDR(v4_a), 1, 1))
+        goto err;
+
+    ossl_quic_admit_on_handshake_start(admit);
+    if (!TEST_size_t_eq(ossl_quic_admit_get_num_handshakes(admit), 2)
+        || !expect_admitted(ADDR(v4_a), 3, 0))
+        goto err;
+
+    ossl_quic_admit_on_handshake_end(admit);
+    if (!expect_admitted(ADDR(v4_a), 1, 1))
+        goto err;
+
+    ossl_quic_admit_get_stats(admit, &stats);
+    if (!TEST_uint64_t_eq(stats.admitted, 2)
+        || !TEST_uint64_t_eq(stats.dropped_cap, 3))
+        goto err;
+
+    /* Freeing the stage restores the handler it was placed in front of. */
+    ossl_quic_admit_free(admit);
+    admit = NULL;
+    if (!expect_admitted(ADDR(v4_a), 3, 3))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_admit_free(admit);
+    ossl_quic_demux_free(demux);
+    demux = NULL;
+    return testresult;
+}
+
+static int test_admit_retry_threshold(void)
+{
+    int testresult = 0;
+    BIO *bio1 = NULL, *bio2 = NULL;
+    QUIC_TOKEN_ENGINE *eng = NULL;
+    QUIC_ADMIT *admit = NULL;
+
+    num_received = 0;
+
+    if (!TEST_true(BIO_new_bio_dgram_pair(&bio1, 0, &bio2, 0))
+        || !TEST_true(BIO_dgram_set_caps(bio2, BIO_DGRAM_CAP_HANDLES_DST_ADDR))
+        || !TEST_ptr(demux = ossl_quic_demux_new(bio1, 8, 1500, NULL, NULL))
+        || !TEST_ptr(eng = ossl_quic_token_engine_new(NULL, NULL, fake_now,
+                                                      NULL))
+        || !TEST_ptr(admit = ossl_quic_admit_new(fixed_libctx, fake_now,
+                                                  NULL))
+        || !TEST_true(ossl_quic_token_engine_set_retry_filter(eng, demux, bio1,
+                                                              server_token_cb,
+                                                              NULL))
+        || !TEST_true(ossl_quic_admit_install(admit, demux)))
+        goto err;
+
+    /* Retry is only required while there are two or more handshakes. */
+    ossl_quic_admit_set_retry_threshold(admit, eng, 2);
+    ossl_quic_admit_on_handshake_start(admit);
+    if (!expect_admitted(ADDR(v4_a), 1, 1)
+        || !TEST_size_t_eq(BIO_ctrl_pending(bio2), 0))
+        goto err;
+
+    ossl_quic_admit_on_handshake_start(admit);
+    if (!expect_admitted(ADDR(v4_a), 1, 0)
+        || !TEST_size_t_gt(BIO_ctrl_pending(bio2), 0))
+        goto err;
+
+    ossl_quic_admit_on_handshake_end(admit);
+    if (!expect_admitted(ADDR(v4_a), 1, 1))
+        goto err;
+
+    /* A threshold of 0 never requires Retry, like the other limits. */
+    ossl_quic_admit_on_handshake_start(admit);
+    ossl_quic_admit_set_retry_threshold(admit, eng, 0);
+    if (!expect_admitted(ADDR(v4_a), 1, 1))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_admit_free(admit);
+    ossl_quic_token_engine_free(eng);
+    ossl_quic_demux_free(demux);
+    demux = NULL;
+    BIO_free(bio1);
+    BIO_free(bio2);
+    return testresult;
+}
+
+int setup_tests(void)
+{
+    if (!TEST_ptr(fixed_libctx = OSSL_LIB_CTX_new())
+        || !TEST_ptr(fake_rand = fake_rand_start(fixed_libctx)))
+        return 0;
+
+    fake_rand_set_public_private_callbacks(fixed_libctx, fixed_bytes);
+
+    ADD_TEST(test_admit_rate_limit);
+    ADD_TEST(test_admit_max_handshakes);
+    ADD_TEST(test_admit_retry_threshold);
+    return 1;
+}
+
+void cleanup_tests(void)
+{
+    fake_rand_finish(fake_rand);
+    OSSL_LIB_CTX_free(fixed_libctx);
+}
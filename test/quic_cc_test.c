@@ -0,0 +1,467 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include "testutil.h"
+#include <openssl/params.h>
+#include "internal/quic_cc.h"
+#include "internal/quic_types.h"
+
+#define MDPL            1200
+#define INITIAL_WINDOW  (10 * MDPL)
+#define MIN_WINDOW      (2 * MDPL)
+
+#define TIME_BASE (ossl_ticks2time(123 * OSSL_TIME_SECOND))
+
+static const OSSL_CC_METHOD *const methods[] = {
+    &ossl_cc_newreno_method,
+    &ossl_cc_cubic_method,
+};
+
+struct cc_helper {
+    const OSSL_CC_METHOD    *method;
+    OSSL_CC_DATA            *cc;
+    size_t                  mdpl;
+    OSSL_PARAM              changeables[2];
+    QUIC_PN                 next_pn;
+};
+
+static int helper_init(struct cc_helper *h, int idx)
+{
+    memset(h, 0, sizeof(*h));
+    h->method           = methods[idx];
+    h->mdpl             = MDPL;
+    h->changeables[0]   = OSSL_PARAM_construct_size_t(OSSL_CC_OPTION_MAX_DGRAM_PAYLOAD_LEN,
+                                                      &h->mdpl);
+    h->changeables[1]   = OSSL_PARAM_construct_end();
+
+    return TEST_ptr(h->cc = h->method->new(NULL, NULL, h->changeables));
+}
+
+static void helper_cleanup(struct cc_helper *h)
+{
+    if (h->cc != NULL)
+        h->method->free(h->cc);
+}
+
+/* Sends whole datagrams until the window is full; returns number sent. */
+static size_t helper_fill_window(struct cc_helper *h)
+{
+    size_t n = 0;
+
+    while (h->method->can_send(h->cc)
+           && h->method->get_send_allowance(h->cc, ossl_time_zero(), 0)
+              >= h->mdpl) {
+        h->method->on_data_sent(h->cc, h->mdpl);
+        ++h->next_pn;
+        ++n;
+    }
+
+    return n;
+}
+
+static int test_cc_slow_start_and_loss(int idx)
+{
+    int testresult = 0;
+    struct cc_helper h;
+    size_t n, cwnd;
+
+    if (!helper_init(&h, idx))
+        goto err;
+
+    /* RFC 9002 initial window. */
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc),
+                        INITIAL_WINDOW))
+        goto err;
+
+    if (!TEST_size_t_eq(n = helper_fill_window(&h), 10)
+        || !TEST_false(h.method->can_send(h.cc))
+        || !TEST_size_t_eq(h.method->get_send_allowance(h.cc,
+                                                        ossl_time_zero(), 0),
+                           0))
+        goto err;
+
+    /* Slow start doubles the window over one round trip. */
+    if (!TEST_true(h.method->on_data_acked(h.cc, TIME_BASE, h.next_pn - 1,
+                                           n * h.mdpl))
+        || !TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc),
+                           2 * INITIAL_WINDOW))
+        goto err;
+
+    /* Exempted probe packets may be sent despite a full window. */
+    helper_fill_window(&h);
+    if (!TEST_false(h.method->can_send(h.cc))
+        || !TEST_true(h.method->set_exemption(h.cc, 2))
+        || !TEST_int_eq(h.method->get_exemption(h.cc), 2)
+        || !TEST_true(h.method->can_send(h.cc)))
+        goto err;
+
+    h.method->on_data_sent(h.cc, h.mdpl);
+    h.method->on_data_sent(h.cc, h.mdpl);
+    h.next_pn += 2;
+    if (!TEST_int_eq(h.method->get_exemption(h.cc), 0)
+        || !TEST_false(h.method->can_send(h.cc)))
+        goto err;
+
+    /* A loss reduces the window and starts a recovery period. */
+    cwnd = h.method->get_bytes_in_flight_max(h.cc);
+    h.method->on_data_lost(h.cc, h.next_pn - 10, h.next_pn - 1, h.mdpl, 0);
+    if (idx == 0) {
+        if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc), cwnd / 2))
+            goto err;
+    } else {
+        if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc),
+                            cwnd * 7 / 10))
+            goto err;
+    }
+
+    cwnd = h.method->get_bytes_in_flight_max(h.cc);
+
+    /* Further losses of packets sent before recovery are ignored. */
+    h.method->on_data_lost(h.cc, h.next_pn - 5, h.next_pn - 1, h.mdpl, 0);
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc), cwnd))
+        goto err;
+
+    /* ACKs of packets sent before recovery do not grow the window. */
+    h.method->on_data_acked(h.cc, TIME_BASE, h.next_pn - 1, 4 * h.mdpl);
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc), cwnd))
+        goto err;
+
+    /* A spurious congestion event restores the previous window. */
+    if (!TEST_true(h.method->on_spurious_congestion_event(h.cc))
+        || !TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc),
+                           2 * INITIAL_WINDOW))
+        goto err;
+
+    /* Persistent congestion collapses the window to the minimum. */
+    h.method->on_data_lost(h.cc, h.next_pn - 1, h.next_pn - 1, 0, 1);
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc), MIN_WINDOW))
+        goto err;
+
+    /* Reset restores the initial state. */
+    h.method->reset(h.cc, 0);
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc),
+                        INITIAL_WINDOW)
+        || !TEST_true(h.method->can_send(h.cc)))
+        goto err;
+
+    testresult = 1;
+err:
+    helper_cleanup(&h);
+    return testresult;
+}
+
+/*
+ * Runs a number of round trips after a single loss and checks that the window
+ * regrows. CUBIC should regain the window it had before the loss within a few
+ * seconds whereas NewReno grows by only one datagram per round trip.
+ */
+static int test_cc_congestion_avoidance(int idx)
+{
+    int testresult = 0, i;
+    struct cc_helper h;
+    size_t n, cwnd_before, cwnd_after, cwnd;
+    OSSL_TIME now = TIME_BASE;
+    const OSSL_TIME rtt = ossl_ms2time(50);
+
+    if (!helper_init(&h, idx))
+        goto err;
+
+    /* Slow start up to 80 datagrams. */
+    for (i = 0; i < 3; ++i) {
+        n = helper_fill_window(&h);
+        now = ossl_time_add(now, rtt);
+        h.method->on_data_acked(h.cc, now, h.next_pn - 1, n * h.mdpl);
+    }
+
+    cwnd_before = h.method->get_bytes_in_flight_max(h.cc);
+    if (!TEST_size_t_eq(cwnd_before, 8 * INITIAL_WINDOW))
+        goto err;
+
+    /* Lose one packet from the next window. */
+    n = helper_fill_window(&h);
+    h.method->on_data_lost(h.cc, h.next_pn - n, h.next_pn - 1, h.mdpl, 0);
+    now = ossl_time_add(now, rtt);
+    h.method->on_data_acked(h.cc, now, h.next_pn - 1, (n - 1) * h.mdpl);
+    cwnd_after = h.method->get_bytes_in_flight_max(h.cc);
+
+    if (!TEST_size_t_lt(cwnd_after, cwnd_before))
+        goto err;
+
+    /* Run for 6 seconds of round trips. */
+    for (i = 0; i < 120; ++i) {
+        n = helper_fill_window(&h);
+        now = ossl_time_add(now, rtt);
+        cwnd = h.method->get_bytes_in_flight_max(h.cc);
+        h.method->on_data_acked(h.cc, now, h.next_pn - 1, n * h.mdpl);
+
+        /* The window never shrinks in the absence of loss. */
+        if (!TEST_size_t_ge(h.method->get_bytes_in_flight_max(h.cc), cwnd))
+            goto err;
+    }
+
+    cwnd = h.method->get_bytes_in_flight_max(h.cc);
+    if (idx == 0) {
+        /* NewReno: about one datagram per RTT. */
+        if (!TEST_size_t_ge(cwnd, cwnd_after + 110 * h.mdpl)
+            || !TEST_size_t_le(cwnd, cwnd_after + 122 * h.mdpl))
+            goto err;
+    } else {
+        /* CUBIC: K is about 3.9s for this window, so we pass W_max. */
+        if (!TEST_size_t_gt(cwnd, cwnd_before))
+            goto err;
+    }
+
+    testresult = 1;
+err:
+    helper_cleanup(&h);
+    return testresult;
+}
+
+/*
+ * Persistent congestion as the first congestion event must still set
+ * ssthresh, so that the window does not go back to unbounded slow start.
+ */
+static int test_cc_persistent_congestion(int idx)
+{
+    int testresult = 0, i;
+    struct cc_helper h;
+    size_t n;
+    OSSL_TIME now = TIME_BASE;
+
+    if (!helper_init(&h, idx))
+        goto err;
+
+    n = helper_fill_window(&h);
+    h.method->on_data_lost(h.cc, h.next_pn - 1, h.next_pn - 1, n * h.mdpl, 1);
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc), MIN_WINDOW))
+        goto err;
+
+    /* Slow start from 2 datagrams would reach 64 in five round trips. */
+    for (i = 0; i < 5; ++i) {
+        n = helper_fill_window(&h);
+        now = ossl_time_add(now, ossl_ms2time(50));
+        h.method->on_data_acked(h.cc, now, h.next_pn - 1, n * h.mdpl);
+    }
+
+    if (!TEST_size_t_lt(h.method->get_bytes_in_flight_max(h.cc),
+                        2 * INITIAL_WINDOW))
+        goto err;
+
+    testresult = 1;
+err:
+    helper_cleanup(&h);
+    return testresult;
+}
+
+/* The maximum datagram payload length is read from the changeables. */
+static int test_cc_changeable_mdpl(int idx)
+{
+    int testresult = 0;
+    struct cc_helper h;
+
+    if (!helper_init(&h, idx))
+        goto err;
+
+    h.mdpl = 1500;
+    h.method->on_data_lost(h.cc, 0, 0, 0, 1);
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc), 2 * 1500))
+        goto err;
+
+    /* min(10 * max_datagram_size, max(14720, 2 * max_datagram_size)) */
+    h.method->reset(h.cc, 0);
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc), 14720))
+        goto err;
+
+    testresult = 1;
+err:
+    helper_cleanup(&h);
+    return testresult;
+}
+
+/*
+ * Simulates a bottleneck link which serves one datagram per millisecond with a
+ * 50ms base RTT, in steps of 100us. BBR should fill the link while keeping the
+ * queue at the bottleneck short, and its pacing rate should track the link
+ * bandwidth.
+ */
+#define SIM_STEP_US         100
+#define SIM_BASE_RTT_MS     50
+#define SIM_LINK_BW         (1000 * MDPL) /* bytes/s */
+#define SIM_MAX_PKTS        4096
+
+struct sim_pkt {
+    OSSL_TIME   sent, acked;
+};
+
+static int test_cc_bbr_bottleneck(void)
+{
+    int testresult = 0;
+    struct cc_helper h;
+    static struct sim_pkt pkts[SIM_MAX_PKTS];
+    size_t head = 0, tail = 0, i, allowance;
+    size_t delivered = 0, max_queue = 0;
+    uint64_t rate;
+    OSSL_TIME now = TIME_BASE, last_send = TIME_BASE, link_free = TIME_BASE;
+    OSSL_TIME queue_delay;
+    const OSSL_TIME step = ossl_us2time(SIM_STEP_US);
+    const OSSL_TIME base_rtt = ossl_ms2time(SIM_BASE_RTT_MS);
+    const OSSL_TIME service = ossl_ms2time(1);
+    const int steps = 4 * 1000000 / SIM_STEP_US;
+    const int measure_from = 2 * 1000000 / SIM_STEP_US;
+    int t;
+
+    memset(&h, 0, sizeof(h));
+    h.method            = &ossl_cc_bbr_method;
+    h.mdpl              = MDPL;
+    h.changeables[0]    = OSSL_PARAM_construct_size_t(OSSL_CC_OPTION_MAX_DGRAM_PAYLOAD_LEN,
+                                                      &h.mdpl);
+    h.changeables[1]    = OSSL_PARAM_construct_end();
+    if (!TEST_ptr(h.cc = h.method->new(NULL, NULL, h.changeables)))
+        goto err;
+
+    for (t = 0; t < steps; ++t) {
+        now = ossl_time_add(now, step);
+
+        /* Deliver ACKs. */
+        while (head != tail
+               && ossl_time_compare(pkts[head].acked, now) <= 0) {
+            h.method->on_rtt_sample(h.cc, now,
+                                    ossl_time_subtract(now, pkts[head].sent));
+            h.method->on_data_acked(h.cc, now, 0, h.mdpl);
+            head = (head + 1) % SIM_MAX_PKTS;
+            if (t >= measure_from)
+                ++delivered;
+        }
+
+        /* Send whatever the controller allows. */
+        allowance = h.method->get_send_allowance(h.cc,
+                                                 ossl_time_subtract(now,
+                                                                    last_send),
+                                                 1);
+        for (i = 0; i + h.mdpl <= allowance; i += h.mdpl) {
+            if (!TEST_size_t_ne((tail + 1) % SIM_MAX_PKTS, head))
+                goto err;
+
+            h.method->on_data_sent(h.cc, h.mdpl);
+            if (ossl_time_compare(link_free, now) < 0)
+                link_free = now;
+
+            link_free = ossl_time_add(link_free, service);
+            pkts[tail].sent  = now;
+            pkts[tail].acked = ossl_time_add(link_free, base_rtt);
+            tail = (tail + 1) % SIM_MAX_PKTS;
+            last_send = now;
+        }
+
+        if (t >= measure_from) {
+            queue_delay = ossl_time_subtract(link_free, now);
+            if (ossl_time2ms(queue_delay) > max_queue)
+                max_queue = (size_t)ossl_time2ms(queue_delay);
+        }
+    }
+
+    /* The link is kept at least 90% utilised. */
+    if (!TEST_size_t_ge(delivered, 1800))
+        goto err;
+
+    /* The standing queue stays well below one BDP. */
+    if (!TEST_size_t_lt(max_queue, SIM_BASE_RTT_MS / 2))
+        goto err;
+
+    /* The pacing rate tracks the bottleneck bandwidth. */
+    rate = h.method->get_pacing_rate(h.cc);
+    if (!TEST_uint64_t_ge(rate, SIM_LINK_BW * 7 / 10)
+        || !TEST_uint64_t_le(rate, SIM_LINK_BW * 16 / 10))
+        goto err;
+
+    testresult = 1;
+err:
+    helper_cleanup(&h);
+    return testresult;
+}
+
+/* BBR bounds inflight on excessive loss and paces its sends. */
+static int test_cc_bbr_loss_and_pacing(void)
+{
+    int testresult = 0;
+    struct cc_helper h;
+    size_t n, cwnd, allowance;
+    uint64_t rate;
+
+    memset(&h, 0, sizeof(h));
+    h.method            = &ossl_cc_bbr_method;
+    h.mdpl              = MDPL;
+    h.changeables[0]    = OSSL_PARAM_construct_size_t(OSSL_CC_OPTION_MAX_DGRAM_PAYLOAD_LEN,
+                                                      &h.mdpl);
+    h.changeables[1]    = OSSL_PARAM_construct_end();
+    if (!TEST_ptr(h.cc = h.method->new(NULL, NULL, h.changeables)))
+        goto err;
+
+    /* Before any ACK, the initial window is paced over kInitialRtt. */
+    if (!TEST_uint64_t_eq(h.method->get_pacing_rate(h.cc),
+                          (uint64_t)INITIAL_WINDOW * 1000000 / 333000
+                          * 277 / 100))
+        goto err;
+
+    if (!TEST_size_t_eq(h.method->get_bytes_in_flight_max(h.cc),
+                        INITIAL_WINDOW)
+        || !TEST_size_t_eq(n = helper_fill_window(&h), 10))
+        goto err;
+
+    h.method->on_rtt_sample(h.cc, TIME_BASE, ossl_ms2time(50));
+    h.method->on_data_acked(h.cc, TIME_BASE, h.next_pn - 1, 5 * h.mdpl);
+
+    /* The pacing rate spreads the window over about one RTT. */
+    if (!TEST_uint64_t_gt(rate = h.method->get_pacing_rate(h.cc), 0))
+        goto err;
+
+    allowance = h.method->get_send_allowance(h.cc, ossl_ms2time(1), 1);
+    if (!TEST_size_t_le(allowance, rate / 1000 + 2 * h.mdpl)
+        || !TEST_size_t_lt(allowance,
+                           h.method->get_send_allowance(h.cc, ossl_time_zero(),
+                                                        0)))
+        goto err;
+
+    /* Losing more than 2% of a round bounds the window below inflight. */
+    helper_fill_window(&h);
+    cwnd = h.method->get_bytes_in_flight_max(h.cc);
+    h.method->on_data_lost(h.cc, h.next_pn - 1, h.next_pn - 1, 2 * h.mdpl, 0);
+    if (!TEST_size_t_lt(h.method->get_bytes_in_flight_max(h.cc), cwnd)
+        || !TEST_size_t_ge(h.method->get_bytes_in_flight_max(h.cc),
+                           4 * h.mdpl))
+        goto err;
+
+    testresult = 1;
+err:
+    helper_cleanup(&h);
+    return testresult;
+}
+
+static int test_cc_by_name(void)
+{
+    return TEST_ptr_eq(ossl_cc_method_by_name("newreno"),
+                       &ossl_cc_newreno_method)
+        && TEST_ptr_eq(ossl_cc_method_by_name("CUBIC"), &ossl_cc_cubic_method)
+        && TEST_ptr_eq(ossl_cc_method_by_name("dummy"), &ossl_cc_dummy_method)
+        && TEST_ptr_eq(ossl_cc_method_by_name("bbr"), &ossl_cc_bbr_method)
+        && TEST_ptr_eq(ossl_cc_method_by_name(NULL), &ossl_cc_newreno_method)
+        && TEST_ptr_null(ossl_cc_method_by_name("nonexistent"));
+}
+
+int setup_tests(void)
+{
+    ADD_ALL_TESTS(test_cc_slow_start_and_loss, OSSL_NELEM(methods));
+    ADD_ALL_TESTS(test_cc_congestion_avoidance, OSSL_NELEM(methods));
+    ADD_ALL_TESTS(test_cc_persistent_congestion, OSSL_NELEM(methods));
+    ADD_ALL_TESTS(test_cc_changeable_mdpl, OSSL_NELEM(methods));
+    ADD_TEST(test_cc_bbr_bottleneck);
+    ADD_TEST(test_cc_bbr_loss_and_pacing);
+    ADD_TEST(test_cc_by_name);
+    return 1;
+}
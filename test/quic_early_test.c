@@ -0,0 +1,188 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include "internal/quic_early.h"
+#include "testutil.h"
+
+static int test_early_params(void)
+{
+    int testresult = 0;
+    QUIC_EARLY_PARAMS params, params2;
+    WPACKET wpkt;
+    PACKET pkt;
+    BUF_MEM *buf = NULL;
+    size_t written;
+    /* initial_max_data = 1000, an unknown parameter, max_streams_uni = 8 */
+    static const unsigned char enc_unknown[] = {
+        0x04, 0x43, 0xe8, 0x40, 0x50, 0x07, 0x09, 0x08
+    };
+    static const unsigned char enc_truncated[] = { 0x04, 0x43 };
+    static const unsigned char enc_bad_cid_limit[] = { 0x0e, 0x01 };
+
+    ossl_quic_early_params_init(&params);
+    if (!TEST_uint64_t_eq(params.active_conn_id_limit, 2))
+        goto err;
+
+    params.init_max_data                    = 1000000;
+    params.init_max_stream_data_bidi_local  = 100000;
+    params.init_max_stream_data_bidi_remote = 200000;
+    params.init_max_stream_data_uni         = 300000;
+    params.init_max_streams_bidi            = 100;
+    params.init_max_streams_uni             = 3;
+    params.active_conn_id_limit             = 8;
+
+    if (!TEST_ptr(buf = BUF_MEM_new())
+        || !TEST_true(WPACKET_init(&wpkt, buf)))
+        goto err;
+
+    if (!TEST_true(ossl_quic_early_params_encode(&wpkt, &params))
+        || !TEST_true(WPACKET_get_total_written(&wpkt, &written))
+        || !TEST_true(WPACKET_finish(&wpkt)))
+        goto err;
+
+    /* A round trip preserves all of the parameters. */
+    if (!TEST_true(PACKET_buf_init(&pkt, (unsigned char *)buf->data, written))
+        || !TEST_true(ossl_quic_early_params_decode(&pkt, &params2))
+        || !TEST_mem_eq(&params, sizeof(params), &params2, sizeof(params2)))
+        goto err;
+
+    if (!TEST_true(PACKET_buf_init(&pkt, enc_unknown, sizeof(enc_unknown)))
+        || !TEST_true(ossl_quic_early_params_decode(&pkt, &params2))
+        || !TEST_uint64_t_eq(params2.init_max_data, 1000)
+        || !TEST_uint64_t_eq(params2.init_max_streams_uni, 8)
+        || !TEST_uint64_t_eq(params2.init_max_streams_bidi, 0)
+        || !TEST_uint64_t_eq(params2.active_conn_id_limit, 2))
+        goto err;
+
+    if (!TEST_true(PACKET_buf_init(&pkt, enc_truncated, sizeof(enc_truncated)))
+        || !TEST_false(ossl_quic_early_params_decode(&pkt, &params2))
+        || !TEST_true(PACKET_buf_init(&pkt, enc_bad_cid_limit,
+                                      sizeof(enc_bad_cid_limit)))
+        || !TEST_false(ossl_quic_early_params_decode(&pkt, &params2)))
+        goto err;
+
+    /* A server may raise limits for 0-RTT, but not lower them. */
+    params2 = params;
+    params2.init_max_data *= 2;
+    if (!TEST_true(ossl_quic_early_params_compatible(&params, &params2)))
+        goto err;
+
+    params2.init_max_streams_uni = 2;
+    if (!TEST_false(ossl_quic_early_params_compatible(&params, &params2)))
+        goto err;
+
+    testresult = 1;
+err:
+    BUF_MEM_free(buf);
+    return testresult;
+}
+
+static OSSL_TIME fake_time;
+
+static OSSL_TIME fake_now(void *arg)
+{
+    return fake_time;
+}
+
+#define WINDOW  (10 * OSSL_TIME_SECOND)
+
+static int check(QUIC_ANTI_REPLAY *ar, unsigned int id, OSSL_TIME issued,
+                 OSSL_TIME client_age)
+{
+    unsigned char buf[4];
+
+    buf[0] = (unsigned char)(id >> 24);
+    buf[1] = (unsigned char)(id >> 16);
+    buf[2] = (unsigned char)(id >> 8);
+    buf[3] = (unsigned char)id;
+    return ossl_quic_anti_replay_check(ar, buf, sizeof(buf), issued,
+                                       client_age);
+}
+
+static int test_anti_replay(void)
+{
+    int testresult = 0;
+    QUIC_ANTI_REPLAY *ar = NULL;
+    QUIC_ANTI_REPLAY_STATS stats;
+    OSSL_TIME issued, age;
+    unsigned int i;
+
+    fake_time = ossl_seconds2time(1000);
+    if (!TEST_ptr(ar = ossl_quic_anti_replay_new(NULL, NULL,
+                                                 ossl_ticks2time(WINDOW),
+                                                 4, fake_now, NULL)))
+        goto err;
+
+    /* A ticket issued 100s ago, with the client's clock in agreement. */
+    issued = ossl_seconds2time(900);
+    age = ossl_seconds2time(100);
+
+    if (!TEST_true(check(ar, 1, issued, age))
+        || !TEST_false(check(ar, 1, issued, age))
+        || !TEST_true(check(ar, 2, issued, age)))
+        goto err;
+
+    /* A ClientHello is only fresh within half a window of when it is due. */
+    if (!TEST_false(check(ar, 3, issued, ossl_seconds2time(94)))
+        || !TEST_false(check(ar, 3, issued, ossl_seconds2time(106)))
+        || !TEST_true(check(ar, 3, issued, ossl_seconds2time(96))))
+        goto err;
+
+    /* The capacity per generation is limited. */
+    if (!TEST_true(check(ar, 4, issued, age))
+        || !TEST_false(check(ar, 5, issued, age)))
+        goto err;
+
+    /* Half a window later, a replay which is still fresh is caught. */
+    fake_time = ossl_time_add(fake_time, ossl_ticks2time(WINDOW / 2));
+    age = ossl_time_add(age, ossl_ticks2time(WINDOW / 2));
+    if (!TEST_false(check(ar, 1, issued, ossl_seconds2time(100)))
+        || !TEST_false(check(ar, 5, issued, age)))
+        goto err;
+
+    /*
+     * After a window, a new generation is started, while the previous one is
+     * still checked.
+     */
+    fake_time = ossl_time_add(fake_time, ossl_ticks2time(WINDOW / 2));
+    age = ossl_time_add(age, ossl_ticks2time(WINDOW / 2));
+    for (i = 5; i < 9; ++i)
+        if (!TEST_true(check(ar, i, issued, age)))
+            goto err;
+
+    if (!TEST_false(check(ar, 9, issued, age))
+        || !TEST_false(check(ar, 1, issued, ossl_seconds2time(105))))
+        goto err;
+
+    /* A window later still, the first generation has been forgotten. */
+    fake_time = ossl_time_add(fake_time, ossl_ticks2time(WINDOW));
+    age = ossl_time_add(age, ossl_ticks2time(WINDOW));
+    if (!TEST_true(check(ar, 1, issued, age))
+        || !TEST_false(check(ar, 5, issued, age)))
+        goto err;
+
+    ossl_quic_anti_replay_get_stats(ar, &stats);
+    if (!TEST_uint64_t_eq(stats.accepted, 9)
+        || !TEST_uint64_t_eq(stats.replayed, 4)
+        || !TEST_uint64_t_eq(stats.stale, 2)
+        || !TEST_uint64_t_eq(stats.full, 3))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_anti_replay_free(ar);
+    return testresult;
+}
+
+int setup_tests(void)
+{
+    ADD_TEST(test_early_params);
+    ADD_TEST(test_anti_replay);
+    return 1;
+}
@@ -624,9 +624,132 @@ static int test_rxfc(int idx)
     return run_rxfc_script(rx_scripts[idx]);
 }
 
+/*
+ * Receives and retires data on a stream up to the credit available, 1ms after
+ * the last call, so that the window is used up well within an RTT.
+ */
+static int consume_window(QUIC_RXFC *stream_rxfc)
+{
+    QUIC_RXFC *conn_rxfc = ossl_quic_rxfc_get_parent(stream_rxfc);
+    uint64_t rwm = ossl_quic_rxfc_get_rwm(stream_rxfc);
+    uint64_t end = ossl_quic_rxfc_get_cwm(stream_rxfc);
+    uint64_t conn_rem = ossl_quic_rxfc_get_cwm(conn_rxfc)
+                        - ossl_quic_rxfc_get_swm(conn_rxfc);
+
+    if (end - ossl_quic_rxfc_get_swm(stream_rxfc) > conn_rem)
+        end = ossl_quic_rxfc_get_swm(stream_rxfc) + conn_rem;
+
+    cur_time = ossl_time_add(cur_time, ossl_ms2time(1));
+    return TEST_true(ossl_quic_rxfc_on_rx_stream_frame(stream_rxfc, end, 0))
+        && TEST_true(ossl_quic_rxfc_on_retire(stream_rxfc, end - rwm,
+                                              ossl_ms2time(100)));
+}
+
+#define BUDGET_INIT_WINDOW  (128 * 1024)
+#define BUDGET_MAX_WINDOW   (16 * 1024 * 1024)
+#define BUDGET_LIMIT        (1024 * 1024)
+
+static int test_rxfc_budget(void)
+{
+    int testresult = 0;
+    QUIC_RXFC_BUDGET *budget = NULL;
+    QUIC_RXFC conn_rxfc[3], stream_rxfc[3];
+    size_t i, num_attached = 0;
+    uint64_t used;
+
+    cur_time = ossl_seconds2time(1);
+
+    if (!TEST_ptr(budget = ossl_quic_rxfc_budget_new(BUDGET_LIMIT)))
+        goto err;
+
+    for (i = 0; i < OSSL_NELEM(conn_rxfc); ++i)
+        if (!TEST_true(ossl_quic_rxfc_init(&conn_rxfc[i], NULL,
+                                           BUDGET_INIT_WINDOW,
+                                           BUDGET_MAX_WINDOW,
+                                           fake_now, NULL))
+            || !TEST_true(ossl_quic_rxfc_init(&stream_rxfc[i], &conn_rxfc[i],
+                                              BUDGET_INIT_WINDOW,
+                                              BUDGET_MAX_WINDOW,
+                                              fake_now, NULL)))
+            goto err;
+
+    /* Only connection-level RXFCs can use a budget. */
+    if (!TEST_false(ossl_quic_rxfc_set_budget(&stream_rxfc[0], budget)))
+        goto err;
+
+    for (num_attached = 0; num_attached < 2; ++num_attached)
+        if (!TEST_true(ossl_quic_rxfc_set_budget(&conn_rxfc[num_attached],
+                                                 budget)))
+            goto err;
+
+    if (!TEST_uint64_t_eq(ossl_quic_rxfc_budget_get_used(budget),
+                          2 * BUDGET_INIT_WINDOW))
+        goto err;
+
+    /* Data retired much faster than the RTT grows each window fourfold. */
+    for (i = 0; i < 2; ++i)
+        if (!consume_window(&stream_rxfc[i])
+            || !TEST_uint64_t_eq(ossl_quic_rxfc_get_window_size(&conn_rxfc[i]),
+                                 4 * BUDGET_INIT_WINDOW))
+            goto err;
+
+    if (!TEST_uint64_t_eq(ossl_quic_rxfc_budget_get_used(budget),
+                          BUDGET_LIMIT))
+        goto err;
+
+    /* With the budget used up, windows cannot grow any further. */
+    if (!consume_window(&stream_rxfc[0])
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_get_window_size(&stream_rxfc[0]),
+                             16 * BUDGET_INIT_WINDOW)
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_get_window_size(&conn_rxfc[0]),
+                             4 * BUDGET_INIT_WINDOW)
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_budget_get_used(budget),
+                             BUDGET_LIMIT))
+        goto err;
+
+    /*
+     * A third connection is charged its initial window regardless, and the
+     * windows above the new fair share give up the excess.
+     */
+    if (!TEST_true(ossl_quic_rxfc_set_budget(&conn_rxfc[2], budget)))
+        goto err;
+
+    ++num_attached;
+    used = BUDGET_LIMIT + BUDGET_INIT_WINDOW;
+    if (!TEST_uint64_t_eq(ossl_quic_rxfc_budget_get_used(budget), used)
+        || !consume_window(&stream_rxfc[0])
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_get_window_size(&conn_rxfc[0]),
+                             BUDGET_LIMIT / 3)
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_budget_get_used(budget),
+                             used - 4 * BUDGET_INIT_WINDOW + BUDGET_LIMIT / 3))
+        goto err;
+
+    /* The new connection can only grow into what is left of the budget. */
+    used = ossl_quic_rxfc_budget_get_used(budget);
+    if (!consume_window(&stream_rxfc[2])
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_get_window_size(&conn_rxfc[2]),
+                             BUDGET_INIT_WINDOW + BUDGET_LIMIT - used)
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_budget_get_used(budget),
+                             BUDGET_LIMIT))
+        goto err;
+
+    testresult = 1;
+err:
+    for (i = 0; i < num_attached; ++i)
+        ossl_quic_rxfc_set_budget(&conn_rxfc[i], NULL);
+
+    if (budget != NULL
+        && !TEST_uint64_t_eq(ossl_quic_rxfc_budget_get_used(budget), 0))
+        testresult = 0;
+
+    ossl_quic_rxfc_budget_free(budget);
+    return testresult;
+}
+
 int setup_tests(void)
 {
     ADD_ALL_TESTS(test_txfc, 2);
     ADD_ALL_TESTS(test_rxfc, OSSL_NELEM(rx_scripts));
+    ADD_TEST(test_rxfc_budget);
     return 1;
 }
@@ -0,0 +1,786 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+/*
+ * Throughput benchmark for the QUIC transport over a simulated network.
+ *
+ * Two endpoints exchange 1-RTT packets through the QTX, QRX and demuxer, over
+ * a pair of links of the deterministic network simulator, with loss detection
+ * and congestion control done by the ACK manager. Application data is carried
+ * in STREAM frames in fixed-size chunks, which are retransmitted when lost;
+ * ACK frames are sent when the ACK manager asks for them, on their own or
+ * along with data. There is no handshake, flow control or stream machinery.
+ *
+ * Two workloads are supported:
+ *
+ *   bulk   the client sends -n bytes to the server (default 10 MB)
+ *   rr     the client makes -n requests (default 1000) of -q bytes, each of
+ *          which the server answers with -a bytes once it has all of it
+ *
+ * The results are reported in virtual time, so they depend only on the
+ * options and the seed and are reproducible, except for the CPU time, which
+ * is the process CPU time spent running the simulation, per byte of
+ * application data delivered.
+ *
+ * This is not run as part of the test suite.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/crypto.h>
+#include "internal/quic_ackm.h"
+#include "internal/quic_cc.h"
+#include "internal/quic_demux.h"
+#include "internal/quic_record_rx.h"
+#include "internal/quic_record_tx.h"
+#include "internal/quic_wire.h"
+#include "internal/quic_wire_pkt.h"
+#include "helpers/quic_netsim.h"
+
+/* Application data per packet, which fits with an ACK frame in 1200 bytes. */
+#define CHUNK_LEN       1100
+#define PN_LEN          4
+#define MAX_ACK_RANGES  64
+#define PKT_BUF_LEN     1472
+
+/* Header, PN and AEAD tag of a 1-RTT packet with an empty DCID. */
+#define PKT_OVERHEAD    (1 + PN_LEN + 16)
+
+/* Per-chunk state of the message being sent. */
+#define CHUNK_ACKED     1
+#define CHUNK_QUEUED    2
+
+/* Give up if the simulation runs this long in virtual time. */
+#define MAX_VIRTUAL_TIME    (3600 * OSSL_TIME_SECOND)
+
+static const unsigned char secret[32] = {
+    0x53, 0xf2, 0x1b, 0x94, 0xa7, 0x65, 0xf7, 0x76, 0xfb, 0x06, 0x27, 0xaa,
+    0xd2, 0x3f, 0xe0, 0x9a, 0xbb, 0xcf, 0x99, 0x6f, 0x13, 0x2c, 0x6a, 0x37,
+    0x95, 0xf3, 0xda, 0x21, 0xcb, 0xcb, 0xa5, 0x26,
+};
+
+static const unsigned char zero_chunk[CHUNK_LEN];
+static const QUIC_CONN_ID empty_conn_id;
+
+typedef struct bench_ep_st BENCH_EP;
+
+typedef struct bench_pkt_st BENCH_PKT;
+
+struct bench_pkt_st {
+    OSSL_ACKM_TX_PKT    ackm_pkt;
+    BENCH_EP            *ep;
+    BENCH_PKT           *prev, *next;   /* in the list of packets in the ACKM */
+    uint64_t            msg;    /* message the chunk belongs to */
+    size_t              chunk;  /* SIZE_MAX if the packet has no data */
+};
+
+struct bench_ep_st {
+    const OSSL_CC_METHOD    *cc_method;
+    QUIC_DEMUX              *demux;
+    OSSL_QRX                *qrx;
+    OSSL_QTX                *qtx;
+    OSSL_STATM              statm;
+    OSSL_CC_DATA            *cc;
+    OSSL_ACKM               *ackm;
+    QUIC_PN                 next_pn;
+    BENCH_PKT               *pkts;  /* packets tracked by the ACKM */
+
+    /* Message being sent, which has stream ID tx_msg. */
+    uint64_t                tx_msg;
+    size_t                  tx_len, tx_num_chunks, tx_next, tx_num_acked;
+    unsigned char           *tx_state;
+    size_t                  *rtx;           /* ring of chunks to resend */
+    size_t                  rtx_head, rtx_len, max_chunks;
+    int                     tx_active;
+
+    /* Message being received. */
+    uint64_t                rx_msg;
+    size_t                  rx_num_chunks, rx_num_got;
+    unsigned char           *rx_got;
+    int                     rx_active;
+
+    /* Statistics. */
+    uint64_t                data_pkts, ack_only_pkts, ack_only_bytes;
+    uint64_t                ack_frames, ack_frame_bytes;
+    uint64_t                data_bytes_sent, chunks_lost;
+};
+
+static NETSIM *sim;
+
+static OSSL_TIME now(void)
+{
+    return netsim_now(sim);
+}
+
+static OSSL_TIME ackm_now(void *arg)
+{
+    return netsim_now(sim);
+}
+
+static void pkt_free(BENCH_PKT *p)
+{
+    if (p->prev != NULL)
+        p->prev->next = p->next;
+    else
+        p->ep->pkts = p->next;
+    if (p->next != NULL)
+        p->next->prev = p->prev;
+
+    OPENSSL_free(p);
+}
+
+static void on_acked(void *arg)
+{
+    BENCH_PKT *p = arg;
+    BENCH_EP *ep = p->ep;
+
+    if (p->chunk != SIZE_MAX && ep->tx_active && p->msg == ep->tx_msg
+        && (ep->tx_state[p->chunk] & CHUNK_ACKED) == 0) {
+        ep->tx_state[p->chunk] |= CHUNK_ACKED;
+        ++ep->tx_num_acked;
+    }
+
+    pkt_free(p);
+}
+
+static void on_lost(void *arg)
+{
+    BENCH_PKT *p = arg;
+    BENCH_EP *ep = p->ep;
+
+    if (p->chunk != SIZE_MAX && ep->tx_active && p->msg == ep->tx_msg
+        && ep->tx_state[p->chunk] == 0) {
+        ep->tx_state[p->chunk] |= CHUNK_QUEUED;
+        ep->rtx[(ep->rtx_head + ep->rtx_len++) % ep->max_chunks] = p->chunk;
+        ++ep->chunks_lost;
+    }
+
+    pkt_free(p);
+}
+
+static void on_discarded(void *arg)
+{
+    pkt_free(arg);
+}
+
+static int ep_init(BENCH_EP *ep, const OSSL_CC_METHOD *cc_method,
+                   size_t max_msg_len)
+{
+    OSSL_QRX_ARGS rx_args = {0};
+
+    ep->cc_method   = cc_method;
+    ep->max_chunks  = (max_msg_len + CHUNK_LEN - 1) / CHUNK_LEN;
+
+    if ((ep->demux = ossl_quic_demux_new(NULL, 0, 1500, netsim_now,
+                                         sim)) == NULL)
+        return 0;
+
+    rx_args.demux           = ep->demux;
+    rx_args.max_deferred    = 32;
+    if ((ep->qrx = ossl_qrx_new(&rx_args)) == NULL
+        || !ossl_qrx_add_dst_conn_id(ep->qrx, &empty_conn_id)
+        || !ossl_qrx_provide_secret(ep->qrx, QUIC_ENC_LEVEL_1RTT,
+                                    QRL_SUITE_AES128GCM, NULL, secret,
+                                    sizeof(secret)))
+        return 0;
+
+    if (!ossl_statm_init(&ep->statm)
+        || (ep->cc = cc_method->new(NULL, NULL, NULL)) == NULL
+        || (ep->ackm = ossl_ackm_new(ackm_now, NULL, &ep->statm, cc_method,
+                                     ep->cc)) == NULL
+        || !ossl_ackm_on_handshake_confirmed(ep->ackm))
+        return 0;
+
+    ep->tx_state    = OPENSSL_zalloc(ep->max_chunks);
+    ep->rtx         = OPENSSL_zalloc(ep->max_chunks * sizeof(*ep->rtx));
+    ep->rx_got      = OPENSSL_zalloc(ep->max_chunks);
+    return ep->tx_state != NULL && ep->rtx != NULL && ep->rx_got != NULL;
+}
+
+/* Creates the QTX sending over the link with the given BIO. */
+static int ep_set_bio(BENCH_EP *ep, BIO *bio)
+{
+    OSSL_QTX_ARGS tx_args = {0};
+
+    tx_args.mdpl    = PKT_BUF_LEN;
+    tx_args.bio     = bio;
+    return (ep->qtx = ossl_qtx_new(&tx_args)) != NULL
+        && ossl_qtx_provide_secret(ep->qtx, QUIC_ENC_LEVEL_1RTT,
+                                   QRL_SUITE_AES128GCM, NULL, secret,
+                                   sizeof(secret));
+}
+
+static void ep_cleanup(BENCH_EP *ep)
+{
+    ossl_ackm_free(ep->ackm);
+    while (ep->pkts != NULL)
+        pkt_free(ep->pkts);
+    if (ep->cc != NULL)
+        ep->cc_method->free(ep->cc);
+    ossl_statm_destroy(&ep->statm);
+    if (ep->qtx != NULL)
+        ossl_qtx_free(ep->qtx);
+    ossl_qrx_free(ep->qrx);
+    ossl_quic_demux_free(ep->demux);
+    OPENSSL_free(ep->tx_state);
+    OPENSSL_free(ep->rtx);
+    OPENSSL_free(ep->rx_got);
+}
+
+static void ep_start_tx(BENCH_EP *ep, uint64_t msg, size_t len)
+{
+    ep->tx_msg          = msg;
+    ep->tx_len          = len;
+    ep->tx_num_chunks   = (len + CHUNK_LEN - 1) / CHUNK_LEN;
+    ep->tx_next         = 0;
+    ep->tx_num_acked    = 0;
+    ep->rtx_head        = 0;
+    ep->rtx_len         = 0;
+    ep->tx_active       = 1;
+    memset(ep->tx_state, 0, ep->tx_num_chunks);
+}
+
+static int ep_tx_done(const BENCH_EP *ep)
+{
+    return ep->tx_num_acked == ep->tx_num_chunks;
+}
+
+static void ep_start_rx(BENCH_EP *ep, uint64_t msg, size_t len)
+{
+    ep->rx_msg          = msg;
+    ep->rx_num_chunks   = (len + CHUNK_LEN - 1) / CHUNK_LEN;
+    ep->rx_num_got      = 0;
+    ep->rx_active       = 1;
+    memset(ep->rx_got, 0, ep->rx_num_chunks);
+}
+
+static int ep_rx_done(const BENCH_EP *ep)
+{
+    return ep->rx_num_got == ep->rx_num_chunks;
+}
+
+/* Returns the next chunk to send, or SIZE_MAX if there is none. */
+static size_t ep_next_chunk(BENCH_EP *ep, int consume)
+{
+    size_t chunk;
+
+    if (!ep->tx_active)
+        return SIZE_MAX;
+
+    /* Retransmissions first, skipping chunks acked since they were lost. */
+    while (ep->rtx_len > 0) {
+        chunk = ep->rtx[ep->rtx_head];
+        if ((ep->tx_state[chunk] & CHUNK_ACKED) == 0) {
+            if (consume) {
+                ep->tx_state[chunk] &= ~CHUNK_QUEUED;
+                ep->rtx_head = (ep->rtx_head + 1) % ep->max_chunks;
+                --ep->rtx_len;
+            }
+            return chunk;
+        }
+
+        ep->tx_state[chunk] &= ~CHUNK_QUEUED;
+        ep->rtx_head = (ep->rtx_head + 1) % ep->max_chunks;
+        --ep->rtx_len;
+    }
+
+    if (ep->tx_next < ep->tx_num_chunks)
+        return consume ? ep->tx_next++ : ep->tx_next;
+
+    return SIZE_MAX;
+}
+
+/*
+ * Sends one packet, with an ACK frame if with_ack is set and the chunk given
+ * unless it is SIZE_MAX, or a PING frame if neither.
+ */
+static int ep_send_pkt(BENCH_EP *ep, int with_ack, size_t chunk)
+{
+    unsigned char buf[PKT_BUF_LEN];
+    WPACKET wpkt;
+    size_t len = 0, ack_len = 0;
+    const OSSL_QUIC_FRAME_ACK *ack;
+    OSSL_QUIC_FRAME_STREAM f = {0};
+    QUIC_PKT_HDR hdr = {0};
+    OSSL_QTX_IOVEC iovec;
+    OSSL_QTX_PKT pkt = {0};
+    BENCH_PKT *p;
+
+    if ((p = OPENSSL_zalloc(sizeof(*p))) == NULL)
+        return 0;
+
+    p->ep                           = ep;
+    p->msg                          = ep->tx_msg;
+    p->chunk                        = chunk;
+    p->ackm_pkt.largest_acked       = QUIC_PN_INVALID;
+
+    if (!WPACKET_init_static_len(&wpkt, buf, sizeof(buf), 0))
+        goto err;
+
+    if (with_ack) {
+        ack = ossl_ackm_get_ack_frame(ep->ackm, QUIC_PN_SPACE_APP);
+        if (ack == NULL || !ossl_quic_wire_encode_frame_ack(&wpkt, 3, ack)
+            || !WPACKET_get_total_written(&wpkt, &ack_len))
+            goto err;
+
+        p->ackm_pkt.largest_acked = ack->ack_ranges[0].end;
+        ++ep->ack_frames;
+        ep->ack_frame_bytes += ack_len;
+    }
+
+    if (chunk != SIZE_MAX) {
+        f.stream_id         = ep->tx_msg;
+        f.offset            = (uint64_t)chunk * CHUNK_LEN;
+        f.len               = ep->tx_len - f.offset;
+        if (f.len > CHUNK_LEN)
+            f.len = CHUNK_LEN;
+        f.data              = zero_chunk;
+        f.has_explicit_len  = 1;
+        f.is_fin            = chunk == ep->tx_num_chunks - 1;
+        if (ossl_quic_wire_encode_frame_stream(&wpkt, &f) == NULL)
+            goto err;
+
+        ep->data_bytes_sent += f.len;
+    } else if (!with_ack && !ossl_quic_wire_encode_frame_ping(&wpkt)) {
+        goto err;
+    }
+
+    if (!WPACKET_get_total_written(&wpkt, &len)
+        || !WPACKET_finish(&wpkt))
+        goto err;
+
+    hdr.type        = QUIC_PKT_TYPE_1RTT;
+    hdr.pn_len      = PN_LEN;
+    hdr.dst_conn_id = empty_conn_id;
+
+    iovec.buf       = buf;
+    iovec.buf_len   = len;
+    pkt.hdr         = &hdr;
+    pkt.iovec       = &iovec;
+    pkt.num_iovec   = 1;
+    pkt.pn          = ep->next_pn;
+
+    if (!ossl_qtx_write_pkt(ep->qtx, &pkt))
+        goto err;
+
+    ossl_qtx_finish_dgram(ep->qtx);
+    ossl_qtx_flush_net(ep->qtx);
+
+    p->ackm_pkt.pkt_num             = ep->next_pn++;
+    p->ackm_pkt.pkt_space           = QUIC_PN_SPACE_APP;
+    p->ackm_pkt.num_bytes           = len + PKT_OVERHEAD;
+    p->ackm_pkt.time                = now();
+    p->ackm_pkt.is_inflight         = len > ack_len;
+    p->ackm_pkt.is_ack_eliciting    = len > ack_len;
+    p->ackm_pkt.on_acked            = on_acked;
+    p->ackm_pkt.on_lost             = on_lost;
+    p->ackm_pkt.on_discarded        = on_discarded;
+    p->ackm_pkt.cb_arg              = p;
+
+    if (len > ack_len) {
+        ++ep->data_pkts;
+    } else {
+        ++ep->ack_only_pkts;
+        ep->ack_only_bytes += len + PKT_OVERHEAD;
+    }
+
+    if (!ossl_ackm_on_tx_packet(ep->ackm, &p->ackm_pkt))
+        goto err;
+
+    p->next = ep->pkts;
+    if (ep->pkts != NULL)
+        ep->pkts->prev = p;
+    ep->pkts = p;
+
+    return netsim_poll(sim);
+
+err:
+    OPENSSL_free(p);
+    return 0;
+}
+
+/* Sends whatever the ACK manager and congestion controller allow. */
+static int ep_send(BENCH_EP *ep)
+{
+    OSSL_ACKM_PROBE_INFO probe;
+    size_t chunk, allowance;
+    int want_ack;
+
+    /* A PTO probe is sent regardless of the congestion window. */
+    if (!ossl_ackm_get_probe_request(ep->ackm, 1, &probe))
+        return 0;
+
+    if (probe.pto[QUIC_PN_SPACE_APP] > 0
+        && !ep_send_pkt(ep, 0, ep_next_chunk(ep, 1)))
+        return 0;
+
+    for (;;) {
+        want_ack = ossl_ackm_is_ack_desired(ep->ackm, QUIC_PN_SPACE_APP);
+        allowance = ep->cc_method->get_send_allowance(ep->cc,
+                                                      ossl_time_zero(), 0);
+
+        chunk = ep_next_chunk(ep, 0);
+        if (chunk != SIZE_MAX && allowance < CHUNK_LEN + PKT_OVERHEAD)
+            chunk = SIZE_MAX;
+
+        if (chunk == SIZE_MAX && !want_ack)
+            return 1;
+
+        if (chunk != SIZE_MAX)
+            ep_next_chunk(ep, 1);
+
+        if (!ep_send_pkt(ep, want_ack, chunk))
+            return 0;
+    }
+}
+
+static int ep_process_frames(BENCH_EP *ep, const OSSL_QRX_PKT *qpkt,
+                             int *ack_eliciting)
+{
+    PACKET pkt;
+    uint64_t type, total_ranges;
+    OSSL_QUIC_ACK_RANGE ranges[MAX_ACK_RANGES];
+    OSSL_QUIC_FRAME_ACK ack;
+    OSSL_QUIC_FRAME_STREAM f;
+    size_t chunk;
+
+    *ack_eliciting = 0;
+    if (!PACKET_buf_init(&pkt, qpkt->hdr->data, qpkt->hdr->len))
+        return 0;
+
+    while (PACKET_remaining(&pkt) > 0) {
+        if (!ossl_quic_wire_peek_frame_header(&pkt, &type))
+            return 0;
+
+        switch (type) {
+        case OSSL_QUIC_FRAME_TYPE_PADDING:
+            ossl_quic_wire_decode_padding(&pkt);
+            break;
+
+        case OSSL_QUIC_FRAME_TYPE_PING:
+            if (!ossl_quic_wire_decode_frame_ping(&pkt))
+                return 0;
+            *ack_eliciting = 1;
+            break;
+
+        case OSSL_QUIC_FRAME_TYPE_ACK_WITHOUT_ECN:
+        case OSSL_QUIC_FRAME_TYPE_ACK_WITH_ECN:
+            memset(&ack, 0, sizeof(ack));
+            ack.ack_ranges      = ranges;
+            ack.num_ack_ranges  = OSSL_NELEM(ranges);
+            if (!ossl_quic_wire_decode_frame_ack(&pkt, 3, &ack, &total_ranges)
+                || !ossl_ackm_on_rx_ack_frame(ep->ackm, &ack,
+                                              QUIC_PN_SPACE_APP, qpkt->time))
+                return 0;
+            break;
+
+        default:
+            if ((type & ~OSSL_QUIC_FRAME_FLAG_STREAM_MASK)
+                != OSSL_QUIC_FRAME_TYPE_STREAM)
+                return 0;
+
+            if (!ossl_quic_wire_decode_frame_stream(&pkt, &f))
+                return 0;
+
+            *ack_eliciting = 1;
+            chunk = (size_t)(f.offset / CHUNK_LEN);
+            if (ep->rx_active && f.stream_id == ep->rx_msg
+                && chunk < ep->rx_num_chunks && !ep->rx_got[chunk]) {
+                ep->rx_got[chunk] = 1;
+                ++ep->rx_num_got;
+            }
+            break;
+        }
+    }
+
+    return 1;
+}
+
+static int ep_recv(BENCH_EP *ep)
+{
+    OSSL_QRX_PKT qpkt;
+    OSSL_ACKM_RX_PKT rx;
+    int ack_eliciting, ok;
+
+    while (ossl_qrx_read_pkt(ep->qrx, &qpkt)) {
+        ok = 1;
+        if (ossl_ackm_is_rx_pn_processable(ep->ackm, qpkt.pn,
+                                           QUIC_PN_SPACE_APP)) {
+            memset(&rx, 0, sizeof(rx));
+            rx.pkt_num          = qpkt.pn;
+            rx.time             = qpkt.time;
+            rx.pkt_space        = QUIC_PN_SPACE_APP;
+
+            ok = ep_process_frames(ep, &qpkt, &ack_eliciting);
+            rx.is_ack_eliciting = ack_eliciting;
+            ok = ok && ossl_ackm_on_rx_packet(ep->ackm, &rx);
+        }
+
+        ossl_qrx_release_pkt(ep->qrx, qpkt.handle);
+        if (!ok)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Fires the ACK manager's loss detection timer if it has expired. */
+static int ep_timeout(BENCH_EP *ep)
+{
+    OSSL_TIME deadline = ossl_ackm_get_loss_detection_deadline(ep->ackm);
+
+    if (ossl_time_is_zero(deadline)
+        || ossl_time_compare(deadline, now()) > 0)
+        return 1;
+
+    return ossl_ackm_on_timeout(ep->ackm);
+}
+
+static OSSL_TIME ep_next_deadline(BENCH_EP *ep)
+{
+    OSSL_TIME t = ossl_ackm_get_loss_detection_deadline(ep->ackm);
+
+    if (ossl_time_is_zero(t))
+        t = ossl_time_infinite();
+
+    return ossl_time_min(t, ossl_ackm_get_ack_deadline(ep->ackm,
+                                                       QUIC_PN_SPACE_APP));
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-w bulk|rr] [-n bytes|requests] [-q req-len] "
+            "[-a resp-len]\n"
+            "       [-d delay-ms] [-B Mbit/s] [-Q queue-pkts] [-l loss%%] "
+            "[-r reorder%%]\n"
+            "       [-c cc] [-s seed]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    const char *workload = "bulk", *cc_name = NULL;
+    uint64_t n = 0, seed = 1, num_done = 0, app_bytes, ns;
+    size_t req_len = 100, resp_len = 10000, max_msg_len, i;
+    double loss_pct = 0, reorder_pct = 0, mbps = 100;
+    unsigned int delay_ms = 20, queue_pkts = 0;
+    int c, rr, ret = EXIT_FAILURE;
+    const OSSL_CC_METHOD *cc_method;
+    NETSIM_LINK_ARGS args = {0};
+    NETSIM_LINK_STATS st[2];
+    BENCH_EP client = {0}, server = {0};
+    BIO *c2s, *s2c;
+    OSSL_TIME start, t, elapsed, req_start = ossl_time_zero();
+    OSSL_TIME total_latency = ossl_time_zero();
+    clock_t cpu_start, cpu;
+
+    for (c = 1; c < argc; c += 2) {
+        if (c + 1 >= argc || argv[c][0] != '-' || argv[c][2] != '\0')
+            usage(argv[0]);
+
+        switch (argv[c][1]) {
+        case 'w':
+            workload = argv[c + 1];
+            break;
+        case 'n':
+            n = strtoull(argv[c + 1], NULL, 0);
+            break;
+        case 'q':
+            req_len = (size_t)strtoull(argv[c + 1], NULL, 0);
+            break;
+        case 'a':
+            resp_len = (size_t)strtoull(argv[c + 1], NULL, 0);
+            break;
+        case 'd':
+            delay_ms = (unsigned int)atoi(argv[c + 1]);
+            break;
+        case 'B':
+            mbps = atof(argv[c + 1]);
+            break;
+        case 'Q':
+            queue_pkts = (unsigned int)atoi(argv[c + 1]);
+            break;
+        case 'l':
+            loss_pct = atof(argv[c + 1]);
+            break;
+        case 'r':
+            reorder_pct = atof(argv[c + 1]);
+            break;
+        case 'c':
+            cc_name = argv[c + 1];
+            break;
+        case 's':
+            seed = strtoull(argv[c + 1], NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    rr = strcmp(workload, "rr") == 0;
+    if ((!rr && strcmp(workload, "bulk") != 0)
+        || req_len == 0 || resp_len == 0
+        || (cc_method = ossl_cc_method_by_name(cc_name)) == NULL)
+        usage(argv[0]);
+
+    if (n == 0)
+        n = rr ? 1000 : 10 * 1024 * 1024;
+
+    if (!rr && n > SIZE_MAX / 2)
+        usage(argv[0]);
+
+    max_msg_len = rr ? (req_len > resp_len ? req_len : resp_len) : (size_t)n;
+
+    start = ossl_seconds2time(1);
+    if ((sim = netsim_new(seed, start)) == NULL)
+        goto err;
+
+    args.latency        = ossl_ms2time(delay_ms);
+    args.bandwidth      = (uint64_t)(mbps * 1000000 / 8);
+    args.queue_limit    = (size_t)queue_pkts * PKT_BUF_LEN;
+    args.loss_ppm       = (uint32_t)(loss_pct * 10000);
+    args.reorder_ppm    = (uint32_t)(reorder_pct * 10000);
+    args.reorder_delay  = ossl_ms2time(delay_ms / 4 + 1);
+
+    if (!ep_init(&client, cc_method, max_msg_len)
+        || !ep_init(&server, cc_method, max_msg_len)
+        || !netsim_add_link(sim, &args, server.demux, &c2s, NULL)
+        || !netsim_add_link(sim, &args, client.demux, &s2c, NULL)
+        || !ep_set_bio(&client, c2s)
+        || !ep_set_bio(&server, s2c))
+        goto err;
+
+    cpu_start = clock();
+
+    if (rr) {
+        ep_start_tx(&client, 0, req_len);
+        ep_start_rx(&server, 0, req_len);
+        req_start = now();
+    } else {
+        ep_start_tx(&client, 0, (size_t)n);
+        ep_start_rx(&server, 0, (size_t)n);
+    }
+
+    for (;;) {
+        if (!ep_recv(&client) || !ep_recv(&server)
+            || !ep_timeout(&client) || !ep_timeout(&server))
+            goto err;
+
+        if (rr) {
+            /* Answer a request once it has all arrived. */
+            if (server.rx_active && ep_rx_done(&server)) {
+                server.rx_active = 0;
+                ep_start_tx(&server, 4 * num_done + 1, resp_len);
+                ep_start_rx(&client, 4 * num_done + 1, resp_len);
+            }
+
+            /* Make the next request once the response has all arrived. */
+            if (client.rx_active && ep_rx_done(&client)) {
+                client.rx_active = 0;
+                total_latency = ossl_time_add(total_latency,
+                                              ossl_time_subtract(now(),
+                                                                 req_start));
+                if (++num_done == n)
+                    break;
+
+                ep_start_tx(&client, 4 * num_done, req_len);
+                ep_start_rx(&server, 4 * num_done, req_len);
+                req_start = now();
+            }
+        } else if (ep_tx_done(&client)) {
+            break;
+        }
+
+        if (!ep_send(&client) || !ep_send(&server))
+            goto err;
+
+        t = ossl_time_min(netsim_next_event(sim),
+                          ossl_time_min(ep_next_deadline(&client),
+                                        ep_next_deadline(&server)));
+        if (ossl_time_compare(t, now()) < 0)
+            t = now();
+
+        if (ossl_time_compare(ossl_time_subtract(t, start),
+                              ossl_ticks2time(MAX_VIRTUAL_TIME)) > 0) {
+            fprintf(stderr, "simulation stalled\n");
+            goto err;
+        }
+
+        if (!netsim_advance(sim, t))
+            goto err;
+    }
+
+    cpu = clock() - cpu_start;
+    elapsed = ossl_time_subtract(now(), start);
+    if (ossl_time_is_zero(elapsed))
+        elapsed = ossl_ticks2time(1);
+
+    app_bytes = rr ? n * (req_len + resp_len) : n;
+    ns = (uint64_t)((double)cpu * 1e9 / CLOCKS_PER_SEC);
+
+    for (i = 0; i < 2; ++i)
+        netsim_get_link_stats(sim, i, &st[i]);
+
+    printf("workload:     %s, ", workload);
+    if (rr)
+        printf("%llu requests of %zu bytes, responses of %zu bytes\n",
+               (unsigned long long)n, req_len, resp_len);
+    else
+        printf("%llu bytes\n", (unsigned long long)n);
+    printf("network:      delay %u ms, %.1f Mbit/s, queue %u pkts, "
+           "loss %.2f%%, reorder %.2f%%, cc %s\n",
+           delay_ms, mbps, queue_pkts, loss_pct, reorder_pct,
+           cc_name != NULL ? cc_name : "default");
+    printf("virtual time: %.3f s\n", ossl_time2ticks(elapsed) / 1e9);
+    printf("goodput:      %.2f Mbit/s\n",
+           (double)app_bytes * 8 * 1e3 / ossl_time2ticks(elapsed));
+    if (rr)
+        printf("latency:      %.3f ms per request\n",
+               ossl_time2ticks(total_latency) / 1e6 / n);
+    printf("cpu:          %.3f s, %.2f ns/byte\n", ns / 1e9,
+           (double)ns / app_bytes);
+    printf("data pkts:    %llu + %llu, %llu chunks lost, "
+           "%llu bytes retransmitted\n",
+           (unsigned long long)client.data_pkts,
+           (unsigned long long)server.data_pkts,
+           (unsigned long long)(client.chunks_lost + server.chunks_lost),
+           (unsigned long long)(client.data_bytes_sent
+                                + server.data_bytes_sent - app_bytes));
+    printf("ack frames:   %llu, %llu bytes (%.3f%% of app data)\n",
+           (unsigned long long)(client.ack_frames + server.ack_frames),
+           (unsigned long long)(client.ack_frame_bytes
+                                + server.ack_frame_bytes),
+           100.0 * (client.ack_frame_bytes + server.ack_frame_bytes)
+           / app_bytes);
+    printf("ack-only:     %llu pkts, %llu bytes (%.3f%% of app data)\n",
+           (unsigned long long)(client.ack_only_pkts + server.ack_only_pkts),
+           (unsigned long long)(client.ack_only_bytes
+                                + server.ack_only_bytes),
+           100.0 * (client.ack_only_bytes + server.ack_only_bytes)
+           / app_bytes);
+    for (i = 0; i < 2; ++i)
+        printf("link %s:   %llu dgrams, %llu lost, %llu dropped, "
+               "%llu reordered\n", i == 0 ? "c->s" : "s->c",
+               (unsigned long long)st[i].dgrams_sent,
+               (unsigned long long)st[i].dgrams_lost,
+               (unsigned long long)st[i].dgrams_dropped,
+               (unsigned long long)st[i].dgrams_reordered);
+
+    ret = EXIT_SUCCESS;
+err:
+    if (ret != EXIT_SUCCESS)
+        fprintf(stderr, "benchmark failed\n");
+
+    ep_cleanup(&client);
+    ep_cleanup(&server);
+    netsim_free(sim);
+    return ret;
+}
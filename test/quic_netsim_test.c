@@ -0,0 +1,211 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include "helpers/quic_netsim.h"
+#include "testutil.h"
+
+#define MAX_RX  1024
+
+struct rx_log {
+    QUIC_DEMUX  *demux;
+    size_t      num;
+    OSSL_TIME   time[MAX_RX];
+    uint32_t    id[MAX_RX];     /* bytes 1 to 4 of each datagram */
+};
+
+static void rx_cb(QUIC_URXE *e, void *arg)
+{
+    struct rx_log *log = arg;
+    const unsigned char *data = ossl_quic_urxe_data(e);
+
+    if (log->num < MAX_RX) {
+        log->time[log->num] = e->time;
+        log->id[log->num]   = ((uint32_t)data[1] << 24) | (data[2] << 16)
+                              | (data[3] << 8) | data[4];
+        ++log->num;
+    }
+
+    ossl_quic_demux_release_urxe(log->demux, e);
+}
+
+static int send_dgram(NETSIM *sim, BIO *bio, uint32_t id, size_t len)
+{
+    unsigned char buf[1200] = {0};
+
+    /* A short header, so that the demuxer hands it to the default handler. */
+    buf[0] = 0x40;
+    buf[1] = (unsigned char)(id >> 24);
+    buf[2] = (unsigned char)(id >> 16);
+    buf[3] = (unsigned char)(id >> 8);
+    buf[4] = (unsigned char)id;
+    return TEST_size_t_le(len, sizeof(buf))
+        && TEST_int_eq(BIO_write(bio, buf, (int)len), (int)len)
+        && TEST_true(netsim_poll(sim));
+}
+
+/* Runs the simulation until everything in flight has been delivered. */
+static int run(NETSIM *sim)
+{
+    OSSL_TIME t;
+
+    while (!ossl_time_is_infinite(t = netsim_next_event(sim)))
+        if (!TEST_true(netsim_advance(sim, t)))
+            return 0;
+
+    return 1;
+}
+
+static int setup(NETSIM **psim, struct rx_log *log, uint64_t seed,
+                 const NETSIM_LINK_ARGS *args, BIO **pbio)
+{
+    memset(log, 0, sizeof(*log));
+    return TEST_ptr(*psim = netsim_new(seed, ossl_seconds2time(1)))
+        && TEST_ptr(log->demux = ossl_quic_demux_new(NULL, 0, 1500,
+                                                     netsim_now, *psim))
+        && TEST_true(netsim_add_link(*psim, args, log->demux, pbio, NULL));
+}
+
+static void teardown(NETSIM *sim, struct rx_log *log)
+{
+    netsim_free(sim);
+    ossl_quic_demux_free(log->demux);
+}
+
+static int test_netsim_link(void)
+{
+    int testresult = 0;
+    NETSIM *sim = NULL;
+    NETSIM_LINK_ARGS args = {0};
+    NETSIM_LINK_STATS stats;
+    struct rx_log log;
+    BIO *bio;
+    uint32_t i;
+
+    args.latency        = ossl_ms2time(50);
+    args.bandwidth      = 1000000;
+    args.queue_limit    = 3000;
+
+    if (!setup(&sim, &log, 1, &args, &bio))
+        goto err;
+
+    ossl_quic_demux_set_default_handler(log.demux, rx_cb, &log);
+
+    /* Each datagram takes 1ms at the bottleneck, and the fourth is dropped. */
+    for (i = 0; i < 4; ++i)
+        if (!send_dgram(sim, bio, i, 1000))
+            goto err;
+
+    if (!run(sim)
+        || !TEST_size_t_eq(log.num, 3))
+        goto err;
+
+    for (i = 0; i < 3; ++i)
+        if (!TEST_uint_eq(log.id[i], i)
+            || !TEST_uint64_t_eq(ossl_time2ms(log.time[i]), 1051 + i))
+            goto err;
+
+    if (!TEST_uint64_t_eq(ossl_time2ms(netsim_now(sim)), 1053))
+        goto err;
+
+    netsim_get_link_stats(sim, 0, &stats);
+    if (!TEST_uint64_t_eq(stats.dgrams_sent, 4)
+        || !TEST_uint64_t_eq(stats.dgrams_delivered, 3)
+        || !TEST_uint64_t_eq(stats.bytes_delivered, 3000)
+        || !TEST_uint64_t_eq(stats.dgrams_dropped, 1))
+        goto err;
+
+    testresult = 1;
+err:
+    teardown(sim, &log);
+    return testresult;
+}
+
+#define NUM_DGRAMS  1000
+
+/* Sends NUM_DGRAMS datagrams over a lossy link, one every 100us. */
+static int run_lossy(uint64_t seed, struct rx_log *log,
+                     NETSIM_LINK_STATS *stats)
+{
+    int ok = 0;
+    NETSIM *sim = NULL;
+    NETSIM_LINK_ARGS args = {0};
+    BIO *bio;
+    uint32_t i;
+
+    args.latency        = ossl_ms2time(20);
+    args.loss_ppm       = 100000;
+    args.reorder_ppm    = 50000;
+    args.reorder_delay  = ossl_ms2time(1);
+
+    if (!setup(&sim, log, seed, &args, &bio))
+        goto err;
+
+    ossl_quic_demux_set_default_handler(log->demux, rx_cb, log);
+
+    for (i = 0; i < NUM_DGRAMS; ++i)
+        if (!send_dgram(sim, bio, i, 100)
+            || !TEST_true(netsim_advance(sim,
+                                         ossl_time_add(netsim_now(sim),
+                                                       ossl_us2time(100)))))
+            goto err;
+
+    if (!run(sim))
+        goto err;
+
+    netsim_get_link_stats(sim, 0, stats);
+    ok = 1;
+err:
+    teardown(sim, log);
+    return ok;
+}
+
+static int test_netsim_lossy(void)
+{
+    static struct rx_log log1, log2;
+    NETSIM_LINK_STATS stats1, stats2;
+    size_t i, num_out_of_order = 0;
+
+    if (!run_lossy(42, &log1, &stats1)
+        || !run_lossy(42, &log2, &stats2))
+        return 0;
+
+    /* The same seed gives exactly the same run. */
+    if (!TEST_mem_eq(&stats1, sizeof(stats1), &stats2, sizeof(stats2))
+        || !TEST_size_t_eq(log1.num, log2.num)
+        || !TEST_mem_eq(log1.id, log1.num * sizeof(log1.id[0]),
+                        log2.id, log2.num * sizeof(log2.id[0]))
+        || !TEST_mem_eq(log1.time, log1.num * sizeof(log1.time[0]),
+                        log2.time, log2.num * sizeof(log2.time[0])))
+        return 0;
+
+    /* Roughly the configured proportions are lost and reordered. */
+    if (!TEST_uint64_t_eq(stats1.dgrams_lost + log1.num, NUM_DGRAMS)
+        || !TEST_uint64_t_gt(stats1.dgrams_lost, 50)
+        || !TEST_uint64_t_lt(stats1.dgrams_lost, 150)
+        || !TEST_uint64_t_gt(stats1.dgrams_reordered, 15)
+        || !TEST_uint64_t_lt(stats1.dgrams_reordered, 80))
+        return 0;
+
+    for (i = 1; i < log1.num; ++i) {
+        if (!TEST_true(ossl_time_compare(log1.time[i - 1], log1.time[i]) <= 0))
+            return 0;
+        if (log1.id[i] < log1.id[i - 1])
+            ++num_out_of_order;
+    }
+
+    return TEST_size_t_gt(num_out_of_order, 0);
+}
+
+int setup_tests(void)
+{
+    ADD_TEST(test_netsim_link);
+    ADD_TEST(test_netsim_lossy);
+    return 1;
+}
@@ -0,0 +1,398 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <openssl/bio.h>
+#include "internal/bio_addr.h"
+#include "internal/packet.h"
+#include "internal/quic_path.h"
+#include "internal/quic_wire.h"
+#include "testutil.h"
+
+static OSSL_TIME fake_time;
+
+static OSSL_TIME fake_now(void *arg)
+{
+    return fake_time;
+}
+
+static const unsigned char ip_a[] = { 192, 0, 2, 1 };
+static const unsigned char ip_b[] = { 198, 51, 100, 1 };
+static const unsigned char ip_local[] = { 203, 0, 113, 1 };
+
+static BIO_ADDR *addr_a, *addr_a2, *addr_b, *addr_local, *addr_local2;
+
+static BIO_ADDR *make_addr(const unsigned char *ip, unsigned short port)
+{
+    BIO_ADDR *addr = BIO_ADDR_new();
+
+    if (addr != NULL && !BIO_ADDR_rawmake(addr, AF_INET, ip, 4, htons(port))) {
+        BIO_ADDR_free(addr);
+        addr = NULL;
+    }
+
+    return addr;
+}
+
+static QUIC_PATH_MGR *new_mgr(int is_server, size_t max_paths, OSSL_ACKM *ackm)
+{
+    QUIC_PATH_MGR_ARGS args = {0};
+
+    args.now        = fake_now;
+    args.is_server  = is_server;
+    args.max_paths  = max_paths;
+    args.ackm       = ackm;
+    args.peer       = addr_a;
+    args.local      = addr_local;
+    return ossl_quic_path_mgr_new(&args);
+}
+
+/*
+ * Writes the frames pending for a path and decodes them. Returns the number of
+ * frames, or -1 on error.
+ */
+static int get_frames(QUIC_PATH_MGR *pm, QUIC_PATH *path, uint64_t *challenge,
+                      uint64_t *response)
+{
+    unsigned char buf[64];
+    WPACKET wpkt;
+    PACKET pkt;
+    size_t num_frames = 0, written = 0;
+    uint64_t frame_type;
+
+    if (!TEST_true(WPACKET_init_static_len(&wpkt, buf, sizeof(buf), 0))
+        || !TEST_true(ossl_quic_path_mgr_write_frames(pm, path, &wpkt,
+                                                      &num_frames))
+        || !TEST_true(WPACKET_get_total_written(&wpkt, &written))
+        || !TEST_true(WPACKET_finish(&wpkt))
+        || !TEST_true(PACKET_buf_init(&pkt, buf, written)))
+        return -1;
+
+    while (PACKET_remaining(&pkt) > 0) {
+        if (!TEST_true(ossl_quic_wire_peek_frame_header(&pkt, &frame_type)))
+            return -1;
+
+        if (frame_type == OSSL_QUIC_FRAME_TYPE_PATH_CHALLENGE) {
+            if (!TEST_true(ossl_quic_wire_decode_frame_path_challenge(&pkt,
+                                                                     challenge)))
+                return -1;
+        } else if (!TEST_uint64_t_eq(frame_type,
+                                     OSSL_QUIC_FRAME_TYPE_PATH_RESPONSE)
+                   || !TEST_true(ossl_quic_wire_decode_frame_path_response(&pkt,
+                                                                          response))) {
+            return -1;
+        }
+    }
+
+    return (int)num_frames;
+}
+
+static int test_path_validation(void)
+{
+    int testresult = 0;
+    QUIC_PATH_MGR *pm = NULL;
+    QUIC_PATH *initial, *path;
+    uint64_t challenge = 0, response = 0;
+    unsigned char small[8];
+    WPACKET wpkt;
+    size_t num_frames;
+
+    fake_time = ossl_seconds2time(100);
+
+    if (!TEST_ptr(pm = new_mgr(1, 0, NULL))
+        || !TEST_ptr(initial = ossl_quic_path_mgr_get0_active(pm))
+        || !TEST_int_eq(ossl_quic_path_get_state(initial),
+                        QUIC_PATH_STATE_VALIDATED)
+        || !TEST_ptr_eq(ossl_quic_path_mgr_on_rx(pm, addr_a, addr_local, 100),
+                        initial)
+        || !TEST_ptr_null(ossl_quic_path_mgr_get_next_tx_path(pm)))
+        goto err;
+
+    /* A packet from a new address creates a path, which is validated. */
+    if (!TEST_ptr(path = ossl_quic_path_mgr_on_rx(pm, addr_b, addr_local, 100))
+        || !TEST_ptr_ne(path, initial)
+        || !TEST_size_t_eq(ossl_quic_path_mgr_get_num_paths(pm), 2)
+        || !TEST_int_eq(ossl_quic_path_get_state(path),
+                        QUIC_PATH_STATE_VALIDATING)
+        || !TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), initial)
+        || !TEST_uint64_t_eq(ossl_quic_path_get_tx_allowance(path), 300)
+        || !TEST_uint64_t_eq(ossl_quic_path_get_tx_allowance(initial),
+                             UINT64_MAX))
+        goto err;
+
+    ossl_quic_path_mgr_on_tx(pm, path, 1200);
+    if (!TEST_uint64_t_eq(ossl_quic_path_get_tx_allowance(path), 0))
+        goto err;
+
+    /* The peer challenges us on the new path too. */
+    ossl_quic_path_mgr_on_path_challenge(pm, path, 0x5a5a5a5a);
+
+    /* A frame which does not fit is not written or lost. */
+    if (!TEST_true(WPACKET_init_static_len(&wpkt, small, sizeof(small), 0))
+        || !TEST_true(ossl_quic_path_mgr_write_frames(pm, path, &wpkt,
+                                                      &num_frames))
+        || !TEST_size_t_eq(num_frames, 0))
+        goto err;
+    WPACKET_finish(&wpkt);
+
+    if (!TEST_ptr_eq(ossl_quic_path_mgr_get_next_tx_path(pm), path)
+        || !TEST_int_eq(get_frames(pm, path, &challenge, &response), 2)
+        || !TEST_uint64_t_eq(response, 0x5a5a5a5a)
+        || !TEST_ptr_null(ossl_quic_path_mgr_get_next_tx_path(pm)))
+        goto err;
+
+    /* A response which matches nothing is ignored. */
+    ossl_quic_path_mgr_on_path_response(pm, path, ~challenge);
+    if (!TEST_int_eq(ossl_quic_path_get_state(path),
+                     QUIC_PATH_STATE_VALIDATING))
+        goto err;
+
+    /* The challenge is retransmitted after a PTO, with new data. */
+    if (!TEST_true(ossl_time_compare(ossl_quic_path_mgr_get_tick_deadline(pm),
+                                     fake_time) > 0))
+        goto err;
+
+    fake_time = ossl_quic_path_mgr_get_tick_deadline(pm);
+    ossl_quic_path_mgr_tick(pm);
+    response = challenge;
+    if (!TEST_int_eq(get_frames(pm, path, &challenge, &response), 1)
+        || !TEST_uint64_t_ne(challenge, response))
+        goto err;
+
+    /* A response to either challenge validates the path. */
+    ossl_quic_path_mgr_on_path_response(pm, initial, response);
+    if (!TEST_int_eq(ossl_quic_path_get_state(path),
+                     QUIC_PATH_STATE_VALIDATED)
+        || !TEST_uint64_t_eq(ossl_quic_path_get_tx_allowance(path),
+                             UINT64_MAX)
+        || !TEST_true(ossl_time_is_infinite(ossl_quic_path_mgr_get_tick_deadline(pm))))
+        goto err;
+
+    /* A validated path is not migrated to by the server on probing alone. */
+    if (!TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), initial))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_path_mgr_free(pm);
+    return testresult;
+}
+
+static int test_path_migration(void)
+{
+    int testresult = 0;
+    QUIC_PATH_MGR *pm = NULL;
+    QUIC_PATH *initial, *path;
+    OSSL_ACKM *ackm = NULL;
+
+    fake_time = ossl_seconds2time(100);
+
+    if (!TEST_ptr(pm = new_mgr(1, 0, NULL))
+        || !TEST_ptr(initial = ossl_quic_path_mgr_get0_active(pm))
+        || !TEST_ptr(ackm = ossl_ackm_new(fake_now, NULL,
+                                          ossl_quic_path_get0_statm(initial),
+                                          &ossl_cc_dummy_method,
+                                          ossl_quic_path_get0_cc_data(initial))))
+        goto err;
+
+    ossl_quic_path_mgr_set_ackm(pm, ackm);
+    ossl_statm_update_rtt(ossl_quic_path_get0_statm(initial),
+                          ossl_time_zero(), ossl_ms2time(20));
+
+    if (!TEST_false(ossl_quic_path_mgr_on_non_probing(pm, initial, 10)))
+        goto err;
+
+    /* A non-probing packet with an old PN does not cause migration. */
+    if (!TEST_ptr(path = ossl_quic_path_mgr_on_rx(pm, addr_b, addr_local, 100))
+        || !TEST_false(ossl_quic_path_mgr_on_non_probing(pm, path, 9))
+        || !TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), initial))
+        goto err;
+
+    /* The highest-numbered one does; the new network path starts afresh. */
+    if (!TEST_true(ossl_quic_path_mgr_on_non_probing(pm, path, 11))
+        || !TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), path)
+        || !TEST_false(ossl_quic_path_get0_statm(path)->have_first_sample)
+        || !TEST_true(ossl_quic_path_get0_statm(initial)->have_first_sample)
+        || !TEST_ptr_ne(ossl_quic_path_get0_cc_data(path),
+                        ossl_quic_path_get0_cc_data(initial)))
+        goto err;
+
+    /*
+     * Validation is not completed in time, so the connection reverts to the
+     * last validated path and the failed one is forgotten.
+     */
+    fake_time = ossl_time_add(fake_time, ossl_seconds2time(10));
+    ossl_quic_path_mgr_tick(pm);
+    if (!TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), initial)
+        || !TEST_size_t_eq(ossl_quic_path_mgr_get_num_paths(pm), 1))
+        goto err;
+
+    /* The server does not move back for reordered packets. */
+    if (!TEST_ptr(path = ossl_quic_path_mgr_on_rx(pm, addr_b, addr_local, 100))
+        || !TEST_false(ossl_quic_path_mgr_on_non_probing(pm, path, 10)))
+        goto err;
+
+    /* The client does not migrate when the server's address changes. */
+    ossl_quic_path_mgr_free(pm);
+    if (!TEST_ptr(pm = new_mgr(0, 0, NULL))
+        || !TEST_ptr(path = ossl_quic_path_mgr_on_rx(pm, addr_b, addr_local,
+                                                     100))
+        || !TEST_false(ossl_quic_path_mgr_on_non_probing(pm, path, 1))
+        || !TEST_ptr_ne(ossl_quic_path_mgr_get0_active(pm), path))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_path_mgr_free(pm);
+    ossl_ackm_free(ackm);
+    return testresult;
+}
+
+static int test_path_nat_rebinding(void)
+{
+    int testresult = 0;
+    QUIC_PATH_MGR *pm = NULL;
+    QUIC_PATH *initial, *path;
+    OSSL_CC_DATA *cc;
+    uint64_t challenge = 0, response = 0;
+
+    fake_time = ossl_seconds2time(100);
+
+    if (!TEST_ptr(pm = new_mgr(1, 0, NULL))
+        || !TEST_ptr(initial = ossl_quic_path_mgr_get0_active(pm)))
+        goto err;
+
+    cc = ossl_quic_path_get0_cc_data(initial);
+    ossl_statm_update_rtt(ossl_quic_path_get0_statm(initial),
+                          ossl_time_zero(), ossl_ms2time(20));
+
+    /* Only the port changes, so RTT and congestion state are kept. */
+    if (!TEST_ptr(path = ossl_quic_path_mgr_on_rx(pm, addr_a2, addr_local, 100))
+        || !TEST_true(ossl_quic_path_mgr_on_non_probing(pm, path, 1))
+        || !TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), path)
+        || !TEST_true(ossl_quic_path_get0_statm(path)->have_first_sample)
+        || !TEST_ptr_eq(ossl_quic_path_get0_cc_data(path), cc)
+        || !TEST_false(ossl_quic_path_get0_statm(initial)->have_first_sample))
+        goto err;
+
+    /* If validation fails, the state goes back with the connection. */
+    fake_time = ossl_time_add(fake_time, ossl_seconds2time(10));
+    ossl_quic_path_mgr_tick(pm);
+    if (!TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), initial)
+        || !TEST_true(ossl_quic_path_get0_statm(initial)->have_first_sample)
+        || !TEST_ptr_eq(ossl_quic_path_get0_cc_data(initial), cc))
+        goto err;
+
+    /* If it succeeds, the new path keeps it. */
+    if (!TEST_ptr(path = ossl_quic_path_mgr_on_rx(pm, addr_a2, addr_local, 100))
+        || !TEST_true(ossl_quic_path_mgr_on_non_probing(pm, path, 2))
+        || !TEST_int_eq(get_frames(pm, path, &challenge, &response), 1))
+        goto err;
+
+    ossl_quic_path_mgr_on_path_response(pm, path, challenge);
+    fake_time = ossl_time_add(fake_time, ossl_seconds2time(10));
+    ossl_quic_path_mgr_tick(pm);
+    if (!TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), path)
+        || !TEST_int_eq(ossl_quic_path_get_state(path),
+                        QUIC_PATH_STATE_VALIDATED)
+        || !TEST_ptr_eq(ossl_quic_path_get0_cc_data(path), cc))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_path_mgr_free(pm);
+    return testresult;
+}
+
+static int test_path_client_probe(void)
+{
+    int testresult = 0;
+    QUIC_PATH_MGR *pm = NULL;
+    QUIC_PATH *initial, *path, *path2;
+    uint64_t challenge = 0, response = 0;
+
+    fake_time = ossl_seconds2time(100);
+
+    if (!TEST_ptr(pm = new_mgr(0, 3, NULL))
+        || !TEST_ptr(initial = ossl_quic_path_mgr_get0_active(pm)))
+        goto err;
+
+    /* The client probes from a new local address, then moves to it. */
+    if (!TEST_ptr(path = ossl_quic_path_mgr_probe(pm, addr_a, addr_local2))
+        || !TEST_ptr_eq(ossl_quic_path_mgr_probe(pm, addr_a, addr_local2), path)
+        || !TEST_int_eq(get_frames(pm, path, &challenge, &response), 1))
+        goto err;
+
+    ossl_quic_path_mgr_on_path_response(pm, path, challenge);
+    if (!TEST_int_eq(ossl_quic_path_get_state(path),
+                     QUIC_PATH_STATE_VALIDATED)
+        || !TEST_true(ossl_quic_path_mgr_migrate(pm, path))
+        || !TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), path))
+        goto err;
+
+    /*
+     * Paths beyond the limit replace the least recently used one which is
+     * neither active nor the fallback.
+     */
+    fake_time = ossl_time_add(fake_time, ossl_ms2time(1));
+    if (!TEST_ptr(path2 = ossl_quic_path_mgr_on_rx(pm, addr_b, addr_local, 10))
+        || !TEST_size_t_eq(ossl_quic_path_mgr_get_num_paths(pm), 3))
+        goto err;
+
+    fake_time = ossl_time_add(fake_time, ossl_ms2time(1));
+    if (!TEST_ptr(ossl_quic_path_mgr_on_rx(pm, addr_b, addr_local2, 10))
+        || !TEST_size_t_eq(ossl_quic_path_mgr_get_num_paths(pm), 3)
+        || !TEST_ptr_eq(ossl_quic_path_mgr_get0_active(pm), path)
+        || !TEST_ptr_eq(ossl_quic_path_mgr_on_rx(pm, addr_b, addr_local, 10),
+                        path2)
+        || !TEST_size_t_eq(ossl_quic_path_mgr_get_num_paths(pm), 3)
+        || !TEST_ptr_eq(ossl_quic_path_mgr_on_rx(pm, addr_b, addr_local2, 10),
+                        ossl_quic_path_mgr_probe(pm, addr_b, addr_local2)))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_path_mgr_free(pm);
+    return testresult;
+}
+
+static int test_addr_eq(void)
+{
+    return TEST_true(ossl_quic_addr_eq(NULL, NULL, 0))
+        && TEST_true(ossl_quic_addr_eq(addr_a, addr_a, 0))
+        && TEST_false(ossl_quic_addr_eq(addr_a, NULL, 0))
+        && TEST_false(ossl_quic_addr_eq(addr_a, addr_a2, 0))
+        && TEST_true(ossl_quic_addr_eq(addr_a, addr_a2, 1))
+        && TEST_false(ossl_quic_addr_eq(addr_a, addr_b, 1));
+}
+
+int setup_tests(void)
+{
+    if (!TEST_ptr(addr_a = make_addr(ip_a, 4433))
+        || !TEST_ptr(addr_a2 = make_addr(ip_a, 5000))
+        || !TEST_ptr(addr_b = make_addr(ip_b, 4433))
+        || !TEST_ptr(addr_local = make_addr(ip_local, 443))
+        || !TEST_ptr(addr_local2 = make_addr(ip_local, 8443)))
+        return 0;
+
+    ADD_TEST(test_addr_eq);
+    ADD_TEST(test_path_validation);
+    ADD_TEST(test_path_migration);
+    ADD_TEST(test_path_nat_rebinding);
+    ADD_TEST(test_path_client_probe);
+    return 1;
+}
+
+void cleanup_tests(void)
+{
+    BIO_ADDR_free(addr_a);
+    BIO_ADDR_free(addr_a2);
+    BIO_ADDR_free(addr_b);
+    BIO_ADDR_free(addr_local);
+    BIO_ADDR_free(addr_local2);
+}
@@ -11,8 +11,10 @@
 #include "internal/quic_rx_depack.h"
 #include "internal/quic_record_tx.h"
 #include "internal/quic_ackm.h"
+#include "internal/quic_demux_shard.h"
 #include "internal/quic_cc.h"
 #include "internal/quic_ssl.h"
+#include "internal/sockets.h"
 #include "testutil.h"
 
 static const QUIC_CONN_ID empty_conn_id = {0, {0}};
@@ -1816,7 +1818,14 @@ static int rx_state_ensure_for_frames(struct rx_state *s)
     return 1;
 }
 
-static int rx_run_script(const struct rx_test_op *script)
+/*
+ * Cipher cache shared by all QRX and QTX instances in the second run of each
+ * script, which must give the same results as the first run without one.
+ */
+static OSSL_QRL_CIPHER_CACHE *cipher_cache;
+
+static int rx_run_script(const struct rx_test_op *script,
+                         OSSL_QRL_CIPHER_CACHE *cache)
 {
     int testresult = 0, pkt_outstanding = 0;
     struct rx_state s = {0};
@@ -1824,6 +1833,8 @@ static int rx_run_script(const struct rx_test_op *script)
     OSSL_QRX_PKT pkt = {0};
     const struct rx_test_op *op = script;
 
+    s.args.cipher_cache = cache;
+
     for (; op->op != RX_TEST_OP_END; ++op)
         switch (op->op) {
             case RX_TEST_OP_SET_SCID_LEN:
@@ -1853,9 +1864,11 @@ static int rx_run_script(const struct rx_test_op *script)
             case RX_TEST_OP_PROVIDE_SECRET_INITIAL:
                 if (!TEST_true(rx_state_ensure(&s)))
                     goto err;
-                if (!TEST_true(ossl_quic_provide_initial_secret(NULL, NULL,
-                                                                op->dcid, 0,
-                                                                s.qrx, NULL)))
+                if (!TEST_true(ossl_quic_provide_initial_secret_ex(NULL, NULL,
+                                                                   cache,
+                                                                   op->dcid, 0,
+                                                                   s.qrx,
+                                                                   NULL)))
                     goto err;
                 break;
             case RX_TEST_OP_DISCARD_EL:
@@ -1957,7 +1970,10 @@ err:
 
 static int test_rx_script(int idx)
 {
-    return rx_run_script(rx_scripts[idx]);
+    size_t n = OSSL_NELEM(rx_scripts);
+
+    return rx_run_script(rx_scripts[idx % n],
+                         idx < (int)n ? NULL : cipher_cache);
 }
 
 /* Packet Header Tests */
@@ -2802,6 +2818,82 @@ static int test_wire_pkt_hdr(int idx)
     return test_wire_pkt_hdr_inner(tidx, repeat, cipher);
 }
 
+/*
+ * Batched header protection must give the same result as protecting each
+ * packet in turn. Enough packets are used to span more than one batch, and
+ * they use both header forms and all PN lengths.
+ */
+#define HPR_BATCH_PKTS      70
+#define HPR_BATCH_PKT_LEN   40
+
+static int test_hdr_prot_batch(int cipher)
+{
+    static const int cipher_ids[HPR_CIPHER_COUNT] = {
+        QUIC_HDR_PROT_CIPHER_AES_128,
+        QUIC_HDR_PROT_CIPHER_AES_256,
+        QUIC_HDR_PROT_CIPHER_CHACHA
+    };
+    static const size_t key_lens[HPR_CIPHER_COUNT] = { 16, 32, 32 };
+    int testresult = 0;
+    QUIC_HDR_PROTECTOR hpr = {0};
+    unsigned char key[32];
+    unsigned char buf1[HPR_BATCH_PKTS * HPR_BATCH_PKT_LEN];
+    unsigned char buf2[HPR_BATCH_PKTS * HPR_BATCH_PKT_LEN];
+    QUIC_PKT_HDR_PTRS ptrs1[HPR_BATCH_PKTS], ptrs2[HPR_BATCH_PKTS];
+    size_t i, pn_off;
+
+    for (i = 0; i < sizeof(key); ++i)
+        key[i] = (unsigned char)(i * 3 + cipher);
+
+    for (i = 0; i < sizeof(buf1); ++i)
+        buf1[i] = (unsigned char)(i * 13 + (i >> 5));
+
+    for (i = 0; i < HPR_BATCH_PKTS; ++i) {
+        unsigned char *p = buf1 + i * HPR_BATCH_PKT_LEN;
+
+        /* Alternate long and short headers and vary the PN length. */
+        p[0] = (unsigned char)((i % 2 == 0 ? 0xc0 : 0x40) | (i % 4));
+        pn_off = 1 + i % 7;
+
+        ptrs1[i].raw_start      = p;
+        ptrs1[i].raw_pn         = p + pn_off;
+        ptrs1[i].raw_sample     = p + pn_off + 4;
+        ptrs1[i].raw_sample_len = HPR_BATCH_PKT_LEN - pn_off - 4;
+
+        ptrs2[i].raw_start      = buf2 + (ptrs1[i].raw_start - buf1);
+        ptrs2[i].raw_pn         = buf2 + (ptrs1[i].raw_pn - buf1);
+        ptrs2[i].raw_sample     = buf2 + (ptrs1[i].raw_sample - buf1);
+        ptrs2[i].raw_sample_len = ptrs1[i].raw_sample_len;
+    }
+
+    memcpy(buf2, buf1, sizeof(buf1));
+
+    if (!TEST_true(ossl_quic_hdr_protector_init(&hpr, NULL, NULL,
+                                                cipher_ids[cipher],
+                                                key, key_lens[cipher])))
+        goto err;
+
+    for (i = 0; i < HPR_BATCH_PKTS; ++i)
+        if (!TEST_true(ossl_quic_hdr_protector_encrypt(&hpr, &ptrs1[i])))
+            goto err;
+
+    if (!TEST_true(ossl_quic_hdr_protector_encrypt_many(&hpr, ptrs2,
+                                                        HPR_BATCH_PKTS))
+        || !TEST_mem_eq(buf1, sizeof(buf1), buf2, sizeof(buf2)))
+        goto err;
+
+    /* Removing the protection restores the original headers. */
+    for (i = 0; i < HPR_BATCH_PKTS; ++i)
+        if (!TEST_true(ossl_quic_hdr_protector_decrypt(&hpr, &ptrs2[i]))
+            || !TEST_int_eq(buf2[i * HPR_BATCH_PKT_LEN] & 3, (int)(i % 4)))
+            goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_hdr_protector_cleanup(&hpr);
+    return testresult;
+}
+
 /* TX Tests */
 #define TX_TEST_OP_END                     0 /* end of script */
 #define TX_TEST_OP_WRITE                   1 /* write packet */
@@ -3396,7 +3488,8 @@ static const struct tx_test_op *const tx_scripts[] = {
     tx_script_6
 };
 
-static int tx_run_script(const struct tx_test_op *script)
+static int tx_run_script(const struct tx_test_op *script,
+                         OSSL_QRL_CIPHER_CACHE *cache)
 {
     int testresult = 0;
     const struct tx_test_op *op = script;
@@ -3404,7 +3497,8 @@ static int tx_run_script(const struct tx_test_op *script)
     BIO_MSG msg = {0};
     OSSL_QTX_ARGS args = {0};
 
-    args.mdpl = 1472;
+    args.mdpl           = 1472;
+    args.cipher_cache   = cache;
 
     if (!TEST_ptr(qtx = ossl_qtx_new(&args)))
         goto err;
@@ -3418,10 +3512,11 @@ static int tx_run_script(const struct tx_test_op *script)
                     goto err;
                 break;
             case TX_TEST_OP_PROVIDE_SECRET_INITIAL:
-                if (!TEST_true(ossl_quic_provide_initial_secret(NULL, NULL,
-                                                                op->dcid,
-                                                                (int)op->suite_id,
-                                                                NULL, qtx)))
+                if (!TEST_true(ossl_quic_provide_initial_secret_ex(NULL, NULL,
+                                                                   cache,
+                                                                   op->dcid,
+                                                                   (int)op->suite_id,
+                                                                   NULL, qtx)))
                     goto err;
                 break;
             case TX_TEST_OP_DISCARD_EL:
@@ -3486,12 +3581,507 @@ err:
 
 static int test_tx_script(int idx)
 {
-    return tx_run_script(tx_scripts[idx]);
+    size_t n = OSSL_NELEM(tx_scripts);
+
+    return tx_run_script(tx_scripts[idx % n],
+                         idx < (int)n ? NULL : cipher_cache);
+}
+
+/* TX Pacing Test */
+static OSSL_TIME tx_pacing_now;
+
+static OSSL_TIME tx_pacing_now_cb(void *arg)
+{
+    return tx_pacing_now;
+}
+
+static int tx_pacing_write(OSSL_QTX *qtx, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i)
+        if (!TEST_true(ossl_qtx_write_pkt(qtx, &tx_script_6_pkt)))
+            return 0;
+
+    return 1;
 }
 
+static int tx_pacing_check_recv(BIO *bio, size_t n)
+{
+    unsigned char buf[64];
+    size_t i;
+
+    for (i = 0; i < n; ++i)
+        if (!TEST_int_eq(BIO_read(bio, buf, sizeof(buf)),
+                         (int)sizeof(tx_script_6_dgram))
+            || !TEST_mem_eq(buf, sizeof(tx_script_6_dgram),
+                            tx_script_6_dgram, sizeof(tx_script_6_dgram)))
+            return 0;
+
+    return TEST_int_le(BIO_read(bio, buf, sizeof(buf)), 0);
+}
+
+static int test_tx_pacing(void)
+{
+    int testresult = 0;
+    OSSL_QTX *qtx = NULL;
+    OSSL_QTX_ARGS args = {0};
+    BIO *bio1 = NULL, *bio2 = NULL;
+    const size_t dlen = sizeof(tx_script_6_dgram);
+
+    tx_pacing_now = ossl_ticks2time(1000 * OSSL_TIME_SECOND);
+
+    if (!TEST_true(BIO_new_bio_dgram_pair(&bio1, 0, &bio2, 0)))
+        goto err;
+
+    args.mdpl       = 1472;
+    args.bio        = bio1;
+    args.now        = tx_pacing_now_cb;
+
+    if (!TEST_ptr(qtx = ossl_qtx_new(&args)))
+        goto err;
+
+    /* A burst is required when pacing. */
+    if (!TEST_false(ossl_qtx_set_pacing_rate(qtx, 1000 * dlen, 0)))
+        goto err;
+
+    /* One datagram per millisecond, bursts of up to two datagrams. */
+    if (!TEST_true(ossl_qtx_set_pacing_rate(qtx, 1000 * dlen, 2 * dlen))
+        || !TEST_true(ossl_time_is_infinite(ossl_qtx_get_flush_deadline(qtx)))
+        || !tx_pacing_write(qtx, 5)
+        || !TEST_true(ossl_time_is_zero(ossl_qtx_get_flush_deadline(qtx))))
+        goto err;
+
+    /* The initial burst is released immediately. */
+    ossl_qtx_flush_net(qtx);
+    if (!TEST_size_t_eq(ossl_qtx_get_queue_len_datagrams(qtx), 3)
+        || !tx_pacing_check_recv(bio2, 2)
+        || !TEST_uint64_t_eq(ossl_time2ticks(ossl_qtx_get_flush_deadline(qtx)),
+                             ossl_time2ticks(ossl_time_add(tx_pacing_now,
+                                                           ossl_ms2time(1)))))
+        goto err;
+
+    /* Nothing more may be sent until the deadline. */
+    tx_pacing_now = ossl_time_add(tx_pacing_now, ossl_us2time(500));
+    ossl_qtx_flush_net(qtx);
+    if (!TEST_size_t_eq(ossl_qtx_get_queue_len_datagrams(qtx), 3)
+        || !tx_pacing_check_recv(bio2, 0))
+        goto err;
+
+    tx_pacing_now = ossl_time_add(tx_pacing_now, ossl_us2time(500));
+    ossl_qtx_flush_net(qtx);
+    if (!TEST_size_t_eq(ossl_qtx_get_queue_len_datagrams(qtx), 2)
+        || !tx_pacing_check_recv(bio2, 1))
+        goto err;
+
+    /* A long idle period does not allow more than one burst. */
+    if (!tx_pacing_write(qtx, 2))
+        goto err;
+
+    tx_pacing_now = ossl_time_add(tx_pacing_now, ossl_seconds2time(5));
+    ossl_qtx_flush_net(qtx);
+    if (!TEST_size_t_eq(ossl_qtx_get_queue_len_datagrams(qtx), 2)
+        || !tx_pacing_check_recv(bio2, 2))
+        goto err;
+
+    /* Disabling pacing releases everything. */
+    if (!TEST_true(ossl_qtx_set_pacing_rate(qtx, 0, 0)))
+        goto err;
+
+    ossl_qtx_flush_net(qtx);
+    if (!TEST_size_t_eq(ossl_qtx_get_queue_len_datagrams(qtx), 0)
+        || !tx_pacing_check_recv(bio2, 2)
+        || !TEST_true(ossl_time_is_infinite(ossl_qtx_get_flush_deadline(qtx))))
+        goto err;
+
+    testresult = 1;
+err:
+    if (qtx != NULL)
+        ossl_qtx_free(qtx);
+    BIO_free(bio1);
+    BIO_free(bio2);
+    return testresult;
+}
+
+/*
+ * Sharded Demuxer Test
+ *
+ * Datagrams arriving at the wrong shard are forwarded to the shard encoded in
+ * their DCID, and unknown DCIDs reach the owning shard's default handler.
+ */
+#define DEMUX_SHARD_NUM         4
+#define DEMUX_SHARD_CID_LEN     8
+
+struct demux_shard_rx {
+    QUIC_DEMUX_SHARDS   *shards;
+    size_t              shard;
+    size_t              count, default_count;
+};
+
+static struct demux_shard_rx demux_shard_rx[DEMUX_SHARD_NUM];
+static size_t demux_shard_notified[DEMUX_SHARD_NUM];
+
+static void demux_shard_rx_cb(QUIC_URXE *e, void *arg)
+{
+    struct demux_shard_rx *rx = arg;
+
+    ++rx->count;
+    ossl_quic_demux_release_urxe(ossl_quic_demux_shards_get_demux(rx->shards,
+                                                                  rx->shard),
+                                 e);
+}
+
+static void demux_shard_default_cb(QUIC_URXE *e, void *arg)
+{
+    struct demux_shard_rx *rx = arg;
+
+    ++rx->default_count;
+    ossl_quic_demux_release_urxe(ossl_quic_demux_shards_get_demux(rx->shards,
+                                                                  rx->shard),
+                                 e);
+}
+
+static void demux_shard_notify_cb(size_t shard, void *arg)
+{
+    ++demux_shard_notified[shard];
+}
+
+static int demux_shard_inject(QUIC_DEMUX_SHARDS *shards, size_t shard,
+                              const QUIC_CONN_ID *dcid)
+{
+    unsigned char buf[32] = {0};
+
+    buf[0] = 0x40; /* 1-RTT packet */
+    memcpy(buf + 1, dcid->id, dcid->id_len);
+    return ossl_quic_demux_inject(ossl_quic_demux_shards_get_demux(shards,
+                                                                   shard),
+                                  buf, sizeof(buf), NULL, NULL);
+}
+
+static int test_demux_shard(void)
+{
+    int testresult = 0;
+    size_t i;
+    BIO *bios[DEMUX_SHARD_NUM] = {0};
+    QUIC_DEMUX_SHARDS_ARGS args = {0};
+    QUIC_DEMUX_SHARDS *shards = NULL;
+    QUIC_CONN_ID cids[DEMUX_SHARD_NUM], unknown_cid;
+
+    memset(demux_shard_rx, 0, sizeof(demux_shard_rx));
+    memset(demux_shard_notified, 0, sizeof(demux_shard_notified));
+
+    args.net_bios               = bios;
+    args.num_shards             = DEMUX_SHARD_NUM;
+    args.short_conn_id_len      = DEMUX_SHARD_CID_LEN;
+    args.default_urxe_alloc_len = 1472;
+    args.notify                 = demux_shard_notify_cb;
+
+    if (!TEST_ptr(shards = ossl_quic_demux_shards_new(&args)))
+        goto err;
+
+    for (i = 0; i < DEMUX_SHARD_NUM; ++i) {
+        demux_shard_rx[i].shards = shards;
+        demux_shard_rx[i].shard  = i;
+
+        if (!TEST_true(ossl_quic_demux_shard_gen_conn_id(NULL,
+                                                         DEMUX_SHARD_CID_LEN,
+                                                         i, &cids[i]))
+            || !TEST_size_t_eq(ossl_quic_demux_shards_steer(shards, &cids[i]),
+                               i)
+            || !TEST_true(ossl_quic_demux_register(
+                              ossl_quic_demux_shards_get_demux(shards, i),
+                              &cids[i], demux_shard_rx_cb,
+                              &demux_shard_rx[i])))
+            goto err;
+
+        ossl_quic_demux_shards_set_default_handler(shards, i,
+                                                   demux_shard_default_cb,
+                                                   &demux_shard_rx[i]);
+    }
+
+    /* Too short for the shard encoding. */
+    if (!TEST_false(ossl_quic_demux_shard_gen_conn_id(NULL, 3, 0, &unknown_cid))
+        || !TEST_true(ossl_quic_demux_shard_gen_conn_id(NULL,
+                                                        DEMUX_SHARD_CID_LEN,
+                                                        2, &unknown_cid)))
+        goto err;
+
+    /* Everything arrives at shard 0, as might happen after a NAT rebinding. */
+    for (i = 0; i < DEMUX_SHARD_NUM; ++i)
+        if (!TEST_true(demux_shard_inject(shards, 0, &cids[i])))
+            goto err;
+
+    /* Only the datagram for shard 0 is delivered without pumping the others. */
+    if (!TEST_size_t_eq(demux_shard_rx[0].count, 1)
+        || !TEST_size_t_eq(demux_shard_rx[1].count, 0)
+        || !TEST_size_t_eq(demux_shard_notified[0], 0)
+        || !TEST_size_t_eq(demux_shard_notified[1], 1))
+        goto err;
+
+    /* An unknown DCID is routed to the default handler of its shard. */
+    if (!TEST_true(demux_shard_inject(shards, 1, &unknown_cid))
+        || !TEST_size_t_eq(demux_shard_rx[1].default_count, 0))
+        goto err;
+
+    /* No network BIO, so pumping only processes the inbox. */
+    for (i = 1; i < DEMUX_SHARD_NUM; ++i)
+        if (!TEST_true(ossl_quic_demux_shards_pump(shards, i))
+            || !TEST_size_t_eq(demux_shard_rx[i].count, 1)
+            || !TEST_size_t_eq(demux_shard_notified[i], 1))
+            goto err;
+
+    if (!TEST_size_t_eq(demux_shard_rx[2].default_count, 1)
+        || !TEST_false(ossl_quic_demux_shards_pump(shards, 1)))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_demux_shards_free(shards);
+    return testresult;
+}
+
+/*
+ * 0-RTT packets are only accepted by a QRX which allows them, as a server's
+ * does.
+ */
+static const QUIC_CONN_ID rx_0rtt_dcid = {
+    8, {0x83, 0x94, 0xc8, 0xf0, 0x3e, 0x51, 0x57, 0x08}
+};
+
+static const unsigned char rx_0rtt_body[] = {
+    0x01,                               /* PING */
+    0x00, 0x00, 0x00, 0x00,             /* PADDING */
+};
+
+static int test_rx_0rtt(int allow)
+{
+    int testresult = 0, have_pkt = 0;
+    OSSL_QTX *qtx = NULL;
+    OSSL_QTX_ARGS tx_args = {0};
+    OSSL_QRX_ARGS rx_args = {0};
+    QUIC_DEMUX *demux = NULL;
+    OSSL_QRX *qrx = NULL;
+    OSSL_QRX_PKT rx_pkt;
+    BIO_MSG msg = {0};
+    QUIC_PKT_HDR hdr = {0};
+    OSSL_QTX_IOVEC iovec = { rx_0rtt_body, sizeof(rx_0rtt_body) };
+    OSSL_QTX_PKT pkt = {0};
+
+    hdr.type        = QUIC_PKT_TYPE_0RTT;
+    hdr.pn_len      = 2;
+    hdr.version     = QUIC_VERSION_1;
+    hdr.dst_conn_id = rx_0rtt_dcid;
+    hdr.pn[1]       = 7;
+
+    pkt.hdr         = &hdr;
+    pkt.iovec       = &iovec;
+    pkt.num_iovec   = 1;
+    pkt.pn          = 7;
+
+    tx_args.mdpl            = 1472;
+    tx_args.cipher_cache    = cipher_cache;
+    if (!TEST_ptr(qtx = ossl_qtx_new(&tx_args))
+        || !TEST_true(ossl_qtx_provide_secret(qtx, QUIC_ENC_LEVEL_0RTT,
+                                              QRL_SUITE_AES128GCM, NULL,
+                                              rx_script_5_1rtt_secret,
+                                              sizeof(rx_script_5_1rtt_secret)))
+        || !TEST_true(ossl_qtx_write_pkt(qtx, &pkt))
+        || !TEST_true(ossl_qtx_pop_net(qtx, &msg)))
+        goto err;
+
+    if (!TEST_ptr(demux = ossl_quic_demux_new(NULL, rx_0rtt_dcid.id_len, 1500,
+                                              fake_time, NULL)))
+        goto err;
+
+    rx_args.demux               = demux;
+    rx_args.short_conn_id_len   = rx_0rtt_dcid.id_len;
+    rx_args.max_deferred        = 32;
+    rx_args.cipher_cache        = cipher_cache;
+    rx_args.allow_0rtt          = allow;
+    if (!TEST_ptr(qrx = ossl_qrx_new(&rx_args))
+        || !TEST_true(ossl_qrx_add_dst_conn_id(qrx, &rx_0rtt_dcid))
+        || !TEST_true(ossl_qrx_provide_secret(qrx, QUIC_ENC_LEVEL_0RTT,
+                                              QRL_SUITE_AES128GCM, NULL,
+                                              rx_script_5_1rtt_secret,
+                                              sizeof(rx_script_5_1rtt_secret)))
+        || !TEST_true(ossl_quic_demux_inject(demux, msg.data, msg.data_len,
+                                             NULL, NULL)))
+        goto err;
+
+    if (!allow) {
+        if (!TEST_false(ossl_qrx_read_pkt(qrx, &rx_pkt)))
+            goto err;
+    } else {
+        if (!TEST_true(have_pkt = ossl_qrx_read_pkt(qrx, &rx_pkt))
+            || !TEST_int_eq(rx_pkt.hdr->type, QUIC_PKT_TYPE_0RTT)
+            || !TEST_uint64_t_eq(rx_pkt.pn, 7)
+            || !TEST_mem_eq(rx_pkt.hdr->data, rx_pkt.hdr->len,
+                            rx_0rtt_body, sizeof(rx_0rtt_body)))
+            goto err;
+    }
+
+    testresult = 1;
+err:
+    if (have_pkt)
+        ossl_qrx_release_pkt(qrx, rx_pkt.handle);
+    ossl_qrx_free(qrx);
+    ossl_quic_demux_free(demux);
+    if (qtx != NULL)
+        ossl_qtx_free(qtx);
+    return testresult;
+}
+
+#if !defined(OPENSSL_NO_DGRAM) && !defined(OPENSSL_NO_SOCK)
+/*
+ * TX Segmentation Offload Test
+ *
+ * Datagrams sent by the QTX over a UDP socket, possibly coalesced using
+ * segmentation offload, are received by a demuxer which splits any coalesced
+ * receives back into individual datagrams. In the second instance, the demuxer
+ * has its own pool with room for one slab of large receive URXEs but fewer
+ * datagram URXEs than are sent, so a coalesced receive cannot be split in one
+ * go; no datagram may be lost.
+ */
+#define TX_GSO_NUM_DGRAMS   40
+#define TX_GSO_RX_POOL_LEN  (4 * QUIC_SLAB_MAX_OBJ_LEN + 64 * 1024 + 1024)
+
+struct tx_gso_rx {
+    QUIC_DEMUX  *demux;
+    size_t      count;
+    int         bad;
+};
+
+static void tx_gso_rx_cb(QUIC_URXE *e, void *arg)
+{
+    struct tx_gso_rx *rx = arg;
+
+    if (!TEST_mem_eq(ossl_quic_urxe_data(e), e->data_len,
+                     tx_script_6_dgram, sizeof(tx_script_6_dgram)))
+        rx->bad = 1;
+
+    ++rx->count;
+    ossl_quic_demux_release_urxe(rx->demux, e);
+}
+
+static int tx_gso_make_bio(BIO_ADDR *addr, int *fd, BIO **bio)
+{
+    struct in_addr ina;
+    union BIO_sock_info_u info;
+
+    ina.s_addr = htonl(0x7f000001UL);
+    info.addr = addr;
+
+    return TEST_int_eq(BIO_ADDR_rawmake(addr, AF_INET, &ina, sizeof(ina), 0), 1)
+        && TEST_int_ge(*fd = BIO_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, 0), 0)
+        && TEST_int_gt(BIO_bind(*fd, addr, 0), 0)
+        && TEST_int_gt(BIO_sock_info(*fd, BIO_SOCK_INFO_ADDRESS, &info), 0)
+        && TEST_true(BIO_socket_nbio(*fd, 1))
+        && TEST_ptr(*bio = BIO_new_dgram(*fd, BIO_CLOSE));
+}
+
+static int test_tx_gso(int idx)
+{
+    int testresult = 0, fd1 = -1, fd2 = -1, i;
+    BIO *bio1 = NULL, *bio2 = NULL;
+    BIO_ADDR *addr1 = NULL, *addr2 = NULL;
+    OSSL_QTX *qtx = NULL;
+    OSSL_QTX_ARGS args = {0};
+    struct tx_gso_rx rx = {0};
+    OSSL_QTX_PKT pkt = tx_script_6_pkt;
+    QUIC_SLAB_POOL *pool = NULL, *rx_pool = NULL;
+    QUIC_SLAB_STATS st;
+
+    if (!TEST_ptr(addr1 = BIO_ADDR_new())
+        || !TEST_ptr(addr2 = BIO_ADDR_new())
+        || !tx_gso_make_bio(addr1, &fd1, &bio1)
+        || !tx_gso_make_bio(addr2, &fd2, &bio2))
+        goto err;
+
+    if (BIO_dgram_get_segment_cap(bio1) == 0)
+        TEST_info("segmentation offload not supported, testing fallback");
+
+    /* Buffers on both sides come from a shared slab pool. */
+    if (!TEST_ptr(pool = ossl_quic_slab_pool_new(0, 0)))
+        goto err;
+
+    if (idx == 1) {
+        if (!TEST_ptr(rx_pool = ossl_quic_slab_pool_new(TX_GSO_RX_POOL_LEN, 0)))
+            goto err;
+    }
+
+    args.mdpl = 1472;
+    args.bio  = bio1;
+    args.pool = pool;
+    if (!TEST_ptr(qtx = ossl_qtx_new(&args))
+        || !TEST_ptr(rx.demux = ossl_quic_demux_new(bio2, 0, 1472, NULL, NULL))
+        || !TEST_true(ossl_quic_demux_set_slab_pool(rx.demux,
+                                                    rx_pool != NULL ? rx_pool
+                                                                    : pool))
+        || !TEST_true(ossl_quic_demux_register(rx.demux, &empty_conn_id,
+                                               tx_gso_rx_cb, &rx)))
+        goto err;
+
+    pkt.peer = addr2;
+    for (i = 0; i < TX_GSO_NUM_DGRAMS; ++i)
+        if (!TEST_true(ossl_qtx_write_pkt(qtx, &pkt)))
+            goto err;
+
+    ossl_qtx_flush_net(qtx);
+    if (!TEST_size_t_eq(ossl_qtx_get_queue_len_datagrams(qtx), 0))
+        goto err;
+
+    /*
+     * Loopback delivery is synchronous, so everything sent should now be
+     * readable without blocking.
+     */
+    while (rx.count < TX_GSO_NUM_DGRAMS)
+        if (!TEST_true(ossl_quic_demux_pump(rx.demux)))
+            goto err;
+
+    if (!TEST_false(rx.bad)
+        || !TEST_size_t_eq(rx.count, TX_GSO_NUM_DGRAMS)
+        || !TEST_false(ossl_quic_demux_set_slab_pool(rx.demux, NULL)))
+        goto err;
+
+    ossl_qtx_free(qtx);
+    qtx = NULL;
+    ossl_quic_demux_free(rx.demux);
+    rx.demux = NULL;
+
+    /* Everything was returned to the pool. */
+    ossl_quic_slab_get_stats(pool, &st);
+    if (!TEST_size_t_eq(st.bytes_in_use, 0)
+        || !TEST_uint64_t_eq(st.num_alloc, st.num_free))
+        goto err;
+
+    if (rx_pool != NULL) {
+        ossl_quic_slab_get_stats(rx_pool, &st);
+        if (!TEST_size_t_eq(st.bytes_in_use, 0)
+            || !TEST_uint64_t_eq(st.num_alloc, st.num_free))
+            goto err;
+    }
+
+    testresult = 1;
+err:
+    if (qtx != NULL)
+        ossl_qtx_free(qtx);
+    ossl_quic_demux_free(rx.demux);
+    ossl_quic_slab_pool_free(pool);
+    ossl_quic_slab_pool_free(rx_pool);
+    BIO_free(bio1);
+    BIO_free(bio2);
+    BIO_ADDR_free(addr1);
+    BIO_ADDR_free(addr2);
+    return testresult;
+}
+#endif
+
 int setup_tests(void)
 {
-    ADD_ALL_TESTS(test_rx_script, OSSL_NELEM(rx_scripts));
+    if (!TEST_ptr(cipher_cache = ossl_qrl_cipher_cache_new(NULL, NULL)))
+        return 0;
+
+    ADD_ALL_TESTS(test_rx_script, OSSL_NELEM(rx_scripts) * 2);
     /*
      * Each instance of this test is executed multiple times to get enough
      * statistical coverage for our statistical test, as well as for each
@@ -3502,6 +4092,18 @@ int setup_tests(void)
      * and otherwise random test ordering will cause itt to randomly fail.
      */
     ADD_ALL_TESTS(test_wire_pkt_hdr, NUM_WIRE_PKT_HDR_TESTS + 1);
-    ADD_ALL_TESTS(test_tx_script, OSSL_NELEM(tx_scripts));
+    ADD_ALL_TESTS(test_hdr_prot_batch, HPR_CIPHER_COUNT);
+    ADD_ALL_TESTS(test_tx_script, OSSL_NELEM(tx_scripts) * 2);
+    ADD_TEST(test_tx_pacing);
+    ADD_TEST(test_demux_shard);
+    ADD_ALL_TESTS(test_rx_0rtt, 2);
+#if !defined(OPENSSL_NO_DGRAM) && !defined(OPENSSL_NO_SOCK)
+    ADD_ALL_TESTS(test_tx_gso, 2);
+#endif
     return 1;
 }
+
+void cleanup_tests(void)
+{
+    ossl_qrl_cipher_cache_free(cipher_cache);
+}
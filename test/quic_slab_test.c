@@ -0,0 +1,122 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include "internal/quic_slab.h"
+#include "testutil.h"
+
+static const uint32_t pool_flags[] = {
+    0,
+    QUIC_SLAB_FLAG_THREAD_SAFE,
+    QUIC_SLAB_FLAG_HUGEPAGES,
+};
+
+/* Objects are rounded up to a size class and reused once freed. */
+static int test_slab_reuse(int idx)
+{
+    int testresult = 0;
+    QUIC_SLAB_POOL *pool = NULL;
+    QUIC_SLAB_STATS st;
+    unsigned char *p = NULL, *q = NULL, *r = NULL;
+
+    if (!TEST_ptr(pool = ossl_quic_slab_pool_new(0, pool_flags[idx]))
+        || !TEST_ptr(p = ossl_quic_slab_alloc(pool, 1500))
+        || !TEST_size_t_eq(ossl_quic_slab_usable_size(p), 2048)
+        || !TEST_ptr(q = ossl_quic_slab_alloc(pool, 1))
+        || !TEST_size_t_eq(ossl_quic_slab_usable_size(q),
+                           QUIC_SLAB_MIN_OBJ_LEN)
+        || !TEST_ptr(r = ossl_quic_slab_alloc(pool, QUIC_SLAB_MAX_OBJ_LEN))
+        || !TEST_ptr_null(ossl_quic_slab_alloc(pool,
+                                               QUIC_SLAB_MAX_OBJ_LEN + 1)))
+        goto err;
+
+    /* Whole object must be usable, and must not overlap others. */
+    memset(p, 0xaa, ossl_quic_slab_usable_size(p));
+    memset(q, 0xbb, ossl_quic_slab_usable_size(q));
+    memset(r, 0xcc, ossl_quic_slab_usable_size(r));
+    if (!TEST_uchar_eq(p[2047], 0xaa)
+        || !TEST_uchar_eq(q[0], 0xbb)
+        || !TEST_uchar_eq(r[0], 0xcc))
+        goto err;
+
+    ossl_quic_slab_get_stats(pool, &st);
+    if (!TEST_uint64_t_eq(st.num_alloc, 3)
+        || !TEST_uint64_t_eq(st.num_alloc_fail, 0)
+        || !TEST_size_t_eq(st.bytes_in_use,
+                           2048 + QUIC_SLAB_MIN_OBJ_LEN + QUIC_SLAB_MAX_OBJ_LEN))
+        goto err;
+
+    /* A freed object is handed out again for the same class. */
+    ossl_quic_slab_free(pool, p);
+    if (!TEST_ptr_eq(ossl_quic_slab_alloc(pool, 1100), p))
+        goto err;
+
+    ossl_quic_slab_free(pool, p);
+    ossl_quic_slab_free(pool, q);
+    ossl_quic_slab_free(pool, r);
+    ossl_quic_slab_free(pool, NULL);
+
+    ossl_quic_slab_get_stats(pool, &st);
+    if (!TEST_uint64_t_eq(st.num_free, 4)
+        || !TEST_size_t_eq(st.bytes_in_use, 0)
+        || !TEST_uint64_t_gt(st.num_slabs, 0))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_slab_pool_free(pool);
+    return testresult;
+}
+
+/* The pool never obtains more memory from the system than its limit. */
+#define LIMIT_BYTES     (256 * 1024)
+#define LIMIT_OBJ_LEN   1472
+
+static int test_slab_limit(void)
+{
+    int testresult = 0;
+    QUIC_SLAB_POOL *pool = NULL;
+    QUIC_SLAB_STATS st;
+    void *objs[LIMIT_BYTES / LIMIT_OBJ_LEN];
+    size_t i, n = 0;
+
+    if (!TEST_ptr(pool = ossl_quic_slab_pool_new(LIMIT_BYTES, 0)))
+        goto err;
+
+    for (n = 0; n < OSSL_NELEM(objs); ++n)
+        if ((objs[n] = ossl_quic_slab_alloc(pool, LIMIT_OBJ_LEN)) == NULL)
+            break;
+
+    ossl_quic_slab_get_stats(pool, &st);
+    if (!TEST_size_t_lt(n, OSSL_NELEM(objs))
+        || !TEST_size_t_gt(n, OSSL_NELEM(objs) / 2)
+        || !TEST_size_t_le(st.bytes_reserved, LIMIT_BYTES)
+        || !TEST_uint64_t_eq(st.num_alloc_fail, 1))
+        goto err;
+
+    /* Freeing makes room again without growing. */
+    ossl_quic_slab_free(pool, objs[--n]);
+    if (!TEST_ptr(objs[n] = ossl_quic_slab_alloc(pool, LIMIT_OBJ_LEN)))
+        goto err;
+
+    ++n;
+    testresult = 1;
+err:
+    for (i = 0; i < n; ++i)
+        ossl_quic_slab_free(pool, objs[i]);
+    ossl_quic_slab_pool_free(pool);
+    return testresult;
+}
+
+int setup_tests(void)
+{
+    ADD_ALL_TESTS(test_slab_reuse, OSSL_NELEM(pool_flags));
+    ADD_TEST(test_slab_limit);
+    return 1;
+}
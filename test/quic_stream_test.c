@@ -0,0 +1,345 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include "internal/packet.h"
+#include "internal/quic_stream.h"
+#include "internal/quic_error.h"
+#include "testutil.h"
+
+#define STREAM_DATA_LEN     4096
+
+static unsigned char stream_data[STREAM_DATA_LEN];
+
+static void init_stream_data(void)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(stream_data); ++i)
+        stream_data[i] = (unsigned char)(i * 7 + (i >> 8));
+}
+
+static int queue(QUIC_RSTREAM *qrs, uint64_t off, size_t len, int fin)
+{
+    return ossl_quic_rstream_queue_data(qrs, NULL, off, stream_data + off, len,
+                                        fin);
+}
+
+/*
+ * Records returned for zero-copy reads point into the queued data itself, and
+ * can be consumed partially.
+ */
+static int test_rstream_zero_copy(void)
+{
+    int testresult = 0, fin = -1;
+    QUIC_RSTREAM *qrs = NULL;
+    const unsigned char *rec;
+    size_t rec_len, avail;
+    unsigned char buf[64];
+
+    if (!TEST_ptr(qrs = ossl_quic_rstream_new(NULL, NULL, NULL, 0)))
+        goto err;
+
+    /* Nothing to read yet. */
+    if (!TEST_true(ossl_quic_rstream_get_record(qrs, &rec, &rec_len, &fin))
+        || !TEST_ptr_null(rec)
+        || !TEST_size_t_eq(rec_len, 0)
+        || !TEST_false(fin))
+        goto err;
+
+    if (!TEST_true(queue(qrs, 0, 100, 0))
+        || !TEST_true(queue(qrs, 100, 50, 0))
+        || !TEST_true(queue(qrs, 150, 10, 1)))
+        goto err;
+
+    if (!TEST_true(ossl_quic_rstream_available(qrs, &avail, &fin))
+        || !TEST_size_t_eq(avail, 160)
+        || !TEST_true(fin))
+        goto err;
+
+    if (!TEST_true(ossl_quic_rstream_get_record(qrs, &rec, &rec_len, &fin))
+        || !TEST_ptr_eq(rec, stream_data)
+        || !TEST_size_t_eq(rec_len, 100)
+        || !TEST_false(fin))
+        goto err;
+
+    /* Consume part of the record; the rest is returned next time. */
+    if (!TEST_true(ossl_quic_rstream_release_record(qrs, 40))
+        || !TEST_true(ossl_quic_rstream_get_record(qrs, &rec, &rec_len, &fin))
+        || !TEST_ptr_eq(rec, stream_data + 40)
+        || !TEST_size_t_eq(rec_len, 60)
+        || !TEST_false(ossl_quic_rstream_release_record(qrs, 61))
+        || !TEST_true(ossl_quic_rstream_release_record(qrs, SIZE_MAX))
+        || !TEST_uint64_t_eq(ossl_quic_rstream_get_read_offset(qrs), 100))
+        goto err;
+
+    /* Copying reads may span records. */
+    if (!TEST_true(ossl_quic_rstream_peek(qrs, buf, sizeof(buf), &rec_len,
+                                          &fin))
+        || !TEST_size_t_eq(rec_len, 60)
+        || !TEST_true(fin)
+        || !TEST_mem_eq(buf, rec_len, stream_data + 100, 60)
+        || !TEST_true(ossl_quic_rstream_read(qrs, buf, 55, &rec_len, &fin))
+        || !TEST_size_t_eq(rec_len, 55)
+        || !TEST_false(fin)
+        || !TEST_mem_eq(buf, rec_len, stream_data + 100, 55))
+        goto err;
+
+    if (!TEST_true(ossl_quic_rstream_get_record(qrs, &rec, &rec_len, &fin))
+        || !TEST_ptr_eq(rec, stream_data + 155)
+        || !TEST_size_t_eq(rec_len, 5)
+        || !TEST_true(fin)
+        || !TEST_true(ossl_quic_rstream_release_record(qrs, 5))
+        || !TEST_true(ossl_quic_rstream_get_record(qrs, &rec, &rec_len, &fin))
+        || !TEST_size_t_eq(rec_len, 0)
+        || !TEST_true(fin))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_rstream_free(qrs);
+    return testresult;
+}
+
+/*
+ * Out of order and overlapping frames, including retransmissions of data
+ * already consumed, must reassemble into the original stream.
+ */
+static const struct {
+    uint64_t off;
+    size_t   len;
+} reorder_frames[] = {
+    { 1000, 500 },  /* gap before */
+    { 2000, 96 },
+    { 0, 200 },
+    { 100, 300 },   /* overlaps the end of the previous frame */
+    { 900, 700 },   /* covers 1000..1500 entirely */
+    { 1200, 100 },  /* duplicate */
+    { 400, 500 },
+    { 1600, 400 },
+    { 50, 50 },     /* duplicate */
+};
+
+static int test_rstream_reorder(int consume_early)
+{
+    int testresult = 0, fin = 0;
+    QUIC_RSTREAM *qrs = NULL;
+    unsigned char buf[STREAM_DATA_LEN];
+    size_t i, avail, total = 0, n;
+
+    if (!TEST_ptr(qrs = ossl_quic_rstream_new(NULL, NULL, NULL, 0)))
+        goto err;
+
+    for (i = 0; i < OSSL_NELEM(reorder_frames); ++i) {
+        if (!TEST_true(queue(qrs, reorder_frames[i].off, reorder_frames[i].len,
+                             reorder_frames[i].off + reorder_frames[i].len
+                             == 2096)))
+            goto err;
+
+        if (consume_early) {
+            if (!TEST_true(ossl_quic_rstream_read(qrs, buf + total,
+                                                  sizeof(buf) - total, &n,
+                                                  &fin)))
+                goto err;
+
+            total += n;
+        }
+    }
+
+    if (!consume_early) {
+        if (!TEST_true(ossl_quic_rstream_available(qrs, &avail, &fin))
+            || !TEST_size_t_eq(avail, 2096)
+            || !TEST_true(fin)
+            || !TEST_true(ossl_quic_rstream_read(qrs, buf, sizeof(buf), &total,
+                                                 &fin)))
+            goto err;
+    }
+
+    if (!TEST_true(fin)
+        || !TEST_mem_eq(buf, total, stream_data, 2096))
+        goto err;
+
+    /* Retransmissions of consumed data are ignored. */
+    if (!TEST_true(queue(qrs, 0, 100, 0))
+        || !TEST_true(ossl_quic_rstream_available(qrs, &avail, &fin))
+        || !TEST_size_t_eq(avail, 0))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_rstream_free(qrs);
+    return testresult;
+}
+
+/* RFC 9000 s. 4.5: the final size cannot change. */
+static int test_rstream_final_size(void)
+{
+    int testresult = 0;
+    QUIC_RSTREAM *qrs = NULL;
+
+    if (!TEST_ptr(qrs = ossl_quic_rstream_new(NULL, NULL, NULL, 0))
+        || !TEST_true(queue(qrs, 0, 100, 0))
+        || !TEST_false(queue(qrs, 0, 50, 1))     /* below data received */
+        || !TEST_true(queue(qrs, 100, 100, 1))
+        || !TEST_true(queue(qrs, 150, 50, 1))    /* same final size */
+        || !TEST_false(queue(qrs, 150, 60, 0))   /* beyond final size */
+        || !TEST_false(queue(qrs, 200, 10, 1)))  /* different final size */
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_rstream_free(qrs);
+    return testresult;
+}
+
+/*
+ * With a ring buffer, data which arrives after a gap is copied into it and
+ * coalesced, while data which can be read at once is still referenced in
+ * place. Nothing beyond max_buf bytes past the read offset is held.
+ */
+#define RING_LEN    1024
+
+static int check_stats(QUIC_RSTREAM *qrs, size_t num_frames,
+                       uint64_t bytes_in_place, uint64_t bytes_in_rbuf,
+                       uint64_t bytes_copied, uint64_t bytes_dropped)
+{
+    QUIC_RSTREAM_STATS stats;
+
+    ossl_quic_rstream_get_stats(qrs, &stats);
+    return TEST_size_t_eq(stats.num_frames, num_frames)
+        && TEST_uint64_t_eq(stats.bytes_in_place, bytes_in_place)
+        && TEST_uint64_t_eq(stats.bytes_in_rbuf, bytes_in_rbuf)
+        && TEST_uint64_t_eq(stats.bytes_copied, bytes_copied)
+        && TEST_uint64_t_eq(stats.bytes_dropped, bytes_dropped);
+}
+
+static int test_rstream_ring(void)
+{
+    int testresult = 0, fin;
+    QUIC_RSTREAM *qrs = NULL;
+    const unsigned char *rec;
+    size_t rec_len, avail;
+    unsigned char buf[RING_LEN];
+
+    if (!TEST_ptr(qrs = ossl_quic_rstream_new(NULL, NULL, NULL, RING_LEN)))
+        goto err;
+
+    /* In order: referenced in place. Out of order: copied. */
+    if (!TEST_true(queue(qrs, 0, 100, 0))
+        || !TEST_true(queue(qrs, 300, 100, 0))
+        || !check_stats(qrs, 2, 100, 100, 100, 0)
+        || !TEST_true(ossl_quic_rstream_get_record(qrs, &rec, &rec_len, &fin))
+        || !TEST_ptr_eq(rec, stream_data)
+        || !TEST_size_t_eq(rec_len, 100))
+        goto err;
+
+    /* Adjacent out of order data coalesces into one frame. */
+    if (!TEST_true(queue(qrs, 200, 100, 0))
+        || !check_stats(qrs, 2, 100, 200, 200, 0))
+        goto err;
+
+    /* Filling the gap makes it all readable. */
+    if (!TEST_true(queue(qrs, 100, 100, 0))
+        || !check_stats(qrs, 3, 200, 200, 200, 0)
+        || !TEST_true(ossl_quic_rstream_available(qrs, &avail, &fin))
+        || !TEST_size_t_eq(avail, 400)
+        || !TEST_true(ossl_quic_rstream_read(qrs, buf, sizeof(buf), &rec_len,
+                                             &fin))
+        || !TEST_mem_eq(buf, rec_len, stream_data, 400)
+        || !check_stats(qrs, 0, 0, 0, 200, 0))
+        goto err;
+
+    /*
+     * This wraps around the end of the ring, and extends 76 bytes beyond
+     * read offset + max_buf, which are dropped.
+     */
+    if (!TEST_true(queue(qrs, 1000, 500, 0))
+        || !check_stats(qrs, 2, 0, 424, 624, 76)
+        || !TEST_true(queue(qrs, 400, 600, 0))
+        || !TEST_true(ossl_quic_rstream_read(qrs, buf, sizeof(buf), &rec_len,
+                                             &fin))
+        || !TEST_mem_eq(buf, rec_len, stream_data + 400, RING_LEN)
+        || !TEST_uint64_t_eq(ossl_quic_rstream_get_read_offset(qrs),
+                             400 + RING_LEN))
+        goto err;
+
+    /* The dropped data can be received once the window has moved. */
+    if (!TEST_true(queue(qrs, 1400, 100, 1))
+        || !TEST_true(ossl_quic_rstream_read(qrs, buf, sizeof(buf), &rec_len,
+                                             &fin))
+        || !TEST_true(fin)
+        || !TEST_mem_eq(buf, rec_len, stream_data + 400 + RING_LEN, 76))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_rstream_free(qrs);
+    return testresult;
+}
+
+static OSSL_TIME fake_time;
+
+static OSSL_TIME fake_now(void *arg)
+{
+    return fake_time;
+}
+
+/* Received data is reported to the RXFC, and consumed data retired. */
+static int test_rstream_rxfc(void)
+{
+    int testresult = 0, fin;
+    QUIC_RXFC conn_rxfc, stream_rxfc;
+    QUIC_RSTREAM *qrs = NULL;
+    unsigned char buf[1000];
+    size_t n;
+
+    fake_time = ossl_ticks2time(OSSL_TIME_SECOND);
+
+    if (!TEST_true(ossl_quic_rxfc_init(&conn_rxfc, NULL, 2000, 2000,
+                                       fake_now, NULL))
+        || !TEST_true(ossl_quic_rxfc_init(&stream_rxfc, &conn_rxfc, 1000, 1000,
+                                          fake_now, NULL))
+        || !TEST_ptr(qrs = ossl_quic_rstream_new(NULL, &stream_rxfc, NULL,
+                                                 1000)))
+        goto err;
+
+    if (!TEST_true(queue(qrs, 400, 200, 0))
+        || !TEST_true(queue(qrs, 0, 400, 0))
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_get_swm(&stream_rxfc), 600)
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_get_swm(&conn_rxfc), 600)
+        || !TEST_true(ossl_quic_rstream_read(qrs, buf, sizeof(buf), &n, &fin))
+        || !TEST_size_t_eq(n, 600)
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_get_rwm(&stream_rxfc), 600)
+        || !TEST_uint64_t_eq(ossl_quic_rxfc_get_rwm(&conn_rxfc), 600)
+        || !TEST_true(ossl_quic_rxfc_has_cwm_changed(&stream_rxfc, 1))
+        || !TEST_uint64_t_gt(ossl_quic_rxfc_get_cwm(&stream_rxfc), 1000))
+        goto err;
+
+    /* Beyond the credit extended. */
+    if (!TEST_false(queue(qrs, ossl_quic_rxfc_get_cwm(&stream_rxfc), 10, 0))
+        || !TEST_int_eq(ossl_quic_rxfc_get_error(&stream_rxfc, 0),
+                        QUIC_ERR_FLOW_CONTROL_ERROR))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_rstream_free(qrs);
+    return testresult;
+}
+
+int setup_tests(void)
+{
+    init_stream_data();
+
+    ADD_TEST(test_rstream_zero_copy);
+    ADD_ALL_TESTS(test_rstream_reorder, 2);
+    ADD_TEST(test_rstream_final_size);
+    ADD_TEST(test_rstream_ring);
+    ADD_TEST(test_rstream_rxfc);
+    return 1;
+}
@@ -0,0 +1,484 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <openssl/bio.h>
+#include "internal/packet.h"
+#include "internal/quic_token.h"
+#include "internal/quic_wire_pkt.h"
+#include "testutil.h"
+
+static OSSL_TIME fake_time;
+
+static OSSL_TIME fake_now(void *arg)
+{
+    return fake_time;
+}
+
+static void set_addr(BIO_ADDR *addr, unsigned char last_octet,
+                     unsigned short port)
+{
+    unsigned char ip[4] = { 192, 0, 2, 0 };
+
+    ip[3] = last_octet;
+    BIO_ADDR_rawmake(addr, AF_INET, ip, sizeof(ip), htons(port));
+}
+
+/* RFC 9001 A.4: Retry packet in response to the Initial of A.2. */
+static const unsigned char retry_pkt[] = {
+    0xff, 0x00, 0x00, 0x00, 0x01, 0x00, 0x08, 0xf0, 0x67, 0xa5, 0x50, 0x2a,
+    0x42, 0x62, 0xb5, 0x74, 0x6f, 0x6b, 0x65, 0x6e, 0x04, 0xa2, 0x65, 0xba,
+    0x2e, 0xff, 0x4d, 0x82, 0x90, 0x58, 0xfb, 0x3f, 0x0f, 0x24, 0x96, 0xba
+};
+
+static const QUIC_CONN_ID retry_odcid = {
+    8, { 0x83, 0x94, 0xc8, 0xf0, 0x3e, 0x51, 0x57, 0x08 }
+};
+
+static int test_retry_integrity_tag(void)
+{
+    int i;
+    unsigned char pkt[sizeof(retry_pkt)];
+    unsigned char tag[QUIC_RETRY_INTEGRITY_TAG_LEN];
+    QUIC_CONN_ID odcid = retry_odcid;
+    EVP_CIPHER_CTX *cctx;
+
+    memcpy(pkt, retry_pkt, sizeof(pkt));
+
+    /* A pre-keyed context gives the right tag each time it is used. */
+    if (!TEST_ptr(cctx = ossl_quic_retry_integrity_ctx_new(NULL, NULL)))
+        return 0;
+
+    for (i = 0; i < 2; ++i) {
+        memset(tag, 0, sizeof(tag));
+        if (!TEST_true(ossl_quic_calculate_retry_integrity_tag_ctx(
+                           cctx, pkt, sizeof(pkt) - sizeof(tag), &odcid, tag))
+            || !TEST_mem_eq(tag, sizeof(tag), pkt + sizeof(pkt) - sizeof(tag),
+                            sizeof(tag))) {
+            EVP_CIPHER_CTX_free(cctx);
+            return 0;
+        }
+    }
+
+    EVP_CIPHER_CTX_free(cctx);
+
+    if (!TEST_true(ossl_quic_calculate_retry_integrity_tag(NULL, NULL, pkt,
+                                                           sizeof(pkt)
+                                                           - sizeof(tag),
+                                                           &odcid, tag))
+        || !TEST_mem_eq(tag, sizeof(tag), pkt + sizeof(pkt) - sizeof(tag),
+                        sizeof(tag))
+        || !TEST_true(ossl_quic_validate_retry_integrity_tag(NULL, NULL, pkt,
+                                                             sizeof(pkt),
+                                                             &odcid)))
+        return 0;
+
+    /* A different ODCID, or any change to the packet, invalidates the tag. */
+    odcid.id[7] ^= 1;
+    if (!TEST_false(ossl_quic_validate_retry_integrity_tag(NULL, NULL, pkt,
+                                                           sizeof(pkt),
+                                                           &odcid)))
+        return 0;
+
+    pkt[sizeof(pkt) / 2] ^= 1;
+    if (!TEST_false(ossl_quic_validate_retry_integrity_tag(NULL, NULL, pkt,
+                                                           sizeof(pkt),
+                                                           &retry_odcid)))
+        return 0;
+
+    return 1;
+}
+
+static int test_token_roundtrip(void)
+{
+    int testresult = 0;
+    QUIC_TOKEN_ENGINE *eng = NULL;
+    QUIC_CONN_ID odcid = { 8, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+    QUIC_CONN_ID rscid = { 4, { 9, 10, 11, 12 } };
+    unsigned char token[QUIC_TOKEN_MAX_LEN], new_token[QUIC_TOKEN_MAX_LEN];
+    size_t token_len, new_token_len;
+    BIO_ADDR *peer = NULL, *other = NULL;
+    QUIC_TOKEN_INFO info;
+
+    fake_time = ossl_seconds2time(1000);
+
+    if (!TEST_ptr(peer = BIO_ADDR_new())
+        || !TEST_ptr(other = BIO_ADDR_new())
+        || !TEST_ptr(eng = ossl_quic_token_engine_new(NULL, NULL, fake_now,
+                                                      NULL)))
+        goto err;
+
+    set_addr(peer, 1, 4433);
+
+    if (!TEST_true(ossl_quic_token_engine_gen_retry_token(eng, peer, &odcid,
+                                                          &rscid, token,
+                                                          sizeof(token),
+                                                          &token_len))
+        || !TEST_true(ossl_quic_token_engine_gen_new_token(eng, peer,
+                                                           new_token,
+                                                           sizeof(new_token),
+                                                           &new_token_len))
+        || !TEST_size_t_le(token_len, QUIC_TOKEN_MAX_LEN))
+        goto err;
+
+    if (!TEST_true(ossl_quic_token_engine_validate(eng, peer, token, token_len,
+                                                   &info))
+        || !TEST_int_eq(info.type, QUIC_TOKEN_TYPE_RETRY)
+        || !TEST_true(ossl_quic_conn_id_eq(&info.odcid, &odcid))
+        || !TEST_true(ossl_quic_conn_id_eq(&info.retry_scid, &rscid))
+        || !TEST_uint64_t_eq(ossl_time2ticks(info.issued),
+                             ossl_time2ticks(fake_time)))
+        goto err;
+
+    if (!TEST_true(ossl_quic_token_engine_validate(eng, peer, new_token,
+                                                   new_token_len, &info))
+        || !TEST_int_eq(info.type, QUIC_TOKEN_TYPE_NEW_TOKEN)
+        || !TEST_size_t_eq(info.odcid.id_len, 0))
+        goto err;
+
+    /* Tokens are bound to the address they were issued to. */
+    set_addr(other, 2, 4433);
+    if (!TEST_false(ossl_quic_token_engine_validate(eng, other, token,
+                                                    token_len, NULL))
+        || !TEST_false(ossl_quic_token_engine_validate(eng, other, new_token,
+                                                       new_token_len, NULL)))
+        goto err;
+
+    /* Only Retry tokens are also bound to the port. */
+    set_addr(other, 1, 4434);
+    if (!TEST_false(ossl_quic_token_engine_validate(eng, other, token,
+                                                    token_len, NULL))
+        || !TEST_true(ossl_quic_token_engine_validate(eng, other, new_token,
+                                                      new_token_len, &info))
+        || !TEST_int_eq(info.type, QUIC_TOKEN_TYPE_NEW_TOKEN))
+        goto err;
+
+    /* The type sent in the clear is authenticated. */
+    new_token[1] = QUIC_TOKEN_TYPE_RETRY;
+    if (!TEST_false(ossl_quic_token_engine_validate(eng, peer, new_token,
+                                                    new_token_len, NULL)))
+        goto err;
+    new_token[1] = QUIC_TOKEN_TYPE_NEW_TOKEN;
+
+    /* Tampering with any part of a token invalidates it. */
+    token[0] ^= 2;
+    if (!TEST_false(ossl_quic_token_engine_validate(eng, peer, token,
+                                                    token_len, NULL)))
+        goto err;
+
+    token[0] ^= 2;
+    token[token_len / 2] ^= 1;
+    if (!TEST_false(ossl_quic_token_engine_validate(eng, peer, token,
+                                                    token_len, NULL))
+        || !TEST_false(ossl_quic_token_engine_validate(eng, peer, token,
+                                                       token_len - 1, NULL)))
+        goto err;
+
+    /* Retry tokens expire quickly, NEW_TOKEN tokens much later. */
+    fake_time = ossl_time_add(fake_time, ossl_seconds2time(10));
+    token[token_len / 2] ^= 1;
+    if (!TEST_false(ossl_quic_token_engine_validate(eng, peer, token,
+                                                    token_len, NULL))
+        || !TEST_true(ossl_quic_token_engine_validate(eng, peer, new_token,
+                                                      new_token_len, NULL)))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_token_engine_free(eng);
+    BIO_ADDR_free(peer);
+    BIO_ADDR_free(other);
+    return testresult;
+}
+
+static int test_token_rotation(void)
+{
+    int testresult = 0;
+    QUIC_TOKEN_ENGINE *eng = NULL;
+    unsigned char token[QUIC_TOKEN_MAX_LEN], token2[QUIC_TOKEN_MAX_LEN];
+    size_t token_len, token2_len;
+    BIO_ADDR *peer = NULL;
+
+    fake_time = ossl_seconds2time(1000);
+
+    if (!TEST_ptr(peer = BIO_ADDR_new())
+        || !TEST_ptr(eng = ossl_quic_token_engine_new(NULL, NULL, fake_now,
+                                                      NULL))
+        || !TEST_true(ossl_quic_token_engine_set_lifetimes(eng,
+                                                           ossl_seconds2time(10),
+                                                           ossl_seconds2time(1000),
+                                                           ossl_seconds2time(100))))
+        goto err;
+
+    set_addr(peer, 1, 4433);
+
+    if (!TEST_true(ossl_quic_token_engine_gen_new_token(eng, peer, token,
+                                                        sizeof(token),
+                                                        &token_len)))
+        goto err;
+
+    /* A token sealed with the previous key is still accepted. */
+    if (!TEST_true(ossl_quic_token_engine_rotate(eng))
+        || !TEST_true(ossl_quic_token_engine_validate(eng, peer, token,
+                                                      token_len, NULL))
+        || !TEST_true(ossl_quic_token_engine_gen_new_token(eng, peer, token2,
+                                                           sizeof(token2),
+                                                           &token2_len))
+        || !TEST_int_ne(token[0], token2[0]))
+        goto err;
+
+    /* But not after a second rotation, here due to the interval elapsing. */
+    fake_time = ossl_time_add(fake_time, ossl_seconds2time(100));
+    if (!TEST_false(ossl_quic_token_engine_validate(eng, peer, token,
+                                                    token_len, NULL))
+        || !TEST_true(ossl_quic_token_engine_validate(eng, peer, token2,
+                                                      token2_len, NULL)))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_token_engine_free(eng);
+    BIO_ADDR_free(peer);
+    return testresult;
+}
+
+/*
+ * Retry filter test. Datagrams are injected into a demuxer as if from a
+ * client, and Retry packets are read back from the other half of a datagram
+ * pair.
+ */
+#define CLIENT_DGRAM_LEN    1200
+
+static QUIC_DEMUX *filter_demux;
+static int filter_calls;
+static QUIC_TOKEN_INFO filter_info;
+static int filter_info_valid;
+
+static void filter_cb(QUIC_URXE *e, const QUIC_TOKEN_INFO *info, void *arg)
+{
+    ++filter_calls;
+    filter_info_valid = (info != NULL);
+    if (info != NULL)
+        filter_info = *info;
+
+    ossl_quic_demux_release_urxe(filter_demux, e);
+}
+
+static const QUIC_CONN_ID client_dcid = { 8, { 0xa0, 1, 2, 3, 4, 5, 6, 7 } };
+static const QUIC_CONN_ID client_scid = { 4, { 0xc0, 1, 2, 3 } };
+
+/* Injects an Initial packet padded to dgram_len. */
+static int inject_initial(const QUIC_CONN_ID *dcid,
+                          const unsigned char *token, size_t token_len,
+                          const BIO_ADDR *peer, size_t dgram_len)
+{
+    unsigned char buf[CLIENT_DGRAM_LEN];
+    QUIC_PKT_HDR hdr = {0};
+    WPACKET wpkt;
+    size_t hdr_len;
+    int ok;
+
+    hdr.type        = QUIC_PKT_TYPE_INITIAL;
+    hdr.fixed       = 1;
+    hdr.version     = QUIC_VERSION_1;
+    hdr.pn_len      = 1;
+    hdr.dst_conn_id = *dcid;
+    hdr.src_conn_id = client_scid;
+    hdr.token       = token;
+    hdr.token_len   = token_len;
+    hdr.len         = 100;
+
+    if (!TEST_size_t_le(dgram_len, sizeof(buf))
+        || !TEST_int_gt(hdr_len = ossl_quic_wire_get_encoded_pkt_hdr_len(0,
+                                                                         &hdr),
+                        0))
+        return 0;
+
+    /* The encoded header length does not count the token itself. */
+    hdr.len = dgram_len - hdr_len - token_len;
+    memset(buf, 0, sizeof(buf));
+
+    if (!TEST_true(WPACKET_init_static_len(&wpkt, buf, sizeof(buf), 0)))
+        return 0;
+
+    ok = TEST_true(ossl_quic_wire_encode_pkt_hdr(&wpkt, 0, &hdr, NULL))
+         && TEST_true(WPACKET_allocate_bytes(&wpkt, hdr.len, NULL));
+    WPACKET_cleanup(&wpkt);
+
+    return ok
+        && TEST_true(ossl_quic_demux_inject(filter_demux, buf, dgram_len, peer,
+                                            NULL));
+}
+
+/*
+ * Reads a Retry packet, checking it is addressed to the client and bears a
+ * valid integrity tag for the Initial packet DCID odcid, and extracts its SCID
+ * and token. Fails if there is none.
+ */
+static int read_retry(BIO *bio, const QUIC_CONN_ID *odcid, QUIC_CONN_ID *scid,
+                      unsigned char *token, size_t *token_len)
+{
+    unsigned char buf[512];
+    BIO_MSG msg = {0};
+    size_t num_msg = 0;
+    QUIC_PKT_HDR hdr;
+    PACKET pkt;
+
+    msg.data        = buf;
+    msg.data_len    = sizeof(buf);
+
+    if (!TEST_true(BIO_recvmmsg(bio, &msg, sizeof(msg), 1, 0, &num_msg))
+        || !TEST_size_t_eq(num_msg, 1)
+        || !TEST_true(PACKET_buf_init(&pkt, buf, msg.data_len))
+        || !TEST_true(ossl_quic_wire_decode_pkt_hdr(&pkt, 0, 0, &hdr, NULL))
+        || !TEST_int_eq(hdr.type, QUIC_PKT_TYPE_RETRY)
+        || !TEST_true(ossl_quic_conn_id_eq(&hdr.dst_conn_id, &client_scid))
+        || !TEST_size_t_gt(hdr.len, QUIC_RETRY_INTEGRITY_TAG_LEN)
+        || !TEST_true(ossl_quic_validate_retry_integrity_tag(NULL, NULL, buf,
+                                                             msg.data_len,
+                                                             odcid)))
+        return 0;
+
+    *scid       = hdr.src_conn_id;
+    *token_len  = hdr.len - QUIC_RETRY_INTEGRITY_TAG_LEN;
+    memcpy(token, hdr.data, *token_len);
+    return 1;
+}
+
+static int no_datagram(BIO *bio)
+{
+    return TEST_size_t_eq(BIO_ctrl_pending(bio), 0);
+}
+
+static int test_retry_filter(void)
+{
+    int testresult = 0;
+    BIO *bio1 = NULL, *bio2 = NULL;
+    BIO_ADDR *peer = NULL, *other = NULL;
+    QUIC_TOKEN_ENGINE *eng = NULL;
+    QUIC_TOKEN_ENGINE_STATS stats;
+    QUIC_CONN_ID retry_scid;
+    unsigned char token[QUIC_TOKEN_MAX_LEN], short_pkt[64];
+    size_t token_len;
+
+    fake_time = ossl_seconds2time(1000);
+    filter_calls = 0;
+
+    if (!TEST_true(BIO_new_bio_dgram_pair(&bio1, 0, &bio2, 0))
+        || !TEST_true(BIO_dgram_set_caps(bio2, BIO_DGRAM_CAP_HANDLES_DST_ADDR))
+        || !TEST_ptr(peer = BIO_ADDR_new())
+        || !TEST_ptr(other = BIO_ADDR_new())
+        || !TEST_ptr(filter_demux = ossl_quic_demux_new(bio1, 8, 1500, NULL,
+                                                        NULL))
+        || !TEST_ptr(eng = ossl_quic_token_engine_new(NULL, NULL, fake_now,
+                                                      NULL))
+        || !TEST_true(ossl_quic_token_engine_set_retry_filter(eng, filter_demux,
+                                                              bio1, filter_cb,
+                                                              NULL)))
+        goto err;
+
+    set_addr(peer, 1, 4433);
+    set_addr(other, 2, 4433);
+
+    /* An unpadded Initial is dropped without a response. */
+    if (!TEST_true(inject_initial(&client_dcid, NULL, 0, peer, 1000))
+        || !TEST_int_eq(filter_calls, 0)
+        || !no_datagram(bio2))
+        goto err;
+
+    /* An Initial without a token is answered with a Retry. */
+    if (!TEST_true(inject_initial(&client_dcid, NULL, 0, peer,
+                                  CLIENT_DGRAM_LEN))
+        || !TEST_int_eq(filter_calls, 0)
+        || !TEST_true(read_retry(bio2, &client_dcid, &retry_scid, token,
+                                 &token_len)))
+        goto err;
+
+    /* The token is accepted when echoed to the SCID of the Retry. */
+    if (!TEST_true(inject_initial(&retry_scid, token, token_len, peer,
+                                  CLIENT_DGRAM_LEN))
+        || !TEST_int_eq(filter_calls, 1)
+        || !TEST_true(filter_info_valid)
+        || !TEST_int_eq(filter_info.type, QUIC_TOKEN_TYPE_RETRY)
+        || !TEST_true(ossl_quic_conn_id_eq(&filter_info.odcid, &client_dcid))
+        || !TEST_true(ossl_quic_conn_id_eq(&filter_info.retry_scid,
+                                           &retry_scid))
+        || !no_datagram(bio2))
+        goto err;
+
+    /* But not to any other DCID. */
+    if (!TEST_true(inject_initial(&client_dcid, token, token_len, peer,
+                                  CLIENT_DGRAM_LEN))
+        || !TEST_int_eq(filter_calls, 1)
+        || !no_datagram(bio2))
+        goto err;
+
+    /*
+     * From another address, the token cannot be authenticated, so is treated
+     * as absent and the client gets a Retry of its own.
+     */
+    if (!TEST_true(inject_initial(&retry_scid, token, token_len, other,
+                                  CLIENT_DGRAM_LEN))
+        || !TEST_int_eq(filter_calls, 1)
+        || !TEST_true(read_retry(bio2, &retry_scid, &retry_scid, token,
+                                 &token_len)))
+        goto err;
+
+    /* An expired Retry token is dropped. */
+    fake_time = ossl_time_add(fake_time, ossl_seconds2time(60));
+    if (!TEST_true(inject_initial(&retry_scid, token, token_len, other,
+                                  CLIENT_DGRAM_LEN))
+        || !TEST_int_eq(filter_calls, 1)
+        || !no_datagram(bio2))
+        goto err;
+
+    /* Packets other than Initial packets are passed on. */
+    memset(short_pkt, 0, sizeof(short_pkt));
+    short_pkt[0] = 0x40;
+    if (!TEST_true(ossl_quic_demux_inject(filter_demux, short_pkt,
+                                          sizeof(short_pkt), peer, NULL))
+        || !TEST_int_eq(filter_calls, 2)
+        || !TEST_false(filter_info_valid))
+        goto err;
+
+    /* When Retry is not required, Initial packets are passed on too. */
+    ossl_quic_token_engine_set_require_retry(eng, 0);
+    if (!TEST_true(inject_initial(&client_dcid, NULL, 0, peer,
+                                  CLIENT_DGRAM_LEN))
+        || !TEST_int_eq(filter_calls, 3)
+        || !TEST_false(filter_info_valid)
+        || !no_datagram(bio2))
+        goto err;
+
+    ossl_quic_token_engine_get_stats(eng, &stats);
+    if (!TEST_uint64_t_eq(stats.retry_sent, 2)
+        || !TEST_uint64_t_eq(stats.token_valid, 1)
+        || !TEST_uint64_t_eq(stats.token_invalid, 3)
+        || !TEST_uint64_t_eq(stats.dropped, 5))
+        goto err;
+
+    testresult = 1;
+err:
+    ossl_quic_token_engine_free(eng);
+    ossl_quic_demux_free(filter_demux);
+    filter_demux = NULL;
+    BIO_free(bio1);
+    BIO_free(bio2);
+    BIO_ADDR_free(peer);
+    BIO_ADDR_free(other);
+    return testresult;
+}
+
+int setup_tests(void)
+{
+    ADD_TEST(test_retry_integrity_tag);
+    ADD_TEST(test_token_roundtrip);
+    ADD_TEST(test_token_rotation);
+    ADD_TEST(test_retry_filter);
+    return 1;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2022 The OpenSSL Project Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License 2.0 (the "License").  You may not use
+ * this file except in compliance with the License.  You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://www.openssl.org/source/license.html
+ */
+
+#include <string.h>
+#include <openssl/bio.h>
+#include <openssl/trace.h>
+#include "internal/quic_trace.h"
+#include "internal/quic_ackm.h"
+#include "internal/quic_fc.h"
+#include "testutil.h"
+
+static int test_qlog_disabled(void)
+{
+    QUIC_TXFC txfc;
+
+    /* Nothing is traced with no channel set, or in no-trace builds. */
+    return TEST_false(OSSL_trace_enabled(OSSL_TRACE_CATEGORY_QUIC))
+        && TEST_true(ossl_quic_txfc_init(&txfc, NULL))
+        && TEST_true(ossl_quic_txfc_bump_cwm(&txfc, 100))
+        && TEST_true(ossl_quic_txfc_consume_credit(&txfc, 100))
+        && TEST_true(ossl_quic_txfc_has_become_blocked(&txfc, 1));
+}
+
+#if !defined(OPENSSL_NO_TRACE)
+
+static OSSL_TIME fake_time;
+
+static OSSL_TIME fake_now(void *arg)
+{
+    return fake_time;
+}
+
+/* The trace channel, which is owned by the trace API once set. */
+static BIO *trc_bio;
+
+static int start_trace(void)
+{
+    if (!TEST_ptr(trc_bio = BIO_new(BIO_s_mem())))
+        return 0;
+
+    if (!TEST_true(OSSL_trace_set_channel(OSSL_TRACE_CATEGORY_QUIC,
+                                          trc_bio))) {
+        BIO_free(trc_bio);
+        trc_bio = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+static void stop_trace(void)
+{
+    OSSL_trace_set_channel(OSSL_TRACE_CATEGORY_QUIC, NULL);
+    trc_bio = NULL;
+}
+
+/*
+ * Checks that the output is a sequence of qlog JSON-SEQ records, and returns
+ * the number of records containing needle, or -1 on error.
+ */
+static int count_records(const char *needle)
+{
+    char *data, *rec, *end;
+    long len;
+    int num = 0;
+
+    if (!TEST_long_ge(len = BIO_get_mem_data(trc_bio, &data), 0))
+        return -1;
+
+    for (rec = data; rec < data + len; rec = end + 1) {
+        end = memchr(rec, '\n', data + len - rec);
+        if (!TEST_ptr(end)
+            || !TEST_int_eq(rec[0], 0x1e)
+            || !TEST_int_eq(rec[1], '{')
+            || !TEST_int_eq(end[-1], '}'))
+            return -1;
+
+        *end = '\0';
+        if (strstr(rec, needle) != NULL)
+            ++num;
+        *end = '\n';
+    }
+
+    return num;
+}
+
+static int test_qlog_fc(void)
+{
+    int testresult = 0;
+    QUIC_TXFC conn_txfc, stream_txfc;
+    QUIC_RXFC conn_rxfc, stream_rxfc;
+
+    fake_time = ossl_seconds2time(1);
+
+    if (!start_trace())
+        return 0;
+
+    if (!TEST_true(ossl_quic_txfc_init(&conn_txfc, NULL))
+        || !TEST_true(ossl_quic_txfc_init(&stream_txfc, &conn_txfc))
+        || !TEST_true(ossl_quic_txfc_bump_cwm(&conn_txfc, 1000))
+        || !TEST_true(ossl_quic_txfc_bump_cwm(&stream_txfc, 500))
+        || !TEST_true(ossl_quic_txfc_consume_credit(&stream_txfc, 500))
+        || !TEST_int_eq(count_records("\"name\":\"flow_control:blocked\","
+                                      "\"group_id\""), 1)
+        || !TEST_int_eq(count_records("\"level\":\"stream\",\"limit\":500"),
+                        1))
+        goto err;
+
+    if (!TEST_true(ossl_quic_rxfc_init(&conn_rxfc, NULL, 2000, 2000,
+                                       fake_now, NULL))
+        || !TEST_true(ossl_quic_rxfc_init(&stream_rxfc, &conn_rxfc, 1000,
+                                          1000, fake_now, NULL))
+        || !TEST_true(ossl_quic_rxfc_on_rx_stream_frame(&stream_rxfc, 800, 0))
+        || !TEST_true(ossl_quic_rxfc_on_retire(&stream_rxfc, 800,
+                                               ossl_ms2time(10)))
+        || !TEST_int_eq(count_records("flow_control:window_updated"), 2)
+        || !TEST_int_eq(count_records("\"time\":1000.000000,"), 2)
+        || !TEST_int_eq(count_records("\"level\":\"stream\",\"limit\":1800,"
+                                      "\"window\":1000"), 1))
+        goto err;
+
+    testresult = 1;
+err:
+    stop_trace();
+    return testresult;
+}
+
+static void on_tx_pkt_event(void *arg)
+{
+}
+
+static int test_qlog_ackm(void)
+{
+    int testresult = 0;
+    OSSL_STATM statm;
+    OSSL_ACKM *ackm = NULL;
+    OSSL_CC_DATA *cc_data = NULL;
+    OSSL_ACKM_TX_PKT pkts[6];
+    OSSL_QUIC_ACK_RANGE range = { 5, 5 };
+    OSSL_QUIC_FRAME_ACK ack = {0};
+    size_t i;
+
+    fake_time = ossl_seconds2time(1);
+    memset(pkts, 0, sizeof(pkts));
+
+    if (!TEST_true(ossl_statm_init(&statm))
+        || !TEST_ptr(cc_data = ossl_cc_dummy_method.new(NULL, NULL, NULL))
+        || !TEST_ptr(ackm = ossl_ackm_new(fake_now, NULL, &statm,
+                                          &ossl_cc_dummy_method, cc_data))
+        || !start_trace())
+        goto err;
+
+    for (i = 0; i < OSSL_NELEM(pkts); ++i) {
+        pkts[i].pkt_num             = i;
+        pkts[i].pkt_space           = QUIC_PN_SPACE_APP;
+        pkts[i].is_inflight         = 1;
+        pkts[i].is_ack_eliciting    = 1;
+        pkts[i].num_bytes           = 100;
+        pkts[i].largest_acked       = QUIC_PN_INVALID;
+        pkts[i].time                = fake_time;
+        pkts[i].on_lost             = on_tx_pkt_event;
+        pkts[i].on_acked            = on_tx_pkt_event;
+        pkts[i].on_discarded        = on_tx_pkt_event;
+
+        if (!TEST_true(ossl_ackm_on_tx_packet(ackm, &pkts[i])))
+            goto err;
+    }
+
+    /* Acking 5 alone makes 0-2 lost by the packet threshold. */
+    fake_time = ossl_time_add(fake_time, ossl_ms2time(20));
+    ack.ack_ranges      = &range;
+    ack.num_ack_ranges  = 1;
+    if (!TEST_true(ossl_ackm_on_rx_ack_frame(ackm, &ack, QUIC_PN_SPACE_APP,
+                                             fake_time))
+        || !TEST_int_eq(count_records("recovery:packet_lost"), 3)
+        || !TEST_int_eq(count_records("\"header\":{\"packet_type\":\"1RTT\","
+                                      "\"packet_number\":2}"), 1)
+        || !TEST_int_eq(count_records("recovery:metrics_updated"), 1)
+        || !TEST_int_eq(count_records("\"latest_rtt\":20.000000,"), 1)
+        || !TEST_int_eq(count_records("\"bytes_in_flight\":200}"), 1))
+        goto err;
+
+    testresult = 1;
+err:
+    stop_trace();
+    ossl_ackm_free(ackm);
+    if (cc_data != NULL)
+        ossl_cc_dummy_method.free(cc_data);
+    ossl_statm_destroy(&statm);
+    return testresult;
+}
+
+#endif
+
+int setup_tests(void)
+{
+    ADD_TEST(test_qlog_disabled);
+#if !defined(OPENSSL_NO_TRACE)
+    ADD_TEST(test_qlog_fc);
+    ADD_TEST(test_qlog_ackm);
+#endif
+    return 1;
+}
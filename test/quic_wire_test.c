@@ -1419,10 +1419,347 @@ err:
     return testresult;
 }
 
+/*
+ * Decoder Equivalence Tests
+ * =========================
+ *
+ * The vlint and frame decoders take fast paths when enough of the input is
+ * available. These tests check them against straightforward reference
+ * decoders, which read the input a byte at a time, on randomly generated and
+ * mutated input.
+ */
+#define FUZZ_ITERATIONS     10000
+#define FUZZ_MAX_RANGES     8
+
+static uint64_t fuzz_rand64(void)
+{
+    return ((uint64_t)test_random() << 32) | test_random();
+}
+
+/* Returns a random value which is usually small. */
+static uint64_t fuzz_rand_value(void)
+{
+    switch (test_random() % 4) {
+    case 0:
+        return test_random() % 4;
+    case 1:
+        return test_random() % 64;
+    case 2:
+        return test_random() % OSSL_QUIC_VLINT_4B_MIN;
+    default:
+        return fuzz_rand64() & OSSL_QUIC_VLINT_MAX;
+    }
+}
+
+/* Appends v to buf, sometimes using a longer encoding than needed. */
+static void fuzz_put_vlint(unsigned char *buf, size_t *pos, uint64_t v)
+{
+    size_t len = ossl_quic_vlint_encode_len(v);
+
+    if (len < 8 && test_random() % 4 == 0)
+        len <<= 1 + test_random() % 2;
+    if (len > 8)
+        len = 8;
+
+    ossl_quic_vlint_encode_n(buf + *pos, v, (int)len);
+    *pos += len;
+}
+
+/* Mutates a buffer at random, returning its new length. */
+static size_t fuzz_mutate(unsigned char *buf, size_t len)
+{
+    switch (test_random() % 4) {
+    case 0:
+        return len > 0 ? test_random() % len : 0;
+    case 1:
+        if (len > 0)
+            buf[test_random() % len] ^= (unsigned char)(1 << (test_random() % 8));
+        return len;
+    default:
+        return len;
+    }
+}
+
+static int ref_get_vlint(const unsigned char **p, size_t *remaining,
+                         uint64_t *v)
+{
+    size_t i, len;
+
+    if (*remaining < 1)
+        return 0;
+
+    len = (size_t)1 << (**p >> 6);
+    if (*remaining < len)
+        return 0;
+
+    *v = **p & 0x3F;
+    for (i = 1; i < len; ++i)
+        *v = (*v << 8) | (*p)[i];
+
+    *p          += len;
+    *remaining  -= len;
+    return 1;
+}
+
+static int test_wire_vlint_equiv(void)
+{
+    unsigned char buf[16];
+    const unsigned char *p;
+    size_t len, remaining, i, j;
+    uint64_t v = 0, v_ref = 0, v_peek = 0;
+    int ok, ok_ref;
+    PACKET pkt;
+
+    for (i = 0; i < FUZZ_ITERATIONS; ++i) {
+        len = test_random() % (sizeof(buf) + 1);
+        for (j = 0; j < len; ++j)
+            buf[j] = (unsigned char)test_random();
+
+        p           = buf;
+        remaining   = len;
+        ok_ref      = ref_get_vlint(&p, &remaining, &v_ref);
+
+        if (!TEST_true(PACKET_buf_init(&pkt, buf, len)))
+            return 0;
+
+        ok = PACKET_peek_quic_vlint(&pkt, &v_peek);
+        if (!TEST_int_eq(ok, ok_ref)
+            || !TEST_size_t_eq(PACKET_remaining(&pkt), len))
+            return 0;
+
+        ok = PACKET_get_quic_vlint(&pkt, &v);
+        if (!TEST_int_eq(ok, ok_ref))
+            return 0;
+
+        if (ok_ref
+            && (!TEST_uint64_t_eq(v, v_ref)
+                || !TEST_uint64_t_eq(v_peek, v_ref)
+                || !TEST_size_t_eq(PACKET_remaining(&pkt), remaining)
+                || !TEST_int_eq(ossl_quic_vlint_decode(buf, len, &v),
+                                (int)(len - remaining))
+                || !TEST_uint64_t_eq(v, v_ref)))
+            return 0;
+
+        if (!ok_ref && !TEST_int_eq(ossl_quic_vlint_decode(buf, len, &v), 0))
+            return 0;
+    }
+
+    return 1;
+}
+
+struct ref_ack {
+    OSSL_QUIC_ACK_RANGE ranges[FUZZ_MAX_RANGES];
+    size_t              num_ranges;
+    uint64_t            total_ranges, delay_raw;
+    uint64_t            ect0, ect1, ecnce;
+    int                 ecn_present;
+};
+
+static int ref_decode_ack(const unsigned char *buf, size_t len,
+                          struct ref_ack *ack, size_t *consumed)
+{
+    const unsigned char *p = buf;
+    size_t remaining = len;
+    uint64_t type, largest, count, first, start, end, gap, range_len, i;
+
+    if (!ref_get_vlint(&p, &remaining, &type)
+        || (type & ~(uint64_t)1) != OSSL_QUIC_FRAME_TYPE_ACK_WITHOUT_ECN
+        || !ref_get_vlint(&p, &remaining, &largest)
+        || !ref_get_vlint(&p, &remaining, &ack->delay_raw)
+        || !ref_get_vlint(&p, &remaining, &count)
+        || !ref_get_vlint(&p, &remaining, &first)
+        || first > largest)
+        return 0;
+
+    start = largest - first;
+    ack->ranges[0].start    = start;
+    ack->ranges[0].end      = largest;
+    ack->num_ranges         = 1;
+
+    for (i = 0; i < count; ++i) {
+        if (!ref_get_vlint(&p, &remaining, &gap)
+            || !ref_get_vlint(&p, &remaining, &range_len)
+            || start < gap + 2)
+            return 0;
+
+        end = start - gap - 2;
+        if (range_len > end)
+            return 0;
+
+        if (ack->num_ranges < FUZZ_MAX_RANGES) {
+            start = end - range_len;
+            ack->ranges[ack->num_ranges].start  = start;
+            ack->ranges[ack->num_ranges].end    = end;
+            ++ack->num_ranges;
+        }
+    }
+
+    ack->total_ranges   = count + 1;
+    ack->ecn_present    = type == OSSL_QUIC_FRAME_TYPE_ACK_WITH_ECN;
+    if (ack->ecn_present
+        && (!ref_get_vlint(&p, &remaining, &ack->ect0)
+            || !ref_get_vlint(&p, &remaining, &ack->ect1)
+            || !ref_get_vlint(&p, &remaining, &ack->ecnce)))
+        return 0;
+
+    *consumed = len - remaining;
+    return 1;
+}
+
+/* Generates an ACK frame, which is usually but not always valid. */
+static size_t fuzz_gen_ack(unsigned char *buf)
+{
+    size_t pos = 0;
+    uint64_t i, count, largest;
+
+    fuzz_put_vlint(buf, &pos, OSSL_QUIC_FRAME_TYPE_ACK_WITHOUT_ECN
+                              + test_random() % 2);
+    largest = test_random() % 2 == 0 ? fuzz_rand_value()
+                                     : 1000000 + test_random() % 1000000;
+    fuzz_put_vlint(buf, &pos, largest);
+    fuzz_put_vlint(buf, &pos, fuzz_rand_value());
+    count = test_random() % (2 * FUZZ_MAX_RANGES);
+    fuzz_put_vlint(buf, &pos, count);
+    fuzz_put_vlint(buf, &pos, test_random() % 16);
+
+    for (i = 0; i < count; ++i) {
+        fuzz_put_vlint(buf, &pos, test_random() % 64);
+        fuzz_put_vlint(buf, &pos, test_random() % 64);
+    }
+
+    for (i = 0; i < 3; ++i)
+        fuzz_put_vlint(buf, &pos, fuzz_rand_value());
+
+    return pos;
+}
+
+static int test_wire_ack_equiv(void)
+{
+    unsigned char buf[8 * (8 + 4 * FUZZ_MAX_RANGES)];
+    OSSL_QUIC_ACK_RANGE ranges[FUZZ_MAX_RANGES];
+    OSSL_QUIC_FRAME_ACK ack;
+    struct ref_ack ref;
+    size_t len, consumed = 0, i, j;
+    uint64_t total_ranges;
+    int ok, ok_ref;
+    PACKET pkt;
+
+    for (i = 0; i < FUZZ_ITERATIONS; ++i) {
+        len = fuzz_mutate(buf, fuzz_gen_ack(buf));
+
+        memset(&ref, 0, sizeof(ref));
+        ok_ref = ref_decode_ack(buf, len, &ref, &consumed);
+
+        memset(&ack, 0, sizeof(ack));
+        ack.ack_ranges      = ranges;
+        ack.num_ack_ranges  = OSSL_NELEM(ranges);
+        if (!TEST_true(PACKET_buf_init(&pkt, buf, len)))
+            return 0;
+
+        ok = ossl_quic_wire_decode_frame_ack(&pkt, 3, &ack, &total_ranges);
+        if (!TEST_int_eq(ok, ok_ref))
+            return 0;
+
+        if (!ok)
+            continue;
+
+        if (!TEST_size_t_eq(len - PACKET_remaining(&pkt), consumed)
+            || !TEST_uint64_t_eq(total_ranges, ref.total_ranges)
+            || !TEST_size_t_eq(ack.num_ack_ranges, ref.num_ranges)
+            || !TEST_int_eq(ack.ecn_present, ref.ecn_present))
+            return 0;
+
+        for (j = 0; j < ref.num_ranges; ++j)
+            if (!TEST_uint64_t_eq(ack.ack_ranges[j].start, ref.ranges[j].start)
+                || !TEST_uint64_t_eq(ack.ack_ranges[j].end, ref.ranges[j].end))
+                return 0;
+
+        if (ref.ecn_present
+            && (!TEST_uint64_t_eq(ack.ect0, ref.ect0)
+                || !TEST_uint64_t_eq(ack.ect1, ref.ect1)
+                || !TEST_uint64_t_eq(ack.ecnce, ref.ecnce)))
+            return 0;
+
+        if (ref.delay_raw < 1000000
+            && !TEST_uint64_t_eq(ossl_time2ticks(ack.delay_time),
+                                 (ref.delay_raw << 3) * OSSL_TIME_US))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int test_wire_stream_equiv(void)
+{
+    unsigned char buf[64];
+    const unsigned char *p;
+    OSSL_QUIC_FRAME_STREAM f;
+    size_t len, remaining, pos;
+    uint64_t type, stream_id = 0, offset, data_len = 0, i;
+    int ok, ok_ref;
+    PACKET pkt;
+
+    for (i = 0; i < FUZZ_ITERATIONS; ++i) {
+        /* Generate a STREAM frame with random flags. */
+        pos = 0;
+        type = OSSL_QUIC_FRAME_TYPE_STREAM | (test_random() % 8);
+        fuzz_put_vlint(buf, &pos, type);
+        fuzz_put_vlint(buf, &pos, fuzz_rand_value());
+        if ((type & OSSL_QUIC_FRAME_FLAG_STREAM_OFF) != 0)
+            fuzz_put_vlint(buf, &pos, fuzz_rand_value());
+        if ((type & OSSL_QUIC_FRAME_FLAG_STREAM_LEN) != 0)
+            fuzz_put_vlint(buf, &pos, test_random() % 24);
+        while (pos < 40)
+            buf[pos++] = (unsigned char)test_random();
+
+        len = fuzz_mutate(buf, pos);
+
+        /* Reference decode. */
+        p           = buf;
+        remaining   = len;
+        offset      = 0;
+        ok_ref = ref_get_vlint(&p, &remaining, &type)
+            && (type & ~OSSL_QUIC_FRAME_FLAG_STREAM_MASK)
+               == OSSL_QUIC_FRAME_TYPE_STREAM
+            && ref_get_vlint(&p, &remaining, &stream_id)
+            && ((type & OSSL_QUIC_FRAME_FLAG_STREAM_OFF) == 0
+                || ref_get_vlint(&p, &remaining, &offset));
+        if (ok_ref) {
+            data_len = remaining;
+            if ((type & OSSL_QUIC_FRAME_FLAG_STREAM_LEN) != 0)
+                ok_ref = ref_get_vlint(&p, &remaining, &data_len)
+                    && data_len <= remaining;
+        }
+
+        if (!TEST_true(PACKET_buf_init(&pkt, buf, len)))
+            return 0;
+
+        ok = ossl_quic_wire_decode_frame_stream(&pkt, &f);
+        if (!TEST_int_eq(ok, ok_ref))
+            return 0;
+
+        if (ok
+            && (!TEST_uint64_t_eq(f.stream_id, stream_id)
+                || !TEST_uint64_t_eq(f.offset, offset)
+                || !TEST_uint64_t_eq(f.len, data_len)
+                || !TEST_ptr_eq(f.data, p)
+                || !TEST_int_eq(f.is_fin,
+                                (type & OSSL_QUIC_FRAME_FLAG_STREAM_FIN) != 0)
+                || !TEST_size_t_eq(PACKET_remaining(&pkt),
+                                   remaining - (size_t)data_len)))
+            return 0;
+    }
+
+    return 1;
+}
+
 int setup_tests(void)
 {
     ADD_ALL_TESTS(test_wire_encode,     OSSL_NELEM(encode_cases));
     ADD_ALL_TESTS(test_wire_ack,        OSSL_NELEM(ack_cases));
     ADD_ALL_TESTS(test_wire_pkt_hdr_pn, OSSL_NELEM(pn_tests));
+    ADD_TEST(test_wire_vlint_equiv);
+    ADD_TEST(test_wire_ack_equiv);
+    ADD_TEST(test_wire_stream_equiv);
     return 1;
 }
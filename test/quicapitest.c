@@ -72,6 +72,48 @@ static int test_quic_write_read(void)
     return ret;
 }
 
+/*
+ * Test that the record buffer and gather write functions, which QUIC does not
+ * support, fail with an error rather than silently.
+ */
+static int test_quic_unsupported_io(void)
+{
+    SSL_CTX *cctx = NULL;
+    SSL *clientquic = NULL;
+    const unsigned char *data = NULL;
+    size_t len = 0;
+    SSL_IOVEC iov;
+    int ret = 0;
+
+    iov.data = "x";
+    iov.data_len = 1;
+
+    if (!TEST_ptr(cctx = SSL_CTX_new_ex(libctx, NULL,
+                                        OSSL_QUIC_client_method()))
+            || !TEST_ptr(clientquic = SSL_new(cctx)))
+        goto end;
+
+    ERR_clear_error();
+    if (!TEST_false(SSL_peek_record_buffer(clientquic, &data, &len))
+            || !TEST_int_eq(ERR_GET_REASON(ERR_get_error()),
+                            ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED)
+            || !TEST_false(SSL_release_record_buffer(clientquic, 0))
+            || !TEST_int_eq(ERR_GET_REASON(ERR_get_error()),
+                            ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED)
+            || !TEST_false(SSL_writev_ex(clientquic, &iov, 1, &len))
+            || !TEST_int_eq(ERR_GET_REASON(ERR_get_error()),
+                            ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED))
+        goto end;
+
+    ret = 1;
+
+ end:
+    SSL_free(clientquic);
+    SSL_CTX_free(cctx);
+
+    return ret;
+}
+
 OPT_TEST_DECLARE_USAGE("provider config\n")
 
 int setup_tests(void)
@@ -118,6 +160,7 @@ int setup_tests(void)
         is_fips = 1;
 
     ADD_TEST(test_quic_write_read);
+    ADD_TEST(test_quic_unsupported_io);
     return 1;
 }
 
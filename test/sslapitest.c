@@ -43,6 +43,10 @@
 #include "../ssl/record/methods/recmethod_local.h"
 #include "filterprov.h"
 
+#ifdef OPENSSL_SYS_UNIX
+# include <sys/stat.h>
+#endif
+
 #undef OSSL_NO_USABLE_TLS1_3
 #if defined(OPENSSL_NO_TLS1_3) \
     || (defined(OPENSSL_NO_EC) && defined(OPENSSL_NO_DH))
@@ -7413,6 +7417,194 @@ static int test_ssl_pending(int tst)
     return testresult;
 }
 
+/*
+ * Test SSL_peek_record_buffer() and SSL_release_record_buffer()
+ * Test 0: TLS
+ * Test 1: DTLS
+ */
+static int test_peek_record_buffer(int tst)
+{
+    SSL_CTX *cctx = NULL, *sctx = NULL;
+    SSL *clientssl = NULL, *serverssl = NULL;
+    int testresult = 0;
+    const char msg1[] = "hello", msg2[] = "world!";
+    const unsigned char *data, *first;
+    unsigned char buf[10];
+    size_t len, written, readbytes;
+
+    if (tst == 0) {
+        if (!TEST_true(create_ssl_ctx_pair(libctx, TLS_server_method(),
+                                           TLS_client_method(),
+                                           TLS1_VERSION, 0,
+                                           &sctx, &cctx, cert, privkey)))
+            goto end;
+    } else {
+#ifndef OPENSSL_NO_DTLS
+        if (!TEST_true(create_ssl_ctx_pair(libctx, DTLS_server_method(),
+                                           DTLS_client_method(),
+                                           DTLS1_VERSION, 0,
+                                           &sctx, &cctx, cert, privkey)))
+            goto end;
+
+# ifdef OPENSSL_NO_DTLS1_2
+        /* Not supported in the FIPS provider */
+        if (is_fips) {
+            testresult = 1;
+            goto end;
+        };
+        /*
+         * Default sigalgs are SHA1 based in <DTLS1.2 which is in security
+         * level 0
+         */
+        if (!TEST_true(SSL_CTX_set_cipher_list(sctx, "DEFAULT:@SECLEVEL=0"))
+                || !TEST_true(SSL_CTX_set_cipher_list(cctx,
+                                                    "DEFAULT:@SECLEVEL=0")))
+            goto end;
+# endif
+#else
+        return 1;
+#endif
+    }
+
+    if (!TEST_true(create_ssl_objects(sctx, cctx, &serverssl, &clientssl,
+                                      NULL, NULL))
+            || !TEST_true(create_ssl_connection(serverssl, clientssl,
+                                                SSL_ERROR_NONE)))
+        goto end;
+
+    /* Nothing has been peeked yet */
+    if (!TEST_false(SSL_release_record_buffer(serverssl, 0)))
+        goto end;
+
+    /* Each write goes out in a record of its own */
+    if (!TEST_true(SSL_write_ex(clientssl, msg1, strlen(msg1), &written))
+            || !TEST_true(SSL_write_ex(clientssl, msg2, strlen(msg2),
+                                       &written)))
+        goto end;
+
+    if (!TEST_true(SSL_peek_record_buffer(serverssl, &data, &len))
+            || !TEST_mem_eq(data, len, msg1, strlen(msg1)))
+        goto end;
+    first = data;
+
+    /* A partial release leaves the rest of the record in place */
+    if (!TEST_true(SSL_release_record_buffer(serverssl, 2))
+            || !TEST_true(SSL_peek_record_buffer(serverssl, &data, &len))
+            || !TEST_ptr_eq(data, first + 2)
+            || !TEST_mem_eq(data, len, msg1 + 2, strlen(msg1) - 2)
+            || !TEST_false(SSL_release_record_buffer(serverssl, len + 1))
+            || !TEST_true(SSL_release_record_buffer(serverssl, len)))
+        goto end;
+
+    /* The next record can be peeked, or read as usual */
+    if (!TEST_true(SSL_peek_record_buffer(serverssl, &data, &len))
+            || !TEST_mem_eq(data, len, msg2, strlen(msg2))
+            || !TEST_true(SSL_release_record_buffer(serverssl, 1))
+            || !TEST_true(SSL_read_ex(serverssl, buf, sizeof(buf), &readbytes))
+            || !TEST_mem_eq(buf, readbytes, msg2 + 1, strlen(msg2) - 1))
+        goto end;
+
+    /* All data has been consumed */
+    if (!TEST_false(SSL_release_record_buffer(serverssl, 0)))
+        goto end;
+    ERR_clear_error();
+    if (!TEST_false(SSL_peek_record_buffer(serverssl, &data, &len))
+            || !TEST_int_eq(SSL_get_error(serverssl, 0), SSL_ERROR_WANT_READ))
+        goto end;
+
+    testresult = 1;
+
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+
+/*
+ * Test SSL_writev_ex() fills records across buffers
+ * Test 0: TLSv1.2
+ * Test 1: TLSv1.3
+ */
+static int test_writev(int tst)
+{
+    SSL_CTX *cctx = NULL, *sctx = NULL;
+    SSL *clientssl = NULL, *serverssl = NULL;
+    int testresult = 0;
+    unsigned char msg[1613], buf[sizeof(msg)];
+    /* Buffer boundaries do not line up with the 512 byte records */
+    static const size_t lens[] = { 10, 0, 1000, 3, sizeof(msg) - 1013 };
+    SSL_IOVEC iov[OSSL_NELEM(lens)];
+    unsigned char *bufs[OSSL_NELEM(lens)] = { NULL };
+    size_t i, written, readbytes, recs = 0, tot = 0;
+    int version = tst == 0 ? TLS1_2_VERSION : TLS1_3_VERSION;
+
+#ifdef OPENSSL_NO_TLS1_2
+    if (tst == 0)
+        return 1;
+#endif
+#ifdef OSSL_NO_USABLE_TLS1_3
+    if (tst == 1)
+        return 1;
+#endif
+
+    for (i = 0; i < sizeof(msg); i++)
+        msg[i] = (unsigned char)i;
+    /* Separate allocations, so the data is not contiguous in memory */
+    for (i = 0; i < OSSL_NELEM(lens); i++) {
+        if (!TEST_ptr(bufs[i] = OPENSSL_malloc(lens[i] + 1)))
+            goto end;
+        memcpy(bufs[i], msg + tot, lens[i]);
+        iov[i].data = bufs[i];
+        iov[i].data_len = lens[i];
+        tot += lens[i];
+    }
+    tot = 0;
+
+    if (!TEST_true(create_ssl_ctx_pair(libctx, TLS_server_method(),
+                                       TLS_client_method(), version, version,
+                                       &sctx, &cctx, cert, privkey))
+            || !TEST_true(SSL_CTX_set_max_send_fragment(cctx, 512))
+            || !TEST_true(create_ssl_objects(sctx, cctx, &serverssl,
+                                             &clientssl, NULL, NULL))
+            || !TEST_true(create_ssl_connection(serverssl, clientssl,
+                                                SSL_ERROR_NONE)))
+        goto end;
+
+    if (!TEST_true(SSL_writev_ex(clientssl, iov, OSSL_NELEM(iov), &written))
+            || !TEST_size_t_eq(written, sizeof(msg)))
+        goto end;
+
+    /* Each read returns the contents of one record */
+    while (tot < sizeof(msg)) {
+        if (!TEST_true(SSL_read_ex(serverssl, buf + tot, sizeof(buf) - tot,
+                                   &readbytes)))
+            goto end;
+        if (tot + readbytes < sizeof(msg)
+                && !TEST_size_t_eq(readbytes, 512))
+            goto end;
+        tot += readbytes;
+        recs++;
+    }
+    if (!TEST_size_t_eq(recs, (sizeof(msg) + 511) / 512)
+            || !TEST_mem_eq(buf, tot, msg, sizeof(msg)))
+        goto end;
+
+    testresult = 1;
+
+ end:
+    for (i = 0; i < OSSL_NELEM(bufs); i++)
+        OPENSSL_free(bufs[i]);
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+
+    return testresult;
+}
+
 static struct {
     unsigned int maxprot;
     const char *clntciphers;
@@ -8742,6 +8934,367 @@ static int test_session_timeout(int test)
     return testresult;
 }
 
+/*
+ * Test the sharded session cache: sessions already cached are moved over
+ * when the mode is switched, the size limit applies to the whole cache, and
+ * sessions can still be found, removed and flushed.
+ */
+static int test_session_cache_sharded(void)
+{
+#define NUM_SESS (4 * SSL_SESS_CACHE_NUM_SHARDS)
+    SSL_SESSION *sess[NUM_SESS] = { NULL };
+    SSL_CTX *ctx;
+    int testresult = 0;
+    size_t i;
+
+    if (!TEST_ptr(ctx = SSL_CTX_new_ex(libctx, NULL, TLS_method())))
+        goto end;
+
+    for (i = 0; i < NUM_SESS; i++) {
+        if (!TEST_ptr(sess[i] = SSL_SESSION_new()))
+            goto end;
+        sess[i]->session_id_length = SSL3_SSL_SESSION_ID_LENGTH;
+        memset(sess[i]->session_id, (int)i, SSL3_SSL_SESSION_ID_LENGTH);
+    }
+
+    /* Half of the sessions are added before switching to a sharded cache */
+    for (i = 0; i < NUM_SESS / 2; i++)
+        if (!TEST_int_eq(SSL_CTX_add_session(ctx, sess[i]), 1))
+            goto end;
+
+    if (!TEST_ptr(SSL_CTX_sessions(ctx))
+        || !TEST_long_eq(SSL_CTX_set_session_cache_mode(ctx,
+                                                        SSL_SESS_CACHE_SERVER
+                                                        | SSL_SESS_CACHE_SHARDED),
+                         SSL_SESS_CACHE_SERVER)
+        || !TEST_ptr_null(SSL_CTX_sessions(ctx))
+        || !TEST_long_eq(SSL_CTX_sess_number(ctx), NUM_SESS / 2))
+        goto end;
+
+    for (i = NUM_SESS / 2; i < NUM_SESS; i++)
+        if (!TEST_int_eq(SSL_CTX_add_session(ctx, sess[i]), 1))
+            goto end;
+
+    if (!TEST_long_eq(SSL_CTX_sess_number(ctx), NUM_SESS))
+        goto end;
+    for (i = 0; i < NUM_SESS; i++)
+        if (!TEST_ptr_eq(sess[i]->owner, ctx)
+            || !TEST_int_eq(SSL_CTX_add_session(ctx, sess[i]), 0))
+            goto end;
+
+    /*
+     * The size limit applies to the whole cache. As with an unsharded cache,
+     * the cache is trimmed once it reaches the limit, each time dropping the
+     * oldest session of the shard being added to. This keeps the most recent
+     * session of every shard and drops all of the first half.
+     */
+    SSL_CTX_sess_set_cache_size(ctx, NUM_SESS / 2);
+    SSL_CTX_flush_sessions(ctx, 0);
+    for (i = 0; i < NUM_SESS; i++)
+        if (!TEST_int_eq(SSL_CTX_add_session(ctx, sess[i]), 1))
+            goto end;
+
+    if (!TEST_long_eq(SSL_CTX_sess_number(ctx), NUM_SESS / 2 - 1)
+        || !TEST_long_eq(SSL_CTX_sess_cache_full(ctx), NUM_SESS / 2 + 1))
+        goto end;
+    for (i = 0; i < NUM_SESS; i++)
+        if ((i < NUM_SESS / 2 && !TEST_ptr_null(sess[i]->owner))
+            || (i >= NUM_SESS - SSL_SESS_CACHE_NUM_SHARDS
+                && !TEST_ptr_eq(sess[i]->owner, ctx)))
+            goto end;
+
+    if (!TEST_true(SSL_CTX_remove_session(ctx, sess[NUM_SESS - 1]))
+        || !TEST_false(SSL_CTX_remove_session(ctx, sess[0]))
+        || !TEST_long_eq(SSL_CTX_sess_number(ctx), NUM_SESS / 2 - 2))
+        goto end;
+
+    /* Room is made in other shards if the new session's shard is empty */
+    SSL_CTX_flush_sessions(ctx, 0);
+    SSL_CTX_sess_set_cache_size(ctx, 2);
+    if (!TEST_int_eq(SSL_CTX_add_session(ctx, sess[0]), 1)
+        || !TEST_int_eq(SSL_CTX_add_session(ctx, sess[1]), 1)
+        || !TEST_long_eq(SSL_CTX_sess_number(ctx), 1)
+        || !TEST_ptr_null(sess[0]->owner)
+        || !TEST_ptr_eq(sess[1]->owner, ctx))
+        goto end;
+
+    /* Switching back keeps the remaining sessions */
+    if (!TEST_long_eq(SSL_CTX_set_session_cache_sharded(ctx, 0), 1)
+        || !TEST_long_eq(SSL_CTX_get_session_cache_mode(ctx),
+                         SSL_SESS_CACHE_SERVER)
+        || !TEST_ptr(SSL_CTX_sessions(ctx))
+        || !TEST_long_eq(SSL_CTX_sess_number(ctx), 1))
+        goto end;
+
+    SSL_CTX_flush_sessions(ctx, 0);
+    if (!TEST_long_eq(SSL_CTX_sess_number(ctx), 0))
+        goto end;
+
+    testresult = 1;
+
+ end:
+    SSL_CTX_free(ctx);
+    for (i = 0; i < NUM_SESS; i++)
+        SSL_SESSION_free(sess[i]);
+    return testresult;
+#undef NUM_SESS
+}
+
+/*
+ * Runs a handshake, resuming sess if it is not NULL. The session the client
+ * ends up with is returned in *newsess if newsess is not NULL.
+ */
+static int resume_handshake(SSL_CTX *sctx, SSL_CTX *cctx, SSL_SESSION *sess,
+                            SSL_SESSION **newsess, int *reused)
+{
+    SSL *serverssl = NULL, *clientssl = NULL;
+    int ok = 0;
+
+    if (!TEST_true(create_ssl_objects(sctx, cctx, &serverssl, &clientssl,
+                                      NULL, NULL))
+            || (sess != NULL
+                && !TEST_true(SSL_set_session(clientssl, sess)))
+            || !TEST_true(create_ssl_connection(serverssl, clientssl,
+                                                SSL_ERROR_NONE)))
+        goto end;
+
+    *reused = SSL_session_reused(clientssl);
+    if (newsess != NULL && !TEST_ptr(*newsess = SSL_get1_session(clientssl)))
+        goto end;
+
+    shutdown_ssl_connection(serverssl, clientssl);
+    serverssl = clientssl = NULL;
+    ok = 1;
+
+ end:
+    SSL_free(serverssl);
+    SSL_free(clientssl);
+    return ok;
+}
+
+static int shm_new_called, shm_get_called;
+
+static int shm_user_new_cb(SSL *ssl, SSL_SESSION *sess)
+{
+    shm_new_called++;
+    return 0;
+}
+
+static SSL_SESSION *shm_user_get_cb(SSL *ssl, const unsigned char *id,
+                                    int len, int *copy)
+{
+    shm_get_called++;
+    return NULL;
+}
+
+/*
+ * Test the shared memory session cache with two server SSL_CTXs standing in
+ * for two worker processes. Callbacks set by the application before the cache
+ * is attached are still called.
+ * Test 0: TLSv1.2, anonymous mapping
+ * Test 1: TLSv1.2, two mappings of the same file
+ * Test 2: TLSv1.3 stateful tickets, anonymous mapping
+ * Test 3: TLSv1.3 stateful tickets, two mappings of the same file
+ */
+static int test_session_shm(int idx)
+{
+    SSL_CTX *sctx1 = NULL, *sctx2 = NULL, *cctx = NULL;
+    SSL_SESS_SHM *shm1 = NULL, *shm2 = NULL;
+    SSL_SESSION *sess = NULL, *ssess = NULL;
+    const unsigned char *id;
+    unsigned int id_len;
+    const char *path = (idx & 1) != 0 ? tmpfilename : NULL;
+    int version = idx < 2 ? TLS1_2_VERSION : TLS1_3_VERSION;
+    int testresult = 0, reused;
+
+#ifdef OPENSSL_NO_TLS1_2
+    if (version == TLS1_2_VERSION)
+        return TEST_skip("TLSv1.2 is disabled");
+#endif
+#ifdef OSSL_NO_USABLE_TLS1_3
+    if (version == TLS1_3_VERSION)
+        return TEST_skip("No usable TLSv1.3");
+#endif
+
+    if (path != NULL)
+        remove(path);
+    if ((shm1 = SSL_SESS_SHM_new(path, 64, 0)) == NULL
+            && ERR_GET_REASON(ERR_peek_last_error()) == ERR_R_UNSUPPORTED) {
+        testresult = TEST_skip("No shared memory session cache");
+        goto end;
+    }
+    if (!TEST_ptr(shm1))
+        goto end;
+    if (path != NULL) {
+        /* The geometry of an existing file is kept */
+        if (!TEST_ptr(shm2 = SSL_SESS_SHM_new(path, 1, 0)))
+            goto end;
+#ifdef OPENSSL_SYS_UNIX
+        /* A file others could write sessions into is refused */
+        if (!TEST_int_eq(chmod(path, 0620), 0)
+                || !TEST_ptr_null(SSL_SESS_SHM_new(path, 1, 0))
+                || !TEST_int_eq(chmod(path, 0600), 0))
+            goto end;
+        ERR_clear_error();
+#endif
+    } else {
+        if (!TEST_true(SSL_SESS_SHM_up_ref(shm1)))
+            goto end;
+        shm2 = shm1;
+    }
+
+    if (!TEST_true(create_ssl_ctx_pair(libctx, TLS_server_method(),
+                                       TLS_client_method(), version, version,
+                                       &sctx1, &cctx, cert, privkey))
+            || !TEST_true(create_ssl_ctx_pair(libctx, TLS_server_method(),
+                                              NULL, version, version,
+                                              &sctx2, NULL, cert, privkey)))
+        goto end;
+
+    SSL_CTX_set_options(sctx1, SSL_OP_NO_TICKET);
+    SSL_CTX_set_options(sctx2, SSL_OP_NO_TICKET);
+    SSL_CTX_sess_set_new_cb(sctx1, shm_user_new_cb);
+    SSL_CTX_sess_set_get_cb(sctx2, shm_user_get_cb);
+    shm_new_called = shm_get_called = 0;
+    if (!TEST_true(SSL_CTX_set_num_tickets(sctx1, 1))
+            || !TEST_true(SSL_CTX_set1_session_shm(sctx1, shm1))
+            || !TEST_true(SSL_CTX_set1_session_shm(sctx2, shm2)))
+        goto end;
+
+    /* A full handshake with the first worker stores the session */
+    if (!resume_handshake(sctx1, cctx, NULL, &sess, &reused)
+            || !TEST_false(reused)
+            || !TEST_int_gt(shm_new_called, 0))
+        goto end;
+
+    /* The second worker finds it, even after flushing its own cache */
+    if (!resume_handshake(sctx2, cctx, sess, NULL, &reused)
+            || !TEST_true(reused)
+            || !TEST_long_eq(SSL_CTX_sess_cb_hits(sctx2), 1)
+            || !TEST_int_eq(shm_get_called, 0))
+        goto end;
+    SSL_CTX_flush_sessions(sctx2, 0);
+    if (!resume_handshake(sctx2, cctx, sess, NULL, &reused)
+            || !TEST_true(reused)
+            || !TEST_long_eq(SSL_CTX_sess_cb_hits(sctx2), 2))
+        goto end;
+
+    if (version == TLS1_2_VERSION) {
+        /* Removing the session in one worker removes it for the other */
+        id = SSL_SESSION_get_id(sess, &id_len);
+        if (!TEST_ptr(ssess = SSL_SESSION_new())
+                || !TEST_true(SSL_SESSION_set1_id(ssess, id, id_len)))
+            goto end;
+        SSL_CTX_remove_session(sctx1, ssess);
+        SSL_CTX_flush_sessions(sctx2, 0);
+        if (!resume_handshake(sctx2, cctx, sess, NULL, &reused)
+                || !TEST_false(reused)
+                || !TEST_int_eq(shm_get_called, 1))
+            goto end;
+    }
+
+    /* Detaching the cache gives the application's callbacks back */
+    if (!TEST_true(SSL_CTX_set1_session_shm(sctx1, NULL))
+            || !TEST_true(SSL_CTX_set1_session_shm(sctx2, NULL))
+            || !TEST_true(SSL_CTX_sess_get_new_cb(sctx1) == shm_user_new_cb)
+            || !TEST_true(SSL_CTX_sess_get_get_cb(sctx2) == shm_user_get_cb))
+        goto end;
+
+    testresult = 1;
+
+ end:
+    SSL_SESSION_free(sess);
+    SSL_SESSION_free(ssess);
+    SSL_CTX_free(sctx1);
+    SSL_CTX_free(sctx2);
+    SSL_CTX_free(cctx);
+    SSL_SESS_SHM_free(shm1);
+    SSL_SESS_SHM_free(shm2);
+    if (path != NULL)
+        remove(path);
+    return testresult;
+}
+
+/*
+ * Test rotation of the built-in ticket keys: a ticket is accepted, and
+ * renewed, while its key is the previous one, and rejected after that.
+ * Test 0: TLSv1.2
+ * Test 1: TLSv1.3
+ */
+static int test_ticket_key_rotation(int idx)
+{
+    SSL_CTX *sctx = NULL, *cctx = NULL;
+    SSL_SESSION *sess = NULL, *sess2 = NULL;
+    unsigned char keys1[80], keys2[80];
+    const unsigned char *tick1, *tick2;
+    size_t tick1len, tick2len;
+    int version = idx == 0 ? TLS1_2_VERSION : TLS1_3_VERSION;
+    int testresult = 0, reused;
+
+#ifdef OPENSSL_NO_TLS1_2
+    if (version == TLS1_2_VERSION)
+        return TEST_skip("TLSv1.2 is disabled");
+#endif
+#ifdef OSSL_NO_USABLE_TLS1_3
+    if (version == TLS1_3_VERSION)
+        return TEST_skip("No usable TLSv1.3");
+#endif
+
+    if (!TEST_true(create_ssl_ctx_pair(libctx, TLS_server_method(),
+                                       TLS_client_method(), version, version,
+                                       &sctx, &cctx, cert, privkey))
+            || !TEST_long_eq(SSL_CTX_get_tlsext_ticket_keys(sctx, NULL, 0),
+                             sizeof(keys1))
+            || !TEST_true(SSL_CTX_get_tlsext_ticket_keys(sctx, keys1,
+                                                         sizeof(keys1)))
+            || !TEST_true(SSL_CTX_set_num_tickets(sctx, 1)))
+        goto end;
+
+    if (!resume_handshake(sctx, cctx, NULL, &sess, &reused)
+            || !TEST_false(reused))
+        goto end;
+
+    /* The previous key still works, but a new ticket is issued */
+    if (!TEST_true(SSL_CTX_rotate_ticket_keys(sctx))
+            || !TEST_true(SSL_CTX_get_tlsext_ticket_keys(sctx, keys2,
+                                                         sizeof(keys2)))
+            || !TEST_mem_ne(keys1, sizeof(keys1), keys2, sizeof(keys2))
+            || !resume_handshake(sctx, cctx, sess, &sess2, &reused)
+            || !TEST_true(reused))
+        goto end;
+
+    SSL_SESSION_get0_ticket(sess, &tick1, &tick1len);
+    SSL_SESSION_get0_ticket(sess2, &tick2, &tick2len);
+    if (!TEST_mem_ne(tick1, tick1len, tick2, tick2len))
+        goto end;
+
+    /* Another rotation drops the key of the first ticket, not the second */
+    if (!TEST_true(SSL_CTX_rotate_ticket_keys(sctx))
+            || !resume_handshake(sctx, cctx, sess2, NULL, &reused)
+            || !TEST_true(reused)
+            || !resume_handshake(sctx, cctx, sess, NULL, &reused)
+            || !TEST_false(reused))
+        goto end;
+
+    /* Setting a key replaces the whole ring */
+    if (!TEST_true(SSL_CTX_set_tlsext_ticket_keys(sctx, keys1, sizeof(keys1)))
+            || !resume_handshake(sctx, cctx, sess2, NULL, &reused)
+            || !TEST_false(reused)
+            || !TEST_true(SSL_CTX_get_tlsext_ticket_keys(sctx, keys2,
+                                                         sizeof(keys2)))
+            || !TEST_mem_eq(keys1, sizeof(keys1), keys2, sizeof(keys2)))
+        goto end;
+
+    testresult = 1;
+
+ end:
+    SSL_SESSION_free(sess);
+    SSL_SESSION_free(sess2);
+    SSL_CTX_free(sctx);
+    SSL_CTX_free(cctx);
+    return testresult;
+}
+
 /*
  * Test 0: Client sets servername and server acknowledges it (TLSv1.2)
  * Test 1: Client sets servername and server does not acknowledge it (TLSv1.2)
@@ -10341,6 +10894,8 @@ int setup_tests(void)
 #endif
     ADD_ALL_TESTS(test_info_callback, 6);
     ADD_ALL_TESTS(test_ssl_pending, 2);
+    ADD_ALL_TESTS(test_peek_record_buffer, 2);
+    ADD_ALL_TESTS(test_writev, 2);
     ADD_ALL_TESTS(test_ssl_get_shared_ciphers, OSSL_NELEM(shared_ciphers_data));
     ADD_ALL_TESTS(test_ticket_callbacks, 20);
     ADD_ALL_TESTS(test_shutdown, 7);
@@ -10375,6 +10930,9 @@ int setup_tests(void)
     ADD_TEST(test_set_verify_cert_store_ssl_ctx);
     ADD_TEST(test_set_verify_cert_store_ssl);
     ADD_ALL_TESTS(test_session_timeout, 1);
+    ADD_TEST(test_session_cache_sharded);
+    ADD_ALL_TESTS(test_session_shm, 4);
+    ADD_ALL_TESTS(test_ticket_key_rotation, 2);
     ADD_TEST(test_load_dhfile);
 #ifndef OSSL_NO_USABLE_TLS1_3
     ADD_TEST(test_read_ahead_key_change);